@@ -0,0 +1,9 @@
+# Fails the build when the app image is larger than an OTA slot, which is
+# where the next update has to go. Run with -DIMAGE=<app.bin> -DSLOT_SIZE=<bytes>.
+file(SIZE "${IMAGE}" image_size)
+math(EXPR slot_size "${SLOT_SIZE}")
+math(EXPR free_bytes "${slot_size} - ${image_size}")
+if(free_bytes LESS 0)
+    message(FATAL_ERROR "${IMAGE} is ${image_size} bytes, ${slot_size} fit an OTA slot")
+endif()
+message(STATUS "${IMAGE}: ${image_size} of ${slot_size} OTA slot bytes, ${free_bytes} free")
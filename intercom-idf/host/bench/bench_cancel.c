@@ -0,0 +1,417 @@
+/**
+ * @brief Cancel-during-photo benchmark for the host build.
+ *
+ * Sends photos of growing size over a link throttled to LINK_RATE, with the
+ * device's send buffer capped at lwIP's TCP_SND_BUF. A quarter of the way
+ * into each photo the device sends "cancel" from another task, as the
+ * keypad does, then ends the call. The server parses the channel as tgbot
+ * does and reports, per photo size:
+ *  - cancel-to-server: "cancel" sent -> recognised by the server as a frame
+ *  - how the photo ended: cut short by an end record, completed, or broken
+ *    off by the channel closing
+ *
+ * bench_cancel is built with CONFIG_INTERCOM_TX_QUEUE, bench_cancel_off
+ * without it; there the cancel meets the photo's write in progress, which
+ * lwIP refuses (see host_lwip.h).
+ *
+ * Usage: bench_cancel [photos_per_size] [time_scale]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_camera.h"
+#include "esp_log.h"
+#include "fake_camera.h"
+#include "host_clock.h"
+#include "host_lwip.h"
+#include "host_sync.h"
+#include "power.h"
+#include "sdkconfig.h"
+#include "tcp_client.h"
+
+#define LINK_RATE (200 * 1024) // Bytes per second of device time
+#define LINK_READ 1460         // One segment per read
+#define TCP_SND_BUF 5744       // 4 * TCP_MSS, as on the device
+#define SERVER_RCVBUF 4096
+#define CANCEL_AT 4 // Cancel once 1/CANCEL_AT of the photo has arrived
+#define PHOTO_RECORDS 0x80000000u
+#define RECORD_IMAGE 0
+#define RECORD_CONTROL 1
+#define RECORD_END 2
+#define RECORD_HEADER_SIZE 3
+#define CONTROL_MAX 64
+
+typedef enum
+{
+    PHOTO_COMPLETE,
+    PHOTO_CUT_SHORT, // End record
+    PHOTO_BROKEN,    // The channel closed under it
+} photo_end_t;
+
+static const char *const s_end_names[] = {"complete", "cut short", "broken off"};
+
+// What the server saw of the current photo
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t image_size;
+    uint32_t image_received;
+    uint64_t cancel_us; // When "cancel" was recognised, 0 if not
+    bool done;
+    photo_end_t end;
+    uint32_t closed; // Connections the server has finished with
+} s_server = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+typedef enum
+{
+    PARSE_SIZE,
+    PARSE_RAW_IMAGE,
+    PARSE_RECORD_HEADER,
+    PARSE_RECORD,
+    PARSE_FRAMES,
+} parse_state_t;
+
+// A frame outside the photo, or a control record's payload
+static void server_frame(const uint8_t *data, size_t len)
+{
+    if (len == strlen("cancel") && memcmp(data, "cancel", len) == 0)
+    {
+        pthread_mutex_lock(&s_server.lock);
+        s_server.cancel_us = host_clock_now_us();
+        pthread_cond_broadcast(&s_server.cond);
+        pthread_mutex_unlock(&s_server.lock);
+    }
+}
+
+// Count image bytes; true once the whole image has arrived
+static bool server_image(size_t len)
+{
+    pthread_mutex_lock(&s_server.lock);
+    s_server.image_received += len;
+    bool complete = s_server.image_received == s_server.image_size;
+    pthread_cond_broadcast(&s_server.cond);
+    pthread_mutex_unlock(&s_server.lock);
+    return complete;
+}
+
+static void server_photo_end(photo_end_t end)
+{
+    pthread_mutex_lock(&s_server.lock);
+    if (!s_server.done)
+    {
+        s_server.done = true;
+        s_server.end = end;
+    }
+    pthread_cond_broadcast(&s_server.cond);
+    pthread_mutex_unlock(&s_server.lock);
+}
+
+static void *server_task(void *arg)
+{
+    int listener = *(int *)arg;
+    uint8_t buf[LINK_READ];
+
+    for (;;)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+
+        // Size header, then the image raw or as records, then frames
+        parse_state_t state = PARSE_SIZE;
+        uint8_t header[4], record_header[RECORD_HEADER_SIZE], control[CONTROL_MAX];
+        size_t have = 0, left = 0;
+        uint8_t record_type = 0;
+        int len;
+        while ((len = recv(client, buf, sizeof(buf), 0)) > 0)
+        {
+            host_clock_sleep_us((uint64_t)len * 1000000 / LINK_RATE);
+            size_t offset = 0;
+            while (offset < (size_t)len)
+            {
+                size_t take;
+                switch (state)
+                {
+                case PARSE_SIZE:
+                    header[have++] = buf[offset++];
+                    if (have == sizeof(header))
+                    {
+                        uint32_t size = ((uint32_t)header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+                        pthread_mutex_lock(&s_server.lock);
+                        s_server.image_size = size & ~PHOTO_RECORDS;
+                        pthread_mutex_unlock(&s_server.lock);
+                        state = size & PHOTO_RECORDS ? PARSE_RECORD_HEADER : PARSE_RAW_IMAGE;
+                        left = size & ~PHOTO_RECORDS;
+                        have = 0;
+                    }
+                    break;
+
+                case PARSE_RAW_IMAGE:
+                    take = MIN(left, len - offset);
+                    offset += take;
+                    left -= take;
+                    if (server_image(take))
+                    {
+                        server_photo_end(PHOTO_COMPLETE);
+                        state = PARSE_FRAMES;
+                    }
+                    break;
+
+                case PARSE_RECORD_HEADER:
+                    record_header[have++] = buf[offset++];
+                    if (have < RECORD_HEADER_SIZE)
+                    {
+                        break;
+                    }
+                    have = 0;
+                    record_type = record_header[0];
+                    left = (record_header[1] << 8) | record_header[2];
+                    if (record_type == RECORD_END)
+                    {
+                        server_photo_end(PHOTO_CUT_SHORT);
+                        state = PARSE_FRAMES;
+                    }
+                    else if ((record_type != RECORD_IMAGE && record_type != RECORD_CONTROL) ||
+                             (record_type == RECORD_CONTROL && left > CONTROL_MAX))
+                    {
+                        fprintf(stderr, "bad record %u of %zu bytes\n", record_type, left);
+                        shutdown(client, SHUT_RDWR);
+                        offset = len;
+                    }
+                    else
+                    {
+                        state = PARSE_RECORD;
+                    }
+                    break;
+
+                case PARSE_RECORD:
+                    take = MIN(left, len - offset);
+                    bool complete = false;
+                    if (record_type == RECORD_IMAGE)
+                    {
+                        complete = server_image(take);
+                    }
+                    else
+                    {
+                        memcpy(control + have, buf + offset, take);
+                        have += take;
+                    }
+                    offset += take;
+                    left -= take;
+                    if (left == 0)
+                    {
+                        if (record_type == RECORD_CONTROL)
+                        {
+                            server_frame(control, have);
+                        }
+                        have = 0;
+                        state = complete ? PARSE_FRAMES : PARSE_RECORD_HEADER;
+                    }
+                    if (complete)
+                    {
+                        server_photo_end(PHOTO_COMPLETE);
+                    }
+                    break;
+
+                case PARSE_FRAMES:
+                    // The device spaces frames out; each read is one
+                    server_frame(buf + offset, len - offset);
+                    offset = len;
+                    break;
+                }
+            }
+        }
+        close(client);
+        server_photo_end(PHOTO_BROKEN);
+        pthread_mutex_lock(&s_server.lock);
+        s_server.closed++;
+        pthread_cond_broadcast(&s_server.cond);
+        pthread_mutex_unlock(&s_server.lock);
+    }
+    return NULL;
+}
+
+static int start_server(void)
+{
+    static int s_listener;
+    s_listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1, rcvbuf = SERVER_RCVBUF;
+    setsockopt(s_listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    // Inherited by accepted sockets; keeps the link, not the kernel, the
+    // bottleneck
+    setsockopt(s_listener, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(INTERCOM_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(s_listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(s_listener, 4) != 0)
+    {
+        perror("bench server");
+        return -1;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_task, &s_listener);
+    pthread_detach(thread);
+    return 0;
+}
+
+// The reply task sending the photo the server asked for
+static void *photo_task(void *arg)
+{
+    *(esp_err_t *)arg = tcp_client_send_photo();
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    int photos = argc > 1 ? atoi(argv[1]) : 5;
+    double scale = argc > 2 ? atof(argv[2]) : 1.0;
+    const size_t sizes[] = {16 * 1024, 64 * 1024, 256 * 1024};
+
+    esp_log_level_set("*", getenv("BENCH_VERBOSE") ? ESP_LOG_INFO : ESP_LOG_NONE);
+    signal(SIGPIPE, SIG_IGN);
+    host_clock_set_scale(scale);
+    host_cond_init(&s_server.cond);
+    host_lwip_set_send_buffer(TCP_SND_BUF);
+    if (start_server() != 0)
+    {
+        return 1;
+    }
+
+    camera_config_t config = {.pixel_format = PIXFORMAT_JPEG};
+    esp_camera_init(&config);
+    power_init();
+
+#if CONFIG_INTERCOM_TX_QUEUE
+    printf("cancel during photo: send queue, %d KiB chunks, %d photos per size\n",
+           CONFIG_INTERCOM_TX_CHUNK_SIZE / 1024, photos);
+#else
+    printf("cancel during photo: direct writes, %d photos per size\n", photos);
+#endif
+    printf("%8s %14s %14s %10s  %s\n", "frame", "p50 ms", "max ms", "lost", "photo ended");
+
+    double *latency = calloc(photos, sizeof(double));
+    int failures = 0;
+    uint32_t closed = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        int lost = 0, samples = 0;
+        int ends[3] = {0};
+        fake_camera_set_frame_size(sizes[i]);
+
+        for (int p = 0; p < photos; p++)
+        {
+            pthread_mutex_lock(&s_server.lock);
+            s_server.image_size = 0;
+            s_server.image_received = 0;
+            s_server.cancel_us = 0;
+            s_server.done = false;
+            pthread_mutex_unlock(&s_server.lock);
+
+            if (tcp_client_connect(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT) != ESP_OK)
+            {
+                return 1;
+            }
+            esp_err_t photo_ret;
+            pthread_t photo;
+            pthread_create(&photo, NULL, photo_task, &photo_ret);
+
+            // A quarter of the photo in, the visitor presses '#'
+            pthread_mutex_lock(&s_server.lock);
+            while (s_server.image_size == 0 || s_server.image_received < s_server.image_size / CANCEL_AT)
+            {
+                pthread_cond_wait(&s_server.cond, &s_server.lock);
+            }
+            pthread_mutex_unlock(&s_server.lock);
+            uint64_t cancel_us = host_clock_now_us();
+            esp_err_t cancel_ret = tcp_client_send_string("cancel");
+
+            tcp_client_send_string("\n");
+            tcp_client_end_session();
+            pthread_join(photo, NULL);
+
+            // Everything sent has been parsed once the server sees the
+            // channel close
+            struct timespec deadline = host_clock_deadline(10 * 1000000ull);
+            pthread_mutex_lock(&s_server.lock);
+            while (s_server.closed == closed)
+            {
+                if (pthread_cond_timedwait(&s_server.cond, &s_server.lock, &deadline) != 0)
+                {
+                    fprintf(stderr, "%zuK photo %d: channel not closed\n", sizes[i] / 1024, p);
+                    failures++;
+                    break;
+                }
+            }
+            closed = s_server.closed;
+            uint64_t seen_us = cancel_ret == ESP_OK ? s_server.cancel_us : 0;
+            ends[s_server.end]++;
+            pthread_mutex_unlock(&s_server.lock);
+
+            if (seen_us == 0)
+            {
+                lost++;
+            }
+            else
+            {
+                latency[samples++] = (double)(seen_us - cancel_us) / 1000.0;
+            }
+        }
+
+        char ended[64];
+        int n = 0;
+        for (int e = 0; e < 3; e++)
+        {
+            if (ends[e] > 0)
+            {
+                n += snprintf(ended + n, sizeof(ended) - n, "%s%d %s", n ? ", " : "", ends[e], s_end_names[e]);
+            }
+        }
+        qsort(latency, samples, sizeof(double), compare_double);
+        if (samples > 0)
+        {
+            printf("%7zuK %14.2f %14.2f %10d  %s\n", sizes[i] / 1024, latency[samples / 2], latency[samples - 1],
+                   lost, ended);
+        }
+        else
+        {
+            printf("%7zuK %14s %14s %10d  %s\n", sizes[i] / 1024, "-", "-", lost, ended);
+        }
+#if CONFIG_INTERCOM_TX_QUEUE
+        failures += lost + ends[PHOTO_BROKEN];
+#endif
+    }
+
+    tcp_client_tx_stats_t stats[TCP_CLIENT_TX_PRIORITIES];
+    tcp_client_tx_get_stats(stats);
+    const char *names[TCP_CLIENT_TX_PRIORITIES] = {"control", "photo"};
+    for (int p = 0; p < TCP_CLIENT_TX_PRIORITIES; p++)
+    {
+        printf("tx %-8s frames %-4u bytes %-8llu latency avg %.2f max %.2f ms\n", names[p], stats[p].frames,
+               (unsigned long long)stats[p].bytes,
+               stats[p].frames ? (double)stats[p].latency_us_total / stats[p].frames / 1000.0 : 0.0,
+               stats[p].latency_us_max / 1000.0);
+    }
+
+    free(latency);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,368 @@
+/**
+ * @brief Local flat directory benchmark for the host build.
+ *
+ * Runs app_main() against the fake keypad and a loopback server that
+ * registers flats 12, 15 and 100..120, answers "dir" requests with the
+ * whole directory (see src/flat_dir.h) and calls with "accept" or
+ * "not_found". Visitors alternate between an unregistered number, "13",
+ * and a registered one, "12". Measures:
+ *  - key-to-reject: '*' pressed -> "not found" shown on the LED
+ *  - calls the server took for unregistered numbers
+ *  - key-to-start for registered numbers, which still go to the server
+ * Finally the server registers 13 and the device must let the next "13"
+ * through once it has synced.
+ *
+ * bench_directory is built with CONFIG_INTERCOM_DIRECTORY (synced every
+ * 5 s), bench_directory_off without it.
+ *
+ * Usage: bench_directory [iterations] [time_scale]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "fake_keypad.h"
+#include "flat_dir.h"
+#include "host_clock.h"
+#include "host_gpio.h"
+#include "host_sync.h"
+
+#define DOOR_RELAY_GPIO GPIO_NUM_1
+#define LED_GPIO GPIO_NUM_33
+#define LED_SHOW_MIN_MS 1000 // Blinking never holds the LED low this long
+#define KEY_HOLD_MS 150
+#define KEY_GAP_MS 250
+#define MAX_FLATS 64
+
+void app_main(void);
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t flats[MAX_FLATS];
+    uint32_t count;
+    uint32_t version;
+    uint32_t dir_requests;
+    uint32_t dir_bytes;
+    uint32_t calls;     // Calls started, whatever the number
+    uint32_t not_found; // Calls answered "not_found"
+    uint64_t start_us;
+} s_server = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void put_varint(uint8_t **p, uint32_t v)
+{
+    for (; v >= 0x80; v >>= 7)
+    {
+        *(*p)++ = (v & 0x7f) | 0x80;
+    }
+    *(*p)++ = v;
+}
+
+static void put_u32(uint8_t **p, uint32_t v)
+{
+    uint32_t network_order = htonl(v);
+    memcpy(*p, &network_order, 4);
+    *p += 4;
+}
+
+// Length-prefixed full directory as a gap list; called with the lock held
+static size_t encode_directory(uint8_t *frame)
+{
+    uint8_t *p = frame + 4;
+    memcpy(p, FLAT_DIR_MAGIC, 4);
+    p += 4;
+    *p++ = FLAT_DIR_VERSION;
+    *p++ = FLAT_DIR_FULL;
+    *p++ = FLAT_DIR_GAPS;
+    *p++ = 0;
+    put_u32(&p, 1);
+    put_u32(&p, s_server.version);
+    put_u32(&p, 0);
+    put_varint(&p, s_server.count);
+    for (uint32_t i = 0; i < s_server.count; i++)
+    {
+        put_varint(&p, i == 0 ? s_server.flats[0] : s_server.flats[i] - s_server.flats[i - 1] - 1);
+    }
+    uint8_t *len = frame;
+    put_u32(&len, p - frame - 4);
+    return p - frame;
+}
+
+static bool registered(uint32_t flat)
+{
+    for (uint32_t i = 0; i < s_server.count; i++)
+    {
+        if (s_server.flats[i] == flat)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *server_task(void *arg)
+{
+    int listener = *(int *)arg;
+    char buf[64];
+    uint8_t frame[FLAT_DIR_FRAME_MAX(MAX_FLATS) + 4];
+
+    for (;;)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+
+        // The channel carries directory requests and calls until the device
+        // hangs up at the end of a call
+        int len;
+        while ((len = recv(client, buf, sizeof(buf) - 1, 0)) > 0)
+        {
+            buf[len] = 0;
+            if (strncmp(buf, "dir", 3) == 0)
+            {
+                pthread_mutex_lock(&s_server.lock);
+                size_t size = encode_directory(frame);
+                s_server.dir_requests++;
+                s_server.dir_bytes += size;
+                pthread_mutex_unlock(&s_server.lock);
+                send(client, frame, size, 0);
+            }
+            else if (strcmp(buf, "start") == 0)
+            {
+                uint64_t start_us = host_clock_now_us();
+                len = recv(client, buf, sizeof(buf) - 1, 0);
+                buf[len > 0 ? len : 0] = 0;
+
+                pthread_mutex_lock(&s_server.lock);
+                bool found = registered(strtoul(buf, NULL, 10));
+                s_server.calls++;
+                s_server.not_found += found ? 0 : 1;
+                s_server.start_us = start_us;
+                pthread_cond_broadcast(&s_server.cond);
+                pthread_mutex_unlock(&s_server.lock);
+                send(client, found ? "accept" : "not_found", found ? 6 : 9, 0);
+            }
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+static int start_server(void)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(INTERCOM_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0)
+    {
+        perror("bench server");
+        return -1;
+    }
+
+    static int s_listener;
+    s_listener = listener;
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_task, &s_listener);
+    pthread_detach(thread);
+    return 0;
+}
+
+static void *app_task(void *arg)
+{
+    (void)arg;
+    app_main();
+    return NULL;
+}
+
+static uint64_t type_number(const char *number)
+{
+    fake_keypad_type(number, KEY_HOLD_MS, KEY_GAP_MS);
+    uint64_t pressed_us = fake_keypad_press('*');
+    host_clock_sleep_us(KEY_HOLD_MS * 1000);
+    fake_keypad_release();
+    return pressed_us;
+}
+
+// Wait for the LED to show "not found": held low, unlike a blink. Returns
+// when it went low, or 0 on timeout
+static uint64_t wait_reject(void)
+{
+    uint64_t deadline_us = host_clock_now_us() + 10 * 1000000ull;
+    while (host_clock_now_us() < deadline_us)
+    {
+        uint64_t low_us;
+        if (!host_gpio_wait_level(LED_GPIO, 0, deadline_us - host_clock_now_us(), &low_us))
+        {
+            break;
+        }
+        if (!host_gpio_wait_level(LED_GPIO, 1, LED_SHOW_MIN_MS * 1000, NULL))
+        {
+            host_gpio_wait_level(LED_GPIO, 1, 5 * 1000000ull, NULL);
+            return low_us;
+        }
+    }
+    return 0;
+}
+
+// Wait for a call past `calls`; false on timeout
+static bool wait_call(uint32_t calls, uint64_t *start_us)
+{
+    struct timespec deadline = host_clock_deadline(10 * 1000000ull);
+    pthread_mutex_lock(&s_server.lock);
+    while (s_server.calls == calls)
+    {
+        if (pthread_cond_timedwait(&s_server.cond, &s_server.lock, &deadline) != 0)
+        {
+            break;
+        }
+    }
+    bool started = s_server.calls != calls;
+    *start_us = s_server.start_us;
+    pthread_mutex_unlock(&s_server.lock);
+    return started;
+}
+
+static uint32_t server_calls(void)
+{
+    pthread_mutex_lock(&s_server.lock);
+    uint32_t calls = s_server.calls;
+    pthread_mutex_unlock(&s_server.lock);
+    return calls;
+}
+
+// An accepted call: wait for the door to open and close again
+static bool door_cycle(void)
+{
+    bool opened = host_gpio_wait_level(DOOR_RELAY_GPIO, 0, 5 * 1000000ull, NULL);
+    host_gpio_wait_level(DOOR_RELAY_GPIO, 1, 5 * 1000000ull, NULL);
+    return opened;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *samples, int count)
+{
+    if (count == 0)
+    {
+        printf("%-16s no samples\n", name);
+        return;
+    }
+    qsort(samples, count, sizeof(double), compare_double);
+    printf("%-16s n=%-4d p50=%8.2f p90=%8.2f max=%8.2f ms\n", name, count, samples[count / 2],
+           samples[(count * 9) / 10], samples[count - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 10;
+    double scale = argc > 2 ? atof(argv[2]) : 10.0;
+
+    esp_log_level_set("*", getenv("BENCH_VERBOSE") ? ESP_LOG_INFO : ESP_LOG_NONE);
+    signal(SIGPIPE, SIG_IGN);
+    host_clock_set_scale(scale);
+    host_cond_init(&s_server.cond);
+    s_server.flats[s_server.count++] = 12;
+    s_server.flats[s_server.count++] = 15;
+    for (uint32_t flat = 100; flat <= 120; flat++)
+    {
+        s_server.flats[s_server.count++] = flat;
+    }
+    s_server.version = 1;
+    fake_keypad_init();
+    if (start_server() != 0)
+    {
+        return 1;
+    }
+
+    pthread_t app;
+    pthread_create(&app, NULL, app_task, NULL);
+    pthread_detach(app);
+    // Past the first sync
+    host_clock_sleep_us(3000 * 1000);
+
+    double *to_reject = calloc(iterations, sizeof(double));
+    double *to_start = calloc(iterations, sizeof(double));
+    int rejects = 0, starts = 0, failed = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t pressed_us = type_number("13");
+        uint64_t low_us = wait_reject();
+        if (low_us == 0)
+        {
+            fprintf(stderr, "iteration %d: 13 not rejected\n", i);
+            failed++;
+        }
+        else
+        {
+            to_reject[rejects++] = (double)(low_us - pressed_us) / 1000.0;
+        }
+
+        uint32_t calls = server_calls();
+        pressed_us = type_number("12");
+        uint64_t start_us;
+        if (!wait_call(calls, &start_us) || !door_cycle())
+        {
+            fprintf(stderr, "iteration %d: 12 not let in\n", i);
+            failed++;
+            continue;
+        }
+        to_start[starts++] = (double)(start_us - pressed_us) / 1000.0;
+    }
+
+    pthread_mutex_lock(&s_server.lock);
+    uint32_t not_found = s_server.not_found;
+    // Flat 13 moves in
+    memmove(&s_server.flats[2], &s_server.flats[1], (s_server.count - 1) * sizeof(uint32_t));
+    s_server.flats[1] = 13;
+    s_server.count++;
+    s_server.version++;
+    pthread_mutex_unlock(&s_server.lock);
+
+    // The next sync picks it up
+    host_clock_sleep_us((CONFIG_INTERCOM_DIRECTORY_SYNC_INTERVAL_S + 1) * 1000000ull);
+    uint32_t calls = server_calls();
+    type_number("13");
+    uint64_t start_us;
+    bool moved_in = wait_call(calls, &start_us) && door_cycle();
+
+    pthread_mutex_lock(&s_server.lock);
+    uint32_t dir_requests = s_server.dir_requests;
+    uint32_t dir_bytes = s_server.dir_bytes;
+    pthread_mutex_unlock(&s_server.lock);
+
+#if CONFIG_INTERCOM_DIRECTORY
+    printf("time scale %.1fx, %d iterations, directory on\n", scale, iterations);
+#else
+    printf("time scale %.1fx, %d iterations, directory off\n", scale, iterations);
+#endif
+    report("key-to-reject", to_reject, rejects);
+    report("key-to-start", to_start, starts);
+    printf("server calls for unregistered numbers: %u of %d\n", not_found, iterations);
+    printf("directory requests %u, %u B\n", dir_requests, dir_bytes);
+    printf("new flat let in after sync: %s\n", moved_in ? "yes" : "NO");
+
+    free(to_reject);
+    free(to_start);
+    return failed == 0 && moved_in ? 0 : 1;
+}
@@ -0,0 +1,276 @@
+/**
+ * @brief Keypad-to-network latency and memory benchmark for the host build.
+ *
+ * Runs the real app_main() against the fake keypad and a loopback server
+ * standing in for tgbot, and measures:
+ *  - key-to-start:  '*' pressed on the keypad -> "start" received by server
+ *  - timeout-to-start: every fourth call is entered without '*'; from the
+ *    inactivity timeout expiring -> "start" received by server
+ *  - reply-to-relay: "accept" sent by server -> door relay GPIO driven low
+ *
+ * Usage: bench_keypad [iterations] [time_scale]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "fake_keypad.h"
+#include "host_clock.h"
+#include "host_gpio.h"
+#include "host_i2c.h"
+#include "host_mem.h"
+#include "host_sync.h"
+
+#define DOOR_RELAY_GPIO GPIO_NUM_1
+#define KEY_HOLD_MS 150
+#define KEY_GAP_MS 250
+#define KEYPAD_TIMEOUT_MS 3000 // init_keypad() in main.c
+
+void app_main(void);
+
+typedef enum
+{
+    REPLY_NOT_FOUND,
+    REPLY_ACCEPT
+} reply_mode_t;
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    reply_mode_t mode;
+    uint32_t sessions;
+    uint64_t start_us;
+    uint64_t reply_us;
+} s_server = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void *server_task(void *arg)
+{
+    int listener = *(int *)arg;
+    char buf[64];
+
+    for (;;)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+
+        // "start", then the flat number as a separate frame
+        int len = recv(client, buf, sizeof(buf) - 1, 0);
+        uint64_t start_us = host_clock_now_us();
+        if (len == 5)
+        {
+            len = recv(client, buf, sizeof(buf) - 1, 0);
+        }
+
+        pthread_mutex_lock(&s_server.lock);
+        const char *reply = s_server.mode == REPLY_ACCEPT ? "accept" : "not_found";
+        pthread_mutex_unlock(&s_server.lock);
+
+        uint64_t reply_us = host_clock_now_us();
+        send(client, reply, strlen(reply), 0);
+
+        // Drain until the device hangs up
+        while (recv(client, buf, sizeof(buf), 0) > 0)
+        {
+        }
+        close(client);
+
+        pthread_mutex_lock(&s_server.lock);
+        s_server.start_us = start_us;
+        s_server.reply_us = reply_us;
+        s_server.sessions++;
+        pthread_cond_broadcast(&s_server.cond);
+        pthread_mutex_unlock(&s_server.lock);
+    }
+    return NULL;
+}
+
+static int start_server(void)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(INTERCOM_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0)
+    {
+        perror("bench server");
+        return -1;
+    }
+
+    static int s_listener;
+    s_listener = listener;
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_task, &s_listener);
+    pthread_detach(thread);
+    return 0;
+}
+
+static void *app_task(void *arg)
+{
+    (void)arg;
+    app_main();
+    return NULL;
+}
+
+static uint32_t wait_session(uint32_t seen, uint64_t *start_us, uint64_t *reply_us)
+{
+    struct timespec deadline = host_clock_deadline(30 * 1000000ull);
+    pthread_mutex_lock(&s_server.lock);
+    while (s_server.sessions == seen)
+    {
+        if (pthread_cond_timedwait(&s_server.cond, &s_server.lock, &deadline) != 0)
+        {
+            break;
+        }
+    }
+    uint32_t sessions = s_server.sessions;
+    *start_us = s_server.start_us;
+    *reply_us = s_server.reply_us;
+    pthread_mutex_unlock(&s_server.lock);
+    return sessions;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *samples, int count)
+{
+    if (count == 0)
+    {
+        printf("%-16s no samples\n", name);
+        return;
+    }
+    qsort(samples, count, sizeof(double), compare_double);
+    printf("%-16s n=%-4d p50=%8.2f p90=%8.2f p99=%8.2f max=%8.2f ms\n", name, count,
+           samples[count / 2], samples[(count * 9) / 10], samples[(count * 99) / 100],
+           samples[count - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    double scale = argc > 2 ? atof(argv[2]) : 10.0;
+
+    esp_log_level_set("*", getenv("BENCH_VERBOSE") ? ESP_LOG_INFO : ESP_LOG_NONE);
+    host_clock_set_scale(scale);
+    host_cond_init(&s_server.cond);
+    fake_keypad_init();
+    if (start_server() != 0)
+    {
+        return 1;
+    }
+
+    pthread_t app;
+    pthread_create(&app, NULL, app_task, NULL);
+    pthread_detach(app);
+    host_clock_sleep_us(200 * 1000);
+
+    host_mem_stats_t boot = host_mem_get_stats();
+    uint32_t boot_i2c = host_i2c_transactions();
+    uint64_t boot_us = host_clock_now_us();
+
+    double *key_to_start = calloc(iterations, sizeof(double));
+    double *timeout_to_start = calloc(iterations, sizeof(double));
+    double *reply_to_relay = calloc(iterations, sizeof(double));
+    int key_samples = 0, timeout_samples = 0, relay_samples = 0;
+    uint32_t sessions = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        pthread_mutex_lock(&s_server.lock);
+        s_server.mode = i % 2 == 0 ? REPLY_NOT_FOUND : REPLY_ACCEPT;
+        pthread_mutex_unlock(&s_server.lock);
+
+        bool by_timeout = i % 4 == 2;
+        uint64_t pressed_us;
+        if (by_timeout)
+        {
+            // The digit counts once released; the timeout starts then
+            fake_keypad_type("1", KEY_HOLD_MS, KEY_GAP_MS);
+            fake_keypad_press('2');
+            host_clock_sleep_us(KEY_HOLD_MS * 1000);
+            fake_keypad_release();
+            pressed_us = host_clock_now_us() + KEYPAD_TIMEOUT_MS * 1000ull;
+        }
+        else
+        {
+            fake_keypad_type("12", KEY_HOLD_MS, KEY_GAP_MS);
+            pressed_us = fake_keypad_press('*');
+            host_clock_sleep_us(KEY_HOLD_MS * 1000);
+            fake_keypad_release();
+        }
+
+        uint64_t start_us, reply_us;
+        uint32_t now_sessions = wait_session(sessions, &start_us, &reply_us);
+        if (now_sessions == sessions)
+        {
+            fprintf(stderr, "iteration %d: no session\n", i);
+            continue;
+        }
+        sessions = now_sessions;
+        double latency = (double)(start_us - pressed_us) / 1000.0;
+        if (by_timeout)
+        {
+            timeout_to_start[timeout_samples++] = latency;
+        }
+        else
+        {
+            key_to_start[key_samples++] = latency;
+        }
+
+        if (i % 2 == 1)
+        {
+            uint64_t relay_us;
+            if (host_gpio_wait_level(DOOR_RELAY_GPIO, 0, 5 * 1000000ull, &relay_us))
+            {
+                reply_to_relay[relay_samples++] = (double)(relay_us - reply_us) / 1000.0;
+            }
+            host_gpio_wait_level(DOOR_RELAY_GPIO, 1, 5 * 1000000ull, NULL);
+        }
+        else
+        {
+            // not_found holds the keypad task in led_show() for 3 s
+            host_clock_sleep_us(3200 * 1000);
+        }
+    }
+
+    host_mem_stats_t end = host_mem_get_stats();
+    double elapsed_s = (double)(host_clock_now_us() - boot_us) / 1e6;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("time scale %.1fx, %d iterations\n", scale, iterations);
+    report("key-to-start", key_to_start, key_samples);
+    report("timeout-to-start", timeout_to_start, timeout_samples);
+    report("reply-to-relay", reply_to_relay, relay_samples);
+    printf("device heap: boot %zu B, peak %zu B, now %zu B; static %zu B\n", boot.current_bytes,
+           end.peak_bytes, end.current_bytes, end.static_bytes);
+    printf("tasks: %u at boot, %u created per call, %u alive\n", boot.tasks_created,
+           sessions ? (end.tasks_created - boot.tasks_created) / sessions : 0, end.tasks_alive);
+    printf("allocations per call: %u\n",
+           sessions ? (end.allocations - boot.allocations) / sessions : 0);
+    printf("i2c transactions: %.1f/s\n", (host_i2c_transactions() - boot_i2c) / elapsed_s);
+    printf("host max RSS: %ld KiB\n", usage.ru_maxrss);
+
+    free(key_to_start);
+    free(timeout_to_start);
+    free(reply_to_relay);
+    return key_samples + timeout_samples == iterations ? 0 : 1;
+}
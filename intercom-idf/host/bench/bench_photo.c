@@ -0,0 +1,132 @@
+/**
+ * @brief Photo transmit benchmark for the host build.
+ *
+ * Calls tcp_client_send_photo() against a loopback sink for a range of
+ * frame sizes and reports, per photo, device time to completion, the
+ * modelled device CPU time spent copying frame data into pbufs, and host
+ * CPU time. Built twice: bench_photo (CONFIG_INTERCOM_PHOTO_ZERO_COPY) and
+ * bench_photo_copy (send() path).
+ *
+ * Usage: bench_photo [photos_per_size] [time_scale]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_camera.h"
+#include "esp_log.h"
+#include "fake_camera.h"
+#include "host_clock.h"
+#include "host_lwip.h"
+#include "power.h"
+#include "tcp_client.h"
+
+static void *sink_task(void *arg)
+{
+    int listener = *(int *)arg;
+    static char buf[64 * 1024];
+
+    for (;;)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+        while (recv(client, buf, sizeof(buf), 0) > 0)
+        {
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+static int start_sink(void)
+{
+    static int s_listener;
+    s_listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(s_listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(INTERCOM_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(s_listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(s_listener, 4) != 0)
+    {
+        perror("bench sink");
+        return -1;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, sink_task, &s_listener);
+    pthread_detach(thread);
+    return 0;
+}
+
+static uint64_t thread_cpu_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+int main(int argc, char **argv)
+{
+    int photos = argc > 1 ? atoi(argv[1]) : 50;
+    double scale = argc > 2 ? atof(argv[2]) : 1.0;
+    const size_t sizes[] = {8 * 1024, 16 * 1024, 32 * 1024, 64 * 1024};
+
+    esp_log_level_set("*", getenv("BENCH_VERBOSE") ? ESP_LOG_INFO : ESP_LOG_NONE);
+    host_clock_set_scale(scale);
+    if (start_sink() != 0)
+    {
+        return 1;
+    }
+
+    camera_config_t config = {.pixel_format = PIXFORMAT_JPEG};
+    esp_camera_init(&config);
+    power_init();
+    if (tcp_client_connect(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT) != ESP_OK)
+    {
+        return 1;
+    }
+
+#if CONFIG_INTERCOM_PHOTO_ZERO_COPY
+    printf("photo transmit: zero-copy, %d photos per size\n", photos);
+#else
+    printf("photo transmit: send() copy, %d photos per size\n", photos);
+#endif
+    printf("%8s %12s %12s %14s %12s\n", "frame", "device ms", "MB/s", "copy CPU ms", "host CPU us");
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        fake_camera_set_frame_size(sizes[i]);
+        host_lwip_reset_stats();
+        uint64_t device_start = host_clock_now_us();
+        uint64_t cpu_start = thread_cpu_us();
+
+        for (int p = 0; p < photos; p++)
+        {
+            if (tcp_client_send_photo() != ESP_OK)
+            {
+                failures++;
+            }
+        }
+
+        double device_ms = (double)(host_clock_now_us() - device_start) / 1000.0 / photos;
+        double cpu_us = (double)(thread_cpu_us() - cpu_start) / photos;
+        host_lwip_stats_t stats = host_lwip_get_stats();
+        printf("%7zuK %12.2f %12.2f %14.2f %12.1f\n", sizes[i] / 1024, device_ms,
+               (double)sizes[i] / (device_ms * 1000.0), (double)stats.copy_us / 1000.0 / photos,
+               cpu_us);
+    }
+
+    tcp_client_disconnect();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+/**
+ * @brief Idle power and wake-to-key latency for the host build.
+ *
+ * Runs app_main() against the fake keypad and a loopback server that
+ * accepts every flat, and repeats: the device sits idle, then a visitor
+ * types "12*" and the door opens. Measures:
+ *  - press-to-key: key pressed -> key decoded by the keypad task (target
+ *    under 50 ms, light sleep exit excluded)
+ *  - the firmware's power counters (power_report())
+ *  - time in each power state and the average current, from the model in
+ *    host_power.h
+ *
+ * bench_power is built with CONFIG_INTERCOM_POWER_SAVE, bench_power_off
+ * without it (keypad polled, no DFS, light sleep or modem sleep tuning).
+ *
+ * Usage: bench_power [cycles] [idle_s] [time_scale]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "fake_keypad.h"
+#include "host_clock.h"
+#include "host_gpio.h"
+#include "host_power.h"
+#include "host_sync.h"
+#include "power.h"
+
+#define DOOR_RELAY_GPIO GPIO_NUM_1
+#define KEY_HOLD_MS 150
+#define KEY_GAP_MS 250
+#define KEY_TARGET_MS 50.0
+
+void app_main(void);
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t sessions;
+} s_server = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void *server_task(void *arg)
+{
+    int listener = *(int *)arg;
+    char buf[64];
+
+    for (;;)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+
+        // "start", then the flat number as a separate frame
+        int len = recv(client, buf, sizeof(buf) - 1, 0);
+        if (len == 5)
+        {
+            recv(client, buf, sizeof(buf) - 1, 0);
+        }
+        send(client, "accept", 6, 0);
+
+        // Drain until the device hangs up
+        while (recv(client, buf, sizeof(buf), 0) > 0)
+        {
+        }
+        close(client);
+
+        pthread_mutex_lock(&s_server.lock);
+        s_server.sessions++;
+        pthread_cond_broadcast(&s_server.cond);
+        pthread_mutex_unlock(&s_server.lock);
+    }
+    return NULL;
+}
+
+static int start_server(void)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(INTERCOM_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0)
+    {
+        perror("bench server");
+        return -1;
+    }
+
+    static int s_listener;
+    s_listener = listener;
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_task, &s_listener);
+    pthread_detach(thread);
+    return 0;
+}
+
+static void *app_task(void *arg)
+{
+    (void)arg;
+    app_main();
+    return NULL;
+}
+
+static uint32_t wait_session(uint32_t seen)
+{
+    struct timespec deadline = host_clock_deadline(30 * 1000000ull);
+    pthread_mutex_lock(&s_server.lock);
+    while (s_server.sessions == seen)
+    {
+        if (pthread_cond_timedwait(&s_server.cond, &s_server.lock, &deadline) != 0)
+        {
+            break;
+        }
+    }
+    uint32_t sessions = s_server.sessions;
+    pthread_mutex_unlock(&s_server.lock);
+    return sessions;
+}
+
+// Press `key` and wait for the keypad task to decode it; returns the
+// latency in ms, or -1 if it was not decoded while held
+static double press_key(char key)
+{
+    uint32_t keys = power_get_stats().keys;
+    uint64_t pressed_us = fake_keypad_press(key);
+    double latency = -1;
+    while (host_clock_now_us() - pressed_us < KEY_HOLD_MS * 1000)
+    {
+        power_stats_t stats = power_get_stats();
+        if (stats.keys != keys)
+        {
+            latency = (double)(stats.last_key_us - (int64_t)pressed_us) / 1000.0;
+            break;
+        }
+        host_clock_sleep_us(1000);
+    }
+    uint64_t held_us = host_clock_now_us() - pressed_us;
+    if (held_us < KEY_HOLD_MS * 1000)
+    {
+        host_clock_sleep_us(KEY_HOLD_MS * 1000 - held_us);
+    }
+    fake_keypad_release();
+    host_clock_sleep_us(KEY_GAP_MS * 1000);
+    return latency;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    int cycles = argc > 1 ? atoi(argv[1]) : 5;
+    double idle_s = argc > 2 ? atof(argv[2]) : 60.0;
+    double scale = argc > 3 ? atof(argv[3]) : 20.0;
+    const char *keys = "12*";
+
+    esp_log_level_set("*", getenv("BENCH_VERBOSE") ? ESP_LOG_INFO : ESP_LOG_NONE);
+    host_clock_set_scale(scale);
+    host_cond_init(&s_server.cond);
+    fake_keypad_init();
+    if (start_server() != 0)
+    {
+        return 1;
+    }
+
+    pthread_t app;
+    pthread_create(&app, NULL, app_task, NULL);
+    pthread_detach(app);
+    host_clock_sleep_us(500 * 1000);
+    host_power_start();
+
+    double *latency = calloc(cycles * strlen(keys), sizeof(double));
+    int samples = 0, missed = 0;
+    uint32_t sessions = 0;
+
+    for (int i = 0; i < cycles; i++)
+    {
+        host_clock_sleep_us((uint64_t)(idle_s * 1e6));
+        for (const char *key = keys; *key != '\0'; key++)
+        {
+            double ms = press_key(*key);
+            if (ms < 0)
+            {
+                missed++;
+            }
+            else
+            {
+                latency[samples++] = ms;
+            }
+        }
+
+        uint32_t now_sessions = wait_session(sessions);
+        if (now_sessions == sessions)
+        {
+            fprintf(stderr, "cycle %d: no session\n", i);
+            continue;
+        }
+        sessions = now_sessions;
+        host_gpio_wait_level(DOOR_RELAY_GPIO, 0, 5 * 1000000ull, NULL);
+        host_gpio_wait_level(DOOR_RELAY_GPIO, 1, 5 * 1000000ull, NULL);
+    }
+
+#if CONFIG_INTERCOM_POWER_SAVE
+    printf("time scale %.1fx, %d cycles of %.0f s idle, power save on\n", scale, cycles, idle_s);
+#else
+    printf("time scale %.1fx, %d cycles of %.0f s idle, power save off\n", scale, cycles, idle_s);
+#endif
+    if (samples > 0)
+    {
+        qsort(latency, samples, sizeof(double), compare_double);
+        printf("%-16s n=%-4d p50=%8.2f p90=%8.2f max=%8.2f ms (target < %.0f ms), %d missed\n", "press-to-key",
+               samples, latency[samples / 2], latency[(samples * 9) / 10], latency[samples - 1], KEY_TARGET_MS,
+               missed);
+    }
+    else
+    {
+        printf("%-16s no samples\n", "press-to-key");
+    }
+    host_power_report();
+    fflush(stdout);
+    esp_log_level_set("*", ESP_LOG_INFO);
+    power_report();
+
+    free(latency);
+    return sessions == (uint32_t)cycles && missed == 0 ? 0 : 1;
+}
@@ -0,0 +1,341 @@
+/**
+ * @brief Session resume benchmark for the host build.
+ *
+ * Runs tcp_client (CONFIG_INTERCOM_SESSION_RESUME) against a loopback server
+ * that restarts in the middle of every call: it hands out a session id after
+ * "start", closes the device's channel and its listener, stays down for
+ * `outage_ms`, then listens again and expects "resume" and the same id
+ * before sending "accept". Every other call the server splits the id over
+ * two writes and sends it again with "accept" glued on, as a coalescing or
+ * fragmenting TCP stream would deliver it. Measures
+ *  - drop-to-resume: channel closed -> session id received on the new one
+ *  - drop-to-accept: channel closed -> "accept" dispatched on the device
+ *
+ * Then two calls are lost for good, one before the server handed out an id
+ * and one with the server down past CONFIG_INTERCOM_RESUME_TIMEOUT_MS; each
+ * must end on the device so that the next call can connect.
+ *
+ * Usage: bench_resume [iterations] [outage_ms] [time_scale]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "host_clock.h"
+#include "host_sync.h"
+#include "power.h"
+#include "sdkconfig.h"
+#include "tcp_client.h"
+
+#define FRAME_GAP_MS 500
+#define SESSION_ID "5f3a9c0e7b1d2468"
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t calls;    // Calls the server finished
+    uint32_t accepted; // "accept" commands dispatched on the device
+    uint32_t mismatched;
+    uint64_t drop_us;
+    uint64_t resume_us;
+    uint64_t accept_us;
+    bool losing;          // Drop calls for good
+    uint32_t lost;        // Calls the server dropped for good
+    uint32_t disconnects; // Disconnect callbacks on the device
+} s_bench = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static uint64_t s_outage_us;
+
+static int listen_server(void)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(INTERCOM_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0)
+    {
+        perror("bench server");
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+// Read one frame; the device spaces its frames out
+static int recv_frame(int client, char *buf, size_t size)
+{
+    int len = recv(client, buf, size - 1, 0);
+    buf[len > 0 ? len : 0] = 0;
+    return len;
+}
+
+static void *server_task(void *arg)
+{
+    int listener = *(int *)arg;
+    char buf[64];
+
+    for (;;)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+
+        // "start", then the flat number
+        recv_frame(client, buf, sizeof(buf));
+        recv_frame(client, buf, sizeof(buf));
+        if (s_bench.losing)
+        {
+            // Without an id the device can't resume; with one, stay down
+            // until it gives up
+            bool with_id = s_bench.lost % 2 == 1;
+            if (with_id)
+            {
+                send(client, "session:" SESSION_ID, strlen("session:" SESSION_ID), 0);
+            }
+            host_clock_sleep_us(100 * 1000);
+            close(client);
+            if (with_id)
+            {
+                close(listener);
+                host_clock_sleep_us((CONFIG_INTERCOM_RESUME_TIMEOUT_MS + 2000) * 1000ull);
+                while ((listener = listen_server()) < 0)
+                {
+                    host_clock_sleep_us(10 * 1000);
+                }
+            }
+            pthread_mutex_lock(&s_bench.lock);
+            s_bench.lost++;
+            pthread_cond_broadcast(&s_bench.cond);
+            pthread_mutex_unlock(&s_bench.lock);
+            continue;
+        }
+        bool torn = s_bench.calls % 2 == 1;
+        if (torn)
+        {
+            send(client, "session:5f3a", strlen("session:5f3a"), 0);
+            host_clock_sleep_us(20 * 1000);
+            send(client, SESSION_ID + 4, strlen(SESSION_ID + 4), 0);
+        }
+        else
+        {
+            send(client, "session:" SESSION_ID, strlen("session:" SESSION_ID), 0);
+        }
+
+        // Let the device block on the reply, then go away like a server
+        // being restarted: stop listening and drop the channel
+        host_clock_sleep_us(100 * 1000);
+        close(listener);
+        close(client);
+        uint64_t drop_us = host_clock_now_us();
+        host_clock_sleep_us(s_outage_us);
+        while ((listener = listen_server()) < 0)
+        {
+            host_clock_sleep_us(10 * 1000);
+        }
+
+        client = accept(listener, NULL, NULL);
+        recv_frame(client, buf, sizeof(buf));
+        bool resumed = strcmp(buf, "resume") == 0;
+        recv_frame(client, buf, sizeof(buf));
+        resumed = resumed && strcmp(buf, SESSION_ID) == 0;
+        uint64_t resume_us = host_clock_now_us();
+        if (torn)
+        {
+            send(client, "session:" SESSION_ID "accept", strlen("session:" SESSION_ID "accept"), 0);
+        }
+        else
+        {
+            send(client, "accept", 6, 0);
+        }
+
+        pthread_mutex_lock(&s_bench.lock);
+        s_bench.mismatched += resumed ? 0 : 1;
+        s_bench.drop_us = drop_us;
+        s_bench.resume_us = resume_us;
+        s_bench.calls++;
+        pthread_cond_broadcast(&s_bench.cond);
+        pthread_mutex_unlock(&s_bench.lock);
+
+        // Drain until the device hangs up
+        while (recv(client, buf, sizeof(buf), 0) > 0)
+        {
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+static void accept_command(const char *cmd)
+{
+    (void)cmd;
+    pthread_mutex_lock(&s_bench.lock);
+    s_bench.accept_us = host_clock_now_us();
+    s_bench.accepted++;
+    pthread_cond_broadcast(&s_bench.cond);
+    pthread_mutex_unlock(&s_bench.lock);
+}
+
+static void disconnect_callback(void)
+{
+    pthread_mutex_lock(&s_bench.lock);
+    s_bench.disconnects++;
+    pthread_cond_broadcast(&s_bench.cond);
+    pthread_mutex_unlock(&s_bench.lock);
+}
+
+// Wait for the device's `count`th disconnect and the server to be
+// listening again; false on timeout
+static bool wait_lost(uint32_t count)
+{
+    struct timespec deadline = host_clock_deadline(60 * 1000000ull);
+    bool done = true;
+    pthread_mutex_lock(&s_bench.lock);
+    while (s_bench.disconnects < count || s_bench.lost < count)
+    {
+        if (pthread_cond_timedwait(&s_bench.cond, &s_bench.lock, &deadline) != 0)
+        {
+            done = false;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_bench.lock);
+    return done;
+}
+
+// Wait until the server has finished `calls` calls; false on timeout
+static bool wait_calls(uint32_t calls)
+{
+    struct timespec deadline = host_clock_deadline(60 * 1000000ull);
+    bool done = true;
+    pthread_mutex_lock(&s_bench.lock);
+    while (s_bench.calls < calls || s_bench.accepted < calls)
+    {
+        if (pthread_cond_timedwait(&s_bench.cond, &s_bench.lock, &deadline) != 0)
+        {
+            done = false;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_bench.lock);
+    return done;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *samples, int count)
+{
+    if (count == 0)
+    {
+        printf("%-16s no samples\n", name);
+        return;
+    }
+    qsort(samples, count, sizeof(double), compare_double);
+    printf("%-16s n=%-4d p50=%8.2f p90=%8.2f max=%8.2f ms\n", name, count, samples[count / 2],
+           samples[(count * 9) / 10], samples[count - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 10;
+    s_outage_us = (argc > 2 ? atoi(argv[2]) : 1000) * 1000ull;
+    double scale = argc > 3 ? atof(argv[3]) : 10.0;
+
+    esp_log_level_set("*", getenv("BENCH_VERBOSE") ? ESP_LOG_INFO : ESP_LOG_NONE);
+    signal(SIGPIPE, SIG_IGN);
+    host_clock_set_scale(scale);
+    host_cond_init(&s_bench.cond);
+    power_init();
+
+    static int s_listener;
+    if ((s_listener = listen_server()) < 0)
+    {
+        return 1;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_task, &s_listener);
+    pthread_detach(thread);
+
+    tcp_client_register_command_callback("accept", accept_command);
+
+    double *to_resume = calloc(iterations, sizeof(double));
+    double *to_accept = calloc(iterations, sizeof(double));
+    int count = 0;
+    printf("Server restarted mid-call with a %llu ms outage, %d calls\n",
+           (unsigned long long)s_outage_us / 1000, iterations);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        if (tcp_client_connect(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT) != ESP_OK)
+        {
+            continue;
+        }
+        tcp_client_send_string("start");
+        host_clock_sleep_us(FRAME_GAP_MS * 1000);
+        tcp_client_send_string("42");
+        tcp_client_wait_for_msg();
+
+        if (!wait_calls(i + 1))
+        {
+            tcp_client_disconnect();
+            break;
+        }
+        pthread_mutex_lock(&s_bench.lock);
+        to_resume[count] = (s_bench.resume_us - s_bench.drop_us) / 1000.0;
+        to_accept[count] = (s_bench.accept_us - s_bench.drop_us) / 1000.0;
+        pthread_mutex_unlock(&s_bench.lock);
+        count++;
+        tcp_client_end_session();
+    }
+
+    // Calls that can't be resumed; from here every disconnect is one
+    tcp_client_register_disconnect_callback(disconnect_callback);
+    pthread_mutex_lock(&s_bench.lock);
+    s_bench.losing = true;
+    pthread_mutex_unlock(&s_bench.lock);
+    int ended = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        if (tcp_client_connect(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT) != ESP_OK)
+        {
+            continue;
+        }
+        tcp_client_send_string("start");
+        host_clock_sleep_us(FRAME_GAP_MS * 1000);
+        tcp_client_send_string("42");
+        tcp_client_wait_for_msg();
+        ended += wait_lost(i + 1) && !tcp_client_in_call() ? 1 : 0;
+    }
+    bool next = tcp_client_connect(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT) == ESP_OK;
+    if (next)
+    {
+        tcp_client_disconnect();
+    }
+
+    report("drop-to-resume", to_resume, count);
+    report("drop-to-accept", to_accept, count);
+    printf("calls lost %d, wrong session id %u\n", iterations - count, s_bench.mismatched);
+    printf("unresumable calls ended %d of 2, next call connects: %s\n", ended, next ? "yes" : "no");
+
+    free(to_resume);
+    free(to_accept);
+    return count == iterations && s_bench.mismatched == 0 && ended == 2 && next ? 0 : 1;
+}
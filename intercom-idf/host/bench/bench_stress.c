@@ -0,0 +1,306 @@
+/**
+ * @brief Keypad and door relay latency under load, for the task plan.
+ *
+ * Runs app_main() as bench_keypad does, with tasks scheduled by priority
+ * (SCHED_FIFO, see host_sched.h) and load standing in for the rest of the
+ * device:
+ *  - wifi:    priority 23, core 0, 1 ms of work every 10 ms
+ *  - camera:  priority 23, core 0, 4 ms of work every 40 ms (frame DMA)
+ *  - tiT:     priority 18, core 0, 1 ms of work every 10 ms (lwIP)
+ *  - app_hog: priority 5, unpinned, 20 ms of work then 20 ms asleep, for
+ *             application work at the default priority
+ *
+ * bench_stress uses the plan in task_registry.h; bench_stress_flat is built
+ * without CONFIG_INTERCOM_TASK_PLAN. The host usually has fewer cores than
+ * the device: with one CPU, core 0's load lands on the keypad too and only
+ * the priority half of the plan shows.
+ *
+ * Prints key-to-start and reply-to-relay as bench_keypad does, then the
+ * task report (CPU share, wake-up lateness).
+ *
+ * Usage: bench_stress [iterations] [time_scale]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "fake_keypad.h"
+#include "host_clock.h"
+#include "host_gpio.h"
+#include "host_sched.h"
+#include "host_sync.h"
+#include "task_registry.h"
+
+#define DOOR_RELAY_GPIO GPIO_NUM_1
+#define KEY_HOLD_MS 150
+#define KEY_GAP_MS 250
+// Above every firmware and load task, like the hardware and the server
+#define BENCH_PRIORITY 24
+
+void app_main(void);
+
+typedef struct
+{
+    const char *name;
+    UBaseType_t priority;
+    BaseType_t core;
+    uint32_t busy_ms;
+    uint32_t idle_ms;
+} load_t;
+
+static const load_t s_loads[] = {
+    {"wifi", 23, 0, 1, 9},
+    {"camera", 23, 0, 4, 36},
+    {"tiT", 18, 0, 1, 9},
+    {"app_hog", 5, tskNO_AFFINITY, 20, 20},
+};
+
+typedef enum
+{
+    REPLY_NOT_FOUND,
+    REPLY_ACCEPT
+} reply_mode_t;
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    reply_mode_t mode;
+    uint32_t sessions;
+    uint64_t start_us;
+    uint64_t reply_us;
+} s_server = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Spins on the thread's own CPU clock, so the work is done even when the
+// task is preempted part way
+static void busy(uint32_t device_ms)
+{
+    uint64_t work_ns = (uint64_t)(device_ms * 1e6 / host_clock_scale());
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    uint64_t end_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec + work_ns;
+    do
+    {
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    } while ((uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec < end_ns);
+}
+
+static void load_task(void *arg)
+{
+    const load_t *load = arg;
+    for (;;)
+    {
+        busy(load->busy_ms);
+        vTaskDelay(pdMS_TO_TICKS(load->idle_ms));
+    }
+}
+
+static void *server_task(void *arg)
+{
+    int listener = *(int *)arg;
+    char buf[64];
+    host_sched_set_priority(BENCH_PRIORITY);
+
+    for (;;)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+
+        // "start", then the flat number as a separate frame
+        int len = recv(client, buf, sizeof(buf) - 1, 0);
+        uint64_t start_us = host_clock_now_us();
+        if (len == 5)
+        {
+            len = recv(client, buf, sizeof(buf) - 1, 0);
+        }
+
+        pthread_mutex_lock(&s_server.lock);
+        const char *reply = s_server.mode == REPLY_ACCEPT ? "accept" : "not_found";
+        pthread_mutex_unlock(&s_server.lock);
+
+        uint64_t reply_us = host_clock_now_us();
+        send(client, reply, strlen(reply), 0);
+
+        // Drain until the device hangs up
+        while (recv(client, buf, sizeof(buf), 0) > 0)
+        {
+        }
+        close(client);
+
+        pthread_mutex_lock(&s_server.lock);
+        s_server.start_us = start_us;
+        s_server.reply_us = reply_us;
+        s_server.sessions++;
+        pthread_cond_broadcast(&s_server.cond);
+        pthread_mutex_unlock(&s_server.lock);
+    }
+    return NULL;
+}
+
+static int start_server(void)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(INTERCOM_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0)
+    {
+        perror("bench server");
+        return -1;
+    }
+
+    static int s_listener;
+    s_listener = listener;
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_task, &s_listener);
+    pthread_detach(thread);
+    return 0;
+}
+
+static void *app_task(void *arg)
+{
+    (void)arg;
+    app_main();
+    return NULL;
+}
+
+static uint32_t wait_session(uint32_t seen, uint64_t *start_us, uint64_t *reply_us)
+{
+    struct timespec deadline = host_clock_deadline(30 * 1000000ull);
+    pthread_mutex_lock(&s_server.lock);
+    while (s_server.sessions == seen)
+    {
+        if (pthread_cond_timedwait(&s_server.cond, &s_server.lock, &deadline) != 0)
+        {
+            break;
+        }
+    }
+    uint32_t sessions = s_server.sessions;
+    *start_us = s_server.start_us;
+    *reply_us = s_server.reply_us;
+    pthread_mutex_unlock(&s_server.lock);
+    return sessions;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *samples, int count)
+{
+    if (count == 0)
+    {
+        printf("%-16s no samples\n", name);
+        return;
+    }
+    qsort(samples, count, sizeof(double), compare_double);
+    printf("%-16s n=%-4d p50=%8.2f p90=%8.2f p99=%8.2f max=%8.2f ms\n", name, count,
+           samples[count / 2], samples[(count * 9) / 10], samples[(count * 99) / 100],
+           samples[count - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    double scale = argc > 2 ? atof(argv[2]) : 10.0;
+
+    esp_log_level_set("*", getenv("BENCH_VERBOSE") ? ESP_LOG_INFO : ESP_LOG_NONE);
+    host_clock_set_scale(scale);
+    host_cond_init(&s_server.cond);
+    if (!host_sched_realtime())
+    {
+        fprintf(stderr, "no real-time scheduling on this host; priorities are ignored\n");
+    }
+    host_sched_set_priority(BENCH_PRIORITY);
+    fake_keypad_init();
+    if (start_server() != 0)
+    {
+        return 1;
+    }
+
+    pthread_t app;
+    pthread_create(&app, NULL, app_task, NULL);
+    pthread_detach(app);
+    host_clock_sleep_us(200 * 1000);
+
+    for (size_t i = 0; i < sizeof(s_loads) / sizeof(s_loads[0]); i++)
+    {
+        xTaskCreatePinnedToCore(load_task, s_loads[i].name, 4096, (void *)&s_loads[i],
+                                s_loads[i].priority, NULL, s_loads[i].core);
+    }
+    // Start the report's CPU and latency counts from here
+    task_registry_report();
+
+    double *key_to_start = calloc(iterations, sizeof(double));
+    double *reply_to_relay = calloc(iterations, sizeof(double));
+    int key_samples = 0, relay_samples = 0;
+    uint32_t sessions = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        pthread_mutex_lock(&s_server.lock);
+        s_server.mode = i % 2 == 0 ? REPLY_NOT_FOUND : REPLY_ACCEPT;
+        pthread_mutex_unlock(&s_server.lock);
+
+        fake_keypad_type("12", KEY_HOLD_MS, KEY_GAP_MS);
+        uint64_t pressed_us = fake_keypad_press('*');
+        host_clock_sleep_us(KEY_HOLD_MS * 1000);
+        fake_keypad_release();
+
+        uint64_t start_us, reply_us;
+        uint32_t now_sessions = wait_session(sessions, &start_us, &reply_us);
+        if (now_sessions == sessions)
+        {
+            fprintf(stderr, "iteration %d: no session\n", i);
+            continue;
+        }
+        sessions = now_sessions;
+        key_to_start[key_samples++] = (double)(start_us - pressed_us) / 1000.0;
+
+        if (i % 2 == 1)
+        {
+            uint64_t relay_us;
+            if (host_gpio_wait_level(DOOR_RELAY_GPIO, 0, 5 * 1000000ull, &relay_us))
+            {
+                reply_to_relay[relay_samples++] = (double)(relay_us - reply_us) / 1000.0;
+            }
+            host_gpio_wait_level(DOOR_RELAY_GPIO, 1, 5 * 1000000ull, NULL);
+        }
+        else
+        {
+            // not_found holds the keypad task in led_show() for 3 s
+            host_clock_sleep_us(3200 * 1000);
+        }
+    }
+
+#if CONFIG_INTERCOM_TASK_PLAN
+    printf("time scale %.1fx, %d iterations, task plan on\n", scale, iterations);
+#else
+    printf("time scale %.1fx, %d iterations, task plan off\n", scale, iterations);
+#endif
+    report("key-to-start", key_to_start, key_samples);
+    report("reply-to-relay", reply_to_relay, relay_samples);
+    fflush(stdout);
+    esp_log_level_set("*", ESP_LOG_INFO);
+    task_registry_report();
+
+    free(key_to_start);
+    free(reply_to_relay);
+    return key_samples == iterations ? 0 : 1;
+}
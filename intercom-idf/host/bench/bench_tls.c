@@ -0,0 +1,260 @@
+/**
+ * @brief TLS channel setup benchmark for the host build.
+ *
+ * Runs tcp_client (CONFIG_INTERCOM_TLS) against a loopback TLS-PSK server
+ * configured like tgbot's and times tcp_client_connect() in three cases:
+ *  - full:   the server keeps no sessions, every connect is a full handshake
+ *  - resume: the server issues tickets, reconnects resume the last session
+ *  - reuse:  the channel stays open between calls, as the firmware does
+ * and the round trip of a "start" -> "not_found" exchange on the channel.
+ *
+ * Times are host wall time; on the device the full handshake additionally
+ * pays for the PSK key schedule on the SHA accelerator, still with no
+ * public-key operations.
+ *
+ * Usage: bench_tls [iterations]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <openssl/ssl.h>
+
+#include "esp_log.h"
+#include "host_tls.h"
+#include "power.h"
+#include "sdkconfig.h"
+#include "tcp_client.h"
+
+static SSL_CTX *s_full_ctx;
+static SSL_CTX *s_resume_ctx;
+static _Atomic(SSL_CTX *) s_server_ctx;
+
+static pthread_mutex_t s_reply_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_reply_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t s_replies;
+
+static unsigned int psk_server_cb(SSL *ssl, const char *identity, unsigned char *psk, unsigned int max_psk_len)
+{
+    (void)ssl;
+    const char *hex = CONFIG_INTERCOM_TLS_PSK;
+    size_t len = strlen(hex) / 2;
+    if (strcmp(identity, CONFIG_INTERCOM_TLS_PSK_IDENTITY) != 0 || len > max_psk_len)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned int byte;
+        sscanf(hex + 2 * i, "%2x", &byte);
+        psk[i] = byte;
+    }
+    return (unsigned int)len;
+}
+
+static SSL_CTX *server_ctx(int resumable)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_cipher_list(ctx, "PSK-AES128-GCM-SHA256");
+    SSL_CTX_set_psk_server_callback(ctx, psk_server_cb);
+    if (!resumable)
+    {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+    return ctx;
+}
+
+static void *server_task(void *arg)
+{
+    int listener = *(int *)arg;
+    char buf[256];
+
+    for (;;)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+        SSL *ssl = SSL_new(atomic_load(&s_server_ctx));
+        SSL_set_fd(ssl, client);
+        if (SSL_accept(ssl) == 1)
+        {
+            int len;
+            while ((len = SSL_read(ssl, buf, sizeof(buf))) > 0)
+            {
+                if (len == 5 && memcmp(buf, "start", 5) == 0)
+                {
+                    SSL_write(ssl, "not_found", 9);
+                }
+            }
+            SSL_shutdown(ssl);
+        }
+        SSL_free(ssl);
+        close(client);
+    }
+    return NULL;
+}
+
+static int start_server(void)
+{
+    static int s_listener;
+    s_listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(s_listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(INTERCOM_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(s_listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(s_listener, 4) != 0)
+    {
+        perror("bench server");
+        return -1;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_task, &s_listener);
+    pthread_detach(thread);
+    return 0;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// resumed < 0: not a handshake measurement
+static void report(const char *name, double *samples, int count, int resumed)
+{
+    if (count == 0)
+    {
+        printf("%-8s no samples\n", name);
+        return;
+    }
+    qsort(samples, count, sizeof(double), compare_double);
+    printf("%-8s n=%-4d p50=%7.3f p90=%7.3f max=%7.3f ms", name, count, samples[count / 2],
+           samples[(count * 9) / 10], samples[count - 1]);
+    if (resumed >= 0)
+    {
+        printf("  resumed %d", resumed);
+    }
+    printf("\n");
+}
+
+static void not_found_command(const char *cmd)
+{
+    (void)cmd;
+    pthread_mutex_lock(&s_reply_lock);
+    s_replies++;
+    pthread_cond_signal(&s_reply_cond);
+    pthread_mutex_unlock(&s_reply_lock);
+}
+
+// Connect and disconnect `iterations` times; returns the number of connects
+static int run_reconnects(double *samples, int iterations)
+{
+    int count = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        double started = now_ms();
+        if (tcp_client_connect(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT) != ESP_OK)
+        {
+            continue;
+        }
+        samples[count++] = now_ms() - started;
+        tcp_client_disconnect();
+    }
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+
+    esp_log_level_set("*", getenv("BENCH_VERBOSE") ? ESP_LOG_INFO : ESP_LOG_NONE);
+    signal(SIGPIPE, SIG_IGN);
+    s_full_ctx = server_ctx(0);
+    s_resume_ctx = server_ctx(1);
+    atomic_store(&s_server_ctx, s_full_ctx);
+    if (start_server() != 0)
+    {
+        return 1;
+    }
+    power_init();
+
+    double *samples = calloc(iterations, sizeof(double));
+    int failures = 0;
+    printf("TLS 1.2 PSK-AES128-GCM-SHA256 over loopback, %d connects each\n", iterations);
+
+    host_tls_reset_stats();
+    int count = run_reconnects(samples, iterations);
+    failures += iterations - count;
+    report("full", samples, count, (int)host_tls_get_stats().resumed);
+
+    // Prime a ticket from the resuming server, then measure reconnects
+    atomic_store(&s_server_ctx, s_resume_ctx);
+    run_reconnects(samples, 1);
+    host_tls_reset_stats();
+    count = run_reconnects(samples, iterations);
+    failures += iterations - count;
+    report("resume", samples, count, (int)host_tls_get_stats().resumed);
+
+    count = 0;
+    tcp_client_connect(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT);
+    host_tls_reset_stats();
+    for (int i = 0; i < iterations; i++)
+    {
+        tcp_client_end_session();
+        double started = now_ms();
+        if (tcp_client_connect(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT) == ESP_OK)
+        {
+            samples[count++] = now_ms() - started;
+        }
+    }
+    failures += iterations - count;
+    report("reuse", samples, count, -1);
+    printf("handshakes during reuse: %u\n", host_tls_get_stats().handshakes);
+
+    tcp_client_register_command_callback("not_found", not_found_command);
+    count = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        double started = now_ms();
+        if (tcp_client_send_string("start") != ESP_OK)
+        {
+            continue;
+        }
+        tcp_client_wait_for_msg();
+        pthread_mutex_lock(&s_reply_lock);
+        while (s_replies == (uint32_t)count)
+        {
+            pthread_cond_wait(&s_reply_cond, &s_reply_lock);
+        }
+        pthread_mutex_unlock(&s_reply_lock);
+        samples[count++] = now_ms() - started;
+    }
+    failures += iterations - count;
+    report("command", samples, count, -1);
+    tcp_client_disconnect();
+
+    free(samples);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#include "fake_camera.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_camera.h"
+#include "host_mem.h"
+
+static size_t s_frame_size = 12 * 1024;
+static camera_fb_t s_fb;
+static bool s_initialized = false;
+
+void fake_camera_set_frame_size(size_t size)
+{
+    s_frame_size = size < 4 ? 4 : size;
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config)
+{
+    if (config == NULL || config->pixel_format != PIXFORMAT_JPEG)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_initialized = true;
+    return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get(void)
+{
+    if (!s_initialized || s_fb.buf != NULL)
+    {
+        return NULL;
+    }
+    s_fb.buf = malloc(s_frame_size);
+    if (s_fb.buf == NULL)
+    {
+        return NULL;
+    }
+    memset(s_fb.buf, 0xA5, s_frame_size);
+    s_fb.buf[0] = 0xFF;
+    s_fb.buf[1] = 0xD8;
+    s_fb.buf[s_frame_size - 2] = 0xFF;
+    s_fb.buf[s_frame_size - 1] = 0xD9;
+    s_fb.len = s_frame_size;
+    s_fb.width = 320;
+    s_fb.height = 240;
+    s_fb.format = PIXFORMAT_JPEG;
+    host_mem_psram_alloc(s_frame_size);
+    host_mem_psram_region(s_fb.buf, s_frame_size);
+    return &s_fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb)
+{
+    if (fb == &s_fb && s_fb.buf != NULL)
+    {
+        host_mem_psram_free(s_fb.len);
+        host_mem_psram_region(NULL, 0);
+        free(s_fb.buf);
+        s_fb.buf = NULL;
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef FAKE_CAMERA_H
+#define FAKE_CAMERA_H
+
+#include <stddef.h>
+
+/**
+ * @brief Size of the JPEG returned by the next esp_camera_fb_get().
+ */
+void fake_camera_set_frame_size(size_t size);
+
+#endif // FAKE_CAMERA_H
@@ -0,0 +1,125 @@
+#include "fake_keypad.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "host_clock.h"
+#include "host_gpio.h"
+#include "host_i2c.h"
+#include "sdkconfig.h"
+
+#define PCF8574_ADDR 0x20
+#define PCF8574_ROWS 0xF0
+
+// The expander's open-drain INT output, wired to the ESP32 when the keypad
+// waits for interrupts (keypad.c)
+#if CONFIG_INTERCOM_POWER_SAVE && CONFIG_INTERCOM_KEYPAD_INT_GPIO >= 0
+#define FAKE_KEYPAD_INT_GPIO ((gpio_num_t)CONFIG_INTERCOM_KEYPAD_INT_GPIO)
+#endif
+
+// Same layout as keypad_get_key_pressed(): keymap[3 - row][3 - col]
+static const char keymap[4][3] = {
+    {'1', '2', '3'},
+    {'4', '5', '6'},
+    {'7', '8', '9'},
+    {'*', '0', '#'}};
+
+static uint8_t s_latch = 0xFF;
+static atomic_int s_row = -1;
+static atomic_int s_col = -1;
+
+#ifdef FAKE_KEYPAD_INT_GPIO
+static pthread_mutex_t s_int_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t s_last_read = 0xFF;
+#endif
+
+static uint8_t pins_now(void)
+{
+    uint8_t pins = s_latch;
+    int row = atomic_load(&s_row);
+    int col = atomic_load(&s_col);
+    // A pressed key shorts its row line to its column line
+    if (row >= 0 && !(s_latch & (1 << col)))
+    {
+        pins &= ~(1 << (row + 4));
+    }
+    return pins;
+}
+
+// INT is asserted while the row inputs differ from what was last read, and
+// released by the next read
+static void update_int(bool read)
+{
+#ifdef FAKE_KEYPAD_INT_GPIO
+    pthread_mutex_lock(&s_int_lock);
+    uint8_t pins = pins_now();
+    if (read)
+    {
+        s_last_read = pins;
+    }
+    host_gpio_drive(FAKE_KEYPAD_INT_GPIO, (pins & PCF8574_ROWS) == (s_last_read & PCF8574_ROWS));
+    pthread_mutex_unlock(&s_int_lock);
+#else
+    (void)read;
+#endif
+}
+
+static uint8_t pcf8574_read(void)
+{
+    uint8_t pins = pins_now();
+    update_int(true);
+    return pins;
+}
+
+static void pcf8574_write(uint8_t data)
+{
+    s_latch = data;
+    update_int(false);
+}
+
+static const host_i2c_device_t s_device = {
+    .address = PCF8574_ADDR,
+    .read = pcf8574_read,
+    .write = pcf8574_write,
+};
+
+void fake_keypad_init(void)
+{
+    host_i2c_attach(&s_device);
+    update_int(true);
+}
+
+uint64_t fake_keypad_press(char key)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            if (keymap[i][j] == key)
+            {
+                atomic_store(&s_col, 3 - j);
+                atomic_store(&s_row, 3 - i);
+            }
+        }
+    }
+    uint64_t now = host_clock_now_us();
+    update_int(false);
+    return now;
+}
+
+void fake_keypad_release(void)
+{
+    atomic_store(&s_row, -1);
+    atomic_store(&s_col, -1);
+    update_int(false);
+}
+
+void fake_keypad_type(const char *keys, uint32_t hold_ms, uint32_t gap_ms)
+{
+    for (const char *key = keys; *key != '\0'; key++)
+    {
+        fake_keypad_press(*key);
+        host_clock_sleep_us((uint64_t)hold_ms * 1000);
+        fake_keypad_release();
+        host_clock_sleep_us((uint64_t)gap_ms * 1000);
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef FAKE_KEYPAD_H
+#define FAKE_KEYPAD_H
+
+#include <stdint.h>
+
+/**
+ * @brief Attach a PCF8574 at 0x20 wired to the 4x3 keypad matrix, as on the
+ * board: columns on P1..P3, rows on P4..P7.
+ */
+void fake_keypad_init(void);
+
+/**
+ * @brief Hold a key down until fake_keypad_release() is called.
+ *
+ * @return Device time of the press in microseconds.
+ */
+uint64_t fake_keypad_press(char key);
+
+void fake_keypad_release(void);
+
+/**
+ * @brief Press and release each key of `keys` in turn.
+ */
+void fake_keypad_type(const char *keys, uint32_t hold_ms, uint32_t gap_ms);
+
+#endif // FAKE_KEYPAD_H
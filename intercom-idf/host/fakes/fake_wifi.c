@@ -0,0 +1,13 @@
+#include "wifi_manager.h"
+
+#include "host_power.h"
+
+// The host network is always up; loopback stands in for the AP
+void wifi_init_sta(const char *ssid, const char *password)
+{
+    (void)password;
+#if CONFIG_INTERCOM_POWER_SAVE
+    host_power_set_listen_interval(CONFIG_INTERCOM_WIFI_LISTEN_INTERVAL);
+#endif
+    ESP_LOGI("wifi_manager", "Connected to SSID:%s (host)", ssid);
+}
@@ -0,0 +1,76 @@
+#include "host_clock.h"
+#include "esp_timer.h"
+
+#include <errno.h>
+#include <pthread.h>
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static double s_scale = 1.0;
+static uint64_t s_base_real_ns = 0;
+static uint64_t s_base_device_us = 0;
+
+static uint64_t real_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t device_now_locked(uint64_t real_ns)
+{
+    if (s_base_real_ns == 0)
+    {
+        s_base_real_ns = real_ns;
+    }
+    return s_base_device_us + (uint64_t)((double)(real_ns - s_base_real_ns) * s_scale / 1000.0);
+}
+
+void host_clock_set_scale(double scale)
+{
+    pthread_mutex_lock(&s_lock);
+    uint64_t real_ns = real_now_ns();
+    s_base_device_us = device_now_locked(real_ns);
+    s_base_real_ns = real_ns;
+    s_scale = scale > 0 ? scale : 1.0;
+    pthread_mutex_unlock(&s_lock);
+}
+
+double host_clock_scale(void)
+{
+    return s_scale;
+}
+
+uint64_t host_clock_now_us(void)
+{
+    pthread_mutex_lock(&s_lock);
+    uint64_t now = device_now_locked(real_now_ns());
+    pthread_mutex_unlock(&s_lock);
+    return now;
+}
+
+void host_clock_sleep_us(uint64_t device_us)
+{
+    uint64_t real_ns = (uint64_t)((double)device_us * 1000.0 / s_scale);
+    struct timespec ts = {
+        .tv_sec = (time_t)(real_ns / 1000000000ull),
+        .tv_nsec = (long)(real_ns % 1000000000ull),
+    };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    {
+    }
+}
+
+struct timespec host_clock_deadline(uint64_t device_us)
+{
+    uint64_t deadline_ns = real_now_ns() + (uint64_t)((double)device_us * 1000.0 / s_scale);
+    struct timespec ts = {
+        .tv_sec = (time_t)(deadline_ns / 1000000000ull),
+        .tv_nsec = (long)(deadline_ns % 1000000000ull),
+    };
+    return ts;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)host_clock_now_us();
+}
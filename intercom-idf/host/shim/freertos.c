@@ -0,0 +1,434 @@
+#define _GNU_SOURCE  // pthread_attr_setaffinity_np
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_mem.h"
+#include "host_power.h"
+#include "host_sched.h"
+#include "host_sync.h"
+
+// Approximate ESP-IDF sizes, so memory reports match the device heap
+#define HOST_TCB_SIZE 352
+#define HOST_QUEUE_SIZE 84
+
+struct host_task
+{
+    TaskFunction_t function;
+    void *param;
+    uint32_t stack_depth;
+    bool is_static;
+    char name[16];
+    UBaseType_t priority;
+    BaseType_t core_id;
+    UBaseType_t number;
+    clockid_t cpu_clock;
+    struct host_task *next;
+};
+
+struct host_semaphore
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned count;
+    unsigned max;
+    bool is_static;
+};
+
+static __thread struct host_task *s_current_task = NULL;
+
+// Running tasks, for uxTaskGetSystemState()
+static pthread_mutex_t s_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct host_task *s_tasks = NULL;
+static UBaseType_t s_task_count = 0;
+static UBaseType_t s_next_number = 1;
+
+static bool s_realtime = false;
+
+void host_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void task_release(struct host_task *task)
+{
+    pthread_mutex_lock(&s_tasks_lock);
+    for (struct host_task **link = &s_tasks; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == task)
+        {
+            *link = task->next;
+            s_task_count--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+
+    if (!task->is_static)
+    {
+        host_mem_free(task->stack_depth + HOST_TCB_SIZE);
+    }
+    host_mem_task_deleted();
+    free(task);
+}
+
+static void *task_entry(void *arg)
+{
+    struct host_task *task = arg;
+    s_current_task = task;
+    pthread_getcpuclockid(pthread_self(), &task->cpu_clock);
+    pthread_mutex_lock(&s_tasks_lock);
+    task->next = s_tasks;
+    s_tasks = task;
+    s_task_count++;
+    pthread_mutex_unlock(&s_tasks_lock);
+    task->function(task->param);
+    // A FreeRTOS task must not return; treat it as self-deletion
+    task_release(task);
+    return NULL;
+}
+
+static void set_sched_attr(pthread_attr_t *attr, UBaseType_t priority, BaseType_t core_id)
+{
+    if (!s_realtime)
+    {
+        return;
+    }
+    struct sched_param param = {.sched_priority = 1 + (int)priority};
+    pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+    pthread_attr_setschedparam(attr, &param);
+    if (core_id != tskNO_AFFINITY && core_id < sysconf(_SC_NPROCESSORS_ONLN))
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core_id, &cpus);
+        pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
+    }
+}
+
+static struct host_task *task_start(TaskFunction_t function, const char *name,
+                                    uint32_t stack_depth, void *param, bool is_static,
+                                    UBaseType_t priority, BaseType_t core_id)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL)
+    {
+        return NULL;
+    }
+    task->function = function;
+    task->param = param;
+    task->stack_depth = stack_depth;
+    task->is_static = is_static;
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->priority = priority;
+    task->core_id = core_id;
+    pthread_mutex_lock(&s_tasks_lock);
+    task->number = s_next_number++;
+    pthread_mutex_unlock(&s_tasks_lock);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    set_sched_attr(&attr, priority, core_id);
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (err != 0)
+    {
+        free(task);
+        return NULL;
+    }
+
+    if (is_static)
+    {
+        host_mem_static(stack_depth + HOST_TCB_SIZE);
+    }
+    else
+    {
+        host_mem_alloc(stack_depth + HOST_TCB_SIZE);
+    }
+    host_mem_task_created();
+    return task;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                                   void *param, UBaseType_t priority, TaskHandle_t *created_task,
+                                   BaseType_t core_id)
+{
+    struct host_task *task =
+        task_start(function, name, stack_depth, param, false, priority, core_id);
+    if (task == NULL)
+    {
+        return pdFAIL;
+    }
+    if (created_task != NULL)
+    {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char *name,
+                                           uint32_t stack_depth, void *param, UBaseType_t priority,
+                                           StackType_t *stack_buffer, StaticTask_t *task_buffer,
+                                           BaseType_t core_id)
+{
+    (void)stack_buffer;
+    (void)task_buffer;
+    return task_start(function, name, stack_depth, param, true, priority, core_id);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                       void *param, UBaseType_t priority, TaskHandle_t *created_task)
+{
+    return xTaskCreatePinnedToCore(function, name, stack_depth, param, priority, created_task,
+                                   tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                               void *param, UBaseType_t priority, StackType_t *stack_buffer,
+                               StaticTask_t *task_buffer)
+{
+    return xTaskCreateStaticPinnedToCore(function, name, stack_depth, param, priority,
+                                         stack_buffer, task_buffer, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task != NULL && task != s_current_task)
+    {
+        abort();
+    }
+    if (s_current_task != NULL)
+    {
+        task_release(s_current_task);
+        s_current_task = NULL;
+    }
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        for (;;)
+        {
+            pause();
+        }
+    }
+    host_clock_sleep_us((uint64_t)ticks * portTICK_PERIOD_MS * 1000);
+    host_power_note_wake();
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_clock_now_us() / (portTICK_PERIOD_MS * 1000));
+}
+
+char *pcTaskGetName(TaskHandle_t task)
+{
+    task = task != NULL ? task : s_current_task;
+    return task != NULL ? task->name : "main";
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    task = task != NULL ? task : s_current_task;
+    return task != NULL ? task->stack_depth : 0;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *task_array, UBaseType_t array_size,
+                                 configRUN_TIME_COUNTER_TYPE *total_run_time)
+{
+    double scale = host_clock_scale();
+    UBaseType_t count = 0;
+    pthread_mutex_lock(&s_tasks_lock);
+    if (s_task_count <= array_size)
+    {
+        for (struct host_task *task = s_tasks; task != NULL; task = task->next)
+        {
+            struct timespec cpu = {0};
+            clock_gettime(task->cpu_clock, &cpu);
+            double cpu_ns = (double)cpu.tv_sec * 1e9 + (double)cpu.tv_nsec;
+            task_array[count++] = (TaskStatus_t){
+                .xHandle = task,
+                .pcTaskName = task->name,
+                .xTaskNumber = task->number,
+                .eCurrentState = eRunning,
+                .uxCurrentPriority = task->priority,
+                .uxBasePriority = task->priority,
+                .ulRunTimeCounter = (configRUN_TIME_COUNTER_TYPE)(uint64_t)(cpu_ns * scale / 1000.0),
+                .usStackHighWaterMark = task->stack_depth,
+                .xCoreID = task->core_id,
+            };
+        }
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+    if (total_run_time != NULL)
+    {
+        *total_run_time = (configRUN_TIME_COUNTER_TYPE)host_clock_now_us();
+    }
+    return count;
+}
+
+bool host_sched_realtime(void)
+{
+    struct sched_param param = {.sched_priority = sched_get_priority_min(SCHED_FIFO)};
+    pthread_t self = pthread_self();
+    int policy;
+    struct sched_param old;
+    pthread_getschedparam(self, &policy, &old);
+    // Probe with the calling thread, then put it back
+    if (pthread_setschedparam(self, SCHED_FIFO, &param) != 0)
+    {
+        return false;
+    }
+    pthread_setschedparam(self, policy, &old);
+    s_realtime = true;
+    return true;
+}
+
+bool host_sched_set_priority(UBaseType_t priority)
+{
+    struct sched_param param = {.sched_priority = 1 + (int)priority};
+    return s_realtime && pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+}
+
+static SemaphoreHandle_t semaphore_create(unsigned initial, unsigned max, bool is_static)
+{
+    struct host_semaphore *semaphore = calloc(1, sizeof(*semaphore));
+    if (semaphore == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&semaphore->lock, NULL);
+    host_cond_init(&semaphore->cond);
+    semaphore->count = initial;
+    semaphore->max = max;
+    semaphore->is_static = is_static;
+    if (is_static)
+    {
+        host_mem_static(HOST_QUEUE_SIZE);
+    }
+    else
+    {
+        host_mem_alloc(HOST_QUEUE_SIZE);
+    }
+    return semaphore;
+}
+
+// Mutexes are modelled as binary semaphores: no ownership or priority
+// inheritance, which the firmware does not rely on
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return semaphore_create(1, 1, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return semaphore_create(0, 1, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+    (void)buffer;
+    return semaphore_create(1, 1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+    (void)buffer;
+    return semaphore_create(0, 1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    return semaphore_create(initial, max, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCountingStatic(UBaseType_t max, UBaseType_t initial, StaticSemaphore_t *buffer)
+{
+    (void)buffer;
+    return semaphore_create(initial, max, true);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    struct timespec deadline = host_clock_deadline((uint64_t)ticks * portTICK_PERIOD_MS * 1000);
+    BaseType_t ret = pdTRUE;
+    bool waited = false;
+
+    pthread_mutex_lock(&semaphore->lock);
+    while (semaphore->count == 0)
+    {
+        if (ticks == 0)
+        {
+            ret = pdFALSE;
+            break;
+        }
+        waited = true;
+        if (ticks == portMAX_DELAY)
+        {
+            pthread_cond_wait(&semaphore->cond, &semaphore->lock);
+        }
+        else if (pthread_cond_timedwait(&semaphore->cond, &semaphore->lock, &deadline) != 0)
+        {
+            ret = semaphore->count > 0 ? pdTRUE : pdFALSE;
+            break;
+        }
+    }
+    if (ret == pdTRUE)
+    {
+        semaphore->count--;
+    }
+    pthread_mutex_unlock(&semaphore->lock);
+    if (waited)
+    {
+        host_power_note_wake();
+    }
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    BaseType_t ret = pdFALSE;
+    pthread_mutex_lock(&semaphore->lock);
+    if (semaphore->count < semaphore->max)
+    {
+        semaphore->count++;
+        pthread_cond_signal(&semaphore->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&semaphore->lock);
+    return ret;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken)
+{
+    if (higher_priority_task_woken != NULL)
+    {
+        *higher_priority_task_woken = pdFALSE;
+    }
+    return xSemaphoreGive(semaphore);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    pthread_mutex_destroy(&semaphore->lock);
+    pthread_cond_destroy(&semaphore->cond);
+    if (!semaphore->is_static)
+    {
+        host_mem_free(HOST_QUEUE_SIZE);
+    }
+    free(semaphore);
+}
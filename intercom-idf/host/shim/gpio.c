@@ -0,0 +1,203 @@
+#include "driver/gpio.h"
+
+#include <pthread.h>
+#include "host_clock.h"
+#include "host_gpio.h"
+#include "host_sync.h"
+#include "soc/gpio_periph.h"
+
+const uint32_t GPIO_PIN_MUX_REG[40];
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static uint32_t s_levels[GPIO_NUM_MAX];
+static uint64_t s_changed_at[GPIO_NUM_MAX];
+static bool s_driven[GPIO_NUM_MAX];
+
+static struct
+{
+    gpio_int_type_t type;
+    bool enabled;
+    gpio_isr_t handler;
+    void *arg;
+} s_intr[GPIO_NUM_MAX];
+
+static void gpio_init_once(void)
+{
+    host_cond_init(&s_cond);
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    (void)mode;
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_once(&s_once, gpio_init_once);
+    pthread_mutex_lock(&s_lock);
+    if (s_levels[gpio_num] != !!level)
+    {
+        s_levels[gpio_num] = !!level;
+        s_changed_at[gpio_num] = host_clock_now_us();
+        pthread_cond_broadcast(&s_cond);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    pthread_mutex_lock(&s_lock);
+    int level = (int)s_levels[gpio_num];
+    pthread_mutex_unlock(&s_lock);
+    return level;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    pthread_once(&s_once, gpio_init_once);
+    pthread_mutex_lock(&s_lock);
+    for (int pin = 0; pin < GPIO_NUM_MAX; pin++)
+    {
+        if (config->pin_bit_mask & (1ULL << pin))
+        {
+            s_intr[pin].type = config->intr_type;
+            if (config->pull_up_en && !s_driven[pin])
+            {
+                s_levels[pin] = 1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    (void)flags;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t handler, void *arg)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_intr[gpio_num].handler = handler;
+    s_intr[gpio_num].arg = arg;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+static bool level_triggers(gpio_int_type_t type, uint32_t level)
+{
+    return (type == GPIO_INTR_LOW_LEVEL && level == 0) || (type == GPIO_INTR_HIGH_LEVEL && level == 1);
+}
+
+static bool edge_triggers(gpio_int_type_t type, uint32_t from, uint32_t to)
+{
+    return from != to && (type == GPIO_INTR_ANYEDGE || (type == GPIO_INTR_NEGEDGE && to == 0) ||
+                          (type == GPIO_INTR_POSEDGE && to == 1));
+}
+
+// Handlers run with the lock released; they may disable their interrupt
+static void run_handler(gpio_num_t gpio_num)
+{
+    gpio_isr_t handler = s_intr[gpio_num].handler;
+    void *arg = s_intr[gpio_num].arg;
+    pthread_mutex_unlock(&s_lock);
+    if (handler != NULL)
+    {
+        handler(arg);
+    }
+    pthread_mutex_lock(&s_lock);
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_intr[gpio_num].enabled = true;
+    // A level interrupt fires straight away if the level is already there
+    if (level_triggers(s_intr[gpio_num].type, s_levels[gpio_num]))
+    {
+        run_handler(gpio_num);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_intr[gpio_num].enabled = false;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    bool level = intr_type == GPIO_INTR_LOW_LEVEL || intr_type == GPIO_INTR_HIGH_LEVEL;
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX && level ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+void host_gpio_drive(gpio_num_t gpio_num, uint32_t level)
+{
+    pthread_once(&s_once, gpio_init_once);
+    pthread_mutex_lock(&s_lock);
+    uint32_t from = s_levels[gpio_num];
+    s_driven[gpio_num] = true;
+    if (from != !!level)
+    {
+        s_levels[gpio_num] = !!level;
+        s_changed_at[gpio_num] = host_clock_now_us();
+        pthread_cond_broadcast(&s_cond);
+    }
+    gpio_int_type_t type = s_intr[gpio_num].type;
+    if (s_intr[gpio_num].enabled &&
+        (level_triggers(type, s_levels[gpio_num]) || edge_triggers(type, from, s_levels[gpio_num])))
+    {
+        run_handler(gpio_num);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+bool host_gpio_wait_level(gpio_num_t gpio_num, uint32_t level, uint64_t timeout_us,
+                          uint64_t *changed_at_us)
+{
+    pthread_once(&s_once, gpio_init_once);
+    struct timespec deadline = host_clock_deadline(timeout_us);
+    bool reached = true;
+
+    pthread_mutex_lock(&s_lock);
+    while (s_levels[gpio_num] != !!level)
+    {
+        if (pthread_cond_timedwait(&s_cond, &s_lock, &deadline) != 0)
+        {
+            reached = s_levels[gpio_num] == !!level;
+            break;
+        }
+    }
+    if (reached && changed_at_us != NULL)
+    {
+        *changed_at_us = s_changed_at[gpio_num];
+    }
+    pthread_mutex_unlock(&s_lock);
+    return reached;
+}
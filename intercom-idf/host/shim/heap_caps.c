@@ -0,0 +1,31 @@
+#include "esp_heap_caps.h"
+
+#include "host_mem.h"
+
+// Derived from the shim's own accounting: only allocations made through the
+// shims count against the simulated internal heap
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    host_mem_stats_t stats = host_mem_get_stats();
+    if (caps & MALLOC_CAP_SPIRAM)
+    {
+        return HOST_SPIRAM_HEAP_SIZE - stats.psram_bytes;
+    }
+    return HOST_INTERNAL_HEAP_SIZE - stats.current_bytes;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    host_mem_stats_t stats = host_mem_get_stats();
+    if (caps & MALLOC_CAP_SPIRAM)
+    {
+        return HOST_SPIRAM_HEAP_SIZE - stats.psram_bytes;
+    }
+    return HOST_INTERNAL_HEAP_SIZE - stats.peak_bytes;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
@@ -0,0 +1,9 @@
+#ifndef HOST_SYNC_H
+#define HOST_SYNC_H
+
+#include <pthread.h>
+
+// Condition variable on CLOCK_MONOTONIC, matching host_clock_deadline()
+void host_cond_init(pthread_cond_t *cond);
+
+#endif // HOST_SYNC_H
@@ -0,0 +1,206 @@
+#include "driver/i2c.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "host_i2c.h"
+#include "host_mem.h"
+
+#define HOST_I2C_MAX_OPS 8
+#define HOST_I2C_MAX_DEVICES 4
+
+// Per-link and per-operation heap cost in the ESP-IDF legacy driver
+#define HOST_I2C_STRUCT_SIZE I2C_INTERNAL_STRUCT_SIZE
+
+typedef enum
+{
+    OP_START,
+    OP_WRITE,
+    OP_READ,
+    OP_STOP
+} op_type_t;
+
+typedef struct
+{
+    op_type_t type;
+    uint8_t data;
+    uint8_t *dest;
+} op_t;
+
+typedef struct
+{
+    op_t ops[HOST_I2C_MAX_OPS];
+    int count;
+    bool is_static;
+} cmd_link_t;
+
+static const host_i2c_device_t *s_devices[HOST_I2C_MAX_DEVICES];
+static int s_device_count = 0;
+static uint32_t s_clk_speed[I2C_NUM_MAX] = {100000, 100000};
+static pthread_mutex_t s_bus_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t s_transactions = 0;
+
+void host_i2c_attach(const host_i2c_device_t *device)
+{
+    if (s_device_count < HOST_I2C_MAX_DEVICES)
+    {
+        s_devices[s_device_count++] = device;
+    }
+}
+
+uint32_t host_i2c_transactions(void)
+{
+    return s_transactions;
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf)
+{
+    if (i2c_num >= I2C_NUM_MAX || i2c_conf == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_clk_speed[i2c_num] = i2c_conf->master.clk_speed;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len,
+                             size_t slv_tx_buf_len, int intr_alloc_flags)
+{
+    (void)mode;
+    (void)slv_rx_buf_len;
+    (void)slv_tx_buf_len;
+    (void)intr_alloc_flags;
+    return i2c_num < I2C_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    host_mem_alloc(HOST_I2C_STRUCT_SIZE);
+    return calloc(1, sizeof(cmd_link_t));
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    cmd_link_t *link = cmd_handle;
+    host_mem_free(HOST_I2C_STRUCT_SIZE * (1 + link->count));
+    free(link);
+}
+
+// The caller's buffer only sizes the link on the device; the host keeps its
+// own copy and accounts nothing to the heap
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size)
+{
+    if (buffer == NULL || size < I2C_LINK_RECOMMENDED_SIZE(1))
+    {
+        return NULL;
+    }
+    cmd_link_t *link = calloc(1, sizeof(cmd_link_t));
+    link->is_static = true;
+    return link;
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd_handle)
+{
+    free(cmd_handle);
+}
+
+static esp_err_t push_op(i2c_cmd_handle_t cmd_handle, op_t op)
+{
+    cmd_link_t *link = cmd_handle;
+    if (link->count >= HOST_I2C_MAX_OPS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    link->ops[link->count++] = op;
+    if (!link->is_static)
+    {
+        host_mem_alloc(HOST_I2C_STRUCT_SIZE);
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    return push_op(cmd_handle, (op_t){.type = OP_START});
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    (void)ack_en;
+    return push_op(cmd_handle, (op_t){.type = OP_WRITE, .data = data});
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack)
+{
+    (void)ack;
+    return push_op(cmd_handle, (op_t){.type = OP_READ, .dest = data});
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    return push_op(cmd_handle, (op_t){.type = OP_STOP});
+}
+
+static const host_i2c_device_t *find_device(uint8_t address)
+{
+    for (int i = 0; i < s_device_count; i++)
+    {
+        if (s_devices[i]->address == address)
+        {
+            return s_devices[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle,
+                               TickType_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    cmd_link_t *link = cmd_handle;
+    const host_i2c_device_t *device = NULL;
+    bool addressed = false;
+    uint32_t bits = 0;
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&s_bus_lock);
+    for (int i = 0; i < link->count; i++)
+    {
+        op_t *op = &link->ops[i];
+        switch (op->type)
+        {
+        case OP_START:
+            addressed = false;
+            bits += 1;
+            break;
+        case OP_STOP:
+            bits += 1;
+            break;
+        case OP_WRITE:
+            bits += 9;
+            if (!addressed)
+            {
+                device = find_device(op->data >> 1);
+                addressed = true;
+                if (device == NULL)
+                {
+                    ret = ESP_FAIL; // address NACK
+                }
+            }
+            else if (device != NULL && device->write != NULL)
+            {
+                device->write(op->data);
+            }
+            break;
+        case OP_READ:
+            bits += 9;
+            *op->dest = device != NULL && device->read != NULL ? device->read() : 0xFF;
+            break;
+        }
+    }
+    s_transactions++;
+    pthread_mutex_unlock(&s_bus_lock);
+
+    // Hold the caller for the time the transfer takes on the wire
+    host_clock_sleep_us((uint64_t)bits * 1000000 / s_clk_speed[i2c_num]);
+    return ret;
+}
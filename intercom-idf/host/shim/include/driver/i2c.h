@@ -0,0 +1,85 @@
+#ifndef DRIVER_I2C_H
+#define DRIVER_I2C_H
+
+// Legacy I2C driver API; transactions are executed against fake devices
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+
+typedef enum
+{
+    I2C_NUM_0 = 0,
+    I2C_NUM_1,
+    I2C_NUM_MAX
+} i2c_port_t;
+
+typedef enum
+{
+    I2C_MODE_SLAVE = 0,
+    I2C_MODE_MASTER
+} i2c_mode_t;
+
+typedef enum
+{
+    I2C_MASTER_WRITE = 0,
+    I2C_MASTER_READ
+} i2c_rw_t;
+
+typedef enum
+{
+    I2C_MASTER_ACK = 0,
+    I2C_MASTER_NACK = 1,
+    I2C_MASTER_LAST_NACK = 2
+} i2c_ack_type_t;
+
+typedef struct
+{
+    i2c_mode_t mode;
+    int sda_io_num;
+    int scl_io_num;
+    bool sda_pullup_en;
+    bool scl_pullup_en;
+    union
+    {
+        struct
+        {
+            uint32_t clk_speed;
+        } master;
+    };
+    uint32_t clk_flags;
+} i2c_config_t;
+
+typedef void *i2c_cmd_handle_t;
+
+#define I2C_INTERNAL_STRUCT_SIZE (24)
+#define I2C_LINK_RECOMMENDED_SIZE(TRANSACTIONS) \
+    (2 * I2C_INTERNAL_STRUCT_SIZE + I2C_INTERNAL_STRUCT_SIZE * (5 * (TRANSACTIONS)))
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf);
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len,
+                             size_t slv_tx_buf_len, int intr_alloc_flags);
+
+i2c_cmd_handle_t i2c_cmd_link_create(void);
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle);
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size);
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd_handle);
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle);
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en);
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack);
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle);
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle,
+                               TickType_t ticks_to_wait);
+
+#endif // DRIVER_I2C_H
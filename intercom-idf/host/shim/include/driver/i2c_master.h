@@ -0,0 +1,7 @@
+#ifndef DRIVER_I2C_MASTER_H
+#define DRIVER_I2C_MASTER_H
+
+// The firmware only uses the legacy driver; keep the include resolvable
+#include "driver/i2c.h"
+
+#endif // DRIVER_I2C_MASTER_H
@@ -0,0 +1,7 @@
+#ifndef ESP_ATTR_H
+#define ESP_ATTR_H
+
+// Placement attributes mean nothing on the host
+#define IRAM_ATTR
+
+#endif // ESP_ATTR_H
@@ -0,0 +1,22 @@
+#ifndef ESP_HEAP_CAPS_H
+#define ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+// Sized like an ESP32 with Wi-Fi running and 4 MB of PSRAM mapped
+#define HOST_INTERNAL_HEAP_SIZE (160 * 1024)
+#define HOST_SPIRAM_HEAP_SIZE (4 * 1024 * 1024)
+
+size_t heap_caps_get_free_size(uint32_t caps);
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif // ESP_HEAP_CAPS_H
@@ -0,0 +1,34 @@
+#ifndef ESP_PM_H
+#define ESP_PM_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_PM_CPU_FREQ_MAX,
+    ESP_PM_APB_FREQ_MAX,
+    ESP_PM_NO_LIGHT_SLEEP
+} esp_pm_lock_type_t;
+
+typedef struct
+{
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_t;
+
+typedef struct host_pm_lock *esp_pm_lock_handle_t;
+
+// The configuration and lock hold times feed the power model in
+// host_power.h; the host CPU itself is not scaled
+esp_err_t esp_pm_configure(const void *config);
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name,
+                             esp_pm_lock_handle_t *out_handle);
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle);
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle);
+
+#endif // ESP_PM_H
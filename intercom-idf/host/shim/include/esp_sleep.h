@@ -0,0 +1,27 @@
+#ifndef ESP_SLEEP_H
+#define ESP_SLEEP_H
+
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_PD_DOMAIN_RTC_PERIPH,
+    ESP_PD_DOMAIN_XTAL,
+    ESP_PD_DOMAIN_RC_FAST,
+    ESP_PD_DOMAIN_VDDSDIO,
+    ESP_PD_DOMAIN_MAX
+} esp_sleep_pd_domain_t;
+
+typedef enum
+{
+    ESP_PD_OPTION_OFF,
+    ESP_PD_OPTION_ON,
+    ESP_PD_OPTION_AUTO
+} esp_sleep_pd_option_t;
+
+// Light sleep is modelled, not entered (see host_power.h)
+esp_err_t esp_sleep_enable_gpio_wakeup(void);
+
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t domain, esp_sleep_pd_option_t option);
+
+#endif // ESP_SLEEP_H
@@ -0,0 +1,17 @@
+#ifndef ESP_WIFI_H
+#define ESP_WIFI_H
+
+// Wi-Fi is not simulated on the host; wifi_manager.c is replaced by a fake.
+// Power save modes are recorded for the power model (host_power.h).
+#include "esp_err.h"
+
+typedef enum
+{
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM
+} wifi_ps_type_t;
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+
+#endif // ESP_WIFI_H
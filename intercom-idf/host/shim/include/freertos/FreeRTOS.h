@@ -0,0 +1,55 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+// Host shim: FreeRTOS kernel API backed by pthreads and the virtual clock
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "host_clock.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+// ESP-IDF counts stack depth in bytes
+typedef uint8_t StackType_t;
+
+// Opaque storage for statically allocated kernel objects
+typedef struct
+{
+    uint8_t dummy[352];
+} StaticTask_t;
+
+typedef struct
+{
+    uint8_t dummy[84];
+} StaticSemaphore_t;
+
+typedef struct
+{
+    uint8_t dummy[48];
+} StaticTimer_t;
+
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(ticks) ((uint32_t)(((uint64_t)(ticks) * 1000) / configTICK_RATE_HZ))
+
+// Run time is counted in device microseconds, as with esp_timer on the device
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+
+#endif // FREERTOS_H
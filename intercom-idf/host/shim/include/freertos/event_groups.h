@@ -0,0 +1,9 @@
+#ifndef EVENT_GROUPS_H
+#define EVENT_GROUPS_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_event_group *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+#endif // EVENT_GROUPS_H
@@ -0,0 +1,76 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+
+typedef enum
+{
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+typedef struct
+{
+    TaskHandle_t xHandle;
+    const char *pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    configRUN_TIME_COUNTER_TYPE ulRunTimeCounter;
+    StackType_t *pxStackBase;
+    uint32_t usStackHighWaterMark;
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_depth,
+                       void *param, UBaseType_t priority, TaskHandle_t *created_task);
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t task, const char *name, uint32_t stack_depth,
+                               void *param, UBaseType_t priority, StackType_t *stack_buffer,
+                               StaticTask_t *task_buffer);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stack_depth,
+                                   void *param, UBaseType_t priority, TaskHandle_t *created_task,
+                                   BaseType_t core_id);
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t task, const char *name,
+                                           uint32_t stack_depth, void *param, UBaseType_t priority,
+                                           StackType_t *stack_buffer, StaticTask_t *task_buffer,
+                                           BaseType_t core_id);
+
+// Only self-deletion (NULL) is supported
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+TickType_t xTaskGetTickCount(void);
+
+char *pcTaskGetName(TaskHandle_t task);
+
+/**
+ * @brief Host threads run on host-sized stacks, so this reports the full
+ * configured depth; stack usage is only meaningful on the device.
+ */
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+/**
+ * @brief Live tasks with the thread CPU time each has used, in device
+ * microseconds; `total_run_time` is device time since boot. States are not
+ * tracked and read as eRunning.
+ *
+ * @return Tasks written, or 0 if there are more than `array_size`.
+ */
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *task_array, UBaseType_t array_size,
+                                 configRUN_TIME_COUNTER_TYPE *total_run_time);
+
+#endif // TASK_H
@@ -0,0 +1,28 @@
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_timer *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *timer_id, TimerCallbackFunction_t callback);
+
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, UBaseType_t auto_reload,
+                                 void *timer_id, TimerCallbackFunction_t callback,
+                                 StaticTimer_t *timer_buffer);
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait);
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait);
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait);
+
+void *pvTimerGetTimerID(TimerHandle_t timer);
+
+#include "freertos/task.h"
+
+TaskHandle_t xTimerGetTimerDaemonTaskHandle(void);
+
+#endif // TIMERS_H
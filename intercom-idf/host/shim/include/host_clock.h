@@ -0,0 +1,28 @@
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * @brief Virtual device clock.
+ *
+ * Device time runs `scale` times faster than wall time, so delays in the
+ * firmware (scan intervals, debounce, vTaskDelay between frames) shrink
+ * proportionally while all reported times stay in device microseconds.
+ */
+void host_clock_set_scale(double scale);
+
+double host_clock_scale(void);
+
+uint64_t host_clock_now_us(void);
+
+void host_clock_sleep_us(uint64_t device_us);
+
+/**
+ * @brief Absolute CLOCK_MONOTONIC deadline for a device-time timeout,
+ * for use with pthread_cond_timedwait.
+ */
+struct timespec host_clock_deadline(uint64_t device_us);
+
+#endif // HOST_CLOCK_H
@@ -0,0 +1,26 @@
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+
+/**
+ * @brief Block until `gpio_num` is driven to `level`.
+ *
+ * @param timeout_us Device-time timeout.
+ * @param changed_at_us Receives the device time of the transition.
+ * @return true if the level was reached before the timeout.
+ */
+bool host_gpio_wait_level(gpio_num_t gpio_num, uint32_t level, uint64_t timeout_us,
+                          uint64_t *changed_at_us);
+
+/**
+ * @brief Drive an input from outside the firmware, as a peripheral would.
+ *
+ * An enabled interrupt on the pin that the new level triggers runs its
+ * handler on the calling thread before this returns.
+ */
+void host_gpio_drive(gpio_num_t gpio_num, uint32_t level);
+
+#endif // HOST_GPIO_H
@@ -0,0 +1,26 @@
+#ifndef HOST_I2C_H
+#define HOST_I2C_H
+
+#include <stdint.h>
+
+/**
+ * @brief A fake I2C target attached to the simulated bus.
+ *
+ * `read` returns the byte the device drives for a read transfer; `write`
+ * receives bytes written to it.
+ */
+typedef struct
+{
+    uint8_t address;
+    uint8_t (*read)(void);
+    void (*write)(uint8_t data);
+} host_i2c_device_t;
+
+void host_i2c_attach(const host_i2c_device_t *device);
+
+/**
+ * @brief Total completed transactions, for bus-traffic accounting.
+ */
+uint32_t host_i2c_transactions(void);
+
+#endif // HOST_I2C_H
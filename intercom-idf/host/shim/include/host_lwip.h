@@ -0,0 +1,45 @@
+#ifndef HOST_LWIP_H
+#define HOST_LWIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * @brief Socket send as lwIP implements it on the device.
+ *
+ * The firmware is built with `send` mapped here (see lwip_compat.h). Like
+ * lwip_send(), the data is copied into MSS-sized pbufs before it is queued;
+ * the copy is charged to the virtual clock at ESP32 memcpy rates, which are
+ * much lower when the source is in PSRAM.
+ */
+ssize_t lwip_send(int fd, const void *data, size_t size, int flags);
+
+/**
+ * @brief Socket creation, with the send buffer set by
+ * host_lwip_set_send_buffer().
+ */
+int lwip_socket(int domain, int type, int protocol);
+
+/**
+ * @brief Cap the send buffer of sockets created from now on, as lwIP's
+ * TCP_SND_BUF does on the device; 0 leaves the kernel default.
+ *
+ * lwIP also runs one write per netconn at a time: a send on a socket that
+ * another task is blocked writing to fails with EINPROGRESS, and so does a
+ * netconn write with ERR_INPROGRESS.
+ */
+void host_lwip_set_send_buffer(int bytes);
+
+typedef struct
+{
+    uint64_t copied_bytes;  // Bytes copied into pbufs
+    uint64_t copy_us;       // Device time spent copying
+    uint64_t nocopy_bytes;  // Bytes queued by reference
+} host_lwip_stats_t;
+
+host_lwip_stats_t host_lwip_get_stats(void);
+
+void host_lwip_reset_stats(void);
+
+#endif // HOST_LWIP_H
@@ -0,0 +1,46 @@
+#ifndef HOST_MEM_H
+#define HOST_MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    size_t current_bytes;    // Kernel objects and stacks currently allocated
+    size_t peak_bytes;       // High-water mark of current_bytes
+    size_t static_bytes;     // Kernel objects and stacks in static storage
+    size_t psram_bytes;      // Current external RAM use (frame buffers)
+    uint32_t tasks_created;  // Total xTaskCreate calls
+    uint32_t tasks_alive;    // Tasks not yet deleted
+    uint32_t allocations;    // Total dynamic allocations made by the shims
+} host_mem_stats_t;
+
+/**
+ * @brief Account a device-side allocation (task stack, semaphore, timer,
+ * I2C command link) at the size the ESP-IDF heap would see.
+ */
+void host_mem_alloc(size_t bytes);
+
+void host_mem_free(size_t bytes);
+
+void host_mem_static(size_t bytes);
+
+void host_mem_psram_alloc(size_t bytes);
+
+void host_mem_psram_free(size_t bytes);
+
+/**
+ * @brief Mark [start, start + len) as external RAM (one region at a time).
+ */
+void host_mem_psram_region(const void *start, size_t len);
+
+bool host_mem_is_psram(const void *ptr);
+
+void host_mem_task_created(void);
+
+void host_mem_task_deleted(void);
+
+host_mem_stats_t host_mem_get_stats(void);
+
+#endif // HOST_MEM_H
@@ -0,0 +1,51 @@
+#ifndef HOST_POWER_H
+#define HOST_POWER_H
+
+#include <stdint.h>
+
+/**
+ * @brief Time-in-state energy model of the device.
+ *
+ * The host does not sleep or scale its clock, so the shims record what the
+ * firmware asked for instead: the esp_pm configuration and how long
+ * CPU_FREQ_MAX locks were held, the Wi-Fi power save mode over time, task
+ * wake-ups and I2C transactions. The report turns these into time spent in
+ * each power state and an average current, using typical ESP32 figures:
+ *
+ *   CPU busy      31 / 44 / 68 mA at 80 / 160 / 240 MHz
+ *   CPU idle      20 / 27 / 30 mA (modem sleep, waiting for interrupts)
+ *   light sleep   0.8 mA
+ *   radio listen  +80 mA for 3 ms per beacon listened to (DTIM 1), or
+ *                 throughout with WIFI_PS_NONE
+ *   per wake-up   0.2 ms of CPU work, plus 0.5 ms to leave and re-enter
+ *                 light sleep when it is enabled
+ *   per I2C       0.3 ms of CPU (3 bytes at 100 kHz)
+ *
+ * CPU work between wake-ups and radio transmit time are not modelled; the
+ * camera sensor is not included.
+ */
+
+/**
+ * @brief Start the measured window.
+ */
+void host_power_start(void);
+
+/**
+ * @brief Print time in each state since host_power_start() and the
+ * average current.
+ */
+void host_power_report(void);
+
+/**
+ * @brief Beacons slept through in WIFI_PS_MAX_MODEM, as set in the
+ * station config on the device.
+ */
+void host_power_set_listen_interval(unsigned beacons);
+
+/**
+ * @brief A task woke up from a delay or a blocking wait. Called by the
+ * FreeRTOS and timer shims.
+ */
+void host_power_note_wake(void);
+
+#endif // HOST_POWER_H
@@ -0,0 +1,26 @@
+#ifndef HOST_SCHED_H
+#define HOST_SCHED_H
+
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @brief Schedule tasks created from now on like the device does: under
+ * SCHED_FIFO at 1 + their FreeRTOS priority, so a higher priority task
+ * preempts a lower one and equal ones run until they block. Tasks pinned to
+ * a core are pinned to the host CPU of that number when there is one.
+ *
+ * @return false if the host does not permit real-time scheduling (it needs
+ * root or CAP_SYS_NICE); tasks then keep the default policy.
+ */
+bool host_sched_realtime(void);
+
+/**
+ * @brief Run the calling thread, which is not a task, at a FreeRTOS
+ * priority. For bench threads that stand in for hardware or the server and
+ * must not be held up by the firmware.
+ */
+bool host_sched_set_priority(UBaseType_t priority);
+
+#endif // HOST_SCHED_H
@@ -0,0 +1,16 @@
+#ifndef HOST_TLS_H
+#define HOST_TLS_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t handshakes; // Completed client handshakes
+    uint32_t resumed;    // ...of which resumed a previous session
+} host_tls_stats_t;
+
+host_tls_stats_t host_tls_get_stats(void);
+
+void host_tls_reset_stats(void);
+
+#endif // HOST_TLS_H
@@ -0,0 +1,27 @@
+#ifndef LWIP_API_H
+#define LWIP_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lwip/err.h"
+#include "lwip/tcp.h"
+
+#define NETCONN_NOFLAG 0x00
+#define NETCONN_NOCOPY 0x00
+#define NETCONN_COPY 0x01
+#define NETCONN_MORE 0x02
+
+struct netconn
+{
+    int fd;
+    struct tcp_pcb tcp_pcb;
+    union
+    {
+        struct tcp_pcb *tcp;
+    } pcb;
+};
+
+err_t netconn_write_partly(struct netconn *conn, const void *dataptr, size_t size,
+                           uint8_t apiflags, size_t *bytes_written);
+
+#endif // LWIP_API_H
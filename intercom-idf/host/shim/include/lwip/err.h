@@ -0,0 +1,14 @@
+#ifndef LWIP_ERR_H
+#define LWIP_ERR_H
+
+typedef signed char err_t;
+
+#define ERR_OK 0
+#define ERR_MEM -1
+#define ERR_TIMEOUT -3
+#define ERR_INPROGRESS -5
+#define ERR_VAL -6
+#define ERR_CONN -11
+#define ERR_ARG -16
+
+#endif // LWIP_ERR_H
@@ -0,0 +1,13 @@
+#ifndef LWIP_SOCKETS_PRIV_H
+#define LWIP_SOCKETS_PRIV_H
+
+#include "lwip/api.h"
+
+struct lwip_sock
+{
+    struct netconn *conn;
+};
+
+struct lwip_sock *lwip_socket_dbg_get_socket(int fd);
+
+#endif // LWIP_SOCKETS_PRIV_H
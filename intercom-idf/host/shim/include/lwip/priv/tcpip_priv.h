@@ -0,0 +1,15 @@
+#ifndef LWIP_TCPIP_PRIV_H
+#define LWIP_TCPIP_PRIV_H
+
+#include "lwip/err.h"
+
+struct tcpip_api_call_data
+{
+    err_t err;
+};
+
+typedef err_t (*tcpip_api_call_fn)(struct tcpip_api_call_data *call);
+
+err_t tcpip_api_call(tcpip_api_call_fn fn, struct tcpip_api_call_data *call);
+
+#endif // LWIP_TCPIP_PRIV_H
@@ -0,0 +1,14 @@
+#ifndef LWIP_TCP_H
+#define LWIP_TCP_H
+
+// Only the send-queue fields the firmware inspects; the host fills them
+// from the kernel's SIOCOUTQ before each tcpip_api_call
+struct tcp_seg;
+
+struct tcp_pcb
+{
+    struct tcp_seg *unsent;
+    struct tcp_seg *unacked;
+};
+
+#endif // LWIP_TCP_H
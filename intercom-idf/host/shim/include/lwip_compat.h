@@ -0,0 +1,13 @@
+#ifndef LWIP_COMPAT_H
+#define LWIP_COMPAT_H
+
+// Force-included into the firmware sources on the host. On the device
+// <sys/socket.h> resolves to lwIP, so route socket() and send() through the
+// lwIP shim.
+#include <sys/socket.h>
+#include "host_lwip.h"
+
+#define socket(domain, type, protocol) lwip_socket(domain, type, protocol)
+#define send(fd, data, size, flags) lwip_send(fd, data, size, flags)
+
+#endif // LWIP_COMPAT_H
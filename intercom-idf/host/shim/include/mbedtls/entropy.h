@@ -0,0 +1,15 @@
+#ifndef MBEDTLS_ENTROPY_H
+#define MBEDTLS_ENTROPY_H
+
+#include <stddef.h>
+
+typedef struct
+{
+    int unused;
+} mbedtls_entropy_context;
+
+void mbedtls_entropy_init(mbedtls_entropy_context *ctx);
+
+int mbedtls_entropy_func(void *data, unsigned char *output, size_t len);
+
+#endif // MBEDTLS_ENTROPY_H
@@ -0,0 +1,107 @@
+#ifndef MBEDTLS_SSL_H
+#define MBEDTLS_SSL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The part of the mbedTLS 3.x client API the firmware uses, implemented on
+// OpenSSL in shim/mbedtls.c. Only TLS 1.2 PSK suites are mapped.
+
+#define MBEDTLS_ERR_SSL_BAD_INPUT_DATA -0x7100
+#define MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY -0x7880
+#define MBEDTLS_ERR_SSL_CONN_EOF -0x7280
+#define MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE -0x6E00
+#define MBEDTLS_ERR_SSL_INTERNAL_ERROR -0x6C00
+#define MBEDTLS_ERR_SSL_WANT_READ -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE -0x6880
+#define MBEDTLS_ERR_NET_SEND_FAILED -0x004E
+#define MBEDTLS_ERR_NET_RECV_FAILED -0x004C
+
+#define MBEDTLS_SSL_IS_CLIENT 0
+#define MBEDTLS_SSL_TRANSPORT_STREAM 0
+#define MBEDTLS_SSL_PRESET_DEFAULT 0
+#define MBEDTLS_SSL_SESSION_TICKETS_DISABLED 0
+#define MBEDTLS_SSL_SESSION_TICKETS_ENABLED 1
+#define MBEDTLS_SSL_MAX_FRAG_LEN_NONE 0
+#define MBEDTLS_SSL_MAX_FRAG_LEN_4096 4
+
+#define MBEDTLS_TLS_PSK_WITH_AES_128_GCM_SHA256 0xA8
+
+typedef enum
+{
+    MBEDTLS_SSL_VERSION_UNKNOWN,
+    MBEDTLS_SSL_VERSION_TLS1_2 = 0x0303,
+    MBEDTLS_SSL_VERSION_TLS1_3 = 0x0304,
+} mbedtls_ssl_protocol_version;
+
+typedef int mbedtls_ssl_send_t(void *ctx, const unsigned char *buf, size_t len);
+typedef int mbedtls_ssl_recv_t(void *ctx, unsigned char *buf, size_t len);
+typedef int mbedtls_ssl_recv_timeout_t(void *ctx, unsigned char *buf, size_t len, uint32_t timeout);
+
+typedef struct
+{
+    void *ctx; // SSL_CTX
+    unsigned char psk[64];
+    size_t psk_len;
+    char identity[128];
+} mbedtls_ssl_config;
+
+typedef struct
+{
+    void *ssl; // SSL
+    const mbedtls_ssl_config *conf;
+    void *bio;
+} mbedtls_ssl_context;
+
+typedef struct
+{
+    void *session; // SSL_SESSION
+} mbedtls_ssl_session;
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config *conf);
+
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf, int endpoint, int transport, int preset);
+
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config *conf, int (*f_rng)(void *, unsigned char *, size_t), void *p_rng);
+
+void mbedtls_ssl_conf_ciphersuites(mbedtls_ssl_config *conf, const int *ciphersuites);
+
+void mbedtls_ssl_conf_min_tls_version(mbedtls_ssl_config *conf, mbedtls_ssl_protocol_version version);
+
+void mbedtls_ssl_conf_max_tls_version(mbedtls_ssl_config *conf, mbedtls_ssl_protocol_version version);
+
+int mbedtls_ssl_conf_max_frag_len(mbedtls_ssl_config *conf, unsigned char mfl_code);
+
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config *conf, int use_tickets);
+
+int mbedtls_ssl_conf_psk(mbedtls_ssl_config *conf, const unsigned char *psk, size_t psk_len,
+                         const unsigned char *psk_identity, size_t psk_identity_len);
+
+void mbedtls_ssl_init(mbedtls_ssl_context *ssl);
+
+int mbedtls_ssl_setup(mbedtls_ssl_context *ssl, const mbedtls_ssl_config *conf);
+
+int mbedtls_ssl_session_reset(mbedtls_ssl_context *ssl);
+
+void mbedtls_ssl_set_bio(mbedtls_ssl_context *ssl, void *p_bio, mbedtls_ssl_send_t *f_send,
+                         mbedtls_ssl_recv_t *f_recv, mbedtls_ssl_recv_timeout_t *f_recv_timeout);
+
+int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session);
+
+int mbedtls_ssl_get_session(const mbedtls_ssl_context *ssl, mbedtls_ssl_session *session);
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session *session);
+
+void mbedtls_ssl_session_free(mbedtls_ssl_session *session);
+
+int mbedtls_ssl_handshake(mbedtls_ssl_context *ssl);
+
+int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len);
+
+int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len);
+
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context *ssl);
+
+int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl);
+
+#endif // MBEDTLS_SSL_H
@@ -0,0 +1,6 @@
+#ifndef NVS_FLASH_H
+#define NVS_FLASH_H
+
+#include "esp_err.h"
+
+#endif // NVS_FLASH_H
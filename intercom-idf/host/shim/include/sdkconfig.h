@@ -0,0 +1,76 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// Host equivalents of the sdkconfig values the firmware reads. Boolean
+// options that the host build toggles are set from host/CMakeLists.txt.
+
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_FREERTOS_TIMER_TASK_PRIORITY 1
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 160
+
+// The shim keeps per-task CPU time (see uxTaskGetSystemState())
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY 1
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 1
+
+#ifndef CONFIG_INTERCOM_MEM_REPORT_INTERVAL_MS
+#define CONFIG_INTERCOM_MEM_REPORT_INTERVAL_MS 60000
+#endif
+
+#ifndef CONFIG_INTERCOM_TASK_REPORT_INTERVAL_MS
+#define CONFIG_INTERCOM_TASK_REPORT_INTERVAL_MS 60000
+#endif
+
+#ifndef CONFIG_INTERCOM_POWER_REPORT_INTERVAL_MS
+#define CONFIG_INTERCOM_POWER_REPORT_INTERVAL_MS 60000
+#endif
+
+#ifndef CONFIG_INTERCOM_POWER_CPU_MIN_MHZ
+#define CONFIG_INTERCOM_POWER_CPU_MIN_MHZ 80
+#endif
+
+#ifndef CONFIG_INTERCOM_POWER_CPU_MAX_MHZ
+#define CONFIG_INTERCOM_POWER_CPU_MAX_MHZ 240
+#endif
+
+#ifndef CONFIG_INTERCOM_WIFI_LISTEN_INTERVAL
+#define CONFIG_INTERCOM_WIFI_LISTEN_INTERVAL 3
+#endif
+
+#ifndef CONFIG_INTERCOM_KEYPAD_INT_GPIO
+#define CONFIG_INTERCOM_KEYPAD_INT_GPIO 13
+#endif
+
+#ifndef CONFIG_INTERCOM_TX_CHUNK_SIZE
+#define CONFIG_INTERCOM_TX_CHUNK_SIZE 2048
+#endif
+
+#ifndef CONFIG_INTERCOM_TX_QUEUE_LEN
+#define CONFIG_INTERCOM_TX_QUEUE_LEN 4
+#endif
+
+#ifndef CONFIG_INTERCOM_CAPTURE_SIZE
+#define CONFIG_INTERCOM_CAPTURE_SIZE 8192
+#endif
+
+#ifndef CONFIG_INTERCOM_DIRECTORY_MAX_FLATS
+#define CONFIG_INTERCOM_DIRECTORY_MAX_FLATS 512
+#endif
+
+#ifndef CONFIG_INTERCOM_DIRECTORY_SYNC_INTERVAL_S
+#define CONFIG_INTERCOM_DIRECTORY_SYNC_INTERVAL_S 60
+#endif
+
+#ifndef CONFIG_INTERCOM_RESUME_TIMEOUT_MS
+#define CONFIG_INTERCOM_RESUME_TIMEOUT_MS 20000
+#endif
+
+#ifndef CONFIG_INTERCOM_TLS_PSK_IDENTITY
+#define CONFIG_INTERCOM_TLS_PSK_IDENTITY "intercom"
+#endif
+
+// Loopback-only key; bench_tls serves the same one
+#ifndef CONFIG_INTERCOM_TLS_PSK
+#define CONFIG_INTERCOM_TLS_PSK "000102030405060708090a0b0c0d0e0f"
+#endif
+
+#endif // SDKCONFIG_H
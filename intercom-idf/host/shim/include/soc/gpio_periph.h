@@ -0,0 +1,12 @@
+#ifndef SOC_GPIO_PERIPH_H
+#define SOC_GPIO_PERIPH_H
+
+#include <stdint.h>
+
+#define PIN_FUNC_GPIO 2
+
+extern const uint32_t GPIO_PIN_MUX_REG[40];
+
+#define PIN_FUNC_SELECT(reg, func) ((void)(reg), (void)(func))
+
+#endif // SOC_GPIO_PERIPH_H
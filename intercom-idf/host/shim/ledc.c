@@ -0,0 +1,28 @@
+#include "driver/ledc.h"
+
+// LEDC only drives the camera XCLK and flash LED; nothing to simulate
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf)
+{
+    return timer_conf != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf)
+{
+    return ledc_conf != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty)
+{
+    (void)speed_mode;
+    (void)channel;
+    (void)duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    (void)speed_mode;
+    (void)channel;
+    return ESP_OK;
+}
@@ -0,0 +1,36 @@
+#include "esp_log.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "host_clock.h"
+
+static esp_log_level_t s_level = ESP_LOG_INFO;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Per-tag levels are not tracked; every tag shares the "*" level
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void)tag;
+    s_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    (void)tag;
+    if (level > s_level)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&s_lock);
+    vfprintf(stderr, format, args);
+    pthread_mutex_unlock(&s_lock);
+    va_end(args);
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(host_clock_now_us() / 1000);
+}
@@ -0,0 +1,193 @@
+#include "host_lwip.h"
+
+#include <errno.h>
+#include <linux/sockios.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include "host_clock.h"
+#include "host_mem.h"
+#include "lwip/api.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/priv/tcpip_priv.h"
+
+#define HOST_TCP_MSS 1440
+#define HOST_MAX_SOCKETS 16
+
+// Measured ESP32 memcpy throughput at 240 MHz, bytes per microsecond:
+// internal SRAM, and quad-SPI PSRAM at 40 MHz through the cache
+#define HOST_SRAM_COPY_RATE 120
+#define HOST_PSRAM_COPY_RATE 13
+
+static struct netconn s_conns[HOST_MAX_SOCKETS];
+static struct lwip_sock s_socks[HOST_MAX_SOCKETS];
+static __thread struct netconn *s_api_conn = NULL;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_lwip_stats_t s_stats;
+static int s_send_buffer = 0;
+static bool s_writing[HOST_MAX_SOCKETS]; // A write is in progress on the netconn
+
+// Claim the netconn for a write, as lwIP's do_write does; false while
+// another task's write is in progress
+static bool write_begin(int fd)
+{
+    if (fd < 0 || fd >= HOST_MAX_SOCKETS)
+    {
+        return true;
+    }
+    pthread_mutex_lock(&s_lock);
+    bool claimed = !s_writing[fd];
+    s_writing[fd] = true;
+    pthread_mutex_unlock(&s_lock);
+    return claimed;
+}
+
+static void write_end(int fd)
+{
+    if (fd >= 0 && fd < HOST_MAX_SOCKETS)
+    {
+        pthread_mutex_lock(&s_lock);
+        s_writing[fd] = false;
+        pthread_mutex_unlock(&s_lock);
+    }
+}
+
+int lwip_socket(int domain, int type, int protocol)
+{
+    int fd = socket(domain, type, protocol);
+    if (fd >= 0 && s_send_buffer > 0)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &s_send_buffer, sizeof(s_send_buffer));
+    }
+    return fd;
+}
+
+void host_lwip_set_send_buffer(int bytes)
+{
+    s_send_buffer = bytes;
+}
+
+static ssize_t send_all(int fd, const uint8_t *data, size_t size)
+{
+    size_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t n = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            return -1;
+        }
+        sent += n;
+    }
+    return (ssize_t)sent;
+}
+
+static ssize_t copy_send(int fd, const void *data, size_t size)
+{
+    uint8_t pbuf[HOST_TCP_MSS];
+    const uint8_t *src = data;
+    uint32_t rate = host_mem_is_psram(data) ? HOST_PSRAM_COPY_RATE : HOST_SRAM_COPY_RATE;
+
+    size_t sent = 0;
+    while (sent < size)
+    {
+        size_t chunk = size - sent < sizeof(pbuf) ? size - sent : sizeof(pbuf);
+        memcpy(pbuf, src + sent, chunk);
+        uint64_t copy_us = chunk / rate;
+        host_clock_sleep_us(copy_us);
+
+        pthread_mutex_lock(&s_lock);
+        s_stats.copied_bytes += chunk;
+        s_stats.copy_us += copy_us;
+        pthread_mutex_unlock(&s_lock);
+
+        if (send_all(fd, pbuf, chunk) < 0)
+        {
+            return sent > 0 ? (ssize_t)sent : -1;
+        }
+        sent += chunk;
+    }
+    return (ssize_t)sent;
+}
+
+ssize_t lwip_send(int fd, const void *data, size_t size, int flags)
+{
+    (void)flags;
+    if (!write_begin(fd))
+    {
+        errno = EINPROGRESS;
+        return -1;
+    }
+    ssize_t n = copy_send(fd, data, size);
+    write_end(fd);
+    return n;
+}
+
+struct lwip_sock *lwip_socket_dbg_get_socket(int fd)
+{
+    if (fd < 0 || fd >= HOST_MAX_SOCKETS)
+    {
+        return NULL;
+    }
+    s_conns[fd].fd = fd;
+    s_conns[fd].pcb.tcp = &s_conns[fd].tcp_pcb;
+    s_socks[fd].conn = &s_conns[fd];
+    s_api_conn = &s_conns[fd];
+    return &s_socks[fd];
+}
+
+err_t netconn_write_partly(struct netconn *conn, const void *dataptr, size_t size,
+                           uint8_t apiflags, size_t *bytes_written)
+{
+    if (!write_begin(conn->fd))
+    {
+        return ERR_INPROGRESS;
+    }
+    ssize_t n = apiflags & NETCONN_COPY ? copy_send(conn->fd, dataptr, size) : send_all(conn->fd, dataptr, size);
+    write_end(conn->fd);
+    if (n < 0)
+    {
+        return ERR_CONN;
+    }
+    if (!(apiflags & NETCONN_COPY))
+    {
+        pthread_mutex_lock(&s_lock);
+        s_stats.nocopy_bytes += (uint64_t)n;
+        pthread_mutex_unlock(&s_lock);
+    }
+    *bytes_written = (size_t)n;
+    return ERR_OK;
+}
+
+// There is no tcpip thread on the host; refresh the pcb send queue from the
+// kernel (bytes not yet acknowledged) and run the call inline
+err_t tcpip_api_call(tcpip_api_call_fn fn, struct tcpip_api_call_data *call)
+{
+    struct netconn *conn = s_api_conn;
+    if (conn != NULL)
+    {
+        int pending = 0;
+        ioctl(conn->fd, SIOCOUTQ, &pending);
+        conn->tcp_pcb.unsent = NULL;
+        conn->tcp_pcb.unacked = pending > 0 ? (struct tcp_seg *)conn : NULL;
+    }
+    return fn(call);
+}
+
+host_lwip_stats_t host_lwip_get_stats(void)
+{
+    pthread_mutex_lock(&s_lock);
+    host_lwip_stats_t stats = s_stats;
+    pthread_mutex_unlock(&s_lock);
+    return stats;
+}
+
+void host_lwip_reset_stats(void)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats = (host_lwip_stats_t){0};
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,304 @@
+// mbedTLS client API on OpenSSL, enough for tcp_client.c's TLS-PSK channel
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include "host_tls.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_tls_stats_t s_stats;
+
+static const struct
+{
+    int id;
+    const char *name;
+} s_ciphersuites[] = {
+    {MBEDTLS_TLS_PSK_WITH_AES_128_GCM_SHA256, "PSK-AES128-GCM-SHA256"},
+};
+
+static unsigned int psk_client_cb(SSL *ssl, const char *hint, char *identity, unsigned int max_identity_len,
+                                  unsigned char *psk, unsigned int max_psk_len)
+{
+    (void)hint;
+    const mbedtls_ssl_config *conf = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    if (conf->psk_len > max_psk_len || strlen(conf->identity) >= max_identity_len)
+    {
+        return 0;
+    }
+    strcpy(identity, conf->identity);
+    memcpy(psk, conf->psk, conf->psk_len);
+    return (unsigned int)conf->psk_len;
+}
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config *conf)
+{
+    memset(conf, 0, sizeof(*conf));
+}
+
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf, int endpoint, int transport, int preset)
+{
+    (void)transport;
+    (void)preset;
+    if (endpoint != MBEDTLS_SSL_IS_CLIENT)
+    {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL)
+    {
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+    SSL_CTX_set_app_data(ctx, conf);
+    SSL_CTX_set_psk_client_callback(ctx, psk_client_cb);
+    conf->ctx = ctx;
+    return 0;
+}
+
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config *conf, int (*f_rng)(void *, unsigned char *, size_t), void *p_rng)
+{
+    (void)conf;
+    (void)f_rng;
+    (void)p_rng;
+}
+
+void mbedtls_ssl_conf_ciphersuites(mbedtls_ssl_config *conf, const int *ciphersuites)
+{
+    char list[256] = "";
+    for (; *ciphersuites != 0; ciphersuites++)
+    {
+        for (size_t i = 0; i < sizeof(s_ciphersuites) / sizeof(s_ciphersuites[0]); i++)
+        {
+            if (s_ciphersuites[i].id == *ciphersuites)
+            {
+                if (list[0] != '\0')
+                {
+                    strncat(list, ":", sizeof(list) - strlen(list) - 1);
+                }
+                strncat(list, s_ciphersuites[i].name, sizeof(list) - strlen(list) - 1);
+            }
+        }
+    }
+    SSL_CTX_set_cipher_list(conf->ctx, list);
+}
+
+void mbedtls_ssl_conf_min_tls_version(mbedtls_ssl_config *conf, mbedtls_ssl_protocol_version version)
+{
+    SSL_CTX_set_min_proto_version(conf->ctx, version);
+}
+
+void mbedtls_ssl_conf_max_tls_version(mbedtls_ssl_config *conf, mbedtls_ssl_protocol_version version)
+{
+    SSL_CTX_set_max_proto_version(conf->ctx, version);
+}
+
+int mbedtls_ssl_conf_max_frag_len(mbedtls_ssl_config *conf, unsigned char mfl_code)
+{
+    // mbedTLS and the TLS extension share the 1..4 codes (512..4096 bytes)
+    return SSL_CTX_set_tlsext_max_fragment_length(conf->ctx, mfl_code) == 1 ? 0 : MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+}
+
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config *conf, int use_tickets)
+{
+    if (use_tickets)
+    {
+        SSL_CTX_clear_options(conf->ctx, SSL_OP_NO_TICKET);
+    }
+    else
+    {
+        SSL_CTX_set_options(conf->ctx, SSL_OP_NO_TICKET);
+    }
+}
+
+int mbedtls_ssl_conf_psk(mbedtls_ssl_config *conf, const unsigned char *psk, size_t psk_len,
+                         const unsigned char *psk_identity, size_t psk_identity_len)
+{
+    if (psk_len > sizeof(conf->psk) || psk_identity_len >= sizeof(conf->identity))
+    {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    memcpy(conf->psk, psk, psk_len);
+    conf->psk_len = psk_len;
+    memcpy(conf->identity, psk_identity, psk_identity_len);
+    conf->identity[psk_identity_len] = '\0';
+    return 0;
+}
+
+void mbedtls_ssl_init(mbedtls_ssl_context *ssl)
+{
+    memset(ssl, 0, sizeof(*ssl));
+}
+
+int mbedtls_ssl_setup(mbedtls_ssl_context *ssl, const mbedtls_ssl_config *conf)
+{
+    ssl->conf = conf;
+    ssl->ssl = SSL_new(conf->ctx);
+    return ssl->ssl != NULL ? 0 : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+}
+
+int mbedtls_ssl_session_reset(mbedtls_ssl_context *ssl)
+{
+    SSL_free(ssl->ssl);
+    ssl->ssl = SSL_new(ssl->conf->ctx);
+    return ssl->ssl != NULL ? 0 : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+}
+
+void mbedtls_ssl_set_bio(mbedtls_ssl_context *ssl, void *p_bio, mbedtls_ssl_send_t *f_send,
+                         mbedtls_ssl_recv_t *f_recv, mbedtls_ssl_recv_timeout_t *f_recv_timeout)
+{
+    // OpenSSL drives the socket itself; only mbedtls_net_* BIOs are supported
+    (void)f_send;
+    (void)f_recv;
+    (void)f_recv_timeout;
+    ssl->bio = p_bio;
+    SSL_set_fd(ssl->ssl, ((mbedtls_net_context *)p_bio)->fd);
+}
+
+int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session)
+{
+    return SSL_set_session(ssl->ssl, session->session) == 1 ? 0 : MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+}
+
+int mbedtls_ssl_get_session(const mbedtls_ssl_context *ssl, mbedtls_ssl_session *session)
+{
+    session->session = SSL_get1_session(ssl->ssl);
+    return session->session != NULL ? 0 : MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+}
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session *session)
+{
+    session->session = NULL;
+}
+
+void mbedtls_ssl_session_free(mbedtls_ssl_session *session)
+{
+    SSL_SESSION_free(session->session);
+    session->session = NULL;
+}
+
+int mbedtls_ssl_handshake(mbedtls_ssl_context *ssl)
+{
+    if (SSL_connect(ssl->ssl) != 1)
+    {
+        ERR_clear_error();
+        return MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_stats.handshakes++;
+    s_stats.resumed += SSL_session_reused(ssl->ssl) ? 1 : 0;
+    pthread_mutex_unlock(&s_lock);
+    return 0;
+}
+
+int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len)
+{
+    int ret = SSL_read(ssl->ssl, buf, (int)len);
+    if (ret > 0)
+    {
+        return ret;
+    }
+    switch (SSL_get_error(ssl->ssl, ret))
+    {
+    case SSL_ERROR_ZERO_RETURN:
+        return MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY;
+    case SSL_ERROR_WANT_READ:
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    case SSL_ERROR_SYSCALL:
+        ERR_clear_error();
+        return errno == 0 ? MBEDTLS_ERR_SSL_CONN_EOF : MBEDTLS_ERR_NET_RECV_FAILED;
+    default:
+        ERR_clear_error();
+        return MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+}
+
+int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len)
+{
+    int ret = SSL_write(ssl->ssl, buf, (int)len);
+    if (ret > 0)
+    {
+        return ret;
+    }
+    ERR_clear_error();
+    return MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context *ssl)
+{
+    return (size_t)SSL_pending(ssl->ssl);
+}
+
+int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl)
+{
+    SSL_shutdown(ssl->ssl);
+    ERR_clear_error();
+    return 0;
+}
+
+int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    ssize_t ret = send(((mbedtls_net_context *)ctx)->fd, buf, len, MSG_NOSIGNAL);
+    return ret < 0 ? MBEDTLS_ERR_NET_SEND_FAILED : (int)ret;
+}
+
+int mbedtls_net_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    ssize_t ret = recv(((mbedtls_net_context *)ctx)->fd, buf, len, 0);
+    return ret < 0 ? MBEDTLS_ERR_NET_RECV_FAILED : (int)ret;
+}
+
+void mbedtls_entropy_init(mbedtls_entropy_context *ctx)
+{
+    (void)ctx;
+}
+
+int mbedtls_entropy_func(void *data, unsigned char *output, size_t len)
+{
+    (void)data;
+    return RAND_bytes(output, (int)len) == 1 ? 0 : -1;
+}
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context *ctx)
+{
+    (void)ctx;
+}
+
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context *ctx, int (*f_entropy)(void *, unsigned char *, size_t),
+                          void *p_entropy, const unsigned char *custom, size_t len)
+{
+    (void)ctx;
+    (void)f_entropy;
+    (void)p_entropy;
+    (void)custom;
+    (void)len;
+    return 0;
+}
+
+int mbedtls_ctr_drbg_random(void *p_rng, unsigned char *output, size_t output_len)
+{
+    return mbedtls_entropy_func(p_rng, output, output_len);
+}
+
+host_tls_stats_t host_tls_get_stats(void)
+{
+    pthread_mutex_lock(&s_lock);
+    host_tls_stats_t stats = s_stats;
+    pthread_mutex_unlock(&s_lock);
+    return stats;
+}
+
+void host_tls_reset_stats(void)
+{
+    pthread_mutex_lock(&s_lock);
+    memset(&s_stats, 0, sizeof(s_stats));
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,89 @@
+#include "host_mem.h"
+
+#include <pthread.h>
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_mem_stats_t s_stats;
+
+void host_mem_alloc(size_t bytes)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.current_bytes += bytes;
+    s_stats.allocations++;
+    if (s_stats.current_bytes > s_stats.peak_bytes)
+    {
+        s_stats.peak_bytes = s_stats.current_bytes;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void host_mem_free(size_t bytes)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.current_bytes -= bytes;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void host_mem_static(size_t bytes)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.static_bytes += bytes;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void host_mem_psram_alloc(size_t bytes)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.psram_bytes += bytes;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void host_mem_psram_free(size_t bytes)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.psram_bytes -= bytes;
+    pthread_mutex_unlock(&s_lock);
+}
+
+static const uint8_t *s_psram_start = NULL;
+static size_t s_psram_len = 0;
+
+void host_mem_psram_region(const void *start, size_t len)
+{
+    pthread_mutex_lock(&s_lock);
+    s_psram_start = start;
+    s_psram_len = len;
+    pthread_mutex_unlock(&s_lock);
+}
+
+bool host_mem_is_psram(const void *ptr)
+{
+    pthread_mutex_lock(&s_lock);
+    bool inside = s_psram_start != NULL && (const uint8_t *)ptr >= s_psram_start &&
+                  (const uint8_t *)ptr < s_psram_start + s_psram_len;
+    pthread_mutex_unlock(&s_lock);
+    return inside;
+}
+
+void host_mem_task_created(void)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.tasks_created++;
+    s_stats.tasks_alive++;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void host_mem_task_deleted(void)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.tasks_alive--;
+    pthread_mutex_unlock(&s_lock);
+}
+
+host_mem_stats_t host_mem_get_stats(void)
+{
+    pthread_mutex_lock(&s_lock);
+    host_mem_stats_t stats = s_stats;
+    pthread_mutex_unlock(&s_lock);
+    return stats;
+}
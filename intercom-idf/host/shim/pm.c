@@ -0,0 +1,244 @@
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_wifi.h"
+#include "sdkconfig.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "host_clock.h"
+#include "host_i2c.h"
+#include "host_power.h"
+
+#define BEACON_US 102400
+#define BEACON_LISTEN_US 3000
+#define WAKE_WORK_US 200
+#define SLEEP_EXIT_US 500
+#define I2C_TRANSACTION_US 300
+#define LIGHT_SLEEP_MA 0.8
+#define RADIO_LISTEN_MA 80.0
+
+struct host_pm_lock
+{
+    esp_pm_lock_type_t type;
+    unsigned count;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static esp_pm_config_t s_config = {
+    .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+    .min_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+};
+static bool s_configured = false;
+
+// CPU_FREQ_MAX locks held, and for how long in total
+static unsigned s_max_locks = 0;
+static uint64_t s_max_since_us = 0;
+static uint64_t s_max_held_us = 0;
+
+// ESP-IDF starts the station in WIFI_PS_MIN_MODEM
+static wifi_ps_type_t s_ps = WIFI_PS_MIN_MODEM;
+static uint64_t s_ps_since_us = 0;
+static uint64_t s_ps_us[3];
+static unsigned s_listen_interval = 1;
+
+static atomic_uint s_wakes = 0;
+
+// Counters at host_power_start()
+static struct
+{
+    uint64_t at_us;
+    uint64_t max_held_us;
+    uint64_t ps_us[3];
+    unsigned wakes;
+    uint32_t i2c;
+} s_start;
+
+static double busy_ma(int mhz)
+{
+    return mhz >= 240 ? 68.0 : mhz >= 160 ? 44.0 : 31.0;
+}
+
+static double idle_ma(int mhz)
+{
+    return mhz >= 240 ? 30.0 : mhz >= 160 ? 27.0 : 20.0;
+}
+
+esp_err_t esp_pm_configure(const void *config)
+{
+    if (config == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_config = *(const esp_pm_config_t *)config;
+    s_configured = true;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name,
+                             esp_pm_lock_handle_t *out_handle)
+{
+    (void)arg;
+    (void)name;
+    struct host_pm_lock *lock = calloc(1, sizeof(*lock));
+    if (lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    lock->type = lock_type;
+    *out_handle = lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    handle->count++;
+    if (handle->type == ESP_PM_CPU_FREQ_MAX && s_max_locks++ == 0)
+    {
+        s_max_since_us = host_clock_now_us();
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    if (handle->count == 0)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->count--;
+    if (handle->type == ESP_PM_CPU_FREQ_MAX && --s_max_locks == 0)
+    {
+        s_max_held_us += host_clock_now_us() - s_max_since_us;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t domain, esp_sleep_pd_option_t option)
+{
+    (void)option;
+    return domain < ESP_PD_DOMAIN_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+// Caller holds s_lock
+static void ps_settle(uint64_t now)
+{
+    if (s_ps_since_us != 0)
+    {
+        s_ps_us[s_ps] += now - s_ps_since_us;
+    }
+    s_ps_since_us = now;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    pthread_mutex_lock(&s_lock);
+    ps_settle(host_clock_now_us());
+    s_ps = type;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+void host_power_set_listen_interval(unsigned beacons)
+{
+    s_listen_interval = beacons > 0 ? beacons : 1;
+}
+
+void host_power_note_wake(void)
+{
+    atomic_fetch_add(&s_wakes, 1);
+}
+
+void host_power_start(void)
+{
+    pthread_mutex_lock(&s_lock);
+    uint64_t now = host_clock_now_us();
+    ps_settle(now);
+    s_start.at_us = now;
+    s_start.max_held_us = s_max_held_us + (s_max_locks > 0 ? now - s_max_since_us : 0);
+    for (int i = 0; i < 3; i++)
+    {
+        s_start.ps_us[i] = s_ps_us[i];
+    }
+    s_start.wakes = atomic_load(&s_wakes);
+    s_start.i2c = host_i2c_transactions();
+    pthread_mutex_unlock(&s_lock);
+}
+
+static void print_state(const char *name, double us, double ma, double total_us, double *charge)
+{
+    printf("  %-14s %6.2f%% %7.1f mA\n", name, 100.0 * us / total_us, ma);
+    *charge += us * ma;
+}
+
+void host_power_report(void)
+{
+    pthread_mutex_lock(&s_lock);
+    uint64_t now = host_clock_now_us();
+    ps_settle(now);
+    double total = (double)(now - s_start.at_us);
+    double max_held =
+        (double)(s_max_held_us + (s_max_locks > 0 ? now - s_max_since_us : 0) - s_start.max_held_us);
+    double ps_us[3];
+    for (int i = 0; i < 3; i++)
+    {
+        ps_us[i] = (double)(s_ps_us[i] - s_start.ps_us[i]);
+    }
+    esp_pm_config_t config = s_config;
+    bool sleep = s_configured && config.light_sleep_enable;
+    unsigned listen_interval = s_listen_interval;
+    pthread_mutex_unlock(&s_lock);
+
+    unsigned wakes = atomic_load(&s_wakes) - s_start.wakes;
+    uint32_t i2c = host_i2c_transactions() - s_start.i2c;
+    if (total <= 0)
+    {
+        return;
+    }
+
+    // Without locks the CPU runs at the minimum; unconfigured, min == max
+    double work = wakes * (double)(WAKE_WORK_US + (sleep ? SLEEP_EXIT_US : 0)) + i2c * (double)I2C_TRANSACTION_US;
+    double beacons = ps_us[WIFI_PS_MIN_MODEM] / BEACON_US + ps_us[WIFI_PS_MAX_MODEM] / (BEACON_US * listen_interval);
+    double listen = ps_us[WIFI_PS_NONE] + beacons * BEACON_LISTEN_US;
+    double rest = total - max_held - work;
+    if (rest < 0)
+    {
+        rest = 0;
+    }
+    // The CPU is awake while the radio listens
+    double listen_awake = listen < rest ? listen : rest;
+
+    double charge = 0;
+    printf("power model: %.1f s, CPU %d-%d MHz, light sleep %s, listen interval %u\n", total / 1e6,
+           config.min_freq_mhz, config.max_freq_mhz, sleep ? "on" : "off", listen_interval);
+    printf("  %.1f wakes/s, %.1f I2C transactions/s, %.2f beacons/s\n", wakes / (total / 1e6),
+           i2c / (total / 1e6), beacons / (total / 1e6));
+    print_state("cpu max", max_held, busy_ma(config.max_freq_mhz), total, &charge);
+    print_state("cpu work", work, busy_ma(config.min_freq_mhz), total, &charge);
+    if (sleep)
+    {
+        print_state("radio wake", listen_awake, idle_ma(config.min_freq_mhz), total, &charge);
+        print_state("light sleep", rest - listen_awake, LIGHT_SLEEP_MA, total, &charge);
+    }
+    else
+    {
+        print_state("idle awake", rest, idle_ma(config.min_freq_mhz), total, &charge);
+    }
+    print_state("radio listen", listen, RADIO_LISTEN_MA, total, &charge);
+    double average = charge / total;
+    printf("  average %.2f mA, %.1f mAh/day\n", average, average * 24);
+}
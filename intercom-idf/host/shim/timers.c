@@ -0,0 +1,176 @@
+#include "freertos/timers.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "host_mem.h"
+#include "host_power.h"
+#include "host_sync.h"
+
+#define HOST_MAX_TIMERS 16
+#define HOST_TIMER_SIZE 48
+
+// Stands in for the FreeRTOS timer service task
+#define HOST_TIMER_TASK_STACK 2048
+
+struct host_timer
+{
+    TickType_t period;
+    bool auto_reload;
+    bool active;
+    uint64_t expiry_us;
+    void *id;
+    TimerCallbackFunction_t callback;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static TaskHandle_t s_daemon_task = NULL;
+static struct host_timer *s_timers[HOST_MAX_TIMERS];
+static int s_timer_count = 0;
+
+static uint64_t ticks_to_us(TickType_t ticks)
+{
+    return (uint64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+static void timer_service_loop(void)
+{
+    pthread_mutex_lock(&s_lock);
+    for (;;)
+    {
+        struct host_timer *next = NULL;
+        for (int i = 0; i < s_timer_count; i++)
+        {
+            if (s_timers[i]->active && (next == NULL || s_timers[i]->expiry_us < next->expiry_us))
+            {
+                next = s_timers[i];
+            }
+        }
+
+        if (next == NULL)
+        {
+            pthread_cond_wait(&s_cond, &s_lock);
+            continue;
+        }
+
+        uint64_t now = host_clock_now_us();
+        if (next->expiry_us > now)
+        {
+            struct timespec deadline = host_clock_deadline(next->expiry_us - now);
+            pthread_cond_timedwait(&s_cond, &s_lock, &deadline);
+            continue;
+        }
+
+        if (next->auto_reload)
+        {
+            next->expiry_us += ticks_to_us(next->period);
+        }
+        else
+        {
+            next->active = false;
+        }
+        pthread_mutex_unlock(&s_lock);
+        host_power_note_wake();
+        next->callback(next);
+        pthread_mutex_lock(&s_lock);
+    }
+}
+
+static void timer_service(void *arg)
+{
+    (void)arg;
+    timer_service_loop();
+}
+
+static void timer_service_start(void)
+{
+    host_cond_init(&s_cond);
+    static StackType_t stack[HOST_TIMER_TASK_STACK];
+    static StaticTask_t task_buffer;
+    s_daemon_task = xTaskCreateStatic(timer_service, "Tmr Svc", HOST_TIMER_TASK_STACK, NULL,
+                                      CONFIG_FREERTOS_TIMER_TASK_PRIORITY, stack, &task_buffer);
+}
+
+static TimerHandle_t host_timer_create(TickType_t period, UBaseType_t auto_reload, void *timer_id,
+                                  TimerCallbackFunction_t callback, bool is_static)
+{
+    pthread_once(&s_once, timer_service_start);
+
+    pthread_mutex_lock(&s_lock);
+    if (s_timer_count >= HOST_MAX_TIMERS)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return NULL;
+    }
+    struct host_timer *timer = calloc(1, sizeof(*timer));
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->id = timer_id;
+    timer->callback = callback;
+    s_timers[s_timer_count++] = timer;
+    pthread_mutex_unlock(&s_lock);
+
+    if (is_static)
+    {
+        host_mem_static(HOST_TIMER_SIZE);
+    }
+    else
+    {
+        host_mem_alloc(HOST_TIMER_SIZE);
+    }
+    return timer;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *timer_id, TimerCallbackFunction_t callback)
+{
+    (void)name;
+    return host_timer_create(period, auto_reload, timer_id, callback, false);
+}
+
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, UBaseType_t auto_reload,
+                                 void *timer_id, TimerCallbackFunction_t callback,
+                                 StaticTimer_t *timer_buffer)
+{
+    (void)name;
+    (void)timer_buffer;
+    return host_timer_create(period, auto_reload, timer_id, callback, true);
+}
+
+TaskHandle_t xTimerGetTimerDaemonTaskHandle(void)
+{
+    pthread_once(&s_once, timer_service_start);
+    return s_daemon_task;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    pthread_mutex_lock(&s_lock);
+    timer->expiry_us = host_clock_now_us() + ticks_to_us(timer->period);
+    timer->active = true;
+    pthread_cond_signal(&s_cond);
+    pthread_mutex_unlock(&s_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    pthread_mutex_lock(&s_lock);
+    timer->active = false;
+    pthread_cond_signal(&s_cond);
+    pthread_mutex_unlock(&s_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return xTimerStart(timer, ticks_to_wait);
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
@@ -0,0 +1,572 @@
+#define _GNU_SOURCE // memmem
+#include "capture_file.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#define SESSION_PREFIX "session:"
+#define SESSION_ID_LEN 16
+#define SHOW_BYTES 24 // Of a payload in a mismatch
+
+static const char *const s_kind_names[] = {"?", "open", "close", "device", "server", "event"};
+
+const char *icap_kind_name(uint8_t kind)
+{
+    return kind < sizeof(s_kind_names) / sizeof(s_kind_names[0]) ? s_kind_names[kind] : "?";
+}
+
+static uint64_t get_be(const uint8_t *p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value = value << 8 | p[i];
+    }
+    return value;
+}
+
+static void put_be(uint8_t *p, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        p[i] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+void icap_add(icap_t *capture, uint8_t kind, uint16_t session, uint64_t time_us, const void *data,
+              uint32_t kept, uint32_t length)
+{
+    if (capture->count == capture->cap)
+    {
+        capture->cap = capture->cap ? capture->cap * 2 : 64;
+        capture->records = realloc(capture->records, capture->cap * sizeof(icap_record_t));
+    }
+    icap_record_t *record = &capture->records[capture->count++];
+    record->kind = kind;
+    record->session = session;
+    record->time_us = time_us;
+    record->length = length;
+    record->kept = kept;
+    record->data = malloc(kept + 1);
+    memcpy(record->data, data, kept);
+    record->data[kept] = 0;
+}
+
+void icap_free(icap_t *capture)
+{
+    for (size_t i = 0; i < capture->count; i++)
+    {
+        free(capture->records[i].data);
+    }
+    free(capture->records);
+    *capture = (icap_t){0};
+}
+
+bool icap_parse(const uint8_t *data, size_t len, icap_t *capture)
+{
+    *capture = (icap_t){0};
+    if (len < CAPTURE_FILE_HEADER_SIZE || memcmp(data, CAPTURE_MAGIC, 4) != 0 || data[4] != CAPTURE_VERSION)
+    {
+        fprintf(stderr, "not a version %d capture\n", CAPTURE_VERSION);
+        return false;
+    }
+    capture->recorder = data[5];
+    capture->epoch_us = get_be(data + 8, 8);
+
+    size_t offset = CAPTURE_FILE_HEADER_SIZE;
+    while (offset < len)
+    {
+        if (len - offset < CAPTURE_RECORD_HEADER_SIZE ||
+            len - offset - CAPTURE_RECORD_HEADER_SIZE < get_be(data + offset, 4))
+        {
+            fprintf(stderr, "record at %zu cut short\n", offset);
+            icap_free(capture);
+            return false;
+        }
+        const uint8_t *header = data + offset;
+        uint32_t payload = get_be(header, 4);
+        const uint8_t *body = header + CAPTURE_RECORD_HEADER_SIZE;
+        uint32_t kept = payload, length = payload;
+        if (header[5] & CAPTURE_ELIDED)
+        {
+            if (payload < 4)
+            {
+                fprintf(stderr, "elided record at %zu has no length\n", offset);
+                icap_free(capture);
+                return false;
+            }
+            length = get_be(body, 4);
+            body += 4;
+            kept = payload - 4;
+        }
+        icap_add(capture, header[4], get_be(header + 6, 2), get_be(header + 8, 8), body, kept, length);
+        offset += CAPTURE_RECORD_HEADER_SIZE + payload;
+    }
+    return true;
+}
+
+bool icap_load(const char *path, icap_t *capture)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    bool ok = fread(data, 1, size, f) == (size_t)size && icap_parse(data, size, capture);
+    free(data);
+    fclose(f);
+    return ok;
+}
+
+bool icap_save(const char *path, const icap_t *capture)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    uint8_t header[CAPTURE_FILE_HEADER_SIZE] = {0};
+    memcpy(header, CAPTURE_MAGIC, 4);
+    header[4] = CAPTURE_VERSION;
+    header[5] = capture->recorder;
+    put_be(header + 8, capture->epoch_us, 8);
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+
+    for (size_t i = 0; ok && i < capture->count; i++)
+    {
+        const icap_record_t *record = &capture->records[i];
+        bool elided = record->kept < record->length;
+        uint8_t head[CAPTURE_RECORD_HEADER_SIZE + 4];
+        size_t head_len = CAPTURE_RECORD_HEADER_SIZE;
+        if (elided)
+        {
+            put_be(head + head_len, record->length, 4);
+            head_len += 4;
+        }
+        put_be(head, head_len - CAPTURE_RECORD_HEADER_SIZE + record->kept, 4);
+        head[4] = record->kind;
+        head[5] = elided ? CAPTURE_ELIDED : 0;
+        put_be(head + 6, record->session, 2);
+        put_be(head + 8, record->time_us, 8);
+        ok = fwrite(head, head_len, 1, f) == 1 && fwrite(record->data, 1, record->kept, f) == record->kept;
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+    {
+        fprintf(stderr, "%s: write failed\n", path);
+    }
+    return ok;
+}
+
+// ---- Text form
+
+static void print_escaped(FILE *out, const uint8_t *data, size_t len)
+{
+    fputc('"', out);
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t c = data[i];
+        if (c == '"' || c == '\\')
+        {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c == '\n')
+        {
+            fputs("\\n", out);
+        }
+        else if (isprint(c))
+        {
+            fputc(c, out);
+        }
+        else
+        {
+            fprintf(out, "\\x%02x", c);
+        }
+    }
+    fputc('"', out);
+}
+
+void icap_print(FILE *out, const icap_t *capture)
+{
+    fprintf(out, "recorder %s %llu\n", capture->recorder == CAPTURE_BY_DEVICE ? "device" : "server",
+            (unsigned long long)capture->epoch_us);
+    for (size_t i = 0; i < capture->count; i++)
+    {
+        const icap_record_t *record = &capture->records[i];
+        fprintf(out, "%.3f %u %s ", record->time_us / 1000.0, record->session, icap_kind_name(record->kind));
+        print_escaped(out, record->data, record->kept);
+        if (record->kept < record->length)
+        {
+            fprintf(out, " +%u", record->length - record->kept);
+        }
+        fputc('\n', out);
+    }
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    c = tolower((unsigned char)c);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// Unescape the quoted string at `p` into `out`; returns past the closing
+// quote, or NULL
+static const char *parse_escaped(const char *p, uint8_t *out, uint32_t *len)
+{
+    *len = 0;
+    if (*p++ != '"')
+    {
+        return NULL;
+    }
+    while (*p != '"')
+    {
+        if (*p == 0)
+        {
+            return NULL;
+        }
+        if (*p != '\\')
+        {
+            out[(*len)++] = *p++;
+            continue;
+        }
+        p++;
+        if (*p == 'n')
+        {
+            out[(*len)++] = '\n';
+            p++;
+        }
+        else if (*p == 'x' && hex_digit(p[1]) >= 0 && hex_digit(p[2]) >= 0)
+        {
+            out[(*len)++] = hex_digit(p[1]) << 4 | hex_digit(p[2]);
+            p += 3;
+        }
+        else if (*p != 0)
+        {
+            out[(*len)++] = *p++;
+        }
+    }
+    return p + 1;
+}
+
+bool icap_load_text(const char *path, icap_t *capture)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    *capture = (icap_t){.recorder = CAPTURE_BY_DEVICE};
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    int number = 0;
+    bool ok = true;
+    while (ok && getline(&line, &line_cap, f) >= 0)
+    {
+        number++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == 0)
+        {
+            continue;
+        }
+
+        char recorder[16];
+        unsigned long long epoch = 0;
+        if (sscanf(p, "recorder %15s %llu", recorder, &epoch) >= 1)
+        {
+            capture->recorder = strcmp(recorder, "server") == 0 ? CAPTURE_BY_SERVER : CAPTURE_BY_DEVICE;
+            capture->epoch_us = epoch;
+            continue;
+        }
+
+        double time_ms;
+        unsigned session;
+        char kind_name[16];
+        int used = 0;
+        uint8_t kind = 0;
+        if (sscanf(p, "%lf %u %15s %n", &time_ms, &session, kind_name, &used) == 3)
+        {
+            for (uint8_t k = CAPTURE_OPEN; k <= CAPTURE_EVENT; k++)
+            {
+                kind = strcmp(kind_name, icap_kind_name(k)) == 0 ? k : kind;
+            }
+        }
+        uint8_t *data = malloc(strlen(p) + 1);
+        uint32_t kept;
+        const char *rest = kind ? parse_escaped(p + used, data, &kept) : NULL;
+        unsigned elided = 0;
+        if (rest == NULL || (sscanf(rest, " +%u", &elided) != 1 && strspn(rest, " \t\r\n") != strlen(rest)))
+        {
+            fprintf(stderr, "%s:%d: cannot parse record\n", path, number);
+            ok = false;
+        }
+        else
+        {
+            icap_add(capture, kind, session, (uint64_t)(time_ms * 1000.0 + 0.5), data, kept, kept + elided);
+        }
+        free(data);
+    }
+    free(line);
+    fclose(f);
+    if (!ok)
+    {
+        icap_free(capture);
+    }
+    return ok;
+}
+
+// ---- Turns and comparison
+
+size_t icap_turns(const icap_t *capture, icap_turn_t **turns)
+{
+    *turns = calloc(capture->count + 1, sizeof(icap_turn_t));
+    size_t count = 0;
+    for (size_t i = 0; i < capture->count; i++)
+    {
+        const icap_record_t *record = &capture->records[i];
+        icap_turn_t *turn = count > 0 ? &(*turns)[count - 1] : NULL;
+        bool traffic = record->kind == CAPTURE_DEVICE || record->kind == CAPTURE_SERVER;
+        if (turn == NULL || !traffic || turn->kind != record->kind || turn->session != record->session)
+        {
+            turn = &(*turns)[count++];
+            turn->kind = record->kind;
+            turn->session = record->session;
+            turn->start_us = record->time_us;
+        }
+        turn->end_us = record->time_us;
+        if (turn->known == turn->length)
+        {
+            turn->data = realloc(turn->data, turn->known + record->kept + 1);
+            memcpy(turn->data + turn->known, record->data, record->kept);
+            turn->known += record->kept;
+            turn->data[turn->known] = 0;
+        }
+        turn->length += record->length;
+    }
+    return count;
+}
+
+void icap_turns_free(icap_turn_t *turns, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(turns[i].data);
+    }
+    free(turns);
+}
+
+// Blank out the session ids the server handed out, which differ per run
+static void mask_sessions(icap_turn_t *turns, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (turns[i].kind != CAPTURE_SERVER)
+        {
+            continue;
+        }
+        const uint8_t *at = turns[i].data;
+        size_t left = turns[i].known;
+        const uint8_t *found;
+        while ((found = memmem(at, left, SESSION_PREFIX, strlen(SESSION_PREFIX))) != NULL)
+        {
+            const uint8_t *id = found + strlen(SESSION_PREFIX);
+            if (id + SESSION_ID_LEN > turns[i].data + turns[i].known)
+            {
+                break;
+            }
+            uint8_t saved[SESSION_ID_LEN];
+            memcpy(saved, id, SESSION_ID_LEN);
+            for (size_t j = 0; j < count; j++)
+            {
+                uint8_t *hit;
+                while ((hit = memmem(turns[j].data, turns[j].known, saved, SESSION_ID_LEN)) != NULL)
+                {
+                    memset(hit, '*', SESSION_ID_LEN);
+                }
+            }
+            left = turns[i].data + turns[i].known - (id + SESSION_ID_LEN);
+            at = id + SESSION_ID_LEN;
+        }
+    }
+}
+
+// Events split one side's traffic into turns where the other recorder
+// saw one; join what an event came between again
+static size_t drop_events(icap_turn_t *turns, size_t count)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        icap_turn_t *last = kept > 0 ? &turns[kept - 1] : NULL;
+        bool traffic = turns[i].kind == CAPTURE_DEVICE || turns[i].kind == CAPTURE_SERVER;
+        if (turns[i].kind == CAPTURE_EVENT)
+        {
+            free(turns[i].data);
+        }
+        else if (last != NULL && traffic && last->kind == turns[i].kind && last->session == turns[i].session)
+        {
+            if (last->known == last->length)
+            {
+                last->data = realloc(last->data, last->known + turns[i].known + 1);
+                memcpy(last->data + last->known, turns[i].data, turns[i].known);
+                last->known += turns[i].known;
+                last->data[last->known] = 0;
+            }
+            last->length += turns[i].length;
+            last->end_us = turns[i].end_us;
+            free(turns[i].data);
+        }
+        else
+        {
+            turns[kept++] = turns[i];
+        }
+    }
+    return kept;
+}
+
+// Opens name the peer, which a replay can't reproduce
+static bool turns_match(const icap_turn_t *a, const icap_turn_t *b)
+{
+    if (a->kind != b->kind)
+    {
+        return false;
+    }
+    if (a->kind == CAPTURE_OPEN)
+    {
+        return true;
+    }
+    if (a->length != b->length)
+    {
+        return false;
+    }
+    uint32_t common = a->known < b->known ? a->known : b->known;
+    return memcmp(a->data, b->data, common) == 0;
+}
+
+static void print_turn(FILE *out, const char *label, const icap_turn_t *turn)
+{
+    if (turn == NULL)
+    {
+        fprintf(out, "    %-9s -\n", label);
+        return;
+    }
+    fprintf(out, "    %-9s %-6s %6u B ", label, icap_kind_name(turn->kind), turn->length);
+    print_escaped(out, turn->data, turn->known < SHOW_BYTES ? turn->known : SHOW_BYTES);
+    fputc('\n', out);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report_gaps(FILE *out, const char *name, double *recorded, double *replayed, int n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    double *delta = malloc(n * sizeof(double));
+    double max_delta = 0;
+    for (int i = 0; i < n; i++)
+    {
+        delta[i] = replayed[i] - recorded[i];
+        max_delta = fabs(delta[i]) > fabs(max_delta) ? delta[i] : max_delta;
+    }
+    qsort(recorded, n, sizeof(double), compare_double);
+    qsort(replayed, n, sizeof(double), compare_double);
+    qsort(delta, n, sizeof(double), compare_double);
+    fprintf(out, "%-14s n=%-4d recorded p50 %8.2f max %8.2f  replayed p50 %8.2f max %8.2f  ms\n", name, n,
+            recorded[n / 2], recorded[n - 1], replayed[n / 2], replayed[n - 1]);
+    fprintf(out, "%-14s delta p50 %+8.2f worst %+8.2f ms\n", "", delta[n / 2], max_delta);
+    free(delta);
+}
+
+int icap_diff(FILE *out, const icap_t *recorded, const icap_t *replayed)
+{
+    icap_turn_t *a, *b;
+    size_t a_count = icap_turns(recorded, &a);
+    size_t b_count = icap_turns(replayed, &b);
+    mask_sessions(a, a_count);
+    mask_sessions(b, b_count);
+    if (recorded->recorder != replayed->recorder)
+    {
+        a_count = drop_events(a, a_count);
+        b_count = drop_events(b, b_count);
+    }
+
+    // Reply times: from the end of one side's turn to the start of the
+    // other's
+    size_t n = a_count < b_count ? a_count : b_count;
+    double *gaps[2][2];
+    int gap_count[2] = {0};
+    for (int side = 0; side < 2; side++)
+    {
+        gaps[side][0] = calloc(n + 1, sizeof(double));
+        gaps[side][1] = calloc(n + 1, sizeof(double));
+    }
+
+    int mismatched = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!turns_match(&a[i], &b[i]))
+        {
+            fprintf(out, "turn %zu differs\n", i + 1);
+            print_turn(out, "recorded", &a[i]);
+            print_turn(out, "replayed", &b[i]);
+            mismatched++;
+            continue;
+        }
+        int side = a[i].kind == CAPTURE_DEVICE ? 0 : a[i].kind == CAPTURE_SERVER ? 1 : -1;
+        if (side >= 0 && i > 0 && a[i - 1].kind != a[i].kind && b[i - 1].kind == a[i - 1].kind)
+        {
+            gaps[side][0][gap_count[side]] = (a[i].start_us - a[i - 1].end_us) / 1000.0;
+            gaps[side][1][gap_count[side]] = (b[i].start_us - b[i - 1].end_us) / 1000.0;
+            gap_count[side]++;
+        }
+    }
+    for (size_t i = n; i < a_count; i++)
+    {
+        fprintf(out, "turn %zu missing\n", i + 1);
+        print_turn(out, "recorded", &a[i]);
+    }
+    for (size_t i = n; i < b_count; i++)
+    {
+        fprintf(out, "turn %zu extra\n", i + 1);
+        print_turn(out, "replayed", &b[i]);
+    }
+    fprintf(out, "turns: %zu recorded, %zu replayed, %zu matched\n", a_count, b_count, n - mismatched);
+    report_gaps(out, "device reply", gaps[0][0], gaps[0][1], gap_count[0]);
+    report_gaps(out, "server reply", gaps[1][0], gaps[1][1], gap_count[1]);
+    if (a_count > 0 && b_count > 0)
+    {
+        fprintf(out, "%-14s recorded %.2f ms, replayed %.2f ms\n", "span",
+                (a[a_count - 1].end_us - a[0].start_us) / 1000.0, (b[b_count - 1].end_us - b[0].start_us) / 1000.0);
+    }
+
+    for (int side = 0; side < 2; side++)
+    {
+        free(gaps[side][0]);
+        free(gaps[side][1]);
+    }
+    icap_turns_free(a, a_count);
+    icap_turns_free(b, b_count);
+    return mismatched + (int)(a_count - n) + (int)(b_count - n);
+}
@@ -0,0 +1,87 @@
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Capture files (format in src/capture.h) for the host tools: loading and
+ * saving, a text form to read and write by hand, and the comparison of two
+ * captures that icap diff and replay report.
+ *
+ * The text form has one record per line:
+ *
+ *   recorder device|server [epoch_us]
+ *   <time ms> <session> open|close|device|server|event "<payload>" [+<n>]
+ *
+ * with the payload escaped as a C string and +n for n bytes that were on
+ * the wire but not kept. Lines starting with '#' are comments.
+ */
+
+typedef struct
+{
+    uint8_t kind; // capture_kind_t
+    uint16_t session;
+    uint64_t time_us;
+    uint32_t length; // On the wire
+    uint32_t kept;   // Bytes of data, the first of length
+    uint8_t *data;
+} icap_record_t;
+
+typedef struct
+{
+    uint8_t recorder; // CAPTURE_BY_*
+    uint64_t epoch_us;
+    icap_record_t *records;
+    size_t count;
+    size_t cap;
+} icap_t;
+
+// A run of records of one kind: what one side said before the other
+// answered. Event, open and close records are a turn each.
+typedef struct
+{
+    uint8_t kind;
+    uint16_t session;
+    uint64_t start_us;
+    uint64_t end_us;
+    uint32_t length;
+    uint32_t known; // Bytes of data up to the first that was not kept
+    uint8_t *data;
+} icap_turn_t;
+
+void icap_add(icap_t *capture, uint8_t kind, uint16_t session, uint64_t time_us, const void *data,
+              uint32_t kept, uint32_t length);
+
+bool icap_parse(const uint8_t *data, size_t len, icap_t *capture);
+
+bool icap_load(const char *path, icap_t *capture);
+
+bool icap_save(const char *path, const icap_t *capture);
+
+bool icap_load_text(const char *path, icap_t *capture);
+
+void icap_print(FILE *out, const icap_t *capture);
+
+void icap_free(icap_t *capture);
+
+const char *icap_kind_name(uint8_t kind);
+
+size_t icap_turns(const icap_t *capture, icap_turn_t **turns);
+
+void icap_turns_free(icap_turn_t *turns, size_t count);
+
+/**
+ * @brief Compare a replay with the capture it replayed, turn by turn.
+ *
+ * Session ids the server handed out are ignored, and events only count if
+ * both captures come from the same recorder. Prints mismatches and the
+ * device's and server's reply times side by side.
+ *
+ * @return Turns that differ, are missing or are extra.
+ */
+int icap_diff(FILE *out, const icap_t *recorded, const icap_t *replayed);
+
+#endif // CAPTURE_FILE_H
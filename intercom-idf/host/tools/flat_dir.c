@@ -0,0 +1,565 @@
+/**
+ * @brief Flat directory encoder and checks for the decoder (src/flat_dir.h).
+ *
+ *   flat_dir check [rounds]     randomised round trips through the decoder
+ *   flat_dir bench              frame sizes and lookup time
+ *   flat_dir decode <frame>...  apply frames (server replies without their
+ *                               length) in order and print the directory
+ *
+ * The encoder follows the server's (tgbot/src/directory.ts): a full
+ * directory goes out as a gap list or a bitset, whichever is smaller, and a
+ * delta lists added then removed numbers as gap lists.
+ *
+ * check builds random directories, encodes them whole and as a chain of
+ * deltas, applies the frames with the firmware's decoder and compares the
+ * result with a reference set after every step. It also feeds deltas against
+ * the wrong version, frames cut short and directories over capacity, which
+ * must be refused.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "flat_dir.h"
+
+#define MODEL_RANGE (1u << 18) // Random flat numbers are below this
+#define CAPACITY 4096
+#define DELTAS_PER_ROUND 40
+
+typedef struct
+{
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} buffer_t;
+
+// ---- Encoder
+
+static void put_byte(buffer_t *out, uint8_t byte)
+{
+    if (out->len == out->cap)
+    {
+        out->cap = out->cap ? out->cap * 2 : 256;
+        out->data = realloc(out->data, out->cap);
+    }
+    out->data[out->len++] = byte;
+}
+
+static void put_u32(buffer_t *out, uint32_t v)
+{
+    put_byte(out, v >> 24);
+    put_byte(out, v >> 16);
+    put_byte(out, v >> 8);
+    put_byte(out, v);
+}
+
+static size_t varint_size(uint32_t v)
+{
+    size_t size = 1;
+    for (; v >= 0x80; v >>= 7)
+    {
+        size++;
+    }
+    return size;
+}
+
+static void put_varint(buffer_t *out, uint32_t v)
+{
+    for (; v >= 0x80; v >>= 7)
+    {
+        put_byte(out, (v & 0x7f) | 0x80);
+    }
+    put_byte(out, v);
+}
+
+static void put_header(buffer_t *out, flat_dir_kind_t kind, flat_dir_encoding_t encoding, uint32_t epoch,
+                       uint32_t version, uint32_t base)
+{
+    for (const char *m = FLAT_DIR_MAGIC; *m; m++)
+    {
+        put_byte(out, *m);
+    }
+    put_byte(out, FLAT_DIR_VERSION);
+    put_byte(out, kind);
+    put_byte(out, encoding);
+    put_byte(out, 0);
+    put_u32(out, epoch);
+    put_u32(out, version);
+    put_u32(out, base);
+}
+
+// `flats` ascending and distinct
+static void put_gaps(buffer_t *out, const uint32_t *flats, size_t count)
+{
+    put_varint(out, count);
+    for (size_t i = 0; i < count; i++)
+    {
+        put_varint(out, i == 0 ? flats[0] : flats[i] - flats[i - 1] - 1);
+    }
+}
+
+static size_t gaps_size(const uint32_t *flats, size_t count)
+{
+    size_t size = varint_size(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        size += varint_size(i == 0 ? flats[0] : flats[i] - flats[i - 1] - 1);
+    }
+    return size;
+}
+
+static size_t bitset_size(const uint32_t *flats, size_t count)
+{
+    uint32_t first = count ? flats[0] : 0;
+    uint64_t span = count ? (uint64_t)flats[count - 1] - first + 1 : 0;
+    // A span of 2^32 doesn't fit the varint
+    return span > UINT32_MAX ? SIZE_MAX : varint_size(first) + varint_size(span) + (span + 7) / 8;
+}
+
+static buffer_t encode_full(uint32_t epoch, uint32_t version, const uint32_t *flats, size_t count,
+                            flat_dir_encoding_t *encoding)
+{
+    buffer_t out = {0};
+    *encoding = bitset_size(flats, count) < gaps_size(flats, count) ? FLAT_DIR_BITSET : FLAT_DIR_GAPS;
+    put_header(&out, FLAT_DIR_FULL, *encoding, epoch, version, 0);
+    if (*encoding == FLAT_DIR_GAPS)
+    {
+        put_gaps(&out, flats, count);
+        return out;
+    }
+    uint32_t first = flats[0];
+    uint32_t span = flats[count - 1] - first + 1;
+    put_varint(&out, first);
+    put_varint(&out, span);
+    size_t start = out.len;
+    for (uint32_t i = 0; i < (span + 7) / 8; i++)
+    {
+        put_byte(&out, 0);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t bit = flats[i] - first;
+        out.data[start + bit / 8] |= 1 << (bit % 8);
+    }
+    return out;
+}
+
+static buffer_t encode_delta(uint32_t epoch, uint32_t version, uint32_t base, const uint32_t *added,
+                             size_t added_count, const uint32_t *removed, size_t removed_count)
+{
+    buffer_t out = {0};
+    put_header(&out, FLAT_DIR_DELTA, FLAT_DIR_GAPS, epoch, version, base);
+    put_gaps(&out, added, added_count);
+    put_gaps(&out, removed, removed_count);
+    return out;
+}
+
+// ---- Checks
+
+static uint64_t s_rng = 0x9e3779b97f4a7c15ull;
+
+static uint32_t rnd(uint32_t below)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (uint32_t)(s_rng % below);
+}
+
+// The reference set: a presence map over [0, MODEL_RANGE)
+typedef struct
+{
+    uint8_t *present;
+    uint32_t *sorted;
+    size_t count;
+} model_t;
+
+static void model_sort(model_t *model)
+{
+    model->count = 0;
+    for (uint32_t i = 0; i < MODEL_RANGE; i++)
+    {
+        if (model->present[i])
+        {
+            model->sorted[model->count++] = i;
+        }
+    }
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static bool matches(const flat_dir_t *dir, const model_t *model)
+{
+    if (!dir->valid || dir->count != model->count ||
+        memcmp(dir->flats, model->sorted, model->count * sizeof(uint32_t)) != 0)
+    {
+        return false;
+    }
+    // Lookups agree, in and out of the set
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t flat = rnd(MODEL_RANGE);
+        if (flat_dir_contains(dir, flat) != (model->present[flat] != 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A building: flats 1..n with most registered, or numbers scattered widely
+static void random_building(model_t *model)
+{
+    memset(model->present, 0, MODEL_RANGE);
+    if (rnd(2) == 0)
+    {
+        uint32_t n = 1 + rnd(CAPACITY - 1);
+        uint32_t percent = 30 + rnd(71);
+        for (uint32_t flat = 1; flat <= n; flat++)
+        {
+            model->present[flat] = rnd(100) < percent;
+        }
+    }
+    else
+    {
+        uint32_t n = rnd(CAPACITY / 2);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            model->present[rnd(MODEL_RANGE)] = 1;
+        }
+    }
+    model_sort(model);
+}
+
+static int check_round(model_t *model, flat_dir_t *dir, uint32_t epoch)
+{
+    random_building(model);
+    flat_dir_encoding_t encoding;
+    uint32_t version = rnd(1000);
+    buffer_t frame = encode_full(epoch, version, model->sorted, model->count, &encoding);
+    esp_err_t err = flat_dir_apply(dir, frame.data, frame.len);
+    free(frame.data);
+    if (err != ESP_OK || !matches(dir, model))
+    {
+        fprintf(stderr, "full (%s, %zu flats): 0x%x\n", encoding == FLAT_DIR_BITSET ? "bitset" : "gaps",
+                model->count, err);
+        return 1;
+    }
+
+    uint32_t *added = malloc(CAPACITY * sizeof(uint32_t));
+    uint32_t *removed = malloc(CAPACITY * sizeof(uint32_t));
+    int failed = 0;
+    for (int d = 0; d < DELTAS_PER_ROUND && !failed; d++)
+    {
+        // Changed numbers, as the server finds them: each now registered or
+        // not, whatever the device had before
+        size_t added_count = 0, removed_count = 0;
+        uint32_t changes = 1 + rnd(16);
+        uint32_t touched[16];
+        for (uint32_t i = 0; i < changes; i++)
+        {
+            touched[i] = rnd(2) && model->count ? model->sorted[rnd(model->count)] : rnd(MODEL_RANGE);
+            model->present[touched[i]] = model->count < CAPACITY - changes && rnd(2);
+        }
+        qsort(touched, changes, sizeof(uint32_t), compare_u32);
+        for (uint32_t i = 0; i < changes; i++)
+        {
+            if (i > 0 && touched[i] == touched[i - 1])
+            {
+                continue;
+            }
+            if (model->present[touched[i]])
+            {
+                added[added_count++] = touched[i];
+            }
+            else
+            {
+                removed[removed_count++] = touched[i];
+            }
+        }
+        model_sort(model);
+
+        // One against the version before: refused, directory kept
+        buffer_t stale = encode_delta(epoch, version + 2, version - 1, added, added_count, removed, removed_count);
+        err = flat_dir_apply(dir, stale.data, stale.len);
+        free(stale.data);
+        if (err != ESP_ERR_INVALID_VERSION || !dir->valid || dir->version != version)
+        {
+            fprintf(stderr, "stale delta accepted: 0x%x\n", err);
+            failed = 1;
+            break;
+        }
+
+        buffer_t delta = encode_delta(epoch, version + 1, version, added, added_count, removed, removed_count);
+        err = flat_dir_apply(dir, delta.data, delta.len);
+        free(delta.data);
+        version++;
+        if (err != ESP_OK || dir->version != version || !matches(dir, model))
+        {
+            fprintf(stderr, "delta %d (+%zu -%zu): 0x%x\n", d, added_count, removed_count, err);
+            failed = 1;
+        }
+    }
+    free(added);
+    free(removed);
+    if (failed)
+    {
+        return 1;
+    }
+
+    // Cut short anywhere: refused and dropped
+    frame = encode_full(epoch, version, model->sorted, model->count, &encoding);
+    size_t cut = rnd(frame.len);
+    err = flat_dir_apply(dir, frame.data, cut);
+    free(frame.data);
+    if (err == ESP_OK || (cut >= FLAT_DIR_HEADER_SIZE && dir->valid))
+    {
+        fprintf(stderr, "frame cut at %zu of %zu accepted: 0x%x\n", cut, frame.len, err);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_edges(flat_dir_t *dir)
+{
+    int failed = 0;
+    flat_dir_encoding_t encoding;
+
+    // The ends of the u32 range, in both encodings
+    const uint32_t ends[] = {0, 1, 2, UINT32_MAX - 1, UINT32_MAX};
+    buffer_t frame = encode_full(7, 1, ends, 5, &encoding);
+    failed |= flat_dir_apply(dir, frame.data, frame.len) != ESP_OK || dir->count != 5 ||
+              !flat_dir_contains(dir, UINT32_MAX) || !flat_dir_contains(dir, 0) || flat_dir_contains(dir, 3);
+    free(frame.data);
+    const uint32_t top[] = {UINT32_MAX - 7, UINT32_MAX - 6, UINT32_MAX - 5, UINT32_MAX - 3, UINT32_MAX};
+    frame = encode_full(7, 2, top, 5, &encoding);
+    failed |= encoding != FLAT_DIR_BITSET || flat_dir_apply(dir, frame.data, frame.len) != ESP_OK ||
+              dir->count != 5 || !flat_dir_contains(dir, UINT32_MAX - 3) || flat_dir_contains(dir, UINT32_MAX - 4);
+    free(frame.data);
+
+    // Empty, then a delta from another epoch
+    frame = encode_full(7, 3, NULL, 0, &encoding);
+    failed |= flat_dir_apply(dir, frame.data, frame.len) != ESP_OK || dir->count != 0 || !dir->valid;
+    free(frame.data);
+    const uint32_t one[] = {12};
+    frame = encode_delta(8, 4, 3, one, 1, NULL, 0);
+    failed |= flat_dir_apply(dir, frame.data, frame.len) != ESP_ERR_INVALID_VERSION || dir->count != 0;
+    free(frame.data);
+
+    // Over capacity, whole and by delta
+    uint32_t storage[4];
+    flat_dir_t small;
+    flat_dir_init(&small, storage, 4);
+    const uint32_t five[] = {10, 11, 12, 13, 14};
+    frame = encode_full(7, 1, five, 5, &encoding);
+    failed |= flat_dir_apply(&small, frame.data, frame.len) != ESP_ERR_NO_MEM || small.valid;
+    free(frame.data);
+    frame = encode_full(7, 1, five, 4, &encoding);
+    failed |= flat_dir_apply(&small, frame.data, frame.len) != ESP_OK;
+    free(frame.data);
+    frame = encode_delta(7, 2, 1, five + 4, 1, NULL, 0);
+    failed |= flat_dir_apply(&small, frame.data, frame.len) != ESP_ERR_NO_MEM || small.valid;
+    free(frame.data);
+
+    // A gap past the top of the range
+    const uint8_t overflow[] = {'I', 'D', 'I', 'R', FLAT_DIR_VERSION, FLAT_DIR_FULL, FLAT_DIR_GAPS, 0, 0, 0, 0, 7,
+                                0, 0, 0, 1, 0, 0, 0, 0, 2, 0xff, 0xff, 0xff, 0xff, 0x0f, 1};
+    failed |= flat_dir_apply(dir, overflow, sizeof(overflow)) != ESP_ERR_INVALID_RESPONSE || dir->valid;
+
+    if (failed)
+    {
+        fprintf(stderr, "edge cases failed\n");
+    }
+    return failed;
+}
+
+static int check(int rounds)
+{
+    uint32_t *storage = malloc(CAPACITY * sizeof(uint32_t));
+    flat_dir_t dir;
+    flat_dir_init(&dir, storage, CAPACITY);
+    model_t model = {.present = malloc(MODEL_RANGE), .sorted = malloc(MODEL_RANGE * sizeof(uint32_t))};
+
+    int failed = check_edges(&dir);
+    for (int i = 0; i < rounds && !failed; i++)
+    {
+        failed = check_round(&model, &dir, 1 + i);
+    }
+    printf("%d rounds of a full directory and %d deltas: %s\n", rounds, DELTAS_PER_ROUND, failed ? "FAILED" : "ok");
+
+    free(storage);
+    free(model.present);
+    free(model.sorted);
+    return failed;
+}
+
+// ---- Bench
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_one(const char *name, const uint32_t *flats, size_t count)
+{
+    flat_dir_encoding_t encoding;
+    buffer_t frame = encode_full(1, 1, flats, count, &encoding);
+    uint32_t *storage = malloc(CAPACITY * sizeof(uint32_t));
+    flat_dir_t dir;
+    flat_dir_init(&dir, storage, CAPACITY);
+
+    double started = now_ns();
+    esp_err_t err = flat_dir_apply(&dir, frame.data, frame.len);
+    double applied = now_ns();
+
+    enum { LOOKUPS = 1000000 };
+    uint32_t hits = 0;
+    uint32_t top = count ? flats[count - 1] + 1 : 1;
+    double lookup_started = now_ns();
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        hits += flat_dir_contains(&dir, rnd(top));
+    }
+    double lookup_ns = (now_ns() - lookup_started) / LOOKUPS;
+
+    // One resident moving flats: a number added, one removed
+    const uint32_t moved_to[] = {top}, moved_from[] = {count ? flats[count / 2] : 0};
+    buffer_t delta = encode_delta(1, 2, 1, moved_to, 1, moved_from, count ? 1 : 0);
+
+    printf("%-22s %5zu flats  gaps %5zu B  bitset %5zu B  sent %5zu B (%s)  delta %2zu B  "
+           "apply %6.1f us  lookup %5.1f ns%s\n",
+           name, count, gaps_size(flats, count), bitset_size(flats, count), frame.len,
+           encoding == FLAT_DIR_BITSET ? "bitset" : "gaps", delta.len, (applied - started) / 1000, lookup_ns,
+           err == ESP_OK && hits > 0 ? "" : "  FAILED");
+    free(frame.data);
+    free(delta.data);
+    free(storage);
+}
+
+static void bench(void)
+{
+    uint32_t *flats = malloc(CAPACITY * sizeof(uint32_t));
+    size_t count = 0;
+
+    for (uint32_t flat = 1; flat <= 200; flat++)
+    {
+        flats[count++] = flat;
+    }
+    bench_one("1..200, all", flats, count);
+
+    count = 0;
+    for (uint32_t flat = 1; flat <= 500; flat++)
+    {
+        if (rnd(100) < 60)
+        {
+            flats[count++] = flat;
+        }
+    }
+    bench_one("1..500, 60%", flats, count);
+
+    // Sections numbered by floor: 101..112, 201..212, ...
+    count = 0;
+    for (uint32_t floor = 1; floor <= 25; floor++)
+    {
+        for (uint32_t flat = 1; flat <= 12; flat++)
+        {
+            if (rnd(100) < 70)
+            {
+                flats[count++] = floor * 100 + flat;
+            }
+        }
+    }
+    bench_one("floor*100+1..12, 70%", flats, count);
+
+    count = 0;
+    for (uint32_t flat = rnd(1000); count < 512; flat += 1 + rnd(2000))
+    {
+        flats[count++] = flat;
+    }
+    bench_one("512 scattered", flats, count);
+    free(flats);
+}
+
+// ---- Decode
+
+static bool read_file(const char *path, buffer_t *buf)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    buf->len = buf->cap = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf->data = malloc(buf->len ? buf->len : 1);
+    bool ok = fread(buf->data, 1, buf->len, f) == buf->len;
+    fclose(f);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: short read\n", path);
+    }
+    return ok;
+}
+
+static int decode(int count, char **paths)
+{
+    uint32_t *storage = malloc(CAPACITY * sizeof(uint32_t));
+    flat_dir_t dir;
+    flat_dir_init(&dir, storage, CAPACITY);
+    for (int i = 0; i < count; i++)
+    {
+        buffer_t frame;
+        if (!read_file(paths[i], &frame))
+        {
+            return 1;
+        }
+        esp_err_t err = flat_dir_apply(&dir, frame.data, frame.len);
+        free(frame.data);
+        if (err != ESP_OK)
+        {
+            fprintf(stderr, "%s: 0x%x\n", paths[i], err);
+            return 1;
+        }
+    }
+    printf("epoch %u version %u, %u flats:", (unsigned)dir.epoch, (unsigned)dir.version, (unsigned)dir.count);
+    for (uint32_t i = 0; i < dir.count; i++)
+    {
+        printf(" %u", (unsigned)dir.flats[i]);
+    }
+    printf("\n");
+    free(storage);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && argc <= 3 && strcmp(argv[1], "check") == 0)
+    {
+        return check(argc == 3 ? atoi(argv[2]) : 100);
+    }
+    if (argc == 2 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+        return 0;
+    }
+    if (argc >= 3 && strcmp(argv[1], "decode") == 0)
+    {
+        return decode(argc - 2, argv + 2);
+    }
+    fprintf(stderr, "usage: %s check [rounds]\n"
+                    "       %s bench\n"
+                    "       %s decode <frame>...\n",
+            argv[0], argv[0], argv[0]);
+    return 2;
+}
@@ -0,0 +1,154 @@
+/**
+ * @brief Capture file tool (format in src/capture.h).
+ *
+ *   icap dump <capture>             print records in the text form
+ *   icap build <text> <capture>     the reverse, for hand-made captures
+ *   icap fromlog <log> <capture>    extract the last "ICAP" dump from a
+ *                                   device console log
+ *   icap diff <recorded> <replayed> compare turns and reply times
+ *
+ * Server captures come from tgbot with CAPTURE_DIR set, device captures
+ * from the console when a call loses its channel. See host/tools/replay.c
+ * and tgbot/src/loadgen/replay.ts to play them back.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+#include "capture_file.h"
+
+#define LOG_MARKER "ICAP "
+
+static int from_log(const char *log_path, const char *out_path)
+{
+    FILE *f = fopen(log_path, "r");
+    if (f == NULL)
+    {
+        perror(log_path);
+        return 1;
+    }
+
+    // Each "ICAP begin" starts over; the last complete dump wins
+    uint8_t *data = NULL, *dump = NULL;
+    size_t len = 0, cap = 0, dump_len = 0;
+    bool in_dump = false;
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, f) >= 0)
+    {
+        char *at = strstr(line, LOG_MARKER);
+        if (at == NULL)
+        {
+            continue;
+        }
+        at += strlen(LOG_MARKER);
+        if (strncmp(at, "begin", 5) == 0)
+        {
+            in_dump = true;
+            len = 0;
+            continue;
+        }
+        if (strncmp(at, "end", 3) == 0)
+        {
+            if (in_dump)
+            {
+                free(dump);
+                dump = malloc(len ? len : 1);
+                memcpy(dump, data, len);
+                dump_len = len;
+            }
+            in_dump = false;
+            continue;
+        }
+        for (; in_dump && at[0] && at[1] && at[0] != '\n' && at[0] != '\r'; at += 2)
+        {
+            unsigned byte;
+            if (sscanf(at, "%2x", &byte) != 1)
+            {
+                break;
+            }
+            if (len == cap)
+            {
+                cap = cap ? cap * 2 : 4096;
+                data = realloc(data, cap);
+            }
+            data[len++] = byte;
+        }
+    }
+    free(line);
+    free(data);
+    fclose(f);
+
+    icap_t capture;
+    if (dump == NULL)
+    {
+        fprintf(stderr, "%s: no complete capture dump\n", log_path);
+        return 1;
+    }
+    bool ok = icap_parse(dump, dump_len, &capture) && icap_save(out_path, &capture);
+    if (ok)
+    {
+        printf("%s: %zu records\n", out_path, capture.count);
+        icap_free(&capture);
+    }
+    free(dump);
+    return ok ? 0 : 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: icap dump <capture>\n"
+                    "       icap build <text> <capture>\n"
+                    "       icap fromlog <log> <capture>\n"
+                    "       icap diff <recorded> <replayed>\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "dump") == 0)
+    {
+        icap_t capture;
+        if (!icap_load(argv[2], &capture))
+        {
+            return 1;
+        }
+        icap_print(stdout, &capture);
+        icap_free(&capture);
+        return 0;
+    }
+    if (argc == 4 && strcmp(argv[1], "build") == 0)
+    {
+        icap_t capture;
+        if (!icap_load_text(argv[2], &capture))
+        {
+            return 1;
+        }
+        bool ok = icap_save(argv[3], &capture);
+        icap_free(&capture);
+        return ok ? 0 : 1;
+    }
+    if (argc == 4 && strcmp(argv[1], "fromlog") == 0)
+    {
+        return from_log(argv[2], argv[3]);
+    }
+    if (argc == 4 && strcmp(argv[1], "diff") == 0)
+    {
+        icap_t recorded, replayed;
+        if (!icap_load(argv[2], &recorded))
+        {
+            return 1;
+        }
+        if (!icap_load(argv[3], &replayed))
+        {
+            icap_free(&recorded);
+            return 1;
+        }
+        int differing = icap_diff(stdout, &recorded, &replayed);
+        icap_free(&recorded);
+        icap_free(&replayed);
+        return differing == 0 ? 0 : 1;
+    }
+    usage();
+    return 2;
+}
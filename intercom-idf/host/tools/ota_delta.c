@@ -0,0 +1,647 @@
+/**
+ * @brief Firmware update patch generator and applier (see src/ota_patch.h).
+ *
+ *   ota_delta diff  <old.bin|-> <new.bin> <patch>   delta, or LZ with "-"
+ *   ota_delta apply <old.bin|-> <patch> <new.bin>
+ *   ota_delta bench <old.bin> <new.bin>
+ *   ota_delta check [rounds]
+ *
+ * apply runs the same decoder as the firmware, fed in chunks the size of the
+ * device's requests. bench builds both kinds of patch, applies them (once
+ * straight through and once restarted from a checkpoint halfway, as after a
+ * disconnect) and reports sizes and times. check round-trips random images
+ * through both kinds of patch, restarted at a random point, makes sure a
+ * corrupted patch never yields a wrong image, and feeds the decoder
+ * malformed ops it must refuse.
+ *
+ * The encoder is greedy: at each position it takes the run, from the old
+ * image or from the output so far, that saves the most bytes once its op is
+ * paid for. The old image is searched at the displacement of the previous
+ * COPY_OLD first, which is what survives a change that shifts code.
+ */
+#include <openssl/sha.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ota_patch.h"
+
+#define CHUNK_SIZE 4096 // As CONFIG_INTERCOM_OTA_CHUNK_SIZE
+#define MIN_MATCH 4
+#define HASH_BITS 18
+#define MAX_CHAIN 48
+#define MAX_OUT_DISTANCE (1u << 20)
+
+typedef struct
+{
+    uint8_t *data;
+    size_t len;
+} buffer_t;
+
+// ---- Encoder
+
+typedef struct
+{
+    int32_t *head;
+    int32_t *prev;
+} index_t;
+
+static uint32_t hash4(const uint8_t *p)
+{
+    uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void index_init(index_t *index, size_t len)
+{
+    index->head = malloc(sizeof(int32_t) << HASH_BITS);
+    index->prev = malloc(sizeof(int32_t) * (len + 1));
+    memset(index->head, 0xff, sizeof(int32_t) << HASH_BITS);
+}
+
+static void index_add(index_t *index, const uint8_t *data, size_t len, size_t pos)
+{
+    if (pos + MIN_MATCH <= len)
+    {
+        uint32_t h = hash4(data + pos);
+        index->prev[pos] = index->head[h];
+        index->head[h] = pos;
+    }
+}
+
+static void index_free(index_t *index)
+{
+    free(index->head);
+    free(index->prev);
+}
+
+static size_t match_len(const uint8_t *a, size_t a_len, const uint8_t *b, size_t b_len)
+{
+    size_t max = a_len < b_len ? a_len : b_len;
+    size_t n = 0;
+    while (n < max && a[n] == b[n])
+    {
+        n++;
+    }
+    return n;
+}
+
+static size_t varint_size(uint32_t v)
+{
+    size_t n = 1;
+    while (v >= 0x80)
+    {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static void put_varint(buffer_t *out, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        out->data[out->len++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    out->data[out->len++] = v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void emit_add(buffer_t *out, const uint8_t *data, size_t len)
+{
+    if (len > 0)
+    {
+        put_varint(out, (uint32_t)len << 2 | OTA_PATCH_ADD);
+        memcpy(out->data + out->len, data, len);
+        out->len += len;
+    }
+}
+
+// old may be NULL for a plain compressed image
+static buffer_t encode(const buffer_t *old, const buffer_t *new)
+{
+    // Ops only replace bytes they save, but each can split a literal and
+    // restart it with another ADD
+    buffer_t out = {malloc(OTA_PATCH_HEADER_SIZE + 2 * new->len + 16), 0};
+
+    uint8_t *h = out.data;
+    memset(h, 0, OTA_PATCH_HEADER_SIZE);
+    memcpy(h, OTA_PATCH_MAGIC, 4);
+    h[4] = OTA_PATCH_VERSION;
+    h[5] = old ? OTA_PATCH_FLAG_DELTA : 0;
+    put_u32(h + 8, new->len);
+    SHA256(new->data, new->len, h + 12);
+    if (old)
+    {
+        SHA256(old->data, old->len, h + 44);
+        put_u32(h + 76, old->len);
+    }
+    out.len = OTA_PATCH_HEADER_SIZE;
+
+    index_t old_index = {0}, new_index;
+    if (old)
+    {
+        index_init(&old_index, old->len);
+        for (size_t i = 0; i < old->len; i++)
+        {
+            index_add(&old_index, old->data, old->len, i);
+        }
+    }
+    index_init(&new_index, new->len);
+
+    size_t pos = 0, literal = 0;
+    uint32_t old_next = 0;     // End of the previous COPY_OLD
+    int64_t displacement = 0;  // Old offset minus new offset of that copy
+    while (pos < new->len)
+    {
+        const uint8_t *cur = new->data + pos;
+        size_t remaining = new->len - pos;
+        ota_patch_op_t best_kind = OTA_PATCH_ADD;
+        size_t best_len = 0;
+        uint32_t best_arg = 0;
+        long best_gain = 0;
+
+#define CONSIDER(kind, len, arg, arg_cost)                                              \
+    do                                                                                  \
+    {                                                                                   \
+        long gain_ = (long)(len) - (long)varint_size((uint32_t)(len) << 2) - (arg_cost); \
+        if ((len) >= MIN_MATCH && gain_ > best_gain)                                    \
+        {                                                                               \
+            best_kind = (kind), best_len = (len), best_arg = (arg), best_gain = gain_;  \
+        }                                                                               \
+    } while (0)
+
+        if (old)
+        {
+            int64_t at = (int64_t)pos + displacement;
+            if (at >= 0 && (size_t)at < old->len)
+            {
+                size_t n = match_len(cur, remaining, old->data + at, old->len - at);
+                uint32_t arg = zigzag((int32_t)(at - old_next));
+                CONSIDER(OTA_PATCH_COPY_OLD, n, (uint32_t)at, (long)varint_size(arg));
+            }
+            if (remaining >= MIN_MATCH)
+            {
+                int32_t cand = old_index.head[hash4(cur)];
+                for (int chain = 0; cand >= 0 && chain < MAX_CHAIN; chain++, cand = old_index.prev[cand])
+                {
+                    size_t n = match_len(cur, remaining, old->data + cand, old->len - cand);
+                    uint32_t arg = zigzag((int32_t)((int64_t)cand - old_next));
+                    CONSIDER(OTA_PATCH_COPY_OLD, n, (uint32_t)cand, (long)varint_size(arg));
+                }
+            }
+        }
+        if (remaining >= MIN_MATCH)
+        {
+            int32_t cand = new_index.head[hash4(cur)];
+            for (int chain = 0; cand >= 0 && chain < MAX_CHAIN && pos - cand <= MAX_OUT_DISTANCE;
+                 chain++, cand = new_index.prev[cand])
+            {
+                // The source may run into the bytes being produced
+                size_t n = match_len(cur, remaining, new->data + cand, new->len - cand);
+                uint32_t distance = pos - cand;
+                CONSIDER(OTA_PATCH_COPY_OUT, n, distance, (long)varint_size(distance));
+            }
+        }
+#undef CONSIDER
+
+        // A run that breaks up a literal also pays for restarting it
+        if (best_len == 0 || (literal > 0 && best_gain <= 1))
+        {
+            index_add(&new_index, new->data, new->len, pos);
+            literal++;
+            pos++;
+            continue;
+        }
+
+        emit_add(&out, new->data + pos - literal, literal);
+        literal = 0;
+        put_varint(&out, (uint32_t)best_len << 2 | best_kind);
+        if (best_kind == OTA_PATCH_COPY_OLD)
+        {
+            put_varint(&out, zigzag((int32_t)((int64_t)best_arg - old_next)));
+            old_next = best_arg + best_len;
+            displacement = (int64_t)best_arg - (int64_t)pos;
+        }
+        else
+        {
+            put_varint(&out, best_arg);
+        }
+        for (size_t i = 0; i < best_len; i++)
+        {
+            index_add(&new_index, new->data, new->len, pos + i);
+        }
+        pos += best_len;
+    }
+    emit_add(&out, new->data + pos - literal, literal);
+    put_varint(&out, OTA_PATCH_END);
+
+    if (old)
+    {
+        index_free(&old_index);
+    }
+    index_free(&new_index);
+    return out;
+}
+
+// ---- Decoder, over in-memory images
+
+typedef struct
+{
+    const buffer_t *old;
+    buffer_t out;
+    size_t capacity;
+} memory_io_t;
+
+static esp_err_t mem_read_old(void *ctx, uint32_t offset, uint8_t *buf, size_t len)
+{
+    memory_io_t *io = ctx;
+    if (io->old == NULL || offset + len > io->old->len)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(buf, io->old->data + offset, len);
+    return ESP_OK;
+}
+
+static esp_err_t mem_read_out(void *ctx, uint32_t offset, uint8_t *buf, size_t len)
+{
+    memory_io_t *io = ctx;
+    memcpy(buf, io->out.data + offset, len);
+    return ESP_OK;
+}
+
+static esp_err_t mem_write(void *ctx, uint32_t offset, const uint8_t *buf, size_t len)
+{
+    memory_io_t *io = ctx;
+    if (offset + len > io->capacity)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(io->out.data + offset, buf, len);
+    if (offset + len > io->out.len)
+    {
+        io->out.len = offset + len;
+    }
+    return ESP_OK;
+}
+
+// Apply the patch in CHUNK_SIZE pieces. With stop_at > 0 the decode is
+// abandoned once that many patch bytes have been fed and restarted from its
+// last checkpoint with a fresh decoder, over output written past it.
+static esp_err_t apply(const buffer_t *old, const buffer_t *patch_data, size_t stop_at, buffer_t *result)
+{
+    if (patch_data->len < OTA_PATCH_HEADER_SIZE)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint32_t image_size = (uint32_t)patch_data->data[8] << 24 | (uint32_t)patch_data->data[9] << 16 |
+                          (uint32_t)patch_data->data[10] << 8 | patch_data->data[11];
+    memory_io_t io = {.old = old, .out = {malloc(image_size ? image_size : 1), 0}, .capacity = image_size};
+    ota_patch_io_t callbacks = {mem_read_old, mem_read_out, mem_write, &io};
+    ota_patch_t patch;
+    ota_patch_init(&patch, &callbacks);
+
+    esp_err_t err = ESP_OK;
+    size_t offset = 0;
+    while (err == ESP_OK && !ota_patch_done(&patch) && offset < patch_data->len)
+    {
+        size_t n = patch_data->len - offset < CHUNK_SIZE ? patch_data->len - offset : CHUNK_SIZE;
+        err = ota_patch_feed(&patch, patch_data->data + offset, n);
+        offset += n;
+
+        if (err == ESP_OK && stop_at > 0 && offset >= stop_at && !ota_patch_done(&patch))
+        {
+            ota_patch_checkpoint_t checkpoint = patch.checkpoint;
+            stop_at = 0;
+            ota_patch_init(&patch, &callbacks);
+            err = ota_patch_feed(&patch, patch_data->data, OTA_PATCH_HEADER_SIZE);
+            if (err == ESP_OK)
+            {
+                err = ota_patch_restore(&patch, &checkpoint);
+            }
+            offset = checkpoint.in;
+        }
+    }
+    if (err == ESP_OK && !ota_patch_done(&patch))
+    {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK && patch.header.flags & OTA_PATCH_FLAG_DELTA)
+    {
+        uint8_t sha[32];
+        SHA256(old->data, old->len, sha);
+        if (memcmp(sha, patch.header.base_sha256, 32) != 0)
+        {
+            err = ESP_ERR_INVALID_VERSION;
+        }
+    }
+    if (err == ESP_OK)
+    {
+        uint8_t sha[32];
+        SHA256(io.out.data, io.out.len, sha);
+        if (io.out.len != image_size || memcmp(sha, patch.header.image_sha256, 32) != 0)
+        {
+            err = ESP_ERR_INVALID_CRC;
+        }
+    }
+    if (err != ESP_OK)
+    {
+        free(io.out.data);
+        return err;
+    }
+    *result = io.out;
+    return ESP_OK;
+}
+
+// ---- Files and commands
+
+static bool read_file(const char *path, buffer_t *buf)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    buf->len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf->data = malloc(buf->len ? buf->len : 1);
+    bool ok = fread(buf->data, 1, buf->len, f) == buf->len;
+    fclose(f);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: short read\n", path);
+        free(buf->data);
+    }
+    return ok;
+}
+
+static bool write_file(const char *path, const buffer_t *buf)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    bool ok = fwrite(buf->data, 1, buf->len, f) == buf->len;
+    ok = fclose(f) == 0 && ok;
+    return ok;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int bench_one(const char *name, const buffer_t *old, const buffer_t *new)
+{
+    double started = now_ms();
+    buffer_t patch = encode(old, new);
+    double encoded = now_ms();
+    buffer_t result;
+    esp_err_t err = apply(old, &patch, 0, &result);
+    double applied = now_ms();
+    if (err == ESP_OK)
+    {
+        free(result.data);
+        err = apply(old, &patch, patch.len / 2, &result);
+    }
+    if (err == ESP_OK)
+    {
+        free(result.data);
+    }
+
+    printf("%-6s %9zu bytes %6.1f%%  encode %8.1f ms  apply %6.1f ms  %s\n", name, patch.len,
+           100.0 * patch.len / new->len, encoded - started, applied - encoded,
+           err == ESP_OK ? "ok" : "MISMATCH");
+    free(patch.data);
+    return err == ESP_OK ? 0 : 1;
+}
+
+// ---- Checks
+
+static uint32_t s_rng = 0x9e3779b9;
+
+static uint32_t rng(void)
+{
+    // xorshift32
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+// Words from a small vocabulary, so that the image compresses like code
+static buffer_t random_image(size_t len)
+{
+    uint32_t words[64];
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+    {
+        words[i] = rng();
+    }
+    buffer_t image = {malloc(len ? len : 1), len};
+    for (size_t i = 0; i < len; i += 4)
+    {
+        uint32_t word = words[rng() % 64];
+        memcpy(image.data + i, &word, len - i < 4 ? len - i : 4);
+    }
+    return image;
+}
+
+// The old image with a few regions rewritten, inserted or cut out
+static buffer_t mutate(const buffer_t *old)
+{
+    buffer_t new = {malloc(old->len + 64 * 1024), 0};
+    size_t pos = 0;
+    for (int edits = 1 + rng() % 12; edits > 0 && pos < old->len; edits--)
+    {
+        size_t keep = rng() % (old->len - pos + 1) / 2;
+        memcpy(new.data + new.len, old->data + pos, keep);
+        new.len += keep;
+        pos += keep;
+        size_t n = 1 + rng() % 2048;
+        switch (rng() % 3)
+        {
+        case 0: // Rewrite
+            pos += n < old->len - pos ? n : old->len - pos;
+            // Fall through
+        case 1: // Insert
+            for (size_t i = 0; i < n && new.len < old->len + 60 * 1024; i++)
+            {
+                new.data[new.len++] = rng();
+            }
+            break;
+        default: // Cut
+            pos += n < old->len - pos ? n : old->len - pos;
+            break;
+        }
+    }
+    memcpy(new.data + new.len, old->data + pos, old->len - pos);
+    new.len += old->len - pos;
+    return new;
+}
+
+// Straight through, restarted from a checkpoint at a random point, and
+// with one byte flipped, which may fail but must not yield a wrong image
+static int check_round_trip(const buffer_t *old, const buffer_t *new)
+{
+    buffer_t patch = encode(old, new);
+    int failed = 0;
+    for (int pass = 0; pass < 3; pass++)
+    {
+        size_t flip = 0;
+        if (pass == 2)
+        {
+            flip = OTA_PATCH_HEADER_SIZE + rng() % (patch.len - OTA_PATCH_HEADER_SIZE);
+            patch.data[flip] ^= 1 << rng() % 8;
+        }
+        buffer_t result;
+        esp_err_t err = apply(old, &patch, pass == 1 ? 1 + rng() % patch.len : 0, &result);
+        if (err == ESP_OK)
+        {
+            failed |= result.len != new->len || memcmp(result.data, new->data, new->len) != 0;
+            free(result.data);
+        }
+        else
+        {
+            failed |= pass < 2;
+        }
+    }
+    free(patch.data);
+    return failed;
+}
+
+// Ops after a valid header for a 16-byte image, fed in one piece
+static int check_malformed(void)
+{
+    static const struct
+    {
+        const char *name;
+        uint8_t ops[6];
+        size_t len;
+        esp_err_t expect;
+    } cases[] = {
+        {"5-byte varint", {0x84, 0x80, 0x80, 0x80, 0x00}, 5, ESP_OK},
+        {"varint bit 32", {0x84, 0x80, 0x80, 0x80, 0x10}, 5, ESP_ERR_INVALID_RESPONSE},
+        {"varint bit 34", {0x84, 0x80, 0x80, 0x80, 0x40}, 5, ESP_ERR_INVALID_RESPONSE},
+        {"6-byte varint", {0x84, 0x80, 0x80, 0x80, 0x80, 0x00}, 6, ESP_ERR_INVALID_RESPONSE},
+        {"ADD past the image", {17 << 2 | OTA_PATCH_ADD}, 1, ESP_ERR_INVALID_RESPONSE},
+        {"COPY_OLD without a base", {4 << 2 | OTA_PATCH_COPY_OLD, 0}, 2, ESP_ERR_INVALID_RESPONSE},
+        {"COPY_OUT before the output", {4 << 2 | OTA_PATCH_COPY_OUT, 1}, 2, ESP_ERR_INVALID_RESPONSE},
+        {"END before the image", {OTA_PATCH_END}, 1, ESP_ERR_INVALID_RESPONSE},
+    };
+    uint8_t image[16] = {0};
+    buffer_t new = {image, sizeof(image)};
+    buffer_t valid = encode(NULL, &new);
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        uint8_t out[sizeof(image)];
+        memory_io_t io = {.out = {out, 0}, .capacity = sizeof(out)};
+        ota_patch_io_t callbacks = {mem_read_old, mem_read_out, mem_write, &io};
+        ota_patch_t patch;
+        ota_patch_init(&patch, &callbacks);
+        esp_err_t err = ota_patch_feed(&patch, valid.data, OTA_PATCH_HEADER_SIZE);
+        if (err == ESP_OK)
+        {
+            err = ota_patch_feed(&patch, cases[i].ops, cases[i].len);
+        }
+        if (err != cases[i].expect)
+        {
+            printf("%s: 0x%x, expected 0x%x\n", cases[i].name, err, cases[i].expect);
+            failed = 1;
+        }
+    }
+    free(valid.data);
+    return failed;
+}
+
+static int check(int rounds)
+{
+    int failed = check_malformed();
+    for (int i = 0; i < rounds && !failed; i++)
+    {
+        // Down to the empty image
+        buffer_t old = random_image(i == 0 ? 0 : rng() % (256 * 1024));
+        buffer_t new = mutate(&old);
+        failed = check_round_trip(NULL, &new) || check_round_trip(&old, &new);
+        if (failed)
+        {
+            printf("round %d: old %zu bytes, new %zu bytes\n", i, old.len, new.len);
+        }
+        free(old.data);
+        free(new.data);
+    }
+    printf("%d round trips, delta and compressed, and malformed ops: %s\n", rounds, failed ? "FAILED" : "ok");
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 5 && (strcmp(argv[1], "diff") == 0 || strcmp(argv[1], "apply") == 0))
+    {
+        bool has_old = strcmp(argv[2], "-") != 0;
+        buffer_t old = {0}, in;
+        if ((has_old && !read_file(argv[2], &old)) || !read_file(argv[3], &in))
+        {
+            return 1;
+        }
+        buffer_t out;
+        if (strcmp(argv[1], "diff") == 0)
+        {
+            out = encode(has_old ? &old : NULL, &in);
+        }
+        else
+        {
+            esp_err_t err = apply(has_old ? &old : NULL, &in, 0, &out);
+            if (err != ESP_OK)
+            {
+                fprintf(stderr, "apply failed: 0x%x\n", err);
+                return 1;
+            }
+        }
+        return write_file(argv[4], &out) ? 0 : 1;
+    }
+    if (argc == 4 && strcmp(argv[1], "bench") == 0)
+    {
+        buffer_t old, new;
+        if (!read_file(argv[2], &old) || !read_file(argv[3], &new))
+        {
+            return 1;
+        }
+        printf("old %zu bytes, new %zu bytes\n", old.len, new.len);
+        int failed = bench_one("lz", NULL, &new) + bench_one("delta", &old, &new);
+        return failed ? 1 : 0;
+    }
+    if (argc >= 2 && argc <= 3 && strcmp(argv[1], "check") == 0)
+    {
+        return check(argc == 3 ? atoi(argv[2]) : 50);
+    }
+    fprintf(stderr, "usage: %s diff <old|-> <new> <patch>\n"
+                    "       %s apply <old|-> <patch> <new>\n"
+                    "       %s bench <old> <new>\n"
+                    "       %s check [rounds]\n",
+            argv[0], argv[0], argv[0], argv[0]);
+    return 2;
+}
@@ -0,0 +1,425 @@
+/**
+ * @brief Replays a capture (src/capture.h) against the host build of the
+ * firmware and compares what the firmware does with what was recorded.
+ *
+ *   replay <capture> [time_scale] [out]
+ *
+ * Runs the real app_main() built with CONFIG_INTERCOM_CAPTURE and plays the
+ * server's side of the capture on the loopback port: server turns are sent
+ * as recorded, with elided bytes filled in, as long after the device's last
+ * turn as they were then. The visitor is played on the fake keypad, from
+ * the device's "number" and "cancel" events or, in a server capture, from
+ * the "start" and "cancel" frames. Photos are taken at the recorded size.
+ *
+ * Records before the first call in the capture (the start of a device's
+ * ring is usually cut off) are skipped. The firmware's own capture of the
+ * replay is written to `out` (default <capture>.replay) and compared with
+ * the recording as by icap diff; the exit status is nonzero if any turn
+ * differs.
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "capture_file.h"
+#include "esp_log.h"
+#include "fake_camera.h"
+#include "fake_keypad.h"
+#include "host_clock.h"
+#include "host_sync.h"
+#include "sdkconfig.h"
+
+#define KEY_HOLD_MS 150
+#define KEY_GAP_MS 250
+#define WAIT_US (30 * 1000000ull) // For the device to do what it did then
+#define SETTLE_US (1000 * 1000)   // After the last turn, for late records
+#define FILL_BYTE 0xa5            // Stands in for bytes that were not kept
+#define PHOTO_RECORDS 0x80000000u
+
+void app_main(void);
+
+// The connection from the firmware
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int client;
+    uint32_t opened;
+    uint32_t closed;
+    uint64_t received; // Bytes on the current connection
+} s_link = {.lock = PTHREAD_MUTEX_INITIALIZER, .client = -1};
+
+typedef enum
+{
+    WAIT_OPENED,
+    WAIT_RECEIVED,
+    WAIT_CLOSED,
+} wait_t;
+
+static void *server_task(void *arg)
+{
+    int listener = *(int *)arg;
+    uint8_t buf[1460];
+
+    for (;;)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+        pthread_mutex_lock(&s_link.lock);
+        s_link.client = client;
+        s_link.received = 0;
+        s_link.opened++;
+        pthread_cond_broadcast(&s_link.cond);
+        pthread_mutex_unlock(&s_link.lock);
+
+        int len;
+        while ((len = recv(client, buf, sizeof(buf), 0)) > 0)
+        {
+            pthread_mutex_lock(&s_link.lock);
+            s_link.received += len;
+            pthread_cond_broadcast(&s_link.cond);
+            pthread_mutex_unlock(&s_link.lock);
+        }
+
+        pthread_mutex_lock(&s_link.lock);
+        s_link.client = -1;
+        s_link.closed++;
+        pthread_cond_broadcast(&s_link.cond);
+        pthread_mutex_unlock(&s_link.lock);
+        close(client);
+    }
+    return NULL;
+}
+
+static int start_server(void)
+{
+    static int s_listener;
+    s_listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(s_listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(INTERCOM_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(s_listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(s_listener, 4) != 0)
+    {
+        perror("replay server");
+        return -1;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_task, &s_listener);
+    pthread_detach(thread);
+    return 0;
+}
+
+static bool link_reached(wait_t what, uint64_t target)
+{
+    switch (what)
+    {
+    case WAIT_OPENED:
+        return s_link.opened >= target;
+    case WAIT_RECEIVED:
+        return s_link.received >= target || s_link.client < 0;
+    case WAIT_CLOSED:
+        return s_link.closed >= target;
+    }
+    return false;
+}
+
+static bool link_wait(wait_t what, uint64_t target)
+{
+    struct timespec deadline = host_clock_deadline(WAIT_US);
+    pthread_mutex_lock(&s_link.lock);
+    while (!link_reached(what, target) && pthread_cond_timedwait(&s_link.cond, &s_link.lock, &deadline) == 0)
+    {
+    }
+    bool reached = link_reached(what, target) && (what != WAIT_RECEIVED || s_link.received >= target);
+    pthread_mutex_unlock(&s_link.lock);
+    return reached;
+}
+
+static bool link_send(const icap_turn_t *turn)
+{
+    uint8_t *data = malloc(turn->length);
+    memcpy(data, turn->data, turn->known);
+    memset(data + turn->known, FILL_BYTE, turn->length - turn->known);
+
+    pthread_mutex_lock(&s_link.lock);
+    int client = s_link.client;
+    pthread_mutex_unlock(&s_link.lock);
+    bool sent = client >= 0 && send(client, data, turn->length, MSG_NOSIGNAL) == (ssize_t)turn->length;
+    free(data);
+    return sent;
+}
+
+static bool starts_with(const icap_turn_t *turn, const char *prefix)
+{
+    return turn->known >= strlen(prefix) && memcmp(turn->data, prefix, strlen(prefix)) == 0;
+}
+
+// The flat number of a server capture's call: the frame after "start"
+static bool call_number(const icap_turn_t *turns, size_t count, size_t from, char *number, size_t size)
+{
+    for (size_t i = from; i < count && turns[i].kind != CAPTURE_CLOSE; i++)
+    {
+        if (turns[i].kind == CAPTURE_DEVICE && starts_with(&turns[i], "start"))
+        {
+            size_t len = 0;
+            for (size_t j = strlen("start"); j < turns[i].known && len + 1 < size; j++)
+            {
+                if (turns[i].data[j] >= '0' && turns[i].data[j] <= '9')
+                {
+                    number[len++] = turns[i].data[j];
+                }
+            }
+            number[len] = 0;
+            return len > 0;
+        }
+    }
+    return false;
+}
+
+// The size of the photo the device sent after this turn, from its header
+static void set_photo_size(const icap_turn_t *turns, size_t count, size_t from)
+{
+    for (size_t i = from; i < count; i++)
+    {
+        const icap_turn_t *turn = &turns[i];
+        if (turn->kind == CAPTURE_DEVICE && starts_with(turn, "photo") && turn->known >= strlen("photo") + 4)
+        {
+            const uint8_t *p = turn->data + strlen("photo");
+            uint32_t size = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+            fake_camera_set_frame_size(size & ~PHOTO_RECORDS);
+            return;
+        }
+    }
+}
+
+// Type the number so that '*' goes down at `at_us`
+static void enter_number(const char *number, uint64_t at_us)
+{
+    uint64_t typing_us = strlen(number) * (KEY_HOLD_MS + KEY_GAP_MS) * 1000ull;
+    uint64_t now = host_clock_now_us();
+    if (at_us > now + typing_us)
+    {
+        host_clock_sleep_us(at_us - now - typing_us);
+    }
+    fake_keypad_type(number, KEY_HOLD_MS, KEY_GAP_MS);
+    fake_keypad_press('*');
+    host_clock_sleep_us(KEY_HOLD_MS * 1000);
+    fake_keypad_release();
+}
+
+static void press_cancel(void)
+{
+    fake_keypad_press('#');
+    host_clock_sleep_us(KEY_HOLD_MS * 1000);
+    fake_keypad_release();
+}
+
+static void sleep_until(uint64_t at_us)
+{
+    uint64_t now = host_clock_now_us();
+    if (at_us > now)
+    {
+        host_clock_sleep_us(at_us - now);
+    }
+}
+
+// Drop what comes before the first call: its open, and the number entered
+// for it
+static void trim(const icap_t *capture, icap_t *trimmed)
+{
+    size_t first = capture->count;
+    for (size_t i = 0; i < capture->count && first == capture->count; i++)
+    {
+        if (capture->records[i].kind == CAPTURE_OPEN)
+        {
+            first = i;
+        }
+    }
+    if (first > 0 && first < capture->count && capture->records[first - 1].kind == CAPTURE_EVENT &&
+        strncmp((const char *)capture->records[first - 1].data, "number ", 7) == 0)
+    {
+        first--;
+    }
+
+    *trimmed = (icap_t){.recorder = capture->recorder, .epoch_us = capture->epoch_us};
+    for (size_t i = first; i < capture->count; i++)
+    {
+        const icap_record_t *r = &capture->records[i];
+        icap_add(trimmed, r->kind, r->session, r->time_us, r->data, r->kept, r->length);
+    }
+    if (first > 0)
+    {
+        printf("skipped %zu records before the first call\n", first);
+    }
+}
+
+// Play the server's side of the turns; false if the firmware stopped
+// following them
+static bool play(const icap_t *capture, const icap_turn_t *turns, size_t count)
+{
+    bool by_device = capture->recorder == CAPTURE_BY_DEVICE;
+    uint32_t opened = 0, closed = 0;
+    uint64_t received = 0;
+    // The same moment in the recording and in the replay, to time from
+    uint64_t anchor_recorded = count > 0 ? turns[0].start_us : 0;
+    uint64_t anchor_replay = host_clock_now_us();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const icap_turn_t *turn = &turns[i];
+        uint64_t at_us = anchor_replay + (turn->start_us - anchor_recorded);
+        bool followed = true;
+        bool acted = false;
+
+        switch (turn->kind)
+        {
+        case CAPTURE_OPEN:
+            if (!by_device)
+            {
+                char number[16];
+                if (call_number(turns, count, i, number, sizeof(number)))
+                {
+                    enter_number(number, at_us);
+                }
+            }
+            followed = link_wait(WAIT_OPENED, ++opened);
+            received = 0;
+            break;
+
+        case CAPTURE_CLOSE:
+            followed = link_wait(WAIT_CLOSED, ++closed);
+            break;
+
+        case CAPTURE_DEVICE:
+            if (!by_device && starts_with(turn, "cancel"))
+            {
+                sleep_until(at_us);
+                press_cancel();
+            }
+            received += turn->length;
+            followed = link_wait(WAIT_RECEIVED, received);
+            break;
+
+        case CAPTURE_SERVER:
+            if (starts_with(turn, "photo") && turn->length == strlen("photo"))
+            {
+                set_photo_size(turns, count, i + 1);
+            }
+            sleep_until(at_us);
+            followed = link_send(turn);
+            acted = true;
+            break;
+
+        case CAPTURE_EVENT:
+            if (starts_with(turn, "number "))
+            {
+                enter_number((const char *)turn->data + strlen("number "), at_us);
+                acted = true;
+            }
+            else if (starts_with(turn, "cancel"))
+            {
+                sleep_until(at_us);
+                press_cancel();
+                acted = true;
+            }
+            else
+            {
+                // The device's own doing; its traffic shows it
+                continue;
+            }
+            break;
+        }
+
+        if (!followed)
+        {
+            fprintf(stderr, "turn %zu (%s): the firmware did not follow the capture\n", i + 1,
+                    icap_kind_name(turn->kind));
+            return false;
+        }
+        anchor_recorded = acted ? turn->start_us : turn->end_us;
+        anchor_replay = host_clock_now_us();
+    }
+    return true;
+}
+
+static void *app_task(void *arg)
+{
+    (void)arg;
+    app_main();
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: replay <capture> [time_scale] [out]\n");
+        return 2;
+    }
+    double scale = argc > 2 ? atof(argv[2]) : 1.0;
+    char out_path[4096];
+    snprintf(out_path, sizeof(out_path), "%s%s", argv[argc > 3 ? 3 : 1], argc > 3 ? "" : ".replay");
+
+    icap_t loaded, recorded;
+    if (!icap_load(argv[1], &loaded))
+    {
+        return 1;
+    }
+    trim(&loaded, &recorded);
+    icap_free(&loaded);
+    icap_turn_t *turns;
+    size_t count = icap_turns(&recorded, &turns);
+
+    esp_log_level_set("*", getenv("BENCH_VERBOSE") ? ESP_LOG_INFO : ESP_LOG_NONE);
+    signal(SIGPIPE, SIG_IGN);
+    host_clock_set_scale(scale);
+    host_cond_init(&s_link.cond);
+    fake_keypad_init();
+    if (start_server() != 0)
+    {
+        return 1;
+    }
+    pthread_t app;
+    pthread_create(&app, NULL, app_task, NULL);
+    pthread_detach(app);
+    host_clock_sleep_us(200 * 1000);
+
+    printf("replaying %zu turns of a %s capture at %.1fx\n", count,
+           recorded.recorder == CAPTURE_BY_DEVICE ? "device" : "server", scale);
+    play(&recorded, turns, count);
+    host_clock_sleep_us(SETTLE_US);
+
+    uint8_t *snapshot = malloc(CAPTURE_FILE_HEADER_SIZE + CONFIG_INTERCOM_CAPTURE_SIZE);
+    size_t size = capture_snapshot(snapshot, CAPTURE_FILE_HEADER_SIZE + CONFIG_INTERCOM_CAPTURE_SIZE);
+    icap_t replayed;
+    if (size == 0 || !icap_parse(snapshot, size, &replayed))
+    {
+        fprintf(stderr, "no capture from the firmware\n");
+        return 1;
+    }
+    free(snapshot);
+    icap_save(out_path, &replayed);
+
+    int differing = icap_diff(stdout, &recorded, &replayed);
+    printf("replay capture: %s\n", out_path);
+
+    icap_turns_free(turns, count);
+    icap_free(&recorded);
+    icap_free(&replayed);
+    return differing == 0 ? 0 : 1;
+}
@@ -67,6 +67,9 @@ esp_err_t camera_init()
     config.frame_size = FRAMESIZE_QVGA;
     config.jpeg_quality = 12; // 0-63 lower number means higher quality
     config.fb_count = 1;      // Number of frame buffers
+    // Frames are too large for internal RAM; keep them in PSRAM explicitly
+    config.fb_location = CAMERA_FB_IN_PSRAM;
+    config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
 
     // Initialize the camera
     esp_err_t err = esp_camera_init(&config);
@@ -0,0 +1,275 @@
+#include "capture.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#if CONFIG_INTERCOM_CAPTURE
+
+#define CAPTURE_KEEP 64       // Bytes kept of a longer write, e.g. a photo
+#define CAPTURE_EVENT_MAX 48
+#define CAPTURE_DUMP_LINE 32  // Bytes per "ICAP" line
+#define CAPTURE_EPOCH_MIN 1600000000 // Wall-clock time before this is unset
+
+static const char *TAG = "capture";
+
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static uint8_t s_ring[CONFIG_INTERCOM_CAPTURE_SIZE];
+#else
+static uint8_t *s_ring;
+#endif
+static size_t s_head = 0; // Where the next record goes
+static size_t s_tail = 0; // The oldest record
+static size_t s_used = 0;
+static uint16_t s_session = 0;
+
+// Taken by every task that writes to the channel, and the wait task
+static SemaphoreHandle_t s_lock = NULL;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t s_lock_buffer;
+#endif
+
+static void put_be(uint8_t *p, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        p[i] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+static void ring_put(const void *data, size_t len)
+{
+    size_t first = MIN(len, CONFIG_INTERCOM_CAPTURE_SIZE - s_head);
+    memcpy(s_ring + s_head, data, first);
+    memcpy(s_ring, (const uint8_t *)data + first, len - first);
+    s_head = (s_head + len) % CONFIG_INTERCOM_CAPTURE_SIZE;
+    s_used += len;
+}
+
+static void ring_get(size_t offset, void *out, size_t len)
+{
+    size_t at = (s_tail + offset) % CONFIG_INTERCOM_CAPTURE_SIZE;
+    size_t first = MIN(len, CONFIG_INTERCOM_CAPTURE_SIZE - at);
+    memcpy(out, s_ring + at, first);
+    memcpy((uint8_t *)out + first, s_ring, len - first);
+}
+
+// Drop the oldest records until `len` bytes fit
+static void ring_make_room(size_t len)
+{
+    while (CONFIG_INTERCOM_CAPTURE_SIZE - s_used < len)
+    {
+        uint8_t length[4];
+        ring_get(0, length, sizeof(length));
+        size_t record = CAPTURE_RECORD_HEADER_SIZE +
+                        ((uint32_t)length[0] << 24 | length[1] << 16 | length[2] << 8 | length[3]);
+        s_tail = (s_tail + record) % CONFIG_INTERCOM_CAPTURE_SIZE;
+        s_used -= record;
+    }
+}
+
+// Called with s_lock held
+static void record(capture_kind_t kind, const void *data, size_t len)
+{
+    uint8_t header[CAPTURE_RECORD_HEADER_SIZE + 4];
+    size_t header_len = CAPTURE_RECORD_HEADER_SIZE;
+    size_t keep = len;
+    uint8_t flags = 0;
+    if (len > CAPTURE_KEEP)
+    {
+        keep = CAPTURE_KEEP;
+        flags = CAPTURE_ELIDED;
+        put_be(header + CAPTURE_RECORD_HEADER_SIZE, len, 4);
+        header_len += 4;
+    }
+
+    put_be(header, header_len - CAPTURE_RECORD_HEADER_SIZE + keep, 4);
+    header[4] = kind;
+    header[5] = flags;
+    put_be(header + 6, s_session, 2);
+    put_be(header + 8, esp_timer_get_time(), 8);
+
+    ring_make_room(header_len + keep);
+    ring_put(header, header_len);
+    ring_put(data, keep);
+}
+
+void capture_init(void)
+{
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buffer);
+#else
+    s_ring = malloc(CONFIG_INTERCOM_CAPTURE_SIZE);
+    if (s_ring == NULL)
+    {
+        ESP_LOGE(TAG, "No memory for the capture ring");
+        return;
+    }
+    s_lock = xSemaphoreCreateMutex();
+#endif
+}
+
+void capture_open(const char *peer)
+{
+    if (s_lock == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_session++;
+    record(CAPTURE_OPEN, peer, strlen(peer));
+    xSemaphoreGive(s_lock);
+}
+
+void capture_record(capture_kind_t kind, const void *data, size_t len)
+{
+    if (s_lock == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    record(kind, data, len);
+    xSemaphoreGive(s_lock);
+}
+
+void capture_event(const char *format, ...)
+{
+    if (s_lock == NULL)
+    {
+        return;
+    }
+    char text[CAPTURE_EVENT_MAX];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    capture_record(CAPTURE_EVENT, text, MIN((size_t)MAX(len, 0), sizeof(text) - 1));
+}
+
+static void file_header(uint8_t *header)
+{
+    memcpy(header, CAPTURE_MAGIC, 4);
+    header[4] = CAPTURE_VERSION;
+    header[5] = CAPTURE_BY_DEVICE;
+    header[6] = header[7] = 0;
+
+    // Times are since boot; the wall clock is only known once set by SNTP
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint64_t boot_us = 0;
+    if (now.tv_sec >= CAPTURE_EPOCH_MIN)
+    {
+        boot_us = (uint64_t)now.tv_sec * 1000000 + now.tv_usec - esp_timer_get_time();
+    }
+    put_be(header + 8, boot_us, 8);
+}
+
+size_t capture_snapshot(uint8_t *out, size_t max)
+{
+    if (s_lock == NULL)
+    {
+        return 0;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t size = CAPTURE_FILE_HEADER_SIZE + s_used;
+    if (out != NULL)
+    {
+        if (size <= max)
+        {
+            file_header(out);
+            ring_get(0, out + CAPTURE_FILE_HEADER_SIZE, s_used);
+        }
+        else
+        {
+            size = 0;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return size;
+}
+
+void capture_dump(void)
+{
+    if (s_lock == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t size = CAPTURE_FILE_HEADER_SIZE + s_used;
+    ESP_LOGW(TAG, "ICAP begin %u", (unsigned)size);
+
+    uint8_t header[CAPTURE_FILE_HEADER_SIZE];
+    file_header(header);
+    for (size_t offset = 0; offset < size; offset += CAPTURE_DUMP_LINE)
+    {
+        uint8_t bytes[CAPTURE_DUMP_LINE];
+        size_t len = MIN(size - offset, CAPTURE_DUMP_LINE);
+        for (size_t i = 0; i < len; i++)
+        {
+            size_t at = offset + i;
+            if (at < CAPTURE_FILE_HEADER_SIZE)
+            {
+                bytes[i] = header[at];
+            }
+            else
+            {
+                ring_get(at - CAPTURE_FILE_HEADER_SIZE, &bytes[i], 1);
+            }
+        }
+
+        char hex[2 * CAPTURE_DUMP_LINE + 1];
+        for (size_t i = 0; i < len; i++)
+        {
+            sprintf(hex + 2 * i, "%02x", bytes[i]);
+        }
+        ESP_LOGW(TAG, "ICAP %s", hex);
+    }
+    ESP_LOGW(TAG, "ICAP end");
+    xSemaphoreGive(s_lock);
+}
+
+#else
+
+void capture_init(void)
+{
+}
+
+void capture_open(const char *peer)
+{
+    (void)peer;
+}
+
+void capture_record(capture_kind_t kind, const void *data, size_t len)
+{
+    (void)kind;
+    (void)data;
+    (void)len;
+}
+
+void capture_event(const char *format, ...)
+{
+    (void)format;
+}
+
+size_t capture_snapshot(uint8_t *out, size_t max)
+{
+    (void)out;
+    (void)max;
+    return 0;
+}
+
+void capture_dump(void)
+{
+}
+
+#endif
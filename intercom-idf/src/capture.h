@@ -0,0 +1,77 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Traffic capture (CONFIG_INTERCOM_CAPTURE).
+ *
+ * Every byte on the server channel and the visitor's key presses are kept
+ * in a RAM ring of CONFIG_INTERCOM_CAPTURE_SIZE bytes, oldest records first
+ * to go. When a call loses its channel the ring is printed to the console
+ * ("ICAP" lines, see capture_dump()), and the host tools turn it back into
+ * a capture file to inspect or replay (host/tools/icap.c, replay.c).
+ *
+ * The file format is shared with the server (tgbot/src/capture.ts). All
+ * integers are big-endian.
+ *
+ *   file:   "ICAP", u8 version, u8 recorder (CAPTURE_BY_*), u16 zero,
+ *           u64 wall-clock time of time 0 in us since the epoch, or 0
+ *   record: u32 payload length, u8 kind (capture_kind_t), u8 flags,
+ *           u16 session, u64 time in us, payload
+ *
+ * A session is one channel, from its open record to its close record. With
+ * CAPTURE_ELIDED set the payload is a u32 of the length that was on the
+ * wire followed by its first bytes only; the rest is not kept.
+ *
+ * Without CONFIG_INTERCOM_CAPTURE the functions do nothing.
+ */
+
+#define CAPTURE_MAGIC "ICAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_FILE_HEADER_SIZE 16
+#define CAPTURE_RECORD_HEADER_SIZE 16
+#define CAPTURE_ELIDED 0x01
+
+#define CAPTURE_BY_SERVER 0
+#define CAPTURE_BY_DEVICE 1
+
+typedef enum
+{
+    CAPTURE_OPEN = 1, // Channel opened; the payload names the peer
+    CAPTURE_CLOSE,
+    CAPTURE_DEVICE, // Bytes sent by the device
+    CAPTURE_SERVER, // Bytes sent by the server
+    CAPTURE_EVENT,  // Text, e.g. "number 12" or "door"
+} capture_kind_t;
+
+/**
+ * @brief Set the ring up. Records made before are dropped.
+ */
+void capture_init(void);
+
+/**
+ * @brief Start a new session with an open record.
+ */
+void capture_open(const char *peer);
+
+void capture_record(capture_kind_t kind, const void *data, size_t len);
+
+void capture_event(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief Copy the ring out as a capture file.
+ *
+ * @return Bytes written, or the size needed if `out` is NULL. 0 if `max`
+ * is too small.
+ */
+size_t capture_snapshot(uint8_t *out, size_t max);
+
+/**
+ * @brief Print the ring as a capture file in hex: "ICAP begin <size>", then
+ * "ICAP <hex>" lines, then "ICAP end".
+ */
+void capture_dump(void);
+
+#endif // CAPTURE_H
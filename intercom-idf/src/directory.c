@@ -0,0 +1,161 @@
+#include "directory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "flat_dir.h"
+#include "task_registry.h"
+#include "tcp_client.h"
+
+#define DIRECTORY_FIRST_SYNC_MS 2000
+#define DIRECTORY_CALL_PAUSE_MS 5000 // Polling for the end of a call
+#define DIRECTORY_FRAME_SIZE FLAT_DIR_FRAME_MAX(CONFIG_INTERCOM_DIRECTORY_MAX_FLATS)
+
+static const char *TAG = "directory";
+
+static const char *s_server_ip;
+static uint16_t s_server_port;
+
+static flat_dir_t s_dir;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static uint32_t s_flats[CONFIG_INTERCOM_DIRECTORY_MAX_FLATS];
+static uint8_t s_frame[DIRECTORY_FRAME_SIZE];
+#else
+static uint32_t *s_flats;
+static uint8_t *s_frame;
+#endif
+
+// Held by lookups and while a frame is applied
+static SemaphoreHandle_t s_lock = NULL;
+// Given to cut the wait for the next sync short
+static SemaphoreHandle_t s_sync = NULL;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t s_lock_buffer;
+static StaticSemaphore_t s_sync_buffer;
+#endif
+
+static esp_err_t sync(void)
+{
+    char request[32];
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_dir.valid)
+    {
+        snprintf(request, sizeof(request), "dir %u %u", (unsigned)s_dir.epoch, (unsigned)s_dir.version);
+    }
+    else
+    {
+        strcpy(request, "dir");
+    }
+    xSemaphoreGive(s_lock);
+
+    size_t len;
+    esp_err_t err = tcp_client_request(s_server_ip, s_server_port, request, s_frame, DIRECTORY_FRAME_SIZE, &len);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t version = s_dir.version;
+    err = flat_dir_apply(&s_dir, s_frame, len);
+    if (err == ESP_ERR_INVALID_VERSION)
+    {
+        // A delta for another version, or a frame this firmware can't read:
+        // ask for the whole directory next time
+        s_dir.valid = false;
+    }
+    uint32_t count = s_dir.count;
+    xSemaphoreGive(s_lock);
+
+    if (err == ESP_ERR_NO_MEM)
+    {
+        ESP_LOGW(TAG, "Directory has more than %d flats, not used", CONFIG_INTERCOM_DIRECTORY_MAX_FLATS);
+    }
+    else if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Bad directory frame: 0x%x", err);
+    }
+    else if (s_dir.version != version || len > FLAT_DIR_HEADER_SIZE + 2)
+    {
+        ESP_LOGI(TAG, "Directory version %u, %u flats (%u byte update)", (unsigned)s_dir.version,
+                 (unsigned)count, (unsigned)len);
+    }
+    return err;
+}
+
+static void directory_task(void *arg)
+{
+    (void)arg;
+    vTaskDelay(pdMS_TO_TICKS(DIRECTORY_FIRST_SYNC_MS));
+    while (1)
+    {
+        TickType_t next = pdMS_TO_TICKS(CONFIG_INTERCOM_DIRECTORY_SYNC_INTERVAL_S * 1000ull);
+        esp_err_t err = tcp_client_in_call() ? ESP_ERR_INVALID_STATE : sync();
+        if (err == ESP_ERR_INVALID_STATE)
+        {
+            next = pdMS_TO_TICKS(DIRECTORY_CALL_PAUSE_MS);
+        }
+        xSemaphoreTake(s_sync, next);
+    }
+}
+
+void directory_start(const char *server_ip, uint16_t server_port)
+{
+    s_server_ip = server_ip;
+    s_server_port = server_port;
+
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buffer);
+    s_sync = xSemaphoreCreateBinaryStatic(&s_sync_buffer);
+#else
+    s_flats = malloc(CONFIG_INTERCOM_DIRECTORY_MAX_FLATS * sizeof(uint32_t));
+    s_frame = malloc(DIRECTORY_FRAME_SIZE);
+    if (s_flats == NULL || s_frame == NULL)
+    {
+        ESP_LOGE(TAG, "No memory for the directory");
+        free(s_flats);
+        free(s_frame);
+        return;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    s_sync = xSemaphoreCreateBinary();
+#endif
+    flat_dir_init(&s_dir, s_flats, CONFIG_INTERCOM_DIRECTORY_MAX_FLATS);
+    task_registry_start(TASK_DIRECTORY, directory_task, NULL);
+}
+
+directory_result_t directory_lookup(const char *number)
+{
+    // The server reads the number with Number(); anything past a u32 or
+    // with other characters is left to it
+    size_t len = strlen(number);
+    if (s_lock == NULL || len == 0 || len > 10 || strspn(number, "0123456789") != len)
+    {
+        return DIRECTORY_UNKNOWN;
+    }
+    unsigned long long flat = strtoull(number, NULL, 10);
+    if (flat > UINT32_MAX)
+    {
+        return DIRECTORY_UNKNOWN;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    directory_result_t result = !s_dir.valid                             ? DIRECTORY_UNKNOWN
+                                : flat_dir_contains(&s_dir, (uint32_t)flat) ? DIRECTORY_LISTED
+                                                                            : DIRECTORY_NOT_LISTED;
+    xSemaphoreGive(s_lock);
+    return result;
+}
+
+void directory_sync_now(void)
+{
+    if (s_sync != NULL)
+    {
+        xSemaphoreGive(s_sync);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+
+#include <stdint.h>
+
+typedef enum
+{
+    DIRECTORY_LISTED,     // Registered on the server
+    DIRECTORY_NOT_LISTED, // Not registered; no need to ask the server
+    DIRECTORY_UNKNOWN,    // No directory yet, or not a number it can hold
+} directory_result_t;
+
+/**
+ * @brief Keep a copy of the server's flat directory (see flat_dir.h).
+ *
+ * The whole directory is fetched once, then the changes since the version
+ * held every CONFIG_INTERCOM_DIRECTORY_SYNC_INTERVAL_S, between calls. Up to
+ * CONFIG_INTERCOM_DIRECTORY_MAX_FLATS numbers are kept; a larger directory
+ * is not used and every number goes to the server.
+ *
+ * @param server_ip   Server address, as for tcp_client_connect().
+ * @param server_port Server port.
+ */
+void directory_start(const char *server_ip, uint16_t server_port);
+
+/**
+ * @brief Look up a number as typed on the keypad.
+ */
+directory_result_t directory_lookup(const char *number);
+
+/**
+ * @brief Sync now rather than at the next interval, e.g. after the server
+ * disagreed with the directory.
+ */
+void directory_sync_now(void);
+
+#endif // DIRECTORY_H
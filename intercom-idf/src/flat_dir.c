@@ -0,0 +1,209 @@
+#include "flat_dir.h"
+
+#include <string.h>
+
+typedef struct
+{
+    const uint8_t *p;
+    const uint8_t *end;
+} reader_t;
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static bool read_varint(reader_t *r, uint32_t *value)
+{
+    uint32_t v = 0;
+    for (int shift = 0; shift <= 28; shift += 7)
+    {
+        if (r->p == r->end)
+        {
+            return false;
+        }
+        uint8_t byte = *r->p++;
+        v |= (uint32_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+void flat_dir_init(flat_dir_t *dir, uint32_t *storage, uint32_t capacity)
+{
+    memset(dir, 0, sizeof(*dir));
+    dir->flats = storage;
+    dir->capacity = capacity;
+}
+
+// Index of the first number not below `flat`
+static uint32_t lower_bound(const flat_dir_t *dir, uint32_t flat)
+{
+    uint32_t lo = 0, hi = dir->count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (dir->flats[mid] < flat)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool flat_dir_contains(const flat_dir_t *dir, uint32_t flat)
+{
+    uint32_t i = lower_bound(dir, flat);
+    return i < dir->count && dir->flats[i] == flat;
+}
+
+// Calls `each` for every number of a GAPS list, in ascending order
+static esp_err_t read_gaps(reader_t *r, flat_dir_t *dir, esp_err_t (*each)(flat_dir_t *dir, uint32_t flat))
+{
+    uint32_t count;
+    if (!read_varint(r, &count))
+    {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    uint64_t flat = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t gap;
+        if (!read_varint(r, &gap))
+        {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        flat = i == 0 ? gap : flat + gap + 1;
+        if (flat > UINT32_MAX)
+        {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        esp_err_t err = each(dir, (uint32_t)flat);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t append(flat_dir_t *dir, uint32_t flat)
+{
+    if (dir->count == dir->capacity)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    dir->flats[dir->count++] = flat;
+    return ESP_OK;
+}
+
+static esp_err_t insert(flat_dir_t *dir, uint32_t flat)
+{
+    uint32_t i = lower_bound(dir, flat);
+    if (i < dir->count && dir->flats[i] == flat)
+    {
+        return ESP_OK;
+    }
+    if (dir->count == dir->capacity)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memmove(&dir->flats[i + 1], &dir->flats[i], (dir->count - i) * sizeof(uint32_t));
+    dir->flats[i] = flat;
+    dir->count++;
+    return ESP_OK;
+}
+
+static esp_err_t erase(flat_dir_t *dir, uint32_t flat)
+{
+    uint32_t i = lower_bound(dir, flat);
+    if (i < dir->count && dir->flats[i] == flat)
+    {
+        memmove(&dir->flats[i], &dir->flats[i + 1], (dir->count - i - 1) * sizeof(uint32_t));
+        dir->count--;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t read_bitset(reader_t *r, flat_dir_t *dir)
+{
+    uint32_t first, span;
+    if (!read_varint(r, &first) || !read_varint(r, &span) || (uint64_t)first + span > (uint64_t)UINT32_MAX + 1 ||
+        (size_t)(r->end - r->p) < ((uint64_t)span + 7) / 8)
+    {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    for (uint32_t i = 0; i < span; i++)
+    {
+        if (r->p[i / 8] & (1 << (i % 8)))
+        {
+            esp_err_t err = append(dir, first + i);
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+        }
+    }
+    r->p += ((uint64_t)span + 7) / 8;
+    return ESP_OK;
+}
+
+esp_err_t flat_dir_apply(flat_dir_t *dir, const uint8_t *frame, size_t len)
+{
+    if (len < FLAT_DIR_HEADER_SIZE || memcmp(frame, FLAT_DIR_MAGIC, 4) != 0 || frame[4] != FLAT_DIR_VERSION)
+    {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    flat_dir_kind_t kind = frame[5];
+    flat_dir_encoding_t encoding = frame[6];
+    uint32_t epoch = read_u32(frame + 8);
+    uint32_t version = read_u32(frame + 12);
+    uint32_t base = read_u32(frame + 16);
+    reader_t r = {.p = frame + FLAT_DIR_HEADER_SIZE, .end = frame + len};
+
+    esp_err_t err;
+    if (kind == FLAT_DIR_FULL)
+    {
+        if (encoding != FLAT_DIR_GAPS && encoding != FLAT_DIR_BITSET)
+        {
+            return ESP_ERR_INVALID_VERSION;
+        }
+        dir->count = 0;
+        err = encoding == FLAT_DIR_GAPS ? read_gaps(&r, dir, append) : read_bitset(&r, dir);
+    }
+    else if (kind == FLAT_DIR_DELTA)
+    {
+        if (!dir->valid || epoch != dir->epoch || base != dir->version)
+        {
+            return ESP_ERR_INVALID_VERSION;
+        }
+        err = read_gaps(&r, dir, insert);
+        if (err == ESP_OK)
+        {
+            err = read_gaps(&r, dir, erase);
+        }
+    }
+    else
+    {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    if (err != ESP_OK)
+    {
+        dir->count = 0;
+        dir->valid = false;
+        return err;
+    }
+    dir->valid = true;
+    dir->epoch = epoch;
+    dir->version = version;
+    return ESP_OK;
+}
@@ -0,0 +1,81 @@
+#ifndef FLAT_DIR_H
+#define FLAT_DIR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * The set of flat numbers registered on the server, kept on the device so a
+ * wrong number is turned away without a round trip. The server sends either
+ * the whole set or the changes since the version the device holds.
+ *
+ * Layout, integers big endian:
+ *   "IDIR", u8 version, u8 kind, u8 encoding, u8 reserved, u32 epoch,
+ *   u32 directory version, u32 base version
+ * then for FULL, in the given encoding:
+ *  - GAPS: varint count, then the numbers in ascending order, the first as
+ *    is and each next one as the varint (LEB128) of its distance from the
+ *    previous less one;
+ *  - BITSET: varint first number, varint span, then span bits (LSB first),
+ *    bit i set if first + i is in the set.
+ * DELTA applies to the directory at `base` and lists the numbers added,
+ * then those removed, each as a GAPS list. A delta with nothing in it says
+ * the device is up to date. The epoch changes when the server's history
+ * starts over; a delta only applies within the same epoch.
+ */
+
+#define FLAT_DIR_MAGIC "IDIR"
+#define FLAT_DIR_VERSION 1
+#define FLAT_DIR_HEADER_SIZE 20
+
+// Largest frame for a directory of `flats` numbers: a full GAPS list (the
+// server picks BITSET only when it is smaller, and a full set over a delta
+// that would be larger)
+#define FLAT_DIR_FRAME_MAX(flats) (FLAT_DIR_HEADER_SIZE + 5 + 5 * (flats))
+
+typedef enum
+{
+    FLAT_DIR_FULL = 0,
+    FLAT_DIR_DELTA = 1,
+} flat_dir_kind_t;
+
+typedef enum
+{
+    FLAT_DIR_GAPS = 0,
+    FLAT_DIR_BITSET = 1,
+} flat_dir_encoding_t;
+
+typedef struct
+{
+    uint32_t *flats; // Ascending
+    uint32_t count;
+    uint32_t capacity;
+    bool valid;      // Whether a directory has been received
+    uint32_t epoch;
+    uint32_t version;
+} flat_dir_t;
+
+/**
+ * @brief Start with no directory, storing up to `capacity` numbers.
+ */
+void flat_dir_init(flat_dir_t *dir, uint32_t *storage, uint32_t capacity);
+
+/**
+ * @brief Apply a FULL or DELTA frame.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_VERSION for a frame this decoder can't
+ *         read or a delta against another version, ESP_ERR_NO_MEM if the
+ *         set outgrows the storage, or ESP_ERR_INVALID_RESPONSE for a
+ *         corrupt frame. After an error other than ESP_ERR_INVALID_VERSION
+ *         the directory is dropped (valid is false) and has to be sent whole.
+ */
+esp_err_t flat_dir_apply(flat_dir_t *dir, const uint8_t *frame, size_t len);
+
+/**
+ * @brief Whether `flat` is in the directory. Binary search.
+ */
+bool flat_dir_contains(const flat_dir_t *dir, uint32_t flat);
+
+#endif // FLAT_DIR_H
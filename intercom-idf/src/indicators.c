@@ -1,18 +1,42 @@
 #include <indicators.h>
+#include <task_registry.h>
+#include "esp_sleep.h"
+#include "freertos/semphr.h"
 
 static const char *TAG = "indicators";
 
 gpio_num_t LED_PIN = GPIO_NUM_33;
 
+// Light sleep stops the APB clock, so the flash PWM runs from the 8 MHz
+// RC oscillator, kept on in sleep, at a rate that clock can reach with
+// 8-bit resolution
+#if CONFIG_INTERCOM_POWER_LIGHT_SLEEP
+#define FLASH_PWM_CLK LEDC_USE_RC_FAST_CLK
+#define FLASH_PWM_HZ 20000
+#else
+#define FLASH_PWM_CLK LEDC_AUTO_CLK
+#define FLASH_PWM_HZ 40000
+#endif
+
+// Given when blinking starts; the blinking task sleeps on it otherwise
+static SemaphoreHandle_t s_blink_start = NULL;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t s_blink_start_buffer;
+#endif
+
 void init_flash()
 {
+#if CONFIG_INTERCOM_POWER_LIGHT_SLEEP
+    esp_sleep_pd_config(ESP_PD_DOMAIN_RC_FAST, ESP_PD_OPTION_ON);
+#endif
+
     // Configure the LEDC timer
     ledc_timer_config_t ledc_timer = {
         .duty_resolution = LEDC_TIMER_8_BIT, // Resolution of PWM duty
-        .freq_hz = 40000,                    // Frequency of PWM signal
+        .freq_hz = FLASH_PWM_HZ,             // Frequency of PWM signal
         .speed_mode = LEDC_LOW_SPEED_MODE,   // LEDC speed mode
         .timer_num = LEDC_TIMER_1,           // Timer index
-        .clk_cfg = LEDC_AUTO_CLK             // Auto select the source clock
+        .clk_cfg = FLASH_PWM_CLK             // Source clock
     };
     ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
 
@@ -41,6 +65,8 @@ void init_flash()
 
 bool blinking = false;
 bool showing = false;
+// Set by led_show_async() for the blinking task
+static volatile int s_show_ms = 0;
 
 void led_show(int ms)
 {
@@ -52,38 +78,58 @@ void led_show(int ms)
     showing = false;
 }
 
+void led_show_async(int ms)
+{
+    s_show_ms = ms;
+    xSemaphoreGive(s_blink_start);
+}
+
 void blinking_task()
 {
     int ON = 0;
     while (true)
     {
+        if (s_show_ms > 0)
+        {
+            int ms = s_show_ms;
+            s_show_ms = 0;
+            led_show(ms);
+            continue;
+        }
         if (showing)
         {
-            vTaskDelay(pdMS_TO_TICKS(500));
+            task_registry_delay(TASK_BLINK, pdMS_TO_TICKS(500));
             continue;
         }
         if (!blinking)
         {
             gpio_set_level(LED_PIN, 1);
-            vTaskDelay(pdMS_TO_TICKS(500));
+            // Nothing to do until the next call
+            xSemaphoreTake(s_blink_start, portMAX_DELAY);
             continue;
         }
 
         ON = !ON;
         gpio_set_level(LED_PIN, ON);
-        vTaskDelay(pdMS_TO_TICKS(500));
+        task_registry_delay(TASK_BLINK, pdMS_TO_TICKS(500));
     }
 }
 
 void init_led()
 {
     gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
-    xTaskCreate(blinking_task, "blinking_task", 2048, NULL, 5, NULL);
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    s_blink_start = xSemaphoreCreateBinaryStatic(&s_blink_start_buffer);
+#else
+    s_blink_start = xSemaphoreCreateBinary();
+#endif
+    task_registry_start(TASK_BLINK, blinking_task, NULL);
 }
 
 void led_start_blinking()
 {
     blinking = true;
+    xSemaphoreGive(s_blink_start);
 }
 
 void led_stop_blinking()
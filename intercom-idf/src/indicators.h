@@ -13,6 +13,9 @@ void init_led();
 
 void led_show(int ms);
 
+// led_show() from the blinking task, without blocking the caller
+void led_show_async(int ms);
+
 void led_start_blinking();
 
 void led_stop_blinking();
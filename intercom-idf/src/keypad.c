@@ -4,13 +4,26 @@
 #include "freertos/timers.h"
 #include "driver/gpio.h"
 #include <string.h>
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
 #include "pcf8574.h"
+#include "power.h"
+#include "task_registry.h"
 
-#define KEYPAD_TASK_STACK_SIZE 4096
-#define KEYPAD_TASK_PRIORITY 5
 #define KEYPAD_SCAN_INTERVAL_MS 100 // Scan the keypad every 50 ms
 #define KEYPAD_MAX_BUFFER_SIZE 32   // Maximum number size
+#define KEYPAD_IDLE_PINS 0xF0       // Rows as inputs, every column driven low
+
+// With the PCF8574 INT line wired up the scan task sleeps until a key
+// changes a row input instead of polling the bus
+#if CONFIG_INTERCOM_POWER_SAVE && CONFIG_INTERCOM_KEYPAD_INT_GPIO >= 0
+#define KEYPAD_WAKE_ON_INT 1
+#define KEYPAD_INT_GPIO ((gpio_num_t)CONFIG_INTERCOM_KEYPAD_INT_GPIO)
+#else
+#define KEYPAD_WAKE_ON_INT 0
+#endif
 
 static const char *TAG = "keypad";
 
@@ -31,10 +44,36 @@ static SemaphoreHandle_t s_mutex = NULL;
 
 static bool scan = true;
 
+// Set by the inactivity timer for the scan task, which sends the number:
+// the callback opens the server connection, and the timer service has
+// neither the stack nor the priority for a TLS handshake
+static volatile bool s_entry_due = false;
+
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t s_mutex_buffer;
+static StaticTimer_t s_inactivity_timer_buffer;
+#endif
+
+// Interrupt time of the wake the current scan follows, 0 when not woken
+static int64_t s_woke_us = 0;
+
+#if KEYPAD_WAKE_ON_INT
+static SemaphoreHandle_t s_key_interrupt = NULL;
+static volatile int64_t s_key_interrupt_us = 0;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t s_key_interrupt_buffer;
+#endif
+#endif
+
 // Forward declarations of static functions
 static void keypad_scan_task(void *arg);
 static void keypad_inactivity_timer_callback(TimerHandle_t xTimer);
+static void keypad_finish_number(void);
 static char keypad_get_key_pressed(void);
+#if KEYPAD_WAKE_ON_INT
+static void keypad_interrupt_init(void);
+static void keypad_wait_for_press(void);
+#endif
 
 /**
  * @brief Initialize the keypad module.
@@ -43,6 +82,18 @@ void init_keypad(uint32_t inactivity_timeout_ms)
 {
     s_inactivity_timeout_ms = inactivity_timeout_ms;
 
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    // Create a mutex for shared resources
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+
+    // Create inactivity timer
+    s_inactivity_timer = xTimerCreateStatic("keypad_inactivity_timer",
+                                            pdMS_TO_TICKS(s_inactivity_timeout_ms),
+                                            pdFALSE,
+                                            NULL,
+                                            keypad_inactivity_timer_callback,
+                                            &s_inactivity_timer_buffer);
+#else
     // Create a mutex for shared resources
     s_mutex = xSemaphoreCreateMutex();
 
@@ -52,9 +103,14 @@ void init_keypad(uint32_t inactivity_timeout_ms)
                                       pdFALSE,
                                       NULL,
                                       keypad_inactivity_timer_callback);
+#endif
+
+#if KEYPAD_WAKE_ON_INT
+    keypad_interrupt_init();
+#endif
 
     // Create keypad scanning task
-    xTaskCreate(keypad_scan_task, "keypad_scan_task", KEYPAD_TASK_STACK_SIZE, NULL, KEYPAD_TASK_PRIORITY, NULL);
+    task_registry_start(TASK_KEYPAD, keypad_scan_task, NULL);
 
     ESP_LOGI(TAG, "Keypad initialized");
 }
@@ -78,22 +134,34 @@ void keypad_register_cancel_callback(keypad_cancel_callback_t callback)
 /**
  * @brief Inactivity timer callback function.
  *
- * This function is called when the inactivity timer expires.
+ * This function is called when the inactivity timer expires. It only
+ * hands the number to the scan task, waking it if it sleeps on INT; a
+ * polling scan picks it up within KEYPAD_SCAN_INTERVAL_MS.
  */
 static void keypad_inactivity_timer_callback(TimerHandle_t xTimer)
 {
-    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    (void)xTimer;
+    s_entry_due = true;
+#if KEYPAD_WAKE_ON_INT
+    xSemaphoreGive(s_key_interrupt);
+#endif
+}
+
+/**
+ * @brief Pass the digits entered so far to the number entry callback and
+ * clear them. Called with s_mutex held.
+ */
+static void keypad_finish_number(void)
+{
     if (s_number_index > 0)
     {
-        // Inactivity timeout occurred, trigger number entry callback if set
+        s_number_buffer[s_number_index] = '\0'; // Null-terminate the string
         if (s_number_entry_callback)
         {
-            s_number_buffer[s_number_index] = '\0'; // Null-terminate the string
             s_number_entry_callback(s_number_buffer);
         }
         s_number_index = 0; // Reset the buffer
     }
-    xSemaphoreGive(s_mutex);
 }
 
 /**
@@ -103,13 +171,24 @@ static void keypad_inactivity_timer_callback(TimerHandle_t xTimer)
  */
 static void keypad_scan_task(void *arg)
 {
+    (void)arg;
     while (1)
     {
+        if (s_entry_due)
+        {
+            // Inactivity timeout occurred
+            s_entry_due = false;
+            xSemaphoreTake(s_mutex, portMAX_DELAY);
+            keypad_finish_number();
+            xSemaphoreGive(s_mutex);
+        }
+
         char key = keypad_get_key_pressed();
+        s_woke_us = 0;
 
         if (!scan && key != '#')
         {
-            vTaskDelay(pdMS_TO_TICKS(200));
+            task_registry_delay(TASK_KEYPAD, pdMS_TO_TICKS(200));
             continue;
         }
 
@@ -132,15 +211,7 @@ static void keypad_scan_task(void *arg)
             else if (key == '*')
             {
                 // Number entry completion
-                if (s_number_index > 0)
-                {
-                    s_number_buffer[s_number_index] = '\0'; // Null-terminate the string
-                    if (s_number_entry_callback)
-                    {
-                        s_number_entry_callback(s_number_buffer);
-                    }
-                    s_number_index = 0; // Reset the buffer
-                }
+                keypad_finish_number();
             }
             else if (key >= '0' && key <= '9')
             {
@@ -165,16 +236,91 @@ static void keypad_scan_task(void *arg)
             xSemaphoreGive(s_mutex);
 
             // Debounce delay
-            vTaskDelay(pdMS_TO_TICKS(200)); // Wait 200 ms before scanning again
+            task_registry_delay(TASK_KEYPAD, pdMS_TO_TICKS(200)); // Wait 200 ms before scanning again
         }
         else
         {
+#if KEYPAD_WAKE_ON_INT
+            keypad_wait_for_press();
+#else
             // No key pressed, scan at regular interval
-            vTaskDelay(pdMS_TO_TICKS(KEYPAD_SCAN_INTERVAL_MS));
+            task_registry_delay(TASK_KEYPAD, pdMS_TO_TICKS(KEYPAD_SCAN_INTERVAL_MS));
+#endif
         }
     }
 }
 
+#if KEYPAD_WAKE_ON_INT
+/**
+ * @brief PCF8574 INT ISR.
+ *
+ * INT stays low until the port is read, so the interrupt is level
+ * triggered (as light sleep wake-up requires) and disabled here until the
+ * scan task arms it again.
+ */
+static void IRAM_ATTR keypad_interrupt_handler(void *arg)
+{
+    (void)arg;
+    gpio_intr_disable(KEYPAD_INT_GPIO);
+    s_key_interrupt_us = esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(s_key_interrupt, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void keypad_interrupt_init(void)
+{
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    s_key_interrupt = xSemaphoreCreateBinaryStatic(&s_key_interrupt_buffer);
+#else
+    s_key_interrupt = xSemaphoreCreateBinary();
+#endif
+
+    // INT is open drain
+    gpio_config_t config = {
+        .pin_bit_mask = 1ULL << KEYPAD_INT_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .intr_type = GPIO_INTR_LOW_LEVEL,
+    };
+    ESP_ERROR_CHECK(gpio_config(&config));
+    gpio_intr_disable(KEYPAD_INT_GPIO);
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    {
+        ESP_ERROR_CHECK(err);
+    }
+    ESP_ERROR_CHECK(gpio_isr_handler_add(KEYPAD_INT_GPIO, keypad_interrupt_handler, NULL));
+    ESP_ERROR_CHECK(gpio_wakeup_enable(KEYPAD_INT_GPIO, GPIO_INTR_LOW_LEVEL));
+    ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+}
+
+/**
+ * @brief Block until a key goes down or the inactivity timer expires.
+ *
+ * With every column low a pressed key pulls its row low, which the PCF8574
+ * reports on INT. Reading the port clears INT; a key already held returns
+ * at once.
+ */
+static void keypad_wait_for_press(void)
+{
+    write_pcf8574(KEYPAD_IDLE_PINS);
+    if ((read_pcf8574() & 0xF0) != 0xF0)
+    {
+        return;
+    }
+    gpio_intr_enable(KEYPAD_INT_GPIO);
+    xSemaphoreTake(s_key_interrupt, portMAX_DELAY);
+    if (s_entry_due)
+    {
+        // The inactivity timer, not a key
+        return;
+    }
+    s_woke_us = s_key_interrupt_us;
+    power_key_wake();
+}
+#endif
+
 /**
  * @brief Scan the keypad and return the key that is pressed.
  *
@@ -214,6 +360,7 @@ static char keypad_get_key_pressed(void)
                 data = read_pcf8574() & 0xF0;
                 if (!(data & (1 << (row + 4))))
                 {
+                    power_key_decoded(s_woke_us);
                     // Wait until key is released
                     while (!(read_pcf8574() & (1 << (row + 4))))
                     {
@@ -4,14 +4,40 @@
 #include <keypad.h>
 #include <cam.h>
 #include <pcf8574.h>
+#include <mem_report.h>
+#include <task_registry.h>
+#include <power.h>
+#include <directory.h>
+#include <ota.h>
+#include <capture.h>
 #include <soc/gpio_periph.h>
 
+#ifndef INTERCOM_SERVER_IP
+#define INTERCOM_SERVER_IP "89.169.155.3"
+#endif
+
+#ifndef INTERCOM_SERVER_PORT
+#define INTERCOM_SERVER_PORT 3001
+#endif
+
 const char *TAG = "APP_MAIN";
 
-void number_callback(char *s)
+void number_callback(const char *s)
 {
     ESP_LOGE(TAG, "%s", s);
-    esp_err_t ret = tcp_client_connect("89.169.155.3", 3001);
+    capture_event("number %s", s);
+#if CONFIG_INTERCOM_DIRECTORY
+    // Turned away here, with the same feedback as the server's not_found;
+    // the keypad stays free meanwhile, as it does for that
+    if (directory_lookup(s) == DIRECTORY_NOT_LISTED)
+    {
+        ESP_LOGI(TAG, "Flat %s is not in the directory", s);
+        capture_event("not listed");
+        led_show_async(3000);
+        return;
+    }
+#endif
+    esp_err_t ret = tcp_client_connect(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT);
     if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to initialize TCP client");
@@ -26,37 +52,43 @@ void number_callback(char *s)
 
 void cancel_callback()
 {
+    capture_event("cancel");
     led_stop_blinking();
     tcp_client_send_string("cancel");
     vTaskDelay(pdMS_TO_TICKS(500));
     tcp_client_send_string("\n");
-    tcp_client_disconnect();
+    tcp_client_end_session();
 }
 
-void photo_command(char *cmd)
+void photo_command(const char *cmd)
 {
+    (void)cmd;
     tcp_client_send_string("photo");
     vTaskDelay(pdMS_TO_TICKS(500));
     tcp_client_send_photo();
     tcp_client_wait_for_msg();
 }
 
-void reject_command(char *cmd)
+void reject_command(const char *cmd)
 {
+    (void)cmd;
+    capture_event("rejected");
     tcp_client_send_string("reject_ok");
     vTaskDelay(pdMS_TO_TICKS(500));
     tcp_client_send_string("\n");
-    tcp_client_disconnect();
+    tcp_client_end_session();
     led_stop_blinking();
     led_show(3000);
 }
 
-void accept_command(char *cmd)
+void accept_command(const char *cmd)
 {
+    (void)cmd;
+    capture_event("door");
     tcp_client_send_string("accept_ok");
     vTaskDelay(pdMS_TO_TICKS(500));
     tcp_client_send_string("\n");
-    tcp_client_disconnect();
+    tcp_client_end_session();
 
     led_stop_blinking();
 
@@ -65,18 +97,32 @@ void accept_command(char *cmd)
     gpio_set_level(GPIO_NUM_1, 1);
 }
 
-void not_found_command(char *cmd)
+void not_found_command(const char *cmd)
 {
-    tcp_client_disconnect();
+    (void)cmd;
+    capture_event("not found");
+    tcp_client_end_session();
+#if CONFIG_INTERCOM_DIRECTORY
+    // If the directory listed the flat, it is out of date
+    directory_sync_now();
+#endif
     led_stop_blinking();
     led_show(3000);
 }
 
+// Also when the channel is lost mid-call and the call is over
+void disconnect_callback()
+{
+    led_stop_blinking();
+}
+
 void app_main()
 {
     const char *ssid = "Dima";
     const char *password = "bebriksex";
+    capture_init();
     wifi_init_sta(ssid, password);
+    power_init();
     i2c_master_init();
 
     camera_init();
@@ -91,11 +137,24 @@ void app_main()
     tcp_client_register_command_callback("photo", *photo_command);
     tcp_client_register_command_callback("reject", *reject_command);
     tcp_client_register_command_callback("not_found", *not_found_command);
+    tcp_client_register_disconnect_callback(*disconnect_callback);
 
     PIN_FUNC_SELECT(GPIO_PIN_MUX_REG[1], PIN_FUNC_GPIO);
     gpio_set_direction(GPIO_NUM_1, GPIO_MODE_OUTPUT);
     gpio_set_level(GPIO_NUM_1, 1);
 
+    mem_report_start();
+    task_registry_report_start();
+    power_report_start();
+
+#if CONFIG_INTERCOM_DIRECTORY
+    directory_start(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT);
+#endif
+
+#if CONFIG_INTERCOM_OTA
+    ota_start(INTERCOM_SERVER_IP, INTERCOM_SERVER_PORT);
+#endif
+
     while (1)
     {
         vTaskDelay(portMAX_DELAY);
@@ -0,0 +1,47 @@
+#include "mem_report.h"
+
+#include "freertos/timers.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "task_registry.h"
+
+#define MEM_REPORT_MAX_TASKS 8
+
+static const char *TAG = "mem_report";
+
+static TaskHandle_t s_tasks[MEM_REPORT_MAX_TASKS];
+static int s_task_count = 0;
+
+void mem_report_register_task(TaskHandle_t task)
+{
+    if (task == NULL || s_task_count >= MEM_REPORT_MAX_TASKS)
+    {
+        return;
+    }
+    s_tasks[s_task_count++] = task;
+}
+
+void mem_report_log(void)
+{
+    ESP_LOGI(TAG, "internal: free %u, min free %u, largest block %u",
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    ESP_LOGI(TAG, "psram: free %u, min free %u",
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+             (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+
+    for (int i = 0; i < s_task_count; i++)
+    {
+        ESP_LOGI(TAG, "stack %-24s %u bytes unused", pcTaskGetName(s_tasks[i]),
+                 (unsigned)uxTaskGetStackHighWaterMark(s_tasks[i]));
+    }
+}
+
+void mem_report_start(void)
+{
+    // The timer service task runs the keypad inactivity timer
+    mem_report_register_task(xTimerGetTimerDaemonTaskHandle());
+    mem_report_log();
+    task_registry_report_every(mem_report_log, CONFIG_INTERCOM_MEM_REPORT_INTERVAL_MS);
+}
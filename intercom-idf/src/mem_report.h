@@ -0,0 +1,29 @@
+#ifndef MEM_REPORT_H
+#define MEM_REPORT_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @brief Add a task to the stack high-water-mark report.
+ *
+ * Up to 8 tasks can be tracked; further registrations are ignored.
+ *
+ * @param task Handle of the task to track.
+ */
+void mem_report_register_task(TaskHandle_t task);
+
+/**
+ * @brief Log free/minimum-free heap for internal RAM and PSRAM and the stack
+ * high-water mark of every registered task.
+ */
+void mem_report_log(void);
+
+/**
+ * @brief Print the boot report and start the periodic one.
+ *
+ * The period is CONFIG_INTERCOM_MEM_REPORT_INTERVAL_MS; 0 disables it.
+ */
+void mem_report_start(void);
+
+#endif // MEM_REPORT_H
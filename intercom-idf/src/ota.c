@@ -0,0 +1,450 @@
+#include "ota.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_app_desc.h"
+#include "esp_camera.h"
+#include "esp_image_format.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+#include "nvs.h"
+#include "ota_patch.h"
+#include "task_registry.h"
+#include "tcp_client.h"
+
+#define OTA_FIRST_CHECK_MS 10000
+#define OTA_RETRY_MS (60 * 1000)      // After a download was cut short
+#define OTA_CALL_PAUSE_MS 5000        // Polling for the end of a call
+#define OTA_SELFTEST_RETRY_MS 2000
+#define OTA_NAME_MAX 48
+#define OTA_NVS_NAMESPACE "ota"
+#define CHECKPOINT_BYTES (64 * 1024)  // Image bytes written between saved checkpoints
+#define SECTOR_SIZE 4096
+
+static const char *TAG = "ota";
+
+static const char *s_server_ip;
+static uint16_t s_server_port;
+
+static const esp_partition_t *s_running;
+static const esp_partition_t *s_update;
+// The running image, which deltas are built against
+static uint32_t s_running_size;
+static uint8_t s_running_sha256[32];
+// Update partition bytes erased so far; writes only go to erased sectors
+static uint32_t s_erased_to;
+
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static uint8_t s_chunk[CONFIG_INTERCOM_OTA_CHUNK_SIZE];
+// What restore_sector keeps of a partly written sector
+static uint8_t s_sector[SECTOR_SIZE];
+#else
+static uint8_t *s_chunk;
+#endif
+
+static esp_err_t read_old(void *ctx, uint32_t offset, uint8_t *buf, size_t len)
+{
+    return esp_partition_read(s_running, offset, buf, len);
+}
+
+static esp_err_t read_out(void *ctx, uint32_t offset, uint8_t *buf, size_t len)
+{
+    return esp_partition_read(s_update, offset, buf, len);
+}
+
+static esp_err_t write_out(void *ctx, uint32_t offset, const uint8_t *buf, size_t len)
+{
+    if (offset + len > s_update->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    while (offset + len > s_erased_to)
+    {
+        esp_err_t err = esp_partition_erase_range(s_update, s_erased_to, SECTOR_SIZE);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        s_erased_to += SECTOR_SIZE;
+    }
+    return esp_partition_write(s_update, offset, buf, len);
+}
+
+static esp_err_t hash_partition(const esp_partition_t *partition, uint32_t len, uint8_t sha256[32])
+{
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    esp_err_t err = ESP_OK;
+    for (uint32_t offset = 0; offset < len && err == ESP_OK;)
+    {
+        size_t n = MIN(CONFIG_INTERCOM_OTA_CHUNK_SIZE, len - offset);
+        err = esp_partition_read(partition, offset, s_chunk, n);
+        mbedtls_sha256_update(&sha, s_chunk, n);
+        offset += n;
+    }
+    mbedtls_sha256_finish(&sha, sha256);
+    mbedtls_sha256_free(&sha);
+    return err;
+}
+
+// The image is as long as the .bin it was flashed from; the rest of the
+// partition is left over from whatever was there before
+static esp_err_t hash_running_image(void)
+{
+    esp_partition_pos_t pos = {.offset = s_running->address, .size = s_running->size};
+    esp_image_metadata_t metadata;
+    esp_err_t err = esp_image_get_metadata(&pos, &metadata);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    s_running_size = metadata.image_len;
+    return hash_partition(s_running, s_running_size, s_running_sha256);
+}
+
+// Checkpoints are saved in NVS with the name of the patch they belong to
+static bool progress_load(const char *name, ota_patch_checkpoint_t *checkpoint)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+    {
+        return false;
+    }
+    char saved[OTA_NAME_MAX];
+    size_t len = sizeof(saved);
+    bool ok = nvs_get_str(nvs, "name", saved, &len) == ESP_OK && strcmp(saved, name) == 0 &&
+              nvs_get_u32(nvs, "in", &checkpoint->in) == ESP_OK && nvs_get_u32(nvs, "out", &checkpoint->out) == ESP_OK &&
+              nvs_get_u32(nvs, "old", &checkpoint->old) == ESP_OK;
+    nvs_close(nvs);
+    return ok;
+}
+
+static void progress_save(const char *name, const ota_patch_checkpoint_t *checkpoint)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        return;
+    }
+    nvs_set_str(nvs, "name", name);
+    nvs_set_u32(nvs, "in", checkpoint->in);
+    nvs_set_u32(nvs, "out", checkpoint->out);
+    nvs_set_u32(nvs, "old", checkpoint->old);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+static void progress_clear(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK)
+    {
+        nvs_erase_all(nvs);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+}
+
+// The sector holding the checkpoint may have been written past it; keep
+// what comes before and erase the rest so it can be written again
+static esp_err_t restore_sector(uint32_t out)
+{
+    uint32_t sector = out - out % SECTOR_SIZE;
+    s_erased_to = sector;
+    if (out == sector)
+    {
+        return ESP_OK;
+    }
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    uint8_t *prefix = s_sector;
+#else
+    uint8_t *prefix = malloc(out - sector);
+    if (prefix == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    esp_err_t err = esp_partition_read(s_update, sector, prefix, out - sector);
+    if (err == ESP_OK)
+    {
+        err = write_out(NULL, sector, prefix, out - sector);
+    }
+#if !CONFIG_INTERCOM_STATIC_ALLOC
+    free(prefix);
+#endif
+    return err;
+}
+
+// Ask the server for firmware to replace this image; ESP_ERR_NOT_FOUND if
+// it has none
+static esp_err_t check(char *name, uint32_t *patch_size)
+{
+    char request[128];
+    int len = snprintf(request, sizeof(request), "ota %s ", esp_app_get_description()->version);
+    for (int i = 0; i < 32 && len < sizeof(request) - 2; i++)
+    {
+        len += snprintf(request + len, sizeof(request) - len, "%02x", s_running_sha256[i]);
+    }
+
+    size_t reply_len;
+    esp_err_t err = tcp_client_request(s_server_ip, s_server_port, request, s_chunk,
+                                       CONFIG_INTERCOM_OTA_CHUNK_SIZE - 1, &reply_len);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    s_chunk[reply_len] = 0;
+    if (strcmp((char *)s_chunk, "none") == 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    unsigned size;
+    if (sscanf((char *)s_chunk, "%47s %u", name, &size) != 2)
+    {
+        ESP_LOGE(TAG, "Bad update reply: %s", (char *)s_chunk);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    *patch_size = size;
+    return ESP_OK;
+}
+
+// Fetch patch bytes into s_chunk, waiting for calls in progress to end
+static esp_err_t fetch(const char *name, uint32_t offset, size_t len, size_t *received)
+{
+    char request[OTA_NAME_MAX + 32];
+    snprintf(request, sizeof(request), "ota_chunk %s %u %u", name, (unsigned)offset, (unsigned)len);
+    esp_err_t err;
+    while ((err = tcp_client_request(s_server_ip, s_server_port, request, s_chunk, len, received)) ==
+           ESP_ERR_INVALID_STATE)
+    {
+        vTaskDelay(pdMS_TO_TICKS(OTA_CALL_PAUSE_MS));
+    }
+    if (err == ESP_OK && *received == 0)
+    {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    return err;
+}
+
+// Runs before anything is written, so a patch for an image that can't be
+// used never erases the slot
+static esp_err_t check_header(const ota_patch_header_t *header)
+{
+    s_update = esp_ota_get_next_update_partition(NULL);
+    if (s_update == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (header->image_size > s_update->size)
+    {
+        ESP_LOGE(TAG, "Image of %u bytes does not fit the %u byte partition %s", (unsigned)header->image_size,
+                 (unsigned)s_update->size, s_update->label);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if ((header->flags & OTA_PATCH_FLAG_DELTA) &&
+        (header->base_size != s_running_size || memcmp(header->base_sha256, s_running_sha256, 32) != 0))
+    {
+        ESP_LOGE(TAG, "Delta was built against another image");
+        return ESP_ERR_INVALID_VERSION;
+    }
+    return ESP_OK;
+}
+
+// Download and apply the patch, carrying on from a saved checkpoint if
+// there is one. Errors other than a lost connection mean the patch can't be
+// used and its progress is dropped.
+static esp_err_t download(const char *name, uint32_t patch_size)
+{
+    ota_patch_io_t io = {.read_old = read_old, .read_out = read_out, .write = write_out};
+    ota_patch_t patch;
+    ota_patch_init(&patch, &io);
+
+    size_t len;
+    esp_err_t err = fetch(name, 0, OTA_PATCH_HEADER_SIZE, &len);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (len != OTA_PATCH_HEADER_SIZE || (err = ota_patch_feed(&patch, s_chunk, len)) != ESP_OK ||
+        (err = check_header(&patch.header)) != ESP_OK)
+    {
+        goto invalid;
+    }
+
+    ota_patch_checkpoint_t checkpoint;
+    if (progress_load(name, &checkpoint) && ota_patch_restore(&patch, &checkpoint) == ESP_OK &&
+        restore_sector(checkpoint.out) == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Resuming %s at %u of %u bytes", name, (unsigned)checkpoint.in, (unsigned)patch_size);
+    }
+    else
+    {
+        ota_patch_init(&patch, &io);
+        ota_patch_feed(&patch, s_chunk, OTA_PATCH_HEADER_SIZE);
+        s_erased_to = 0;
+        ESP_LOGI(TAG, "Downloading %s, %u bytes for a %u byte image", name, (unsigned)patch_size,
+                 (unsigned)patch.header.image_size);
+    }
+
+    int64_t started = esp_timer_get_time();
+    uint32_t offset = patch.in;
+    uint32_t saved_out = patch.out;
+    while (!ota_patch_done(&patch))
+    {
+        if (offset >= patch_size)
+        {
+            err = ESP_ERR_INVALID_SIZE;
+            goto invalid;
+        }
+        err = fetch(name, offset, MIN(CONFIG_INTERCOM_OTA_CHUNK_SIZE, patch_size - offset), &len);
+        if (err != ESP_OK)
+        {
+            progress_save(name, &patch.checkpoint);
+            return err;
+        }
+        if ((err = ota_patch_feed(&patch, s_chunk, len)) != ESP_OK)
+        {
+            goto invalid;
+        }
+        offset += len;
+
+        if (patch.checkpoint.out - saved_out >= CHECKPOINT_BYTES)
+        {
+            progress_save(name, &patch.checkpoint);
+            saved_out = patch.checkpoint.out;
+        }
+        // Leave the air and the flash to the rest of the firmware
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_INTERCOM_OTA_CHUNK_INTERVAL_MS));
+    }
+
+    uint8_t sha256[32];
+    if ((err = hash_partition(s_update, patch.header.image_size, sha256)) != ESP_OK)
+    {
+        goto invalid;
+    }
+    if (memcmp(sha256, patch.header.image_sha256, 32) != 0)
+    {
+        ESP_LOGE(TAG, "Image hash mismatch");
+        err = ESP_ERR_INVALID_CRC;
+        goto invalid;
+    }
+    ESP_LOGI(TAG, "Image written and verified in %lld ms", (long long)(esp_timer_get_time() - started) / 1000);
+    progress_clear();
+    // Validates the image, and with CONFIG_SECURE_SIGNED_ON_UPDATE checks
+    // its signature, before the bootloader is pointed at it
+    if ((err = esp_ota_set_boot_partition(s_update)) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Update %s rejected: %s", name, esp_err_to_name(err));
+    }
+    return err;
+
+invalid:
+    ESP_LOGE(TAG, "Update %s failed: %s", name, esp_err_to_name(err));
+    progress_clear();
+    return err;
+}
+
+// A new image proves itself by bringing the camera up and reaching the
+// server; otherwise the bootloader goes back to the previous one
+static void confirm_image(void)
+{
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(s_running, &state) != ESP_OK || state != ESP_OTA_IMG_PENDING_VERIFY)
+    {
+        return;
+    }
+    ESP_LOGI(TAG, "First boot of this image, running self-test");
+
+    int64_t deadline = esp_timer_get_time() + (int64_t)CONFIG_INTERCOM_OTA_SELFTEST_TIMEOUT_MS * 1000;
+    char name[OTA_NAME_MAX];
+    uint32_t size;
+    while (esp_timer_get_time() < deadline)
+    {
+        esp_err_t err = check(name, &size);
+        if (esp_camera_sensor_get() != NULL && (err == ESP_OK || err == ESP_ERR_NOT_FOUND))
+        {
+            ESP_LOGI(TAG, "Self-test passed");
+            esp_ota_mark_app_valid_cancel_rollback();
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(OTA_SELFTEST_RETRY_MS));
+    }
+    ESP_LOGE(TAG, "Self-test failed, rolling back");
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+static void ota_task(void *arg)
+{
+    if (hash_running_image() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cannot read the running image, updates disabled");
+        vTaskDelete(NULL);
+        return;
+    }
+    confirm_image();
+    vTaskDelay(pdMS_TO_TICKS(OTA_FIRST_CHECK_MS));
+
+    char name[OTA_NAME_MAX];
+    uint32_t patch_size;
+    while (1)
+    {
+        TickType_t next = pdMS_TO_TICKS(CONFIG_INTERCOM_OTA_CHECK_INTERVAL_S * 1000ull);
+        esp_err_t err = tcp_client_in_call() ? ESP_ERR_INVALID_STATE : check(name, &patch_size);
+        if (err == ESP_OK)
+        {
+            err = download(name, patch_size);
+            if (err == ESP_OK)
+            {
+                while (tcp_client_in_call())
+                {
+                    vTaskDelay(pdMS_TO_TICKS(OTA_CALL_PAUSE_MS));
+                }
+                ESP_LOGI(TAG, "Restarting into the new image");
+                esp_restart();
+            }
+            next = pdMS_TO_TICKS(OTA_RETRY_MS);
+        }
+        else if (err == ESP_ERR_INVALID_STATE)
+        {
+            next = pdMS_TO_TICKS(OTA_CALL_PAUSE_MS);
+        }
+        vTaskDelay(next);
+    }
+}
+
+void ota_start(const char *server_ip, uint16_t server_port)
+{
+    s_server_ip = server_ip;
+    s_server_port = server_port;
+    s_running = esp_ota_get_running_partition();
+    s_update = esp_ota_get_next_update_partition(NULL);
+    if (s_update == NULL)
+    {
+        ESP_LOGW(TAG, "No OTA partition to update into");
+        return;
+    }
+
+#if !CONFIG_INTERCOM_STATIC_ALLOC
+    s_chunk = malloc(CONFIG_INTERCOM_OTA_CHUNK_SIZE);
+    if (s_chunk == NULL)
+    {
+        ESP_LOGE(TAG, "No memory for the download buffer");
+        return;
+    }
+#endif
+#if !CONFIG_SECURE_SIGNED_ON_UPDATE
+    ESP_LOGW(TAG, "Images are not signed, updates are trusted on the server's key alone");
+#endif
+    // Lowest priority and on core 0, away from the keypad and relay
+    task_registry_start(TASK_OTA, ota_task, NULL);
+}
@@ -0,0 +1,23 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include <stdint.h>
+
+/**
+ * @brief Start firmware updates from the server.
+ *
+ * An image booting for the first time after an update is confirmed once the
+ * camera is up and the server answers, or rolled back to the previous one
+ * after CONFIG_INTERCOM_OTA_SELFTEST_TIMEOUT_MS. After that the server is
+ * asked for new firmware every CONFIG_INTERCOM_OTA_CHECK_INTERVAL_S. Updates
+ * are patches (see ota_patch.h) streamed into the other OTA partition in
+ * CONFIG_INTERCOM_OTA_CHUNK_SIZE requests, only while no call is in
+ * progress, and carry on from the last checkpoint after a disconnect or
+ * reboot. The device restarts into the new image once its SHA-256 matches.
+ *
+ * @param server_ip   Server address, as for tcp_client_connect().
+ * @param server_port Server port.
+ */
+void ota_start(const char *server_ip, uint16_t server_port);
+
+#endif // OTA_H
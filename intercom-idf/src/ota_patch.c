@@ -0,0 +1,251 @@
+#include "ota_patch.h"
+
+#include <string.h>
+
+#define COPY_BUFFER_SIZE 512
+
+enum
+{
+    STATE_HEADER,
+    STATE_OP,
+    STATE_ARG,
+    STATE_ADD,
+    STATE_DONE,
+};
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+void ota_patch_init(ota_patch_t *patch, const ota_patch_io_t *io)
+{
+    memset(patch, 0, sizeof(*patch));
+    patch->io = *io;
+    patch->state = STATE_HEADER;
+}
+
+bool ota_patch_has_header(const ota_patch_t *patch)
+{
+    return patch->state != STATE_HEADER;
+}
+
+bool ota_patch_done(const ota_patch_t *patch)
+{
+    return patch->state == STATE_DONE;
+}
+
+static esp_err_t parse_header(ota_patch_t *patch)
+{
+    const uint8_t *p = patch->header_buf;
+    if (memcmp(p, OTA_PATCH_MAGIC, 4) != 0 || p[4] != OTA_PATCH_VERSION)
+    {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    patch->header.flags = p[5];
+    patch->header.image_size = read_u32(p + 8);
+    memcpy(patch->header.image_sha256, p + 12, 32);
+    memcpy(patch->header.base_sha256, p + 44, 32);
+    patch->header.base_size = read_u32(p + 76);
+    return ESP_OK;
+}
+
+static void commit(ota_patch_t *patch)
+{
+    patch->checkpoint.in = patch->in;
+    patch->checkpoint.out = patch->out;
+    patch->checkpoint.old = patch->old;
+    patch->state = STATE_OP;
+    patch->varint = 0;
+    patch->varint_shift = 0;
+}
+
+// Accumulate one varint byte; true once the varint is complete
+static bool varint_byte(ota_patch_t *patch, uint8_t byte, esp_err_t *err)
+{
+    // 32 bits take five bytes, the fifth carrying only the top four
+    if (patch->varint_shift > 28 || (patch->varint_shift == 28 && (byte & 0x70)))
+    {
+        *err = ESP_ERR_INVALID_RESPONSE;
+        return false;
+    }
+    patch->varint |= (uint32_t)(byte & 0x7f) << patch->varint_shift;
+    patch->varint_shift += 7;
+    return (byte & 0x80) == 0;
+}
+
+static esp_err_t copy_old(ota_patch_t *patch, uint32_t offset)
+{
+    uint8_t buf[COPY_BUFFER_SIZE];
+    for (uint32_t done = 0; done < patch->len;)
+    {
+        size_t n = patch->len - done < sizeof(buf) ? patch->len - done : sizeof(buf);
+        esp_err_t err = patch->io.read_old(patch->io.ctx, offset + done, buf, n);
+        if (err == ESP_OK)
+        {
+            err = patch->io.write(patch->io.ctx, patch->out, buf, n);
+        }
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        patch->out += n;
+        done += n;
+    }
+    patch->old = offset + patch->len;
+    return ESP_OK;
+}
+
+// Runs may overlap their source (distance < length), so copy at most one
+// distance at a time
+static esp_err_t copy_out(ota_patch_t *patch, uint32_t distance)
+{
+    uint8_t buf[COPY_BUFFER_SIZE];
+    for (uint32_t done = 0; done < patch->len;)
+    {
+        size_t n = patch->len - done;
+        n = n < sizeof(buf) ? n : sizeof(buf);
+        n = n < distance ? n : distance;
+        esp_err_t err = patch->io.read_out(patch->io.ctx, patch->out - distance, buf, n);
+        if (err == ESP_OK)
+        {
+            err = patch->io.write(patch->io.ctx, patch->out, buf, n);
+        }
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        patch->out += n;
+        done += n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t run_copy(ota_patch_t *patch)
+{
+    if (patch->kind == OTA_PATCH_COPY_OLD)
+    {
+        // Zigzag: the run may start before or after the previous one ended
+        int64_t offset = (int64_t)patch->old + (int32_t)((patch->varint >> 1) ^ -(patch->varint & 1));
+        if (!(patch->header.flags & OTA_PATCH_FLAG_DELTA) || offset < 0 ||
+            offset + patch->len > patch->header.base_size)
+        {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        return copy_old(patch, (uint32_t)offset);
+    }
+    if (patch->varint == 0 || patch->varint > patch->out)
+    {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return copy_out(patch, patch->varint);
+}
+
+// A complete op varint: validate it and move on to its argument or data
+static esp_err_t start_op(ota_patch_t *patch)
+{
+    patch->kind = patch->varint & 3;
+    patch->len = patch->varint >> 2;
+    patch->varint = 0;
+    patch->varint_shift = 0;
+
+    if (patch->kind == OTA_PATCH_END)
+    {
+        if (patch->len != 0 || patch->out != patch->header.image_size)
+        {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        commit(patch);
+        patch->state = STATE_DONE;
+        return ESP_OK;
+    }
+    if (patch->len == 0 || patch->len > patch->header.image_size - patch->out)
+    {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    patch->state = patch->kind == OTA_PATCH_ADD ? STATE_ADD : STATE_ARG;
+    return ESP_OK;
+}
+
+esp_err_t ota_patch_feed(ota_patch_t *patch, const uint8_t *data, size_t len)
+{
+    size_t pos = 0;
+    esp_err_t err = ESP_OK;
+
+    while (pos < len && err == ESP_OK)
+    {
+        switch (patch->state)
+        {
+        case STATE_HEADER:
+        {
+            size_t n = OTA_PATCH_HEADER_SIZE - patch->in;
+            n = n < len - pos ? n : len - pos;
+            memcpy(patch->header_buf + patch->in, data + pos, n);
+            pos += n;
+            patch->in += n;
+            if (patch->in == OTA_PATCH_HEADER_SIZE)
+            {
+                err = parse_header(patch);
+                if (err == ESP_OK)
+                {
+                    commit(patch);
+                }
+            }
+            break;
+        }
+        case STATE_OP:
+            patch->in++;
+            if (varint_byte(patch, data[pos++], &err))
+            {
+                err = start_op(patch);
+            }
+            break;
+        case STATE_ARG:
+            patch->in++;
+            if (varint_byte(patch, data[pos++], &err))
+            {
+                err = run_copy(patch);
+                if (err == ESP_OK)
+                {
+                    commit(patch);
+                }
+            }
+            break;
+        case STATE_ADD:
+        {
+            // Literals go straight from the caller's buffer to the image
+            size_t n = patch->len < len - pos ? patch->len : len - pos;
+            err = patch->io.write(patch->io.ctx, patch->out, data + pos, n);
+            if (err == ESP_OK)
+            {
+                pos += n;
+                patch->in += n;
+                patch->out += n;
+                patch->len -= n;
+                if (patch->len == 0)
+                {
+                    commit(patch);
+                }
+            }
+            break;
+        }
+        case STATE_DONE:
+            return ESP_OK;
+        }
+    }
+    return err;
+}
+
+esp_err_t ota_patch_restore(ota_patch_t *patch, const ota_patch_checkpoint_t *checkpoint)
+{
+    if (!ota_patch_has_header(patch) || checkpoint->in < OTA_PATCH_HEADER_SIZE ||
+        checkpoint->out > patch->header.image_size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    patch->in = checkpoint->in;
+    patch->out = checkpoint->out;
+    patch->old = checkpoint->old;
+    commit(patch);
+    return ESP_OK;
+}
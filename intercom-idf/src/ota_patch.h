@@ -0,0 +1,121 @@
+#ifndef OTA_PATCH_H
+#define OTA_PATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Firmware update patches. A patch rebuilds a new image from a stream of
+ * operations, each either
+ *  - ADD: literal bytes from the patch,
+ *  - COPY_OLD: a run of the image being replaced (the running firmware), or
+ *  - COPY_OUT: a run of the new image written so far, LZ77-style.
+ * Without a base image this is plain LZ compression; with one, unchanged
+ * code and data cost a few bytes per run. Nothing is buffered in RAM: the
+ * old image and the output are read back from wherever they live (flash on
+ * the device), so the decoder works in a few hundred bytes.
+ *
+ * Layout, integers big endian:
+ *   "IOTA", u8 version, u8 flags, u16 reserved, u32 image size,
+ *   u8[32] SHA-256 of the new image, u8[32] SHA-256 of the base image,
+ *   u32 base size
+ * then ops. Each op starts with a varint (LEB128) holding length << 2 |
+ * kind; COPY_OLD is followed by the zigzag varint distance from the end of
+ * the previous COPY_OLD, COPY_OUT by the varint distance back from the
+ * current output position. END (kind 3, length 0) closes the stream.
+ */
+
+#define OTA_PATCH_MAGIC "IOTA"
+#define OTA_PATCH_VERSION 1
+#define OTA_PATCH_HEADER_SIZE 80
+#define OTA_PATCH_FLAG_DELTA 0x01 // Built against the base image
+
+typedef enum
+{
+    OTA_PATCH_ADD = 0,
+    OTA_PATCH_COPY_OLD = 1,
+    OTA_PATCH_COPY_OUT = 2,
+    OTA_PATCH_END = 3,
+} ota_patch_op_t;
+
+typedef struct
+{
+    uint8_t flags;
+    uint32_t image_size;
+    uint8_t image_sha256[32];
+    uint8_t base_sha256[32];
+    uint32_t base_size;
+} ota_patch_header_t;
+
+// Where the image lives. Offsets are relative to the start of each image.
+typedef struct
+{
+    esp_err_t (*read_old)(void *ctx, uint32_t offset, uint8_t *buf, size_t len);
+    esp_err_t (*read_out)(void *ctx, uint32_t offset, uint8_t *buf, size_t len);
+    esp_err_t (*write)(void *ctx, uint32_t offset, const uint8_t *buf, size_t len);
+    void *ctx;
+} ota_patch_io_t;
+
+// Decoder position at an op boundary, enough to carry on after a restart:
+// patch bytes consumed, image bytes written and the COPY_OLD reference
+typedef struct
+{
+    uint32_t in;
+    uint32_t out;
+    uint32_t old;
+} ota_patch_checkpoint_t;
+
+typedef struct
+{
+    ota_patch_io_t io;
+    ota_patch_header_t header;
+    uint8_t header_buf[OTA_PATCH_HEADER_SIZE];
+    int state;
+    uint32_t varint;
+    int varint_shift;
+    ota_patch_op_t kind;
+    uint32_t len;
+    uint32_t in;
+    uint32_t out;
+    uint32_t old;
+    ota_patch_checkpoint_t checkpoint;
+} ota_patch_t;
+
+/**
+ * @brief Start decoding a patch.
+ */
+void ota_patch_init(ota_patch_t *patch, const ota_patch_io_t *io);
+
+/**
+ * @brief Decode the next part of the patch, in pieces of any size.
+ *
+ * The header is parsed from the first OTA_PATCH_HEADER_SIZE bytes; the image
+ * is written as ops complete. Bytes after END are ignored.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_VERSION for a header this decoder can't
+ *         read, ESP_ERR_INVALID_RESPONSE for a corrupt op stream, or the
+ *         error of a failed read or write.
+ */
+esp_err_t ota_patch_feed(ota_patch_t *patch, const uint8_t *data, size_t len);
+
+/**
+ * @brief Whether the header has been parsed, so patch->header is valid.
+ */
+bool ota_patch_has_header(const ota_patch_t *patch);
+
+/**
+ * @brief Whether END has been decoded and the whole image written.
+ */
+bool ota_patch_done(const ota_patch_t *patch);
+
+/**
+ * @brief Carry on from a checkpoint of an earlier decode of the same patch.
+ *
+ * Feed the header again first, then the patch from checkpoint->in on. The
+ * image must be intact up to checkpoint->out.
+ */
+esp_err_t ota_patch_restore(ota_patch_t *patch, const ota_patch_checkpoint_t *checkpoint);
+
+#endif // OTA_PATCH_H
@@ -5,6 +5,28 @@
 #define I2C_MASTER_FREQ_HZ        100000
 #define I2C_MASTER_NUM            I2C_NUM_1
 #define PCF8574_ADDR              0x20  // The I2C address of the PCF8574
+#define PCF8574_LINK_SIZE         I2C_LINK_RECOMMENDED_SIZE(3)
+
+// With static allocation the command link lives in the caller's buffer
+// instead of being heap-allocated on every transaction
+static i2c_cmd_handle_t cmd_link_create(uint8_t *buffer)
+{
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    return i2c_cmd_link_create_static(buffer, PCF8574_LINK_SIZE);
+#else
+    (void)buffer;
+    return i2c_cmd_link_create();
+#endif
+}
+
+static void cmd_link_delete(i2c_cmd_handle_t cmd)
+{
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    i2c_cmd_link_delete_static(cmd);
+#else
+    i2c_cmd_link_delete(cmd);
+#endif
+}
 
 void i2c_master_init()
 {
@@ -24,24 +46,26 @@ void i2c_master_init()
 uint8_t read_pcf8574()
 {
     uint8_t data = 0;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    uint8_t link_buffer[PCF8574_LINK_SIZE] = {0};
+    i2c_cmd_handle_t cmd = cmd_link_create(link_buffer);
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, (PCF8574_ADDR << 1) | I2C_MASTER_READ, true);
     i2c_master_read_byte(cmd, &data, I2C_MASTER_NACK);
     i2c_master_stop(cmd);
     i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, pdMS_TO_TICKS(1000));
-    i2c_cmd_link_delete(cmd);
+    cmd_link_delete(cmd);
     return data;
 }
 
 void write_pcf8574(uint8_t data)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    uint8_t link_buffer[PCF8574_LINK_SIZE] = {0};
+    i2c_cmd_handle_t cmd = cmd_link_create(link_buffer);
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, (PCF8574_ADDR << 1) | I2C_MASTER_WRITE, true);
     i2c_master_write_byte(cmd, data, true);
     i2c_master_stop(cmd);
     i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, pdMS_TO_TICKS(1000));
-    i2c_cmd_link_delete(cmd);
+    cmd_link_delete(cmd);
 }
 
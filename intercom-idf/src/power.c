@@ -0,0 +1,173 @@
+#include "power.h"
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "task_registry.h"
+
+static const char *TAG = "power";
+
+static const char *const s_activity_names[POWER_ACTIVITY_COUNT] = {
+    [POWER_CAPTURE] = "capture",
+    [POWER_TX] = "tx",
+};
+
+static SemaphoreHandle_t s_lock = NULL;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t s_lock_buffer;
+#endif
+
+static power_stats_t s_stats;
+static uint32_t s_depth[POWER_ACTIVITY_COUNT];
+static int64_t s_since_us[POWER_ACTIVITY_COUNT];
+
+#if CONFIG_INTERCOM_POWER_SAVE
+static esp_pm_lock_handle_t s_pm_locks[POWER_ACTIVITY_COUNT];
+#endif
+
+void power_init(void)
+{
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buffer);
+#else
+    s_lock = xSemaphoreCreateMutex();
+#endif
+
+#if CONFIG_INTERCOM_POWER_SAVE
+    esp_pm_config_t config = {
+        .max_freq_mhz = CONFIG_INTERCOM_POWER_CPU_MAX_MHZ,
+        .min_freq_mhz = CONFIG_INTERCOM_POWER_CPU_MIN_MHZ,
+#if CONFIG_INTERCOM_POWER_LIGHT_SLEEP
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Power management not configured: 0x%x", err);
+    }
+    for (int i = 0; i < POWER_ACTIVITY_COUNT; i++)
+    {
+        ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, s_activity_names[i], &s_pm_locks[i]));
+    }
+
+    // The listen interval itself is set when associating (wifi_manager.c)
+    esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+    ESP_LOGI(TAG, "CPU %d-%d MHz, light sleep %s, listen interval %d", CONFIG_INTERCOM_POWER_CPU_MIN_MHZ,
+             CONFIG_INTERCOM_POWER_CPU_MAX_MHZ, config.light_sleep_enable ? "on" : "off",
+             CONFIG_INTERCOM_WIFI_LISTEN_INTERVAL);
+#endif
+}
+
+void power_begin(power_activity_t activity)
+{
+#if CONFIG_INTERCOM_POWER_SAVE
+    esp_pm_lock_acquire(s_pm_locks[activity]);
+#endif
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_depth[activity]++ == 0)
+    {
+        s_since_us[activity] = esp_timer_get_time();
+        s_stats.acquired[activity]++;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void power_end(power_activity_t activity)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_depth[activity] > 0 && --s_depth[activity] == 0)
+    {
+        s_stats.held_us[activity] += esp_timer_get_time() - s_since_us[activity];
+    }
+    xSemaphoreGive(s_lock);
+#if CONFIG_INTERCOM_POWER_SAVE
+    esp_pm_lock_release(s_pm_locks[activity]);
+#endif
+}
+
+void power_call_begin(void)
+{
+    s_stats.calls++;
+#if CONFIG_INTERCOM_POWER_SAVE
+    esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+#endif
+}
+
+void power_call_end(void)
+{
+#if CONFIG_INTERCOM_POWER_SAVE
+    esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+#endif
+}
+
+void power_key_wake(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.key_wakes++;
+    xSemaphoreGive(s_lock);
+}
+
+void power_key_decoded(int64_t woke_us)
+{
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.keys++;
+    s_stats.last_key_us = now;
+    if (woke_us != 0)
+    {
+        uint32_t latency = (uint32_t)(now - woke_us);
+        s_stats.key_latency_count++;
+        s_stats.key_latency_total_us += latency;
+        if (latency > s_stats.key_latency_max_us)
+        {
+            s_stats.key_latency_max_us = latency;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+power_stats_t power_get_stats(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    power_stats_t stats = s_stats;
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < POWER_ACTIVITY_COUNT; i++)
+    {
+        if (s_depth[i] > 0)
+        {
+            stats.held_us[i] += now - s_since_us[i];
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return stats;
+}
+
+void power_report(void)
+{
+    power_stats_t stats = power_get_stats();
+    int64_t uptime = esp_timer_get_time();
+    for (int i = 0; i < POWER_ACTIVITY_COUNT; i++)
+    {
+        ESP_LOGI(TAG, "%-8s %u locks, held %llu ms (%.2f%% of uptime)", s_activity_names[i],
+                 (unsigned)stats.acquired[i], (unsigned long long)(stats.held_us[i] / 1000),
+                 uptime > 0 ? 100.0 * stats.held_us[i] / uptime : 0.0);
+    }
+    ESP_LOGI(TAG, "keypad   %u wakes, %u keys, wake to key avg %u us, max %u us", (unsigned)stats.key_wakes,
+             (unsigned)stats.keys,
+             stats.key_latency_count ? (unsigned)(stats.key_latency_total_us / stats.key_latency_count) : 0,
+             (unsigned)stats.key_latency_max_us);
+    ESP_LOGI(TAG, "calls    %u", (unsigned)stats.calls);
+#if CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout);
+#endif
+}
+
+void power_report_start(void)
+{
+    task_registry_report_every(power_report, CONFIG_INTERCOM_POWER_REPORT_INTERVAL_MS);
+}
@@ -0,0 +1,88 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+/*
+ * Idle power management (CONFIG_INTERCOM_POWER_SAVE).
+ *
+ * Between calls the CPU runs at CONFIG_INTERCOM_POWER_CPU_MIN_MHZ and drops
+ * into automatic light sleep whenever no task is ready. Wi-Fi stays
+ * associated in modem sleep, waking for every
+ * CONFIG_INTERCOM_WIFI_LISTEN_INTERVAL-th DTIM beacon, and the keypad waits
+ * for the PCF8574 INT line instead of being polled. Work that is CPU- or
+ * radio-bound takes an activity lock, which holds the CPU at
+ * CONFIG_INTERCOM_POWER_CPU_MAX_MHZ and keeps it out of light sleep.
+ *
+ * Without CONFIG_INTERCOM_POWER_SAVE the locks only feed the counters.
+ */
+
+typedef enum
+{
+    POWER_CAPTURE, // Camera frame capture
+    POWER_TX,      // Connecting, TLS and sending to the server
+    POWER_ACTIVITY_COUNT
+} power_activity_t;
+
+typedef struct
+{
+    uint32_t acquired[POWER_ACTIVITY_COUNT];
+    uint64_t held_us[POWER_ACTIVITY_COUNT];
+    uint32_t key_wakes;           // Keypad interrupts
+    uint32_t keys;                // Keys decoded
+    uint32_t key_latency_count;   // Wakes that ended in a key
+    uint32_t key_latency_max_us;  // Interrupt to key decoded, worst
+    uint64_t key_latency_total_us;
+    int64_t last_key_us;          // When the last key was decoded
+    uint32_t calls;
+} power_stats_t;
+
+/**
+ * @brief Configure DFS and light sleep, create the activity locks and put
+ * Wi-Fi into idle power save. Call after Wi-Fi is started.
+ */
+void power_init(void);
+
+/**
+ * @brief Hold the CPU at full speed and awake for an activity. Nests.
+ */
+void power_begin(power_activity_t activity);
+
+void power_end(power_activity_t activity);
+
+/**
+ * @brief Switch Wi-Fi to listen to every DTIM beacon for the length of a
+ * call, so server replies are not held back by the listen interval.
+ */
+void power_call_begin(void);
+
+void power_call_end(void);
+
+/**
+ * @brief Note that the keypad interrupt woke the keypad task.
+ */
+void power_key_wake(void);
+
+/**
+ * @brief Note a decoded key.
+ *
+ * @param woke_us esp_timer time of the interrupt that woke the keypad for
+ * this key, or 0 if it was already awake; gives the wake-to-key latency.
+ */
+void power_key_decoded(int64_t woke_us);
+
+power_stats_t power_get_stats(void);
+
+/**
+ * @brief Log the counters and, with CONFIG_PM_PROFILING, time spent in
+ * each power mode.
+ */
+void power_report(void);
+
+/**
+ * @brief Report every CONFIG_INTERCOM_POWER_REPORT_INTERVAL_MS; 0 disables
+ * the periodic report.
+ */
+void power_report_start(void);
+
+#endif // POWER_H
@@ -0,0 +1,243 @@
+#include "task_registry.h"
+
+#include <sys/param.h>
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mem_report.h"
+
+#define FLAT_PRIORITY 5
+#define REPORT_MAX_TASKS 32
+#define PERIODIC_MAX 4
+
+static const char *TAG = "tasks";
+
+typedef struct
+{
+    const char *name;
+    uint32_t stack_size;
+    UBaseType_t priority;
+    BaseType_t core;
+} task_spec_t;
+
+static const task_spec_t s_specs[TASK_COUNT] = {
+#define TASK_REGISTRY_SPEC(id, name, stack, priority, core) [id] = {name, stack, priority, core},
+    TASK_REGISTRY_TABLE(TASK_REGISTRY_SPEC)
+#undef TASK_REGISTRY_SPEC
+};
+
+#if CONFIG_INTERCOM_STATIC_ALLOC
+#define TASK_REGISTRY_STACK(id, name, stack, priority, core) static StackType_t s_stack_##id[stack];
+TASK_REGISTRY_TABLE(TASK_REGISTRY_STACK)
+#undef TASK_REGISTRY_STACK
+
+static StackType_t *const s_stacks[TASK_COUNT] = {
+#define TASK_REGISTRY_STACK_REF(id, name, stack, priority, core) [id] = s_stack_##id,
+    TASK_REGISTRY_TABLE(TASK_REGISTRY_STACK_REF)
+#undef TASK_REGISTRY_STACK_REF
+};
+static StaticTask_t s_task_buffers[TASK_COUNT];
+#endif
+
+// Wake-up lateness since the last report. Each task only updates its own
+// entry; the report may read one mid-update and be off by a wake.
+typedef struct
+{
+    TaskHandle_t handle;
+    uint32_t wakes;
+    uint32_t late_total_us;
+    uint32_t late_max_us;
+} task_state_t;
+
+static task_state_t s_tasks[TASK_COUNT];
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// Run time counters at the last report, to turn them into a CPU share for
+// the interval since
+static TaskStatus_t s_status[REPORT_MAX_TASKS];
+static struct
+{
+    UBaseType_t number;
+    configRUN_TIME_COUNTER_TYPE run_time;
+} s_last_run_time[REPORT_MAX_TASKS];
+static UBaseType_t s_last_count = 0;
+static configRUN_TIME_COUNTER_TYPE s_last_total = 0;
+#endif
+
+// Reports run by the report task. Entries are only added, each complete
+// before the count takes it in.
+typedef struct
+{
+    void (*report)(void);
+    TickType_t interval;
+    TickType_t next;
+} periodic_t;
+
+static periodic_t s_periodic[PERIODIC_MAX];
+static volatile int s_periodic_count = 0;
+// Given when a report is added, so the task works out its sleep again
+static SemaphoreHandle_t s_periodic_added = NULL;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t s_periodic_added_buffer;
+#endif
+
+TaskHandle_t task_registry_start(task_id_t id, TaskFunction_t function, void *arg)
+{
+    const task_spec_t *spec = &s_specs[id];
+#if CONFIG_INTERCOM_TASK_PLAN
+    UBaseType_t priority = spec->priority;
+    BaseType_t core = spec->core;
+#else
+    UBaseType_t priority = FLAT_PRIORITY;
+    BaseType_t core = tskNO_AFFINITY;
+#endif
+
+    TaskHandle_t task = NULL;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    task = xTaskCreateStaticPinnedToCore(function, spec->name, spec->stack_size, arg, priority, s_stacks[id],
+                                         &s_task_buffers[id], core);
+#else
+    xTaskCreatePinnedToCore(function, spec->name, spec->stack_size, arg, priority, &task, core);
+#endif
+    if (task == NULL)
+    {
+        ESP_LOGE(TAG, "Could not create %s", spec->name);
+        return NULL;
+    }
+    s_tasks[id].handle = task;
+    mem_report_register_task(task);
+    return task;
+}
+
+void task_registry_delay(task_id_t id, TickType_t ticks)
+{
+    int64_t asleep = esp_timer_get_time();
+    vTaskDelay(ticks);
+    // The delay ends on a tick, so it can be up to a tick short; lateness
+    // is only resolved to a tick (1 ms at CONFIG_FREERTOS_HZ=1000)
+    int64_t late = esp_timer_get_time() - asleep - (int64_t)pdTICKS_TO_MS(ticks) * 1000;
+    late = late > 0 ? late : 0;
+
+    task_state_t *state = &s_tasks[id];
+    state->wakes++;
+    state->late_total_us += late;
+    if (late > state->late_max_us)
+    {
+        state->late_max_us = late;
+    }
+}
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static configRUN_TIME_COUNTER_TYPE last_run_time(UBaseType_t number)
+{
+    for (UBaseType_t i = 0; i < s_last_count; i++)
+    {
+        if (s_last_run_time[i].number == number)
+        {
+            return s_last_run_time[i].run_time;
+        }
+    }
+    return 0;
+}
+
+static void report_run_time(void)
+{
+    configRUN_TIME_COUNTER_TYPE total;
+    UBaseType_t count = uxTaskGetSystemState(s_status, REPORT_MAX_TASKS, &total);
+    if (count == 0)
+    {
+        ESP_LOGW(TAG, "More than %d tasks, no CPU report", REPORT_MAX_TASKS);
+        return;
+    }
+
+    // Shares are of one core, so each core's tasks add up to 100%
+    configRUN_TIME_COUNTER_TYPE elapsed = total - s_last_total;
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        const TaskStatus_t *status = &s_status[i];
+        configRUN_TIME_COUNTER_TYPE used = status->ulRunTimeCounter - last_run_time(status->xTaskNumber);
+        ESP_LOGI(TAG, "%-16s core %c prio %2u cpu %5.1f%% stack free %5u", status->pcTaskName,
+                 status->xCoreID == tskNO_AFFINITY ? '*' : '0' + (char)status->xCoreID,
+                 (unsigned)status->uxCurrentPriority, elapsed ? 100.0 * used / elapsed : 0.0,
+                 (unsigned)status->usStackHighWaterMark);
+    }
+
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        s_last_run_time[i].number = s_status[i].xTaskNumber;
+        s_last_run_time[i].run_time = s_status[i].ulRunTimeCounter;
+    }
+    s_last_count = count;
+    s_last_total = total;
+}
+#endif
+
+void task_registry_report(void)
+{
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    report_run_time();
+#endif
+    for (int id = 0; id < TASK_COUNT; id++)
+    {
+        task_state_t *state = &s_tasks[id];
+        if (state->handle == NULL || state->wakes == 0)
+        {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-16s %u wakes, late avg %u us, max %u us", s_specs[id].name, (unsigned)state->wakes,
+                 (unsigned)(state->late_total_us / state->wakes), (unsigned)state->late_max_us);
+        state->wakes = 0;
+        state->late_total_us = 0;
+        state->late_max_us = 0;
+    }
+}
+
+static void report_task(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t sleep = portMAX_DELAY;
+        for (int i = 0; i < s_periodic_count; i++)
+        {
+            periodic_t *periodic = &s_periodic[i];
+            if ((int32_t)(now - periodic->next) >= 0)
+            {
+                periodic->report();
+                periodic->next = now + periodic->interval;
+            }
+            sleep = MIN(sleep, periodic->next - now);
+        }
+        xSemaphoreTake(s_periodic_added, sleep);
+    }
+}
+
+void task_registry_report_every(void (*report)(void), uint32_t interval_ms)
+{
+    if (interval_ms == 0 || s_periodic_count >= PERIODIC_MAX)
+    {
+        return;
+    }
+    TickType_t interval = pdMS_TO_TICKS(interval_ms);
+    s_periodic[s_periodic_count] = (periodic_t){report, interval, xTaskGetTickCount() + interval};
+
+    if (s_periodic_added == NULL)
+    {
+#if CONFIG_INTERCOM_STATIC_ALLOC
+        s_periodic_added = xSemaphoreCreateBinaryStatic(&s_periodic_added_buffer);
+#else
+        s_periodic_added = xSemaphoreCreateBinary();
+#endif
+        s_periodic_count++;
+        task_registry_start(TASK_REPORT, report_task, NULL);
+        return;
+    }
+    s_periodic_count++;
+    xSemaphoreGive(s_periodic_added);
+}
+
+void task_registry_report_start(void)
+{
+    task_registry_report_every(task_registry_report, CONFIG_INTERCOM_TASK_REPORT_INTERVAL_MS);
+}
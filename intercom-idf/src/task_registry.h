@@ -0,0 +1,80 @@
+#ifndef TASK_REGISTRY_H
+#define TASK_REGISTRY_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+ * Every task the firmware creates, with its stack, priority and core.
+ *
+ * Core 0 runs the Wi-Fi driver (priority 23), esp_timer (22), lwIP (18,
+ * pinned there in sdkconfig) and the camera's DMA task (23). Tasks that a
+ * visitor or resident is waiting on go to core 1, where they only compete
+ * with each other: the keypad scan above everything, then the task that
+ * reads server replies and drives the door relay. The task writing to the
+ * server, which both wait on when they send, sits just below them.
+ * Cosmetic and background work gets what is left, the periodic reports
+ * included: they format floats and walk every task. The timer service
+ * stays at priority 1 with a 2 KB stack; its only timer, the keypad
+ * inactivity timeout, hands the number to the keypad task, which opens
+ * the call.
+ *
+ * With CONFIG_INTERCOM_TASK_PLAN disabled every task is created unpinned at
+ * priority 5, as before the plan, for comparison.
+ *
+ *       id             name                    stack  prio  core
+ */
+#define TASK_REGISTRY_TABLE(X)                                    \
+    X(TASK_KEYPAD,      "keypad_scan_task",     4096,  10,   1)  \
+    X(TASK_TCP_WAIT,    "tcp_client_wait_task", 4096,  9,    1)  \
+    X(TASK_TCP_TX,      "tcp_client_tx_task",   3072,  8,    1)  \
+    X(TASK_BLINK,       "blinking_task",        2048,  2,    1)  \
+    X(TASK_OTA,         "ota_task",             4096,  1,    0)  \
+    X(TASK_DIRECTORY,   "directory_task",       3072,  1,    0)  \
+    X(TASK_REPORT,      "report_task",          3072,  1,    0)
+
+typedef enum
+{
+#define TASK_REGISTRY_ID(id, name, stack, priority, core) id,
+    TASK_REGISTRY_TABLE(TASK_REGISTRY_ID)
+#undef TASK_REGISTRY_ID
+    TASK_COUNT
+} task_id_t;
+
+/**
+ * @brief Create a task from its table entry.
+ *
+ * Its stack is static with CONFIG_INTERCOM_STATIC_ALLOC, from the heap
+ * otherwise. The task is added to the memory report.
+ *
+ * @return The task, or NULL if it could not be created.
+ */
+TaskHandle_t task_registry_start(task_id_t id, TaskFunction_t function, void *arg);
+
+/**
+ * @brief vTaskDelay() for a task's periodic loop, recording how much later
+ * than asked the task got to run again. That lateness, averaged and at its
+ * worst, is the scheduling latency in the task report.
+ */
+void task_registry_delay(task_id_t id, TickType_t ticks);
+
+/**
+ * @brief Log every task's core, priority, CPU share since the last report
+ * (with CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS) and stack high-water mark,
+ * plus the wake-up lateness of registered tasks.
+ */
+void task_registry_report(void);
+
+/**
+ * @brief Call `report` every `interval_ms` from the report task, which is
+ * started with the first one. 0 does nothing. Up to 4 reports.
+ */
+void task_registry_report_every(void (*report)(void), uint32_t interval_ms);
+
+/**
+ * @brief Report every CONFIG_INTERCOM_TASK_REPORT_INTERVAL_MS; 0 disables
+ * the periodic report.
+ */
+void task_registry_report_start(void);
+
+#endif // TASK_REGISTRY_H
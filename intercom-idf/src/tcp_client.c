@@ -1,6 +1,7 @@
 #include "tcp_client.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/param.h>
@@ -8,20 +9,60 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_camera.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "capture.h"
+#include "power.h"
+#include "task_registry.h"
+
+#if CONFIG_INTERCOM_TLS || CONFIG_INTERCOM_SESSION_RESUME || CONFIG_INTERCOM_TX_QUEUE
+#include "esp_timer.h"
+#endif
+
+#if CONFIG_INTERCOM_TLS
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#elif CONFIG_INTERCOM_PHOTO_ZERO_COPY
+#include "lwip/api.h"
+#include "lwip/tcp.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/priv/tcpip_priv.h"
+#endif
 
 #define MAX_COMMAND_CALLBACKS 10 // Maximum number of commands you can register
+#define KEEPALIVE_IDLE_S 60
+#define KEEPALIVE_INTERVAL_S 10
+#define KEEPALIVE_COUNT 3
+#define SESSION_PREFIX "session:"
+#define SESSION_ID_LEN 16     // Hex digits of the server's call id
+#define RESUME_GAP_MS 500     // Between "resume" and the id, like "start" and the flat
+#define RESUME_RETRY_MS 500
+#define REQUEST_TIMEOUT_MS 5000
 
 static const char *TAG = "tcp_client";
 
 static int sock = -1;
 static struct sockaddr_in server_addr;
 
+// Set from tcp_client_connect() until the call ends. Requests made outside
+// calls (tcp_client_request()) are refused meanwhile, and take channel_lock
+// so that a call starting during one waits for its reply instead of reading
+// it.
+static volatile bool call_active = false;
+static SemaphoreHandle_t channel_lock = NULL;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t channel_lock_buffer;
+#endif
+
 // Structure to hold a command and its associated callback
 typedef struct
 {
@@ -35,84 +76,485 @@ static int command_callback_count = 0;
 
 static tcp_client_disconnect_callback_t disconnect_callback = NULL;
 
+#if CONFIG_INTERCOM_SESSION_RESUME
+// Id of the call in progress, sent by the server after "start". If the
+// channel drops mid-call it is presented on reconnect so the call carries on,
+// e.g. on a server that replaced one being restarted.
+static char session_id[32];
+#endif
+
 esp_err_t tcp_client_register_disconnect_callback(tcp_client_disconnect_callback_t callback)
 {
     disconnect_callback = callback;
     return ESP_OK;
 }
 
-static SemaphoreHandle_t wait_mutex = NULL;
+// Signalled once per expected server message; the wait task is created once
+// and serves every request instead of spawning a task per reply
+static SemaphoreHandle_t wait_request = NULL;
+
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t wait_request_buffer;
+#endif
+
+#if CONFIG_INTERCOM_TLS
+static mbedtls_entropy_context tls_entropy;
+static mbedtls_ctr_drbg_context tls_drbg;
+static mbedtls_ssl_config tls_conf;
+static mbedtls_ssl_context tls;
+static mbedtls_net_context tls_net;
+static bool tls_ready = false;
 
-void tcp_client_wait_task()
+// Session from the last handshake, offered on reconnect so the server can
+// resume it from its ticket instead of running a full handshake
+static mbedtls_ssl_session tls_session;
+static bool tls_session_saved = false;
+
+// An SSL context must not be used from two tasks at once; the wait task
+// reads while keypad and command callbacks write
+static SemaphoreHandle_t tls_lock = NULL;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t tls_lock_buffer;
+#endif
+
+static const int tls_ciphersuites[] = {MBEDTLS_TLS_PSK_WITH_AES_128_GCM_SHA256, 0};
+
+static int hex_to_bytes(const char *hex, unsigned char *out, size_t max)
 {
-    xSemaphoreTake(wait_mutex, portMAX_DELAY);
-    char rx_buffer[128];
+    size_t len = strlen(hex);
+    if (len == 0 || len % 2 != 0 || len / 2 > max)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < len / 2; i++)
+    {
+        unsigned int byte;
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1)
+        {
+            return -1;
+        }
+        out[i] = byte;
+    }
+    return len / 2;
+}
+
+static void tls_init(void)
+{
+    unsigned char psk[32];
+    int psk_len = hex_to_bytes(CONFIG_INTERCOM_TLS_PSK, psk, sizeof(psk));
+    if (psk_len < 16)
+    {
+        ESP_LOGE(TAG, "CONFIG_INTERCOM_TLS_PSK must be 16 to 32 bytes of hex");
+        return;
+    }
+
+    mbedtls_entropy_init(&tls_entropy);
+    mbedtls_ctr_drbg_init(&tls_drbg);
+    mbedtls_ssl_config_init(&tls_conf);
+    mbedtls_ssl_init(&tls);
+    mbedtls_ssl_session_init(&tls_session);
 
-    int len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
-    if (len < 0)
+    int ret = mbedtls_ctr_drbg_seed(&tls_drbg, mbedtls_entropy_func, &tls_entropy, NULL, 0);
+    if (ret == 0)
     {
-        ESP_LOGE(TAG, "recv failed: errno %d", errno);
-        xSemaphoreGive(wait_mutex);
-        vTaskDelete(NULL);
+        ret = mbedtls_ssl_config_defaults(&tls_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (ret == 0)
+    {
+        mbedtls_ssl_conf_rng(&tls_conf, mbedtls_ctr_drbg_random, &tls_drbg);
+        mbedtls_ssl_conf_ciphersuites(&tls_conf, tls_ciphersuites);
+        mbedtls_ssl_conf_min_tls_version(&tls_conf, MBEDTLS_SSL_VERSION_TLS1_2);
+        mbedtls_ssl_conf_max_tls_version(&tls_conf, MBEDTLS_SSL_VERSION_TLS1_2);
+        // Lets CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN be 4 KiB instead of 16 KiB
+        mbedtls_ssl_conf_max_frag_len(&tls_conf, MBEDTLS_SSL_MAX_FRAG_LEN_4096);
+        mbedtls_ssl_conf_session_tickets(&tls_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+        ret = mbedtls_ssl_conf_psk(&tls_conf, psk, psk_len, (const unsigned char *)CONFIG_INTERCOM_TLS_PSK_IDENTITY,
+                                   strlen(CONFIG_INTERCOM_TLS_PSK_IDENTITY));
+    }
+    if (ret == 0)
+    {
+        ret = mbedtls_ssl_setup(&tls, &tls_conf);
+    }
+    memset(psk, 0, sizeof(psk));
+
+    if (ret != 0)
+    {
+        ESP_LOGE(TAG, "TLS setup failed: -0x%04x", -ret);
         return;
     }
-    else if (len == 0)
+    tls_ready = true;
+}
+
+static esp_err_t tls_handshake(void)
+{
+    mbedtls_ssl_session_reset(&tls);
+    tls_net.fd = sock;
+    mbedtls_ssl_set_bio(&tls, &tls_net, mbedtls_net_send, mbedtls_net_recv, NULL);
+    if (tls_session_saved)
+    {
+        mbedtls_ssl_set_session(&tls, &tls_session);
+    }
+
+    int64_t started = esp_timer_get_time();
+    int ret;
+    while ((ret = mbedtls_ssl_handshake(&tls)) != 0)
     {
-        ESP_LOGW(TAG, "Connection closed");
-        if (disconnect_callback != NULL)
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
         {
-            disconnect_callback();
+            ESP_LOGE(TAG, "TLS handshake failed: -0x%04x", -ret);
+            // Don't keep offering a session the server may have rejected
+            tls_session_saved = false;
+            return ESP_FAIL;
         }
-        xSemaphoreGive(wait_mutex);
-        vTaskDelete(NULL);
+    }
+    ESP_LOGI(TAG, "TLS handshake (%s) took %lld ms", tls_session_saved ? "resume" : "full",
+             (long long)(esp_timer_get_time() - started) / 1000);
+
+    mbedtls_ssl_session_free(&tls_session);
+    mbedtls_ssl_session_init(&tls_session);
+    tls_session_saved = mbedtls_ssl_get_session(&tls, &tls_session) == 0;
+    return ESP_OK;
+}
+#endif
+
+// Between calls the server sends nothing unasked, so pending data or EOF on
+// an idle connection both mean the server has dropped it
+static bool channel_idle_ok(void)
+{
+    char byte;
+    int len = recv(sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static void channel_close(void)
+{
+    if (sock == -1)
+    {
         return;
     }
-    rx_buffer[len] = 0; // Null-terminate the string
-    ESP_LOGI(TAG, "Received %d bytes: %s", len, rx_buffer);
+#if CONFIG_INTERCOM_TLS
+    xSemaphoreTake(tls_lock, portMAX_DELAY);
+    mbedtls_ssl_close_notify(&tls);
+    xSemaphoreGive(tls_lock);
+#endif
+    shutdown(sock, 0);
+    close(sock);
+    sock = -1;
+    capture_record(CAPTURE_CLOSE, NULL, 0);
+}
+
+// Write all of data to the server
+static bool channel_write(const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    size_t sent = 0;
+
+#if CONFIG_INTERCOM_TLS
+    xSemaphoreTake(tls_lock, portMAX_DELAY);
+    while (sent < len)
+    {
+        int ret = mbedtls_ssl_write(&tls, bytes + sent, len - sent);
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            continue;
+        }
+        if (ret < 0)
+        {
+            ESP_LOGE(TAG, "TLS write failed: -0x%04x", -ret);
+            break;
+        }
+        sent += ret;
+    }
+    xSemaphoreGive(tls_lock);
+#else
+    while (sent < len)
+    {
+        int ret = send(sock, bytes + sent, len - sent, 0);
+        if (ret < 0)
+        {
+            ESP_LOGE(TAG, "send failed: errno %d", errno);
+            break;
+        }
+        sent += ret;
+    }
+#endif
+    capture_record(CAPTURE_DEVICE, data, sent);
+    return sent == len;
+}
+
+// Read one message from the server; 0 when the server closed the channel
+static int channel_read(char *buffer, size_t len)
+{
+#if CONFIG_INTERCOM_TLS
+    // Block on the socket without the lock so callbacks can still write
+    if (mbedtls_ssl_get_bytes_avail(&tls) == 0)
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sock, &readable);
+        if (select(sock + 1, &readable, NULL, NULL, NULL) < 0)
+        {
+            return -1;
+        }
+    }
+
+    xSemaphoreTake(tls_lock, portMAX_DELAY);
+    int ret;
+    do
+    {
+        ret = mbedtls_ssl_read(&tls, (unsigned char *)buffer, len);
+    } while (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE);
+    xSemaphoreGive(tls_lock);
+
+    if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY || ret == MBEDTLS_ERR_SSL_CONN_EOF)
+    {
+        return 0;
+    }
+    if (ret < 0)
+    {
+        ESP_LOGE(TAG, "TLS read failed: -0x%04x", -ret);
+        return -1;
+    }
+#else
+    int ret = recv(sock, buffer, len, 0);
+    if (ret < 0)
+    {
+        ESP_LOGE(TAG, "recv failed: errno %d", errno);
+    }
+#endif
+    if (ret > 0)
+    {
+        capture_record(CAPTURE_SERVER, buffer, ret);
+    }
+    return ret;
+}
 
-    // Check for registered command callbacks
-    for (int i = 0; i < command_callback_count; i++)
+// Read exactly len bytes, waiting at most timeout_ms for each part
+static bool channel_read_exact(void *data, size_t len, int timeout_ms)
+{
+    uint8_t *bytes = data;
+    size_t received = 0;
+    while (received < len)
     {
-        if (strcmp(rx_buffer, command_callbacks[i].command) == 0)
+#if CONFIG_INTERCOM_TLS
+        bool buffered = mbedtls_ssl_get_bytes_avail(&tls) > 0;
+#else
+        bool buffered = false;
+#endif
+        if (!buffered)
         {
-            if (command_callbacks[i].callback != NULL)
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(sock, &readable);
+            struct timeval timeout = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+            if (select(sock + 1, &readable, NULL, NULL, &timeout) <= 0)
             {
-                command_callbacks[i].callback(rx_buffer);
+                ESP_LOGE(TAG, "No reply from server");
+                return false;
             }
-            xSemaphoreGive(wait_mutex);
-            vTaskDelete(NULL);
-            return;
         }
+        int ret = channel_read((char *)bytes + received, len - received);
+        if (ret <= 0)
+        {
+            return false;
+        }
+        received += ret;
     }
-    ESP_LOGW(TAG, "No callback registered for command: %s", rx_buffer);
-    xSemaphoreGive(wait_mutex);
-    vTaskDelete(NULL);
+    return true;
 }
 
-void tcp_client_wait_for_msg()
+static esp_err_t channel_open(void);
+
+#if CONFIG_INTERCOM_TX_QUEUE
+static void tx_init(void);
+static esp_err_t tx_send(const void *data, size_t len);
+static void tx_abort_photo(void);
+#endif
+
+#if CONFIG_INTERCOM_SESSION_RESUME
+// Write during a call, alongside the keypad's frames
+static bool call_write(const void *data, size_t len)
 {
-    xTaskCreate(tcp_client_wait_task, "tcp_client_wait_task", 4096, NULL, 5, NULL);
+#if CONFIG_INTERCOM_TX_QUEUE
+    return tx_send(data, len) == ESP_OK;
+#else
+    return channel_write(data, len);
+#endif
 }
 
-esp_err_t tcp_client_connect(const char *server_ip, uint16_t server_port)
+// Reconnect and present the session id. The server being restarted stops
+// listening before it lets go of the channel, so retry until its
+// replacement is up.
+static bool session_resume(void)
+{
+    ESP_LOGW(TAG, "Channel lost mid-call, resuming session %s", session_id);
+    channel_close();
+
+    int64_t deadline = esp_timer_get_time() + (int64_t)CONFIG_INTERCOM_RESUME_TIMEOUT_MS * 1000;
+    while (esp_timer_get_time() < deadline)
+    {
+        if (channel_open() == ESP_OK)
+        {
+            if (call_write("resume", strlen("resume")))
+            {
+                vTaskDelay(pdMS_TO_TICKS(RESUME_GAP_MS));
+                if (call_write(session_id, strlen(session_id)))
+                {
+                    ESP_LOGI(TAG, "Session %s resumed", session_id);
+                    return true;
+                }
+            }
+            channel_close();
+        }
+        vTaskDelay(pdMS_TO_TICKS(RESUME_RETRY_MS));
+    }
+    ESP_LOGE(TAG, "Could not resume session %s", session_id);
+    return false;
+}
+#endif
+
+// Read the next command from the server. Session ids are kept instead of
+// dispatched, and a channel lost mid-call is resumed rather than reported.
+// Commands carry no delimiter, so a read can end partway through the id or
+// run on into the command after it; the id is fixed-length, so it is read
+// to its end and whatever follows is returned as the next command.
+static int read_command(char *buffer, size_t size)
+{
+    for (;;)
+    {
+        int len = channel_read(buffer, size - 1);
+#if CONFIG_INTERCOM_SESSION_RESUME
+        if (len <= 0 && session_id[0] != 0)
+        {
+            if (session_resume())
+            {
+                continue;
+            }
+            session_id[0] = 0;
+            return 0;
+        }
+        size_t prefix_len = strlen(SESSION_PREFIX);
+        if (len > 0 && strncmp(buffer, SESSION_PREFIX, MIN((size_t)len, prefix_len)) == 0)
+        {
+            size_t whole = prefix_len + SESSION_ID_LEN;
+            if ((size_t)len < whole)
+            {
+                if (!channel_read_exact(buffer + len, whole - len, REQUEST_TIMEOUT_MS))
+                {
+                    return -1;
+                }
+                len = whole;
+            }
+            memcpy(session_id, buffer + prefix_len, SESSION_ID_LEN);
+            session_id[SESSION_ID_LEN] = 0;
+            len -= whole;
+            if (len == 0)
+            {
+                continue;
+            }
+            memmove(buffer, buffer + whole, len);
+        }
+#endif
+        return len;
+    }
+}
+
+static void tcp_client_wait_task(void *arg)
 {
-    if (wait_mutex == NULL)
+    (void)arg;
+    char rx_buffer[128];
+
+    while (1)
     {
-        wait_mutex = xSemaphoreCreateMutex();
+        xSemaphoreTake(wait_request, portMAX_DELAY);
+
+        int len = read_command(rx_buffer, sizeof(rx_buffer));
+        if (len <= 0)
+        {
+            // A channel closed by ending the call fails the read too
+            if (call_active)
+            {
+                ESP_LOGW(TAG, "Connection %s", len == 0 ? "closed" : "lost");
+                // What led up to it, for host/tools/icap
+                capture_dump();
+                // Lost, or not resumed: the call is over
+                tcp_client_disconnect();
+            }
+            continue;
+        }
+        rx_buffer[len] = 0; // Null-terminate the string
+        ESP_LOGI(TAG, "Received %d bytes: %s", len, rx_buffer);
+
+        // Check for registered command callbacks
+        int i;
+        for (i = 0; i < command_callback_count; i++)
+        {
+            if (strcmp(rx_buffer, command_callbacks[i].command) == 0)
+            {
+                if (command_callbacks[i].callback != NULL)
+                {
+                    command_callbacks[i].callback(rx_buffer);
+                }
+                break;
+            }
+        }
+        if (i == command_callback_count)
+        {
+            ESP_LOGW(TAG, "No callback registered for command: %s", rx_buffer);
+        }
     }
+}
 
+static void tcp_client_init(void)
+{
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    wait_request = xSemaphoreCreateBinaryStatic(&wait_request_buffer);
+    channel_lock = xSemaphoreCreateMutexStatic(&channel_lock_buffer);
+#else
+    wait_request = xSemaphoreCreateBinary();
+    channel_lock = xSemaphoreCreateMutex();
+#endif
+    task_registry_start(TASK_TCP_WAIT, tcp_client_wait_task, NULL);
+#if CONFIG_INTERCOM_TX_QUEUE
+    tx_init();
+#endif
+
+#if CONFIG_INTERCOM_TLS
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    tls_lock = xSemaphoreCreateMutexStatic(&tls_lock_buffer);
+#else
+    tls_lock = xSemaphoreCreateMutex();
+#endif
+    tls_init();
+#endif
+}
+
+void tcp_client_wait_for_msg()
+{
+    xSemaphoreGive(wait_request);
+}
+
+// Open the channel, or reuse the one left by the previous call or request
+static esp_err_t channel_connect(const char *server_ip, uint16_t server_port)
+{
     if (sock != -1)
     {
-        ESP_LOGE(TAG, "Socket already connected");
-        return ESP_FAIL;
+        if (channel_idle_ok())
+        {
+            return ESP_OK;
+        }
+        ESP_LOGW(TAG, "Channel dropped by server, reconnecting");
+        channel_close();
     }
 
-    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
-    if (sock < 0)
+#if CONFIG_INTERCOM_TLS
+    if (!tls_ready)
     {
-        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        ESP_LOGE(TAG, "TLS is not configured");
         return ESP_FAIL;
     }
+#endif
 
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(server_port);
@@ -121,12 +563,113 @@ esp_err_t tcp_client_connect(const char *server_ip, uint16_t server_port)
     if (err != 1)
     {
         ESP_LOGE(TAG, "Invalid server IP address");
-        close(sock);
-        sock = -1;
         return ESP_FAIL;
     }
 
-    err = connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
+    return channel_open();
+}
+
+esp_err_t tcp_client_connect(const char *server_ip, uint16_t server_port)
+{
+    if (wait_request == NULL)
+    {
+        tcp_client_init();
+    }
+
+    if (call_active)
+    {
+        ESP_LOGE(TAG, "Call already in progress");
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(channel_lock, portMAX_DELAY);
+    power_begin(POWER_TX);
+    esp_err_t ret = channel_connect(server_ip, server_port);
+    power_end(POWER_TX);
+    call_active = ret == ESP_OK;
+    xSemaphoreGive(channel_lock);
+    if (call_active)
+    {
+        power_call_begin();
+    }
+    return ret;
+}
+
+static void call_end(void)
+{
+#if CONFIG_INTERCOM_TX_QUEUE
+    // Nothing of the call may follow its end on the channel
+    tx_abort_photo();
+#endif
+    if (call_active)
+    {
+        call_active = false;
+        power_call_end();
+    }
+}
+
+bool tcp_client_in_call(void)
+{
+    return call_active;
+}
+
+esp_err_t tcp_client_request(const char *server_ip, uint16_t server_port, const char *request, uint8_t *reply,
+                             size_t max, size_t *len)
+{
+    if (wait_request == NULL)
+    {
+        tcp_client_init();
+    }
+
+    xSemaphoreTake(channel_lock, portMAX_DELAY);
+    if (call_active)
+    {
+        xSemaphoreGive(channel_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    power_begin(POWER_TX);
+    esp_err_t ret = channel_connect(server_ip, server_port);
+    uint32_t size_network_order;
+    if (ret == ESP_OK && (!channel_write(request, strlen(request)) ||
+                          !channel_read_exact(&size_network_order, sizeof(size_network_order), REQUEST_TIMEOUT_MS)))
+    {
+        ret = ESP_FAIL;
+    }
+    if (ret == ESP_OK)
+    {
+        *len = ntohl(size_network_order);
+        if (*len > max)
+        {
+            ESP_LOGE(TAG, "Reply of %u bytes does not fit %u", (unsigned)*len, (unsigned)max);
+            ret = ESP_ERR_INVALID_SIZE;
+        }
+        else if (!channel_read_exact(reply, *len, REQUEST_TIMEOUT_MS))
+        {
+            ret = ESP_FAIL;
+        }
+    }
+    power_end(POWER_TX);
+    // The rest of a reply would be taken for the next one
+    if (ret != ESP_OK)
+    {
+        channel_close();
+    }
+    xSemaphoreGive(channel_lock);
+    return ret;
+}
+
+// Connect to server_addr and set the channel up
+static esp_err_t channel_open(void)
+{
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    int err = connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
     if (err != 0)
     {
         ESP_LOGE(TAG, "Socket unable to connect: errno %d", errno);
@@ -135,7 +678,32 @@ esp_err_t tcp_client_connect(const char *server_ip, uint16_t server_port)
         return ESP_FAIL;
     }
 
+    // Control messages are already spaced out; don't hold the tail of a
+    // photo back waiting for an ACK
+    int nodelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+#if CONFIG_INTERCOM_TLS
+    // The channel outlives calls; notice a dead server or NAT entry while idle
+    int keepalive = 1, idle = KEEPALIVE_IDLE_S, interval = KEEPALIVE_INTERVAL_S, count = KEEPALIVE_COUNT;
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+
+    if (tls_handshake() != ESP_OK)
+    {
+        close(sock);
+        sock = -1;
+        return ESP_FAIL;
+    }
+#endif
+
     ESP_LOGI(TAG, "Successfully connected");
+    char peer[INET_ADDRSTRLEN + 6];
+    inet_ntop(AF_INET, &server_addr.sin_addr, peer, INET_ADDRSTRLEN);
+    snprintf(peer + strlen(peer), 7, ":%u", ntohs(server_addr.sin_port));
+    capture_open(peer);
 
     return ESP_OK;
 }
@@ -168,15 +736,483 @@ esp_err_t tcp_client_send_string(const char *message)
         return ESP_FAIL;
     }
 
-    int err = send(sock, message, strlen(message), 0);
-    if (err < 0)
+#if CONFIG_INTERCOM_TX_QUEUE
+    bool sent = tx_send(message, strlen(message)) == ESP_OK;
+#else
+    power_begin(POWER_TX);
+    bool sent = channel_write(message, strlen(message));
+    power_end(POWER_TX);
+#endif
+    if (!sent)
+    {
+        ESP_LOGE(TAG, "Error occurred during sending");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+#if !CONFIG_INTERCOM_TLS && CONFIG_INTERCOM_PHOTO_ZERO_COPY
+typedef struct
+{
+    struct tcpip_api_call_data call;
+    struct netconn *conn;
+    bool drained;
+} tx_drain_call_t;
+
+// Runs in the tcpip thread, where the pcb can be inspected safely
+static err_t tx_drain_check(struct tcpip_api_call_data *call)
+{
+    tx_drain_call_t *drain = (tx_drain_call_t *)call;
+    struct tcp_pcb *pcb = drain->conn->pcb.tcp;
+    drain->drained = pcb == NULL || (pcb->unsent == NULL && pcb->unacked == NULL);
+    return ERR_OK;
+}
+
+static struct netconn *socket_netconn(void)
+{
+    struct lwip_sock *lwsock = lwip_socket_dbg_get_socket(sock);
+    if (lwsock == NULL || lwsock->conn == NULL)
+    {
+        ESP_LOGE(TAG, "No netconn for socket %d", sock);
+        return NULL;
+    }
+    return lwsock->conn;
+}
+
+// Queue the data on the socket's netconn by reference. lwIP keeps pointing
+// into the buffer until the segments are acknowledged; see wait_acked().
+static esp_err_t queue_nocopy(const uint8_t *data, size_t len)
+{
+    struct netconn *conn = socket_netconn();
+    if (conn == NULL)
+    {
+        return ESP_FAIL;
+    }
+
+    size_t sent = 0;
+    while (sent < len)
+    {
+        size_t written = 0;
+        err_t err = netconn_write_partly(conn, data + sent, len - sent, NETCONN_NOCOPY, &written);
+        if (err != ERR_OK)
+        {
+            ESP_LOGE(TAG, "Error occurred during sending image data: err %d", err);
+            return ESP_FAIL;
+        }
+        sent += written;
+    }
+    capture_record(CAPTURE_DEVICE, data, len);
+    return ESP_OK;
+}
+
+// Wait for the send queue to drain, after which no data queued by
+// reference is in use any more
+static esp_err_t wait_acked(void)
+{
+    struct netconn *conn = socket_netconn();
+    if (conn == NULL)
     {
-        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
         return ESP_FAIL;
     }
+
+    tx_drain_call_t drain = {.conn = conn, .drained = false};
+    TickType_t start = xTaskGetTickCount();
+    while (tcpip_api_call(tx_drain_check, &drain.call) == ERR_OK && !drain.drained)
+    {
+        if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(CONFIG_INTERCOM_PHOTO_TX_TIMEOUT_MS))
+        {
+            ESP_LOGE(TAG, "Image data not acknowledged in time");
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(1);
+    }
     return ESP_OK;
 }
 
+#if !CONFIG_INTERCOM_TX_QUEUE
+static esp_err_t send_nocopy(const uint8_t *data, size_t len)
+{
+    esp_err_t ret = queue_nocopy(data, len);
+    return ret == ESP_OK ? wait_acked() : ret;
+}
+#endif
+#endif
+
+#if CONFIG_INTERCOM_TX_QUEUE
+/*
+ * Everything sent during a call goes through one writer task, so that
+ * frames from the keypad, the reply task and session resume never race on
+ * the channel. Control frames go ahead of photo data, which is sent in
+ * CONFIG_INTERCOM_TX_CHUNK_SIZE pieces: a frame queued during a photo waits
+ * for the piece being written, not the rest of the photo.
+ *
+ * While a photo is being sent the channel carries records: a u8 type, a u16
+ * (network order) length and the payload. The photo's size has its top bit
+ * set to announce them. Image records carry the photo, control records a
+ * frame as it would have been sent on its own, and an end record (no
+ * payload) stops a photo cut short by the end of the call. Otherwise the
+ * photo ends with its last image byte and raw frames follow again.
+ */
+#define TX_PHOTO_RECORDS 0x80000000u
+#define TX_RECORD_IMAGE 0
+#define TX_RECORD_CONTROL 1
+#define TX_RECORD_END 2
+#define TX_RECORD_HEADER_SIZE 3
+#define TX_CONTROL_MAX 64         // Longest frame tx_send() takes
+#define TX_ABORT_WAIT_MS 5000     // For the piece being written when a call ends
+
+typedef enum
+{
+    TX_SLOT_FREE,
+    TX_SLOT_QUEUED,
+    TX_SLOT_WRITING,
+} tx_slot_state_t;
+
+// A queued control frame; its sender waits on `done`
+typedef struct
+{
+    tx_slot_state_t state;
+    uint32_t seq;
+    uint8_t data[TX_CONTROL_MAX];
+    size_t len;
+    int64_t queued_us;
+    bool sent;
+    SemaphoreHandle_t done;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    StaticSemaphore_t done_buffer;
+#endif
+} tx_slot_t;
+
+static tx_slot_t tx_slots[CONFIG_INTERCOM_TX_QUEUE_LEN];
+static uint32_t tx_seq = 0;
+
+// The photo being sent. Its sender sets it up and waits on tx_photo_done;
+// `announced` and `sent` belong to the writer.
+static struct
+{
+    bool active;
+    bool abort; // The call ended under it
+    bool announced;
+    const uint8_t *data;
+    size_t len;
+    size_t sent;
+    int64_t queued_us;
+    esp_err_t result;
+} tx_photo;
+
+static tcp_client_tx_stats_t tx_stats[TCP_CLIENT_TX_PRIORITIES];
+
+// tx_lock guards the slots, tx_photo's request fields and the counters;
+// tx_wake is given whenever there is something to write; tx_free counts
+// free slots
+static SemaphoreHandle_t tx_lock = NULL;
+static SemaphoreHandle_t tx_wake = NULL;
+static SemaphoreHandle_t tx_free = NULL;
+static SemaphoreHandle_t tx_photo_done = NULL;
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static StaticSemaphore_t tx_lock_buffer;
+static StaticSemaphore_t tx_wake_buffer;
+static StaticSemaphore_t tx_free_buffer;
+static StaticSemaphore_t tx_photo_done_buffer;
+#endif
+
+#if !CONFIG_INTERCOM_PHOTO_ZERO_COPY || CONFIG_INTERCOM_TLS
+// An image record is assembled here so that it goes out in one write
+#if CONFIG_INTERCOM_STATIC_ALLOC
+static uint8_t tx_chunk[TX_RECORD_HEADER_SIZE + CONFIG_INTERCOM_TX_CHUNK_SIZE];
+#else
+static uint8_t *tx_chunk;
+#endif
+#endif
+
+static void tx_count(tcp_client_tx_priority_t priority, size_t bytes, int64_t queued_us)
+{
+    uint32_t latency_us = esp_timer_get_time() - queued_us;
+    tx_stats[priority].frames++;
+    tx_stats[priority].bytes += bytes;
+    tx_stats[priority].latency_us_total += latency_us;
+    tx_stats[priority].latency_us_max = MAX(tx_stats[priority].latency_us_max, latency_us);
+}
+
+static void tx_record_header(uint8_t *header, uint8_t type, size_t len)
+{
+    header[0] = type;
+    header[1] = len >> 8;
+    header[2] = len & 0xff;
+}
+
+static void tx_write_control(tx_slot_t *slot)
+{
+    bool sent;
+    if (tx_photo.announced)
+    {
+        uint8_t record[TX_RECORD_HEADER_SIZE + TX_CONTROL_MAX];
+        tx_record_header(record, TX_RECORD_CONTROL, slot->len);
+        memcpy(record + TX_RECORD_HEADER_SIZE, slot->data, slot->len);
+        sent = channel_write(record, TX_RECORD_HEADER_SIZE + slot->len);
+    }
+    else
+    {
+        sent = channel_write(slot->data, slot->len);
+    }
+
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    slot->sent = sent;
+    if (sent)
+    {
+        tx_count(TCP_CLIENT_TX_CONTROL, slot->len, slot->queued_us);
+    }
+    xSemaphoreGive(tx_lock);
+    xSemaphoreGive(slot->done);
+}
+
+static void tx_photo_finish(esp_err_t result)
+{
+#if CONFIG_INTERCOM_PHOTO_ZERO_COPY && !CONFIG_INTERCOM_TLS
+    // The frame buffer goes back to the camera once nothing points into it
+    if (tx_photo.sent > 0)
+    {
+        esp_err_t acked = wait_acked();
+        result = result == ESP_OK ? acked : result;
+    }
+#endif
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    if (result == ESP_OK)
+    {
+        tx_count(TCP_CLIENT_TX_PHOTO, tx_photo.len, tx_photo.queued_us);
+    }
+    tx_photo.result = result;
+    tx_photo.announced = false;
+    tx_photo.active = false;
+    xSemaphoreGive(tx_lock);
+    xSemaphoreGive(tx_photo_done);
+}
+
+// Write the next part of the photo: its size, a piece, or the end record
+static void tx_write_photo(void)
+{
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    bool abort = tx_photo.abort;
+    xSemaphoreGive(tx_lock);
+
+    if (!tx_photo.announced)
+    {
+        if (abort)
+        {
+            tx_photo_finish(ESP_ERR_INVALID_STATE);
+            return;
+        }
+        uint32_t size_network_order = htonl(tx_photo.len | TX_PHOTO_RECORDS);
+        if (!channel_write(&size_network_order, sizeof(size_network_order)))
+        {
+            ESP_LOGE(TAG, "Error occurred during sending image size");
+            tx_photo_finish(ESP_FAIL);
+            return;
+        }
+        tx_photo.announced = true;
+        return;
+    }
+
+    if (abort)
+    {
+        uint8_t record[TX_RECORD_HEADER_SIZE];
+        tx_record_header(record, TX_RECORD_END, 0);
+        channel_write(record, sizeof(record));
+        tx_photo_finish(ESP_ERR_INVALID_STATE);
+        return;
+    }
+
+    size_t len = MIN(tx_photo.len - tx_photo.sent, CONFIG_INTERCOM_TX_CHUNK_SIZE);
+    const uint8_t *chunk = tx_photo.data + tx_photo.sent;
+#if CONFIG_INTERCOM_PHOTO_ZERO_COPY && !CONFIG_INTERCOM_TLS
+    // The header is copied; the piece is queued by reference
+    uint8_t header[TX_RECORD_HEADER_SIZE];
+    tx_record_header(header, TX_RECORD_IMAGE, len);
+    bool sent = channel_write(header, sizeof(header)) && queue_nocopy(chunk, len) == ESP_OK;
+#else
+    tx_record_header(tx_chunk, TX_RECORD_IMAGE, len);
+    memcpy(tx_chunk + TX_RECORD_HEADER_SIZE, chunk, len);
+    bool sent = channel_write(tx_chunk, TX_RECORD_HEADER_SIZE + len);
+#endif
+    if (!sent)
+    {
+        ESP_LOGE(TAG, "Error occurred during sending image data");
+        tx_photo_finish(ESP_FAIL);
+        return;
+    }
+    tx_photo.sent += len;
+    if (tx_photo.sent == tx_photo.len)
+    {
+        tx_photo_finish(ESP_OK);
+    }
+}
+
+static void tcp_client_tx_task(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        // The oldest control frame, else the photo
+        xSemaphoreTake(tx_lock, portMAX_DELAY);
+        tx_slot_t *next = NULL;
+        for (int i = 0; i < CONFIG_INTERCOM_TX_QUEUE_LEN; i++)
+        {
+            tx_slot_t *slot = &tx_slots[i];
+            if (slot->state == TX_SLOT_QUEUED && (next == NULL || (int32_t)(slot->seq - next->seq) < 0))
+            {
+                next = slot;
+            }
+        }
+        if (next != NULL)
+        {
+            next->state = TX_SLOT_WRITING;
+        }
+        bool photo = tx_photo.active;
+        xSemaphoreGive(tx_lock);
+
+        if (next == NULL && !photo)
+        {
+            xSemaphoreTake(tx_wake, portMAX_DELAY);
+            continue;
+        }
+        power_begin(POWER_TX);
+        if (next != NULL)
+        {
+            tx_write_control(next);
+        }
+        else
+        {
+            tx_write_photo();
+        }
+        power_end(POWER_TX);
+    }
+}
+
+static void tx_init(void)
+{
+#if CONFIG_INTERCOM_STATIC_ALLOC
+    tx_lock = xSemaphoreCreateMutexStatic(&tx_lock_buffer);
+    tx_wake = xSemaphoreCreateBinaryStatic(&tx_wake_buffer);
+    tx_free = xSemaphoreCreateCountingStatic(CONFIG_INTERCOM_TX_QUEUE_LEN, CONFIG_INTERCOM_TX_QUEUE_LEN,
+                                             &tx_free_buffer);
+    tx_photo_done = xSemaphoreCreateBinaryStatic(&tx_photo_done_buffer);
+    for (int i = 0; i < CONFIG_INTERCOM_TX_QUEUE_LEN; i++)
+    {
+        tx_slots[i].done = xSemaphoreCreateBinaryStatic(&tx_slots[i].done_buffer);
+    }
+#else
+    tx_lock = xSemaphoreCreateMutex();
+    tx_wake = xSemaphoreCreateBinary();
+    tx_free = xSemaphoreCreateCounting(CONFIG_INTERCOM_TX_QUEUE_LEN, CONFIG_INTERCOM_TX_QUEUE_LEN);
+    tx_photo_done = xSemaphoreCreateBinary();
+    for (int i = 0; i < CONFIG_INTERCOM_TX_QUEUE_LEN; i++)
+    {
+        tx_slots[i].done = xSemaphoreCreateBinary();
+    }
+#if !CONFIG_INTERCOM_PHOTO_ZERO_COPY || CONFIG_INTERCOM_TLS
+    tx_chunk = malloc(TX_RECORD_HEADER_SIZE + CONFIG_INTERCOM_TX_CHUNK_SIZE);
+#endif
+#endif
+    task_registry_start(TASK_TCP_TX, tcp_client_tx_task, NULL);
+}
+
+// Queue a control frame and wait until it has been written
+static esp_err_t tx_send(const void *data, size_t len)
+{
+    if (len > TX_CONTROL_MAX)
+    {
+        ESP_LOGE(TAG, "Frame of %u bytes is too long to queue", (unsigned)len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(tx_free, portMAX_DELAY);
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    tx_slot_t *slot = &tx_slots[0];
+    while (slot->state != TX_SLOT_FREE)
+    {
+        slot++;
+    }
+    memcpy(slot->data, data, len);
+    slot->len = len;
+    slot->seq = tx_seq++;
+    slot->queued_us = esp_timer_get_time();
+    slot->state = TX_SLOT_QUEUED;
+    xSemaphoreGive(tx_lock);
+    xSemaphoreGive(tx_wake);
+
+    xSemaphoreTake(slot->done, portMAX_DELAY);
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    bool sent = slot->sent;
+    slot->state = TX_SLOT_FREE;
+    xSemaphoreGive(tx_lock);
+    xSemaphoreGive(tx_free);
+    return sent ? ESP_OK : ESP_FAIL;
+}
+
+// Queue a photo behind any control frames and wait until it has been sent
+static esp_err_t tx_send_photo(const uint8_t *data, size_t len)
+{
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    if (tx_photo.active || !call_active)
+    {
+        xSemaphoreGive(tx_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    tx_photo.active = true;
+    tx_photo.abort = false;
+    tx_photo.data = data;
+    tx_photo.len = len;
+    tx_photo.sent = 0;
+    tx_photo.queued_us = esp_timer_get_time();
+    xSemaphoreGive(tx_lock);
+    xSemaphoreGive(tx_wake);
+
+    xSemaphoreTake(tx_photo_done, portMAX_DELAY);
+    return tx_photo.result;
+}
+
+// Cut a photo being sent short and wait for the writer to let go of it
+static void tx_abort_photo(void)
+{
+    if (tx_lock == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    bool active = tx_photo.active;
+    tx_photo.abort = true;
+    xSemaphoreGive(tx_lock);
+    if (!active)
+    {
+        return;
+    }
+    xSemaphoreGive(tx_wake);
+
+    TickType_t start = xTaskGetTickCount();
+    while (tx_photo.active && xTaskGetTickCount() - start < pdMS_TO_TICKS(TX_ABORT_WAIT_MS))
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void tcp_client_tx_get_stats(tcp_client_tx_stats_t stats[TCP_CLIENT_TX_PRIORITIES])
+{
+    if (tx_lock == NULL)
+    {
+        memset(stats, 0, sizeof(tx_stats));
+        return;
+    }
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    memcpy(stats, tx_stats, sizeof(tx_stats));
+    xSemaphoreGive(tx_lock);
+}
+#else
+void tcp_client_tx_get_stats(tcp_client_tx_stats_t stats[TCP_CLIENT_TX_PRIORITIES])
+{
+    memset(stats, 0, TCP_CLIENT_TX_PRIORITIES * sizeof(tcp_client_tx_stats_t));
+}
+#endif
+
 esp_err_t tcp_client_send_photo()
 {
     if (sock == -1)
@@ -185,55 +1221,87 @@ esp_err_t tcp_client_send_photo()
         return ESP_FAIL;
     }
 
+    power_begin(POWER_CAPTURE);
+#if CONFIG_INTERCOM_POWER_LIGHT_SLEEP
+    // The frame waiting in the buffer may have been taken before (or cut
+    // short by) light sleep; grab a fresh one
+    camera_fb_t *stale = esp_camera_fb_get();
+    if (stale)
+    {
+        esp_camera_fb_return(stale);
+    }
+#endif
     camera_fb_t *fb = esp_camera_fb_get();
+    power_end(POWER_CAPTURE);
     if (!fb)
     {
         ESP_LOGE(TAG, "Camera capture failed");
         return ESP_FAIL;
     }
 
+#if CONFIG_INTERCOM_TX_QUEUE
+    esp_err_t ret = tx_send_photo(fb->buf, fb->len);
+    esp_camera_fb_return(fb);
+    return ret;
+#else
+    power_begin(POWER_TX);
+
     // Send the size of the image first
     uint32_t image_size = fb->len;
     uint32_t size_network_order = htonl(image_size);
 
-    int err = send(sock, &size_network_order, sizeof(size_network_order), 0);
-    if (err < 0)
+    if (!channel_write(&size_network_order, sizeof(size_network_order)))
     {
-        ESP_LOGE(TAG, "Error occurred during sending image size: errno %d", errno);
+        ESP_LOGE(TAG, "Error occurred during sending image size");
+        power_end(POWER_TX);
         esp_camera_fb_return(fb);
         return ESP_FAIL;
     }
 
-    // Send the image data
-    size_t to_send = fb->len;
-    size_t sent = 0;
-    while (sent < to_send)
+    // Send the image data. Under TLS it is encrypted straight out of the
+    // frame buffer into the record buffer, so there is no socket-level copy
+    // to avoid.
+#if !CONFIG_INTERCOM_TLS && CONFIG_INTERCOM_PHOTO_ZERO_COPY
+    esp_err_t ret = send_nocopy(fb->buf, fb->len);
+#else
+    esp_err_t ret = ESP_OK;
+    if (!channel_write(fb->buf, fb->len))
     {
-        int bytes = send(sock, fb->buf + sent, to_send - sent, 0);
-        if (bytes < 0)
-        {
-            ESP_LOGE(TAG, "Error occurred during sending image data: errno %d", errno);
-            esp_camera_fb_return(fb);
-            return ESP_FAIL;
-        }
-        sent += bytes;
+        ESP_LOGE(TAG, "Error occurred during sending image data");
+        ret = ESP_FAIL;
     }
+#endif
 
+    power_end(POWER_TX);
     esp_camera_fb_return(fb);
-    return ESP_OK;
+    return ret;
+#endif
 }
 
 esp_err_t tcp_client_disconnect()
 {
+    call_end();
+#if CONFIG_INTERCOM_SESSION_RESUME
+    session_id[0] = 0;
+#endif
     if (disconnect_callback != NULL)
     {
         disconnect_callback();
     }
-    if (sock != -1)
-    {
-        shutdown(sock, 0);
-        close(sock);
-        sock = -1;
-    }
+    channel_close();
+    return ESP_OK;
+}
+
+esp_err_t tcp_client_end_session()
+{
+    call_end();
+#if CONFIG_INTERCOM_SESSION_RESUME
+    session_id[0] = 0;
+#endif
+#if CONFIG_INTERCOM_TLS
+    // Keep the channel (and its negotiated keys) for the next call
     return ESP_OK;
+#else
+    return tcp_client_disconnect();
+#endif
 }
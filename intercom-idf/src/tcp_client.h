@@ -1,6 +1,9 @@
 #ifndef TCP_CLIENT_H
 #define TCP_CLIENT_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "esp_err.h"
 #include "esp_camera.h"
 
@@ -9,15 +12,46 @@ typedef void (*tcp_client_command_callback_t)(const char *cmd);
 typedef void (*tcp_client_disconnect_callback_t)(void);
 
 
-// Initialize the TCP client module and connect to the server
+// Initialize the TCP client module and connect to the server for a call
 esp_err_t tcp_client_connect(const char *server_ip, uint16_t server_port);
 
-// Send a raw string to the server
+// Whether a call is in progress, from tcp_client_connect() until it ends
+bool tcp_client_in_call(void);
+
+// Send a one-frame request outside of a call and read the reply, a u32
+// (network order) length and that many bytes, into reply. Connects if
+// needed. Fails with ESP_ERR_INVALID_STATE during a call; a call started
+// meanwhile waits for the reply.
+esp_err_t tcp_client_request(const char *server_ip, uint16_t server_port, const char *request, uint8_t *reply,
+                             size_t max, size_t *len);
+
+// Send a raw string to the server. With CONFIG_INTERCOM_TX_QUEUE it goes
+// ahead of any photo being sent, and this returns once it is written.
 esp_err_t tcp_client_send_string(const char *message);
 
-// Send a photo from the camera module to the server
+// Send a photo from the camera module to the server. Fails with
+// ESP_ERR_INVALID_STATE if the call ends before it is sent.
 esp_err_t tcp_client_send_photo();
 
+typedef enum
+{
+    TCP_CLIENT_TX_CONTROL, // Commands and the session id
+    TCP_CLIENT_TX_PHOTO,
+    TCP_CLIENT_TX_PRIORITIES,
+} tcp_client_tx_priority_t;
+
+typedef struct
+{
+    uint32_t frames; // Photos count as one
+    uint64_t bytes;
+    uint64_t latency_us_total; // From queued to written
+    uint32_t latency_us_max;
+} tcp_client_tx_stats_t;
+
+// Counters of the send queue since boot, by priority; all zero without
+// CONFIG_INTERCOM_TX_QUEUE
+void tcp_client_tx_get_stats(tcp_client_tx_stats_t stats[TCP_CLIENT_TX_PRIORITIES]);
+
 // Register a callback function for a specific server command
 esp_err_t tcp_client_register_command_callback(const char *command, tcp_client_command_callback_t callback);
 
@@ -26,6 +60,10 @@ esp_err_t tcp_client_register_disconnect_callback(tcp_client_disconnect_callback
 // Close the TCP client connection
 esp_err_t tcp_client_disconnect();
 
+// Finish a call. With CONFIG_INTERCOM_TLS the channel stays open for the
+// next call; otherwise the connection is closed.
+esp_err_t tcp_client_end_session();
+
 void tcp_client_wait_for_msg();
 
 #endif // TCP_CLIENT_H
\ No newline at end of file
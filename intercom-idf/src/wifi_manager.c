@@ -92,6 +92,10 @@ void wifi_init_sta(const char *ssid, const char *password)
     strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
     strncpy((char *)wifi_config.sta.password, password, sizeof(wifi_config.sta.password));
     wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+#if CONFIG_INTERCOM_POWER_SAVE
+    // In beacon intervals; used in WIFI_PS_MAX_MODEM between calls
+    wifi_config.sta.listen_interval = CONFIG_INTERCOM_WIFI_LISTEN_INTERVAL;
+#endif
 
     // Set Wi-Fi mode to station
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
@@ -0,0 +1,107 @@
+type BatchWriterOptions = {
+    // Documents per write
+    maxBatch: number;
+    // Longest a document waits for its batch to fill
+    flushMs: number;
+    // Writes in flight at once
+    concurrency: number;
+    // Buffered documents kept while the database is slow or down; the
+    // oldest are dropped beyond this
+    maxBuffered: number;
+};
+
+// Buffers documents and writes them in batches, so a busy server makes one
+// round trip per batch instead of one per document. Failed batches are
+// logged and dropped: the journal is best effort and never holds up a call.
+export class BatchWriter<T> {
+    private buffer: T[] = [];
+    private inFlight = new Set<Promise<void>>();
+    private timer: NodeJS.Timeout | null = null;
+    private options: BatchWriterOptions;
+    written = 0;
+    dropped = 0;
+
+    constructor(
+        private write: (docs: T[]) => Promise<unknown>,
+        options: Partial<BatchWriterOptions> = {}
+    ) {
+        this.options = {
+            maxBatch: 500,
+            flushMs: 1000,
+            concurrency: 2,
+            maxBuffered: 50_000,
+            ...options,
+        };
+    }
+
+    push(doc: T) {
+        if (this.buffer.length >= this.options.maxBuffered) {
+            this.buffer.shift();
+            this.dropped++;
+        }
+        this.buffer.push(doc);
+        this.pump(false);
+    }
+
+    // Resolves once there is room for another batch; bulk producers await
+    // it so they don't outrun the database
+    async ready() {
+        const { maxBatch, concurrency } = this.options;
+        while (this.buffer.length >= maxBatch * concurrency) {
+            await Promise.race(this.inFlight);
+        }
+    }
+
+    // Write everything buffered and wait for it
+    async flush() {
+        if (this.timer) {
+            clearTimeout(this.timer);
+            this.timer = null;
+        }
+        while (this.buffer.length > 0 || this.inFlight.size > 0) {
+            this.pump(true);
+            await Promise.race(this.inFlight);
+        }
+    }
+
+    // Start full batches, or partial ones once flushMs is up, while there
+    // is a free write slot
+    private pump(force: boolean) {
+        const { maxBatch, flushMs, concurrency } = this.options;
+        while (
+            this.inFlight.size < concurrency &&
+            (this.buffer.length >= maxBatch ||
+                (force && this.buffer.length > 0))
+        ) {
+            this.start(this.buffer.splice(0, maxBatch));
+        }
+        if (this.buffer.length > 0 && !this.timer) {
+            this.timer = setTimeout(() => {
+                this.timer = null;
+                this.pump(true);
+            }, flushMs);
+        }
+    }
+
+    private start(docs: T[]) {
+        const write: Promise<void> = this.write(docs)
+            .then(
+                () => {
+                    this.written += docs.length;
+                },
+                (err) => {
+                    this.dropped += docs.length;
+                    console.error(
+                        `Writing ${docs.length} documents failed:`,
+                        err
+                    );
+                }
+            )
+            .finally(() => {
+                this.inFlight.delete(write);
+                // A partial batch whose timer already fired goes out now
+                this.pump(this.timer === null);
+            });
+        this.inFlight.add(write);
+    }
+}
@@ -1,10 +1,49 @@
+import http from 'node:http';
+import https from 'node:https';
 import { Telegraf, Markup, type Context } from 'telegraf';
 import { Flat, flatsRepo } from './flats';
 import { CacheClient } from './cache';
+import { CallOutcome, callsRepo } from './calls';
 
-type BotContext = Context & { flat?: Flat };
+export type BotContext = Context & { flat?: Flat };
 
-export const bot = new Telegraf<BotContext>(process.env.BOT_TOKEN!);
+const apiRoot = process.env.TELEGRAM_API_ROOT;
+
+export const bot = new Telegraf<BotContext>(process.env.BOT_TOKEN!, {
+    // Overridable so the bot can be pointed at a local Bot API mock
+    telegram: apiRoot
+        ? {
+              apiRoot,
+              agent: apiRoot.startsWith('https:')
+                  ? new https.Agent({ keepAlive: true })
+                  : new http.Agent({ keepAlive: true }),
+          }
+        : {},
+});
+
+// Long polling by default. With WEBHOOK_DOMAIN set, Telegram pushes updates
+// to a local HTTP listener instead (WEBHOOK_PORT, behind a TLS-terminating
+// proxy for WEBHOOK_DOMAIN), which several bot workers can share; long
+// polling allows one consumer. A tap arrives about as fast either way, as a
+// pending getUpdates is answered as soon as there is an update.
+export const launchBot = (onLaunch?: () => void) => {
+    const domain = process.env.WEBHOOK_DOMAIN;
+    if (!domain) {
+        return bot.launch(onLaunch);
+    }
+    return bot.launch(
+        {
+            webhook: {
+                domain,
+                host: process.env.WEBHOOK_HOST ?? '127.0.0.1',
+                port: Number(process.env.WEBHOOK_PORT ?? 8080),
+                path: process.env.WEBHOOK_PATH,
+                secretToken: process.env.WEBHOOK_SECRET,
+            },
+        },
+        onLaunch
+    );
+};
 
 const registerFlat = async (ctx: BotContext) => {
     const key = `register:${ctx.chat!.id}`;
@@ -40,9 +79,12 @@ const registerFlat = async (ctx: BotContext) => {
 };
 
 bot.use(async (ctx, next) => {
-    const flat = await flatsRepo.getByChatId(ctx.chat!.id);
     const key = `register:${ctx.chat!.id}`;
-    const registerStarted = Number(await CacheClient.get(key));
+    // Every update, door taps included, waits on both lookups
+    const [flat, registerStarted] = await Promise.all([
+        flatsRepo.getByChatId(ctx.chat!.id),
+        CacheClient.get(key).then(Number),
+    ]);
     if (!flat || registerStarted) {
         if ((await registerFlat(ctx)) == 0) {
             next();
@@ -57,9 +99,47 @@ bot.start((ctx) =>
     ctx.reply(
         'Выберите действие',
         Markup.inlineKeyboard([
-            Markup.button.callback('Перепривязать квартиру', 'change-flat'),
+            [Markup.button.callback('Перепривязать квартиру', 'change-flat')],
+            [Markup.button.callback('Последние посетители', 'visitors')],
         ])
     )
 );
 
 bot.action('change-flat', registerFlat);
+
+const outcomeLabels: Record<CallOutcome, string> = {
+    accept: '✅ впустили',
+    reject: '❌ не впустили',
+    cancel: '↩️ отменен на домофоне',
+    not_found: '❔ квартира не найдена',
+    abandoned: '⚠️ без ответа',
+};
+
+const visitorTime = new Intl.DateTimeFormat('ru-RU', {
+    day: '2-digit',
+    month: '2-digit',
+    hour: '2-digit',
+    minute: '2-digit',
+});
+
+// The flat's last 20 calls from the journal, newest first
+const showVisitors = async (ctx: BotContext) => {
+    const calls = await callsRepo.recentByFlat(ctx.flat!.number, 20);
+    if (calls.length === 0) {
+        await ctx.reply('Посетителей пока не было');
+        return;
+    }
+    const lines = calls.map(
+        (call) =>
+            `${visitorTime.format(call.startedAt)} ${outcomeLabels[call.outcome]}` +
+            (call.snapshots.length > 0 ? ' 📸' : '')
+    );
+    await ctx.reply(['Последние посетители:', ...lines].join('\n'));
+};
+
+bot.command('visitors', showVisitors);
+
+bot.action('visitors', async (ctx) => {
+    await ctx.answerCbQuery();
+    await showVisitors(ctx);
+});
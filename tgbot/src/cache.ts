@@ -1,6 +1,6 @@
 import Redis from 'ioredis';
 
-const redis = new Redis(process.env.REDIS_PATH!);
+const redis = new Redis(process.env.REDIS_PATH!, { lazyConnect: true });
 
 export class CacheClient {
     static set(key: string, value: string | number | Buffer, seconds?: number) {
@@ -15,7 +15,28 @@ export class CacheClient {
         return redis.get(key);
     }
 
+    static getBuffer(key: string) {
+        return redis.getBuffer(key);
+    }
+
     static del(key: string) {
         return redis.del(key);
     }
+
+    static zrangebyscore(
+        key: string,
+        min: number | string,
+        max: number | string
+    ) {
+        return redis.zrangebyscore(key, min, max);
+    }
+
+    // Runs a Lua script; nothing else runs on the server meanwhile
+    static eval(
+        script: string,
+        keys: string[],
+        args: (string | number | Buffer)[]
+    ) {
+        return redis.eval(script, keys.length, ...keys, ...args);
+    }
 }
@@ -0,0 +1,82 @@
+import { model, Schema } from 'mongoose';
+
+export type CallOutcome =
+    | 'accept'
+    | 'reject'
+    | 'cancel'
+    | 'not_found'
+    // The device went away before the call was answered
+    | 'abandoned';
+
+export interface Call {
+    sessionId: string;
+    // The device's address on the socket channel
+    device: string;
+    flat: number;
+    startedAt: Date;
+    endedAt: Date;
+    // When each step happened; a step the call never reached is absent
+    stages: {
+        notified?: Date;
+        photoRequested?: Date;
+        photo?: Date;
+        decided?: Date;
+    };
+    // Resident whose tap opened or refused the door
+    decidedBy?: number;
+    outcome: CallOutcome;
+    // SHA-256 of each photo in the snapshot store
+    snapshots: string[];
+}
+
+// A time-series collection: Mongo groups calls into buckets per flat and
+// time range, so a flat's recent history is a few bucket reads, and the
+// compound index serves "latest calls of a flat" without a sort. Calls are
+// written once, complete, so the collection is insert-only.
+const CallSchema = new Schema<Call>(
+    {
+        sessionId: { type: String, required: true },
+        device: { type: String, required: true },
+        flat: { type: Number, required: true },
+        startedAt: { type: Date, required: true },
+        endedAt: { type: Date, required: true },
+        stages: {
+            notified: Date,
+            photoRequested: Date,
+            photo: Date,
+            decided: Date,
+        },
+        decidedBy: Number,
+        outcome: { type: String, required: true },
+        snapshots: [String],
+    },
+    {
+        timeseries: {
+            timeField: 'startedAt',
+            metaField: 'flat',
+            granularity: 'hours',
+        },
+        versionKey: false,
+    }
+);
+
+CallSchema.index({ flat: 1, startedAt: -1 });
+
+export const CallModel = model<Call>('calls', CallSchema);
+
+export class CallsRepository {
+    async insertMany(calls: Call[]): Promise<void> {
+        // Documents are built by the journal; skip hydration and validation
+        await CallModel.insertMany(calls, { ordered: false, lean: true });
+    }
+
+    async recentByFlat(flat: number, limit: number): Promise<Call[]> {
+        return CallModel.find({ flat })
+            .sort({ startedAt: -1 })
+            .limit(limit)
+            .select({ _id: 0, startedAt: 1, outcome: 1, snapshots: 1 })
+            .lean();
+    }
+}
+
+export const callsRepo = new CallsRepository();
@@ -0,0 +1,373 @@
+import { createWriteStream, mkdirSync, WriteStream } from 'node:fs';
+import fs from 'node:fs/promises';
+import path from 'node:path';
+
+// Session captures: every byte of a device channel and what the server made
+// of it, time-stamped, to replay later (loadgen/replay.ts, or against the
+// firmware with intercom-idf/host/tools/replay.c). The format is the
+// firmware's, see intercom-idf/src/capture.h; all integers big-endian:
+//
+//   file:   "ICAP", u8 version, u8 recorder, u16 0, u64 wall-clock time of
+//           time 0 in µs since the epoch
+//   record: u32 payload length, u8 kind, u8 flags, u16 session, u64 time
+//           in µs, payload
+//
+// An elided record's payload is the u32 length that was on the wire and
+// its first bytes only. With CAPTURE_DIR set the server writes one file per
+// device connection there; CAPTURE_KEEP_BYTES elides longer writes, which
+// are photos, to that many bytes.
+const magic = 'ICAP';
+const version = 1;
+const fileHeaderSize = 16;
+const recordHeaderSize = 16;
+const elided = 0x01;
+
+export const recorders = { server: 0, device: 1 } as const;
+
+const kinds = ['open', 'close', 'device', 'server', 'event'] as const;
+export type CaptureKind = (typeof kinds)[number];
+const kindCode = (kind: CaptureKind) => kinds.indexOf(kind) + 1;
+
+export type CaptureRecord = {
+    kind: CaptureKind;
+    session: number;
+    timeUs: number;
+    length: number; // On the wire
+    data: Buffer; // The first bytes of it, or all
+};
+
+export type Capture = {
+    recorder: number;
+    epochUs: number;
+    records: CaptureRecord[];
+};
+
+const encodeHeader = (recorder: number, epochUs: number) => {
+    const header = Buffer.alloc(fileHeaderSize);
+    header.write(magic, 0, 'latin1');
+    header.writeUInt8(version, 4);
+    header.writeUInt8(recorder, 5);
+    header.writeBigUInt64BE(BigInt(Math.round(epochUs)), 8);
+    return header;
+};
+
+const encodeRecord = (
+    kind: CaptureKind,
+    session: number,
+    timeUs: number,
+    data: Buffer,
+    keepBytes: number
+) => {
+    const cut = keepBytes > 0 && data.length > keepBytes;
+    const kept = cut ? data.subarray(0, keepBytes) : data;
+    const header = Buffer.alloc(recordHeaderSize + (cut ? 4 : 0));
+    header.writeUInt32BE(kept.length + (cut ? 4 : 0), 0);
+    header.writeUInt8(kindCode(kind), 4);
+    header.writeUInt8(cut ? elided : 0, 5);
+    header.writeUInt16BE(session, 6);
+    header.writeBigUInt64BE(BigInt(Math.round(timeUs)), 8);
+    if (cut) {
+        header.writeUInt32BE(data.length, recordHeaderSize);
+    }
+    return Buffer.concat([header, kept]);
+};
+
+// One capture file being written. Records are queued on the stream as they
+// come; nothing waits for the disk.
+export class CaptureWriter {
+    private readonly started = process.hrtime.bigint();
+    private session = 0;
+
+    constructor(
+        private stream: WriteStream,
+        private keepBytes: number,
+        recorder: number = recorders.server
+    ) {
+        stream.on('error', (err) => console.error('Capture failed:', err));
+        stream.write(encodeHeader(recorder, Date.now() * 1000));
+    }
+
+    private now() {
+        return Number(process.hrtime.bigint() - this.started) / 1000;
+    }
+
+    // A new channel; its records carry the next session number
+    open(peer: string) {
+        this.session++;
+        this.record('open', peer);
+    }
+
+    record(kind: CaptureKind, data: string | Buffer = Buffer.alloc(0)) {
+        const bytes = typeof data === 'string' ? Buffer.from(data) : data;
+        this.stream.write(
+            encodeRecord(
+                kind,
+                this.session,
+                this.now(),
+                bytes,
+                kind === 'device' || kind === 'server' ? this.keepBytes : 0
+            )
+        );
+    }
+
+    event(text: string) {
+        this.record('event', text);
+    }
+
+    close() {
+        this.record('close');
+    }
+
+    // Resolves once the file is complete
+    end() {
+        return new Promise<void>((resolve) => this.stream.end(resolve));
+    }
+}
+
+export class CaptureStore {
+    private opened = 0;
+
+    constructor(
+        readonly dir: string | null,
+        readonly keepBytes: number
+    ) {
+        if (dir) {
+            mkdirSync(dir, { recursive: true });
+        }
+    }
+
+    // A writer for one device connection, or null with captures off
+    open(peer: string) {
+        if (!this.dir) {
+            return null;
+        }
+        const name = `${new Date().toISOString().replace(/[:.]/g, '-')}-${process.pid}-${++this.opened}.icap`;
+        const writer = this.writer(path.join(this.dir, name));
+        writer.open(peer);
+        return writer;
+    }
+
+    writer(file: string, recorder: number = recorders.server) {
+        return new CaptureWriter(
+            createWriteStream(file),
+            this.keepBytes,
+            recorder
+        );
+    }
+}
+
+export const captures = new CaptureStore(
+    process.env.CAPTURE_DIR || null,
+    Number(process.env.CAPTURE_KEEP_BYTES ?? 0)
+);
+
+export const readCapture = async (file: string): Promise<Capture> => {
+    const data = await fs.readFile(file);
+    if (
+        data.length < fileHeaderSize ||
+        data.toString('latin1', 0, 4) !== magic ||
+        data.readUInt8(4) !== version
+    ) {
+        throw new Error(`${file}: not a version ${version} capture`);
+    }
+    const capture: Capture = {
+        recorder: data.readUInt8(5),
+        epochUs: Number(data.readBigUInt64BE(8)),
+        records: [],
+    };
+    let offset = fileHeaderSize;
+    while (offset < data.length) {
+        const payload =
+            data.length - offset >= recordHeaderSize
+                ? data.readUInt32BE(offset)
+                : Infinity;
+        if (data.length - offset - recordHeaderSize < payload) {
+            throw new Error(`${file}: record at ${offset} cut short`);
+        }
+        const flags = data.readUInt8(offset + 5);
+        let body = data.subarray(
+            offset + recordHeaderSize,
+            offset + recordHeaderSize + payload
+        );
+        let length = body.length;
+        if (flags & elided) {
+            length = body.readUInt32BE(0);
+            body = body.subarray(4);
+        }
+        capture.records.push({
+            kind: kinds[data.readUInt8(offset + 4) - 1],
+            session: data.readUInt16BE(offset + 6),
+            timeUs: Number(data.readBigUInt64BE(offset + 8)),
+            length,
+            data: body,
+        });
+        offset += recordHeaderSize + payload;
+    }
+    return capture;
+};
+
+// A run of one side's traffic before the other answers; every open, close
+// and event is a turn of its own. `data` is what was on the wire up to the
+// first byte that was not kept.
+export type CaptureTurn = {
+    kind: CaptureKind;
+    session: number;
+    startUs: number;
+    endUs: number;
+    length: number;
+    data: Buffer;
+};
+
+export const captureTurns = (capture: Capture) => {
+    const turns: CaptureTurn[] = [];
+    for (const record of capture.records) {
+        const last = turns.at(-1);
+        const traffic = record.kind === 'device' || record.kind === 'server';
+        if (
+            last &&
+            traffic &&
+            last.kind === record.kind &&
+            last.session === record.session
+        ) {
+            if (last.data.length === last.length) {
+                last.data = Buffer.concat([last.data, record.data]);
+            }
+            last.length += record.length;
+            last.endUs = record.timeUs;
+        } else {
+            turns.push({
+                kind: record.kind,
+                session: record.session,
+                startUs: record.timeUs,
+                endUs: record.timeUs,
+                length: record.length,
+                data: record.data,
+            });
+        }
+    }
+    return turns;
+};
+
+const sessionPrefix = 'session:';
+const sessionIdLength = 16;
+
+// Session ids differ between runs; blank out every id the server handed out
+const maskSessions = (turns: CaptureTurn[]) => {
+    const ids = new Set<string>();
+    for (const turn of turns) {
+        const text = turn.data.toString('latin1');
+        let at = turn.kind === 'server' ? text.indexOf(sessionPrefix) : -1;
+        while (at >= 0) {
+            const start = at + sessionPrefix.length;
+            ids.add(text.slice(start, start + sessionIdLength));
+            at = text.indexOf(sessionPrefix, start);
+        }
+    }
+    return turns.map((turn) => {
+        let text = turn.data.toString('latin1');
+        ids.forEach(
+            (id) => (text = text.replaceAll(id, '*'.repeat(id.length)))
+        );
+        return { ...turn, data: Buffer.from(text, 'latin1') };
+    });
+};
+
+// Opens name the peer, which a replay can't reproduce
+const turnsMatch = (a: CaptureTurn, b: CaptureTurn) => {
+    const common = Math.min(a.data.length, b.data.length);
+    return (
+        a.kind === b.kind &&
+        (a.kind === 'open' ||
+            (a.length === b.length &&
+                a.data.subarray(0, common).equals(b.data.subarray(0, common))))
+    );
+};
+
+const showTurn = (label: string, turn: CaptureTurn) =>
+    `    ${label.padEnd(9)} ${turn.kind.padEnd(6)} ${String(turn.length).padStart(6)} B ${JSON.stringify(turn.data.subarray(0, 24).toString('latin1'))}`;
+
+const percentiles = (values: number[]) => {
+    const sorted = [...values].sort((a, b) => a - b);
+    return { p50: sorted[sorted.length >> 1], max: sorted.at(-1)! };
+};
+
+// Compares a replay with the capture it replayed, turn by turn, like
+// icap diff: mismatches, then each side's reply times in both
+export const diffCaptures = (recorded: Capture, replayed: Capture) => {
+    // Only one recorder sees events, and they would split its side's
+    // traffic into turns the other saw as one
+    const events = recorded.recorder === replayed.recorder;
+    const keep = (capture: Capture) =>
+        maskSessions(
+            captureTurns({
+                ...capture,
+                records: capture.records.filter(
+                    (record) => events || record.kind !== 'event'
+                ),
+            })
+        );
+    const a = keep(recorded);
+    const b = keep(replayed);
+
+    const lines: string[] = [];
+    const gaps = {
+        device: [] as [number, number][],
+        server: [] as [number, number][],
+    };
+    const common = Math.min(a.length, b.length);
+    let mismatched = 0;
+    for (let i = 0; i < common; i++) {
+        if (!turnsMatch(a[i], b[i])) {
+            lines.push(
+                `turn ${i + 1} differs`,
+                showTurn('recorded', a[i]),
+                showTurn('replayed', b[i])
+            );
+            mismatched++;
+            continue;
+        }
+        const side = a[i].kind;
+        if (
+            (side === 'device' || side === 'server') &&
+            i > 0 &&
+            a[i - 1].kind !== side &&
+            b[i - 1].kind === a[i - 1].kind
+        ) {
+            gaps[side].push([
+                (a[i].startUs - a[i - 1].endUs) / 1000,
+                (b[i].startUs - b[i - 1].endUs) / 1000,
+            ]);
+        }
+    }
+    a.slice(common).forEach((turn, i) =>
+        lines.push(
+            `turn ${common + i + 1} missing`,
+            showTurn('recorded', turn)
+        )
+    );
+    b.slice(common).forEach((turn, i) =>
+        lines.push(
+            `turn ${common + i + 1} extra`,
+            showTurn('replayed', turn)
+        )
+    );
+    lines.push(
+        `turns: ${a.length} recorded, ${b.length} replayed, ${common - mismatched} matched`
+    );
+
+    for (const [side, pairs] of Object.entries(gaps)) {
+        if (pairs.length === 0) {
+            continue;
+        }
+        const was = percentiles(pairs.map(([r]) => r));
+        const now = percentiles(pairs.map(([, p]) => p));
+        const delta = percentiles(pairs.map(([r, p]) => p - r));
+        lines.push(
+            `${`${side} reply`.padEnd(14)} n=${pairs.length} recorded p50 ${was.p50.toFixed(2)} max ${was.max.toFixed(2)}  replayed p50 ${now.p50.toFixed(2)} max ${now.max.toFixed(2)}  delta p50 ${delta.p50.toFixed(2)} ms`
+        );
+    }
+    return {
+        differing: mismatched + (a.length - common) + (b.length - common),
+        lines,
+    };
+};
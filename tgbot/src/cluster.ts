@@ -0,0 +1,103 @@
+import cluster, { Worker } from 'node:cluster';
+import { once } from 'node:events';
+
+export type Role = 'all' | 'device' | 'bot';
+
+// What this process runs; the primary sets it on the workers it forks
+export const role = (process.env.INTERCOM_ROLE ?? 'all') as Role;
+
+// Without DEVICE_WORKERS everything runs in this process. With it, the
+// primary forks that many device workers, which share WSS_PORT through the
+// primary's round-robin connection balancing, plus BOT_WORKERS processes
+// for bot updates. Long polling allows one consumer, so more than one bot
+// worker needs webhook mode, where they share the webhook port the same
+// way. Taps reach the device worker holding the call through the Redis
+// router. Workers that die are replaced.
+//
+// SIGHUP replaces the workers one at a time with fresh ones running the
+// code now on disk. The primary keeps the listening socket throughout, and
+// a device worker only drains once its replacement is listening, so
+// devices never find the port closed and calls move over by resuming.
+export const runCluster = (start: (role: Role) => Promise<void>) => {
+    const deviceWorkers = Number(process.env.DEVICE_WORKERS ?? 0);
+    if (deviceWorkers === 0 || cluster.isWorker) {
+        return start(role);
+    }
+
+    const botWorkers = process.env.WEBHOOK_DOMAIN
+        ? Number(process.env.BOT_WORKERS ?? 1)
+        : 1;
+    let stopping = false;
+    const roles = new Map<Worker, Role>();
+    // Replaced workers, which exit without being restarted
+    const retiring = new Set<Worker>();
+
+    const fork = (role: Role) => {
+        const worker = cluster.fork({ INTERCOM_ROLE: role });
+        roles.set(worker, role);
+        worker.on('exit', (code, signal) => {
+            roles.delete(worker);
+            if (stopping || retiring.delete(worker)) {
+                return;
+            }
+            console.error(
+                `${role} worker ${worker.process.pid} exited with ${signal ?? code}, restarting`
+            );
+            fork(role);
+        });
+        return worker;
+    };
+
+    const retire = async (worker: Worker) => {
+        retiring.add(worker);
+        worker.process.kill('SIGTERM');
+        await once(worker, 'exit');
+    };
+
+    let restarting = false;
+    const restart = async () => {
+        if (restarting || stopping) {
+            return;
+        }
+        restarting = true;
+        for (const [worker, role] of [...roles]) {
+            if (role === 'device') {
+                const replacement = fork(role);
+                await once(replacement, 'listening');
+                await retire(worker);
+            } else {
+                // A second long-polling bot would conflict with this one
+                await retire(worker);
+                fork(role);
+            }
+        }
+        restarting = false;
+        console.log('Workers replaced');
+    };
+
+    for (let i = 0; i < deviceWorkers; i++) {
+        fork('device');
+    }
+    for (let i = 0; i < botWorkers; i++) {
+        fork('bot');
+    }
+
+    // Workers flush their journals on SIGTERM; exit once they all have
+    const stop = () => {
+        stopping = true;
+        Object.values(cluster.workers!).forEach((worker) =>
+            worker?.process.kill('SIGTERM')
+        );
+        cluster.on('exit', () => {
+            if (Object.keys(cluster.workers!).length === 0) {
+                process.exit(0);
+            }
+        });
+    };
+    process.once('SIGINT', stop);
+    process.once('SIGTERM', stop);
+    process.on('SIGHUP', () =>
+        restart().catch((err) => console.error('Restart failed:', err))
+    );
+    return Promise.resolve();
+};
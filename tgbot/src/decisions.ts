@@ -0,0 +1,111 @@
+import { CacheClient } from './cache';
+
+export type Decision = { chatId: number; command: 'accept' | 'reject' };
+
+// A message that carries a call's keyboard
+export type CallKeyboard = { chatId: number; messageId: number };
+
+export type Verdict = {
+    // Whether this decision is the call's
+    won: boolean;
+    // The call's decision, this one or the one that came first
+    decision: Decision;
+    // The call's keyboards so far, for the winner to take down
+    keyboards: CallKeyboard[];
+};
+
+// Like the router's session:<flat> keys
+const ttlSeconds = 600;
+
+// Decides unless the call is decided, and hands the winner the keyboards,
+// all in one round trip. SET NX returns nil, false in Lua, when the key
+// is there.
+const decideScript = `
+    if redis.call('SET', KEYS[1], ARGV[1], 'NX', 'EX', ARGV[2]) then
+        return {1, ARGV[1], redis.call('LRANGE', KEYS[2], 0, -1)}
+    end
+    return {0, redis.call('GET', KEYS[1]), {}}`;
+
+// Takes the decision back, unless another has replaced it since
+const withdrawScript = `
+    if redis.call('GET', KEYS[1]) == ARGV[1] then
+        return redis.call('DEL', KEYS[1])
+    end
+    return 0`;
+
+// Records keyboards and returns the decision, if there is one already
+const keyboardsScript = `
+    redis.call('RPUSH', KEYS[2], unpack(ARGV, 2))
+    redis.call('EXPIRE', KEYS[2], ARGV[1])
+    return redis.call('GET', KEYS[1])`;
+
+const keys = (callId: string) => [
+    `decision:${callId}`,
+    `keyboards:${callId}`,
+];
+
+const encodeDecision = ({ chatId, command }: Decision) =>
+    `${chatId} ${command}`;
+
+const decodeDecision = (value: string): Decision => {
+    const [chatId, command] = value.split(' ');
+    return { chatId: Number(chatId), command: command as Decision['command'] };
+};
+
+const encodeKeyboard = ({ chatId, messageId }: CallKeyboard) =>
+    `${chatId} ${messageId}`;
+
+const decodeKeyboard = (value: string): CallKeyboard => {
+    const [chatId, messageId] = value.split(' ');
+    return { chatId: Number(chatId), messageId: Number(messageId) };
+};
+
+// Every chat bound to a flat gets the call's keyboard, and the first accept
+// or reject among them is the call's; a later one is not sent to the
+// device. decision:<call id> holds the decision and keyboards:<call id> the
+// messages with the keyboard, so whichever process handles the winning tap
+// can take the other residents' down. Keyed by call, a tap on a keyboard
+// left over from an earlier call to the flat can't decide this one.
+export const callDecisions = {
+    open: async (callId: string) => {
+        await CacheClient.eval(
+            `return redis.call('DEL', KEYS[1], KEYS[2])`,
+            keys(callId),
+            []
+        );
+    },
+
+    // Null while the call is undecided. Keyboards that went out after the
+    // decision are not the winner's to take down.
+    keyboards: async (callId: string, keyboards: CallKeyboard[]) => {
+        if (keyboards.length === 0) {
+            return null;
+        }
+        const value = (await CacheClient.eval(keyboardsScript, keys(callId), [
+            ttlSeconds,
+            ...keyboards.map(encodeKeyboard),
+        ])) as string | null;
+        return value === null ? null : decodeDecision(value);
+    },
+
+    decide: async (callId: string, decision: Decision): Promise<Verdict> => {
+        const [won, value, keyboards] = (await CacheClient.eval(
+            decideScript,
+            keys(callId),
+            [encodeDecision(decision), ttlSeconds]
+        )) as [number, string, string[]];
+        return {
+            won: won === 1,
+            decision: decodeDecision(value),
+            keyboards: keyboards.map(decodeKeyboard),
+        };
+    },
+
+    // For a decision that never reached the device, so that the next tap
+    // can still decide the call
+    withdraw: async (callId: string, decision: Decision) => {
+        await CacheClient.eval(withdrawScript, keys(callId), [
+            encodeDecision(decision),
+        ]);
+    },
+};
@@ -0,0 +1,202 @@
+import { randomInt } from 'node:crypto';
+import { CacheClient } from './cache';
+import { frame } from './firmware';
+import { flatsRepo } from './flats';
+
+// The registered flat numbers, which devices keep a copy of to turn wrong
+// numbers away without a call (intercom-idf/src/flat_dir.h has the
+// format). Between calls a device asks
+//   dir                      for the whole directory, or
+//   dir <epoch> <version>    for the changes since the version it holds
+// and is answered with a frame, as for firmware requests.
+//
+// Every write to a binding bumps directory:version and records the numbers
+// it touched in directory:changes, scored by that version. A delta lists
+// each number touched since the device's version as added or removed by
+// what Mongo holds now, so a write racing with a sync is picked up by the
+// next one rather than lost. directory:epoch marks the start of the history;
+// a device from another epoch gets the whole directory again. Bindings
+// edited in Mongo by hand are picked up after DEL directory:epoch.
+const headerSize = 20;
+const formatVersion = 1;
+const kindFull = 0;
+const kindDelta = 1;
+const encodingGaps = 0;
+const encodingBitset = 1;
+// Past this many changed numbers the whole directory is sent instead
+const maxDeltaNumbers = 256;
+
+const keys = ['directory:epoch', 'directory:version', 'directory:changes'];
+
+// Starts a history if there is none; returns the epoch and version
+const stateScript = `
+    local epoch = redis.call('GET', KEYS[1])
+    if not epoch then
+        epoch = ARGV[1]
+        redis.call('SET', KEYS[1], epoch)
+        redis.call('DEL', KEYS[2], KEYS[3])
+    end
+    return {epoch, redis.call('GET', KEYS[2]) or '0'}`;
+
+// Records changed numbers at a new version; nothing to do before a history
+// has been started, as the first device gets the whole directory
+const changeScript = `
+    if redis.call('EXISTS', KEYS[1]) == 0 then return 0 end
+    local version = redis.call('INCR', KEYS[2])
+    for _, number in ipairs(ARGV) do
+        redis.call('ZADD', KEYS[3], version, number)
+    end
+    return version`;
+
+// What a device can hold: u32 flat numbers
+const storable = (flat: number) =>
+    Number.isInteger(flat) && flat >= 0 && flat <= 0xffffffff;
+
+const varintSize = (value: number) => {
+    let size = 1;
+    for (; value >= 0x80; value = Math.floor(value / 0x80)) {
+        size++;
+    }
+    return size;
+};
+
+const putVarint = (out: number[], value: number) => {
+    for (; value >= 0x80; value = Math.floor(value / 0x80)) {
+        out.push((value % 0x80) | 0x80);
+    }
+    out.push(value);
+};
+
+// Ascending numbers: the count, the first, then each distance less one
+const putGaps = (out: number[], flats: number[]) => {
+    putVarint(out, flats.length);
+    flats.forEach((flat, i) =>
+        putVarint(out, i === 0 ? flat : flat - flats[i - 1] - 1)
+    );
+};
+
+const header = (
+    kind: number,
+    encoding: number,
+    epoch: number,
+    version: number,
+    base: number
+) => {
+    const data = Buffer.alloc(headerSize);
+    data.write('IDIR', 0, 'latin1');
+    data.writeUInt8(formatVersion, 4);
+    data.writeUInt8(kind, 5);
+    data.writeUInt8(encoding, 6);
+    data.writeUInt32BE(epoch, 8);
+    data.writeUInt32BE(version, 12);
+    data.writeUInt32BE(base, 16);
+    return data;
+};
+
+const ascending = (flats: number[]) =>
+    [...new Set(flats.filter(storable))].sort((a, b) => a - b);
+
+// The smaller of a gap list and a bitset; a bitset wins for a building
+// numbered 1..N with most flats registered
+export const encodeFull = (
+    epoch: number,
+    version: number,
+    flats: number[]
+) => {
+    const sorted = ascending(flats);
+    const gaps: number[] = [];
+    putGaps(gaps, sorted);
+
+    const first = sorted[0] ?? 0;
+    const span = sorted.length > 0 ? sorted[sorted.length - 1] - first + 1 : 0;
+    const bitsetSize =
+        varintSize(first) + varintSize(span) + Math.ceil(span / 8);
+    if (bitsetSize >= gaps.length) {
+        return Buffer.concat([
+            header(kindFull, encodingGaps, epoch, version, 0),
+            Buffer.from(gaps),
+        ]);
+    }
+    const bitset: number[] = [];
+    putVarint(bitset, first);
+    putVarint(bitset, span);
+    const bits = Buffer.alloc(Math.ceil(span / 8));
+    sorted.forEach((flat) => {
+        const i = flat - first;
+        bits[i >> 3] |= 1 << (i & 7);
+    });
+    return Buffer.concat([
+        header(kindFull, encodingBitset, epoch, version, 0),
+        Buffer.from(bitset),
+        bits,
+    ]);
+};
+
+export const encodeDelta = (
+    epoch: number,
+    version: number,
+    base: number,
+    added: number[],
+    removed: number[]
+) => {
+    const body: number[] = [];
+    putGaps(body, ascending(added));
+    putGaps(body, ascending(removed));
+    return Buffer.concat([
+        header(kindDelta, encodingGaps, epoch, version, base),
+        Buffer.from(body),
+    ]);
+};
+
+const serve = async (epoch?: number, version?: number) => {
+    const [epochText, versionText] = (await CacheClient.eval(
+        stateScript,
+        keys,
+        [randomInt(1, 0x100000000)]
+    )) as [string, string];
+    const current = { epoch: Number(epochText), version: Number(versionText) };
+
+    if (epoch === current.epoch && version! <= current.version) {
+        const changed = (
+            await CacheClient.zrangebyscore(keys[2], `(${version}`, '+inf')
+        )
+            .map(Number)
+            .filter(storable);
+        if (changed.length <= maxDeltaNumbers) {
+            const registered = new Set(
+                changed.length > 0 ? await flatsRepo.registered(changed) : []
+            );
+            return encodeDelta(
+                current.epoch,
+                current.version,
+                version!,
+                changed.filter((flat) => registered.has(flat)),
+                changed.filter((flat) => !registered.has(flat))
+            );
+        }
+    }
+    return encodeFull(
+        current.epoch,
+        current.version,
+        await flatsRepo.numbers()
+    );
+};
+
+flatsRepo.onChange((numbers) => {
+    const changed = numbers.filter(storable);
+    return changed.length > 0
+        ? CacheClient.eval(changeScript, keys, changed)
+        : Promise.resolve();
+});
+
+export const flatDirectory = {
+    // The reply to a directory request, or null if the frame isn't one
+    handle: (request: string): Promise<Buffer> | null => {
+        const [command, ...args] = request.trim().split(' ');
+        if (command !== 'dir' || (args.length !== 0 && args.length !== 2)) {
+            return null;
+        }
+        const [epoch, version] = args.map(Number);
+        return serve(epoch, version).then(frame);
+    },
+};
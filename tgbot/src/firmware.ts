@@ -0,0 +1,120 @@
+import fs from 'node:fs/promises';
+import path from 'node:path';
+
+// Firmware updates for the devices, served from OTA_DIR as patches made
+// with intercom-idf's ota_delta (*.iota): the release compressed on its own,
+// plus deltas from the releases devices are running now. A device asks with
+//   ota <version> <sha256 of its image>
+// and is told which patch to fetch ("<name> <size>", or "none"), then
+// downloads it between calls with
+//   ota_chunk <name> <offset> <length>
+// Each reply is a u32 length and that many bytes.
+const headerSize = 80;
+const deltaFlag = 0x01;
+// CONFIG_INTERCOM_OTA_CHUNK_SIZE is at most 16 KiB
+const maxChunk = 16 * 1024;
+export const maxUpdateRequestLength = 128;
+
+type Patch = {
+    name: string;
+    data: Buffer;
+    delta: boolean;
+    imageHash: string;
+    baseHash: string;
+};
+
+const parsePatch = (name: string, data: Buffer): Patch | null => {
+    if (
+        data.length < headerSize ||
+        data.toString('latin1', 0, 4) !== 'IOTA' ||
+        data.readUInt8(4) !== 1
+    ) {
+        return null;
+    }
+    return {
+        name,
+        data,
+        delta: (data.readUInt8(5) & deltaFlag) !== 0,
+        imageHash: data.toString('hex', 12, 44),
+        baseHash: data.toString('hex', 44, 76),
+    };
+};
+
+// Read once; a new release is rolled out by restarting the servers
+let release: Promise<Patch[]> | null = null;
+
+const loadRelease = async () => {
+    const dir = process.env.OTA_DIR ?? 'firmware';
+    const names = await fs.readdir(dir).catch(() => [] as string[]);
+    const patches: Patch[] = [];
+    for (const name of names.filter((name) => name.endsWith('.iota'))) {
+        const patch = parsePatch(
+            name,
+            await fs.readFile(path.join(dir, name))
+        );
+        if (patch) {
+            patches.push(patch);
+        } else {
+            console.error(`Firmware: ${name} is not a patch`);
+        }
+    }
+    // Everything must build the same image, that of the full patch
+    const target = patches.find((patch) => !patch.delta)?.imageHash;
+    const current = patches.filter((patch) => patch.imageHash === target);
+    if (current.length < patches.length) {
+        console.error('Firmware: ignoring patches for another release');
+    }
+    if (current.length > 0) {
+        console.log(
+            `Firmware ${target!.slice(0, 12)}: ${current.map((patch) => patch.name).join(', ')}`
+        );
+    }
+    return current;
+};
+
+const patches = () => (release ??= loadRelease());
+
+// Replies to requests made between calls: a u32 length, then the payload
+export const frame = (payload: Buffer) => {
+    const data = Buffer.alloc(4 + payload.length);
+    data.writeUInt32BE(payload.length, 0);
+    payload.copy(data, 4);
+    return data;
+};
+
+// The smallest patch that turns the device's image into the release
+const offer = async (imageHash: string) => {
+    const release = await patches();
+    if (release.length === 0 || release[0].imageHash === imageHash) {
+        return 'none';
+    }
+    const patch =
+        release.find(
+            (patch) => patch.delta && patch.baseHash === imageHash
+        ) ?? release.find((patch) => !patch.delta);
+    return `${patch!.name} ${patch!.data.length}`;
+};
+
+const chunk = async (name: string, offset: number, length: number) => {
+    const patch = (await patches()).find((patch) => patch.name === name);
+    if (!patch || !(offset >= 0) || !(length > 0)) {
+        return Buffer.alloc(0);
+    }
+    return patch.data.subarray(offset, offset + Math.min(length, maxChunk));
+};
+
+export const firmwareUpdates = {
+    // The reply to an update request, or null if the frame isn't one
+    handle: (request: string): Promise<Buffer> | null => {
+        const [command, ...args] = request.trim().split(' ');
+        if (command === 'ota' && args.length === 2) {
+            return offer(args[1]).then((reply) => frame(Buffer.from(reply)));
+        }
+        if (command === 'ota_chunk' && args.length === 3) {
+            return chunk(args[0], Number(args[1]), Number(args[2])).then(
+                frame
+            );
+        }
+        return null;
+    },
+};
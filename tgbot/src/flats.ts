@@ -12,7 +12,36 @@ const FlatSchema = new Schema<Flat>({
 
 const FlatModel = model<Flat>('flats', FlatSchema);
 
+// Told the flat numbers whose bindings a write may have changed
+type ChangeListener = (numbers: number[]) => Promise<unknown>;
+
 export class FlatsRepository {
+    private listeners: ChangeListener[] = [];
+
+    onChange(listener: ChangeListener) {
+        this.listeners.push(listener);
+    }
+
+    private async changed(numbers: number[]) {
+        await Promise.all(
+            this.listeners.map((listener) =>
+                listener(numbers).catch((err) =>
+                    console.error('Flat change listener failed:', err)
+                )
+            )
+        );
+    }
+
+    // Every number with at least one resident
+    async numbers(): Promise<number[]> {
+        return FlatModel.distinct('number');
+    }
+
+    // Those of `numbers` with at least one resident
+    async registered(numbers: number[]): Promise<number[]> {
+        return FlatModel.distinct('number', { number: { $in: numbers } });
+    }
+
     async getByChatId(chatId: number): Promise<Flat | null> {
         return FlatModel.findOne({ chatId }).lean();
     }
@@ -21,20 +50,34 @@ export class FlatsRepository {
         return FlatModel.find({ number }).lean();
     }
 
+    // Both writes return the previous binding first, so the number a
+    // resident moved away from is reported along with the new one
     async update(
         chatId: number,
         updateData: Partial<Omit<Flat, 'chatId'>>
     ): Promise<Flat | null> {
-        return FlatModel.findOneAndUpdate({ chatId }, updateData, {
-            new: true,
-        }).lean();
+        const previous = await FlatModel.findOneAndUpdate(
+            { chatId },
+            updateData
+        ).lean();
+        if (!previous) {
+            return null;
+        }
+        const flat = { ...previous, ...updateData };
+        await this.changed([previous.number, flat.number]);
+        return flat;
     }
 
     async upsert(flat: Flat): Promise<Flat> {
-        return FlatModel.findOneAndUpdate({ chatId: flat.chatId }, flat, {
-            new: true,
-            upsert: true,
-        }).lean();
+        const previous = await FlatModel.findOneAndUpdate(
+            { chatId: flat.chatId },
+            flat,
+            { upsert: true }
+        ).lean();
+        await this.changed(
+            previous ? [previous.number, flat.number] : [flat.number]
+        );
+        return { ...previous, ...flat };
     }
 }
 
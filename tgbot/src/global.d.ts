@@ -7,6 +7,29 @@ declare global {
             MONGO_URI: string;
             MONGO_PASSWORD: string;
             MONGO_USER: string;
+            TELEGRAM_API_ROOT?: string;
+            TLS_PSK: string;
+            TLS_PSK_IDENTITY?: string;
+            WEBHOOK_DOMAIN?: string;
+            WEBHOOK_HOST?: string;
+            WEBHOOK_PORT?: string;
+            WEBHOOK_PATH?: string;
+            WEBHOOK_SECRET?: string;
+            MAX_PHOTO_SIZE?: string;
+            PHOTO_TRANSFORMS?: string;
+            ENTRANCE_NAME?: string;
+            IMAGE_WORKERS?: string;
+            IMAGE_QUEUE?: string;
+            SNAPSHOT_DIR?: string;
+            JOURNAL_BATCH?: string;
+            JOURNAL_FLUSH_MS?: string;
+            DEVICE_WORKERS?: string;
+            BOT_WORKERS?: string;
+            INTERCOM_ROLE?: string;
+            SESSION_RESUME?: string;
+            RESUME_GRACE_MS?: string;
+            DRAIN_TIMEOUT_MS?: string;
+            OTA_DIR?: string;
         }
     }
 }
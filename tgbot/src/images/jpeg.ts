@@ -0,0 +1,214 @@
+// Segment-level JPEG edits. Nothing here decodes pixels: the entropy-coded
+// scan is copied through untouched, so every transform is lossless and
+// costs one pass over the frame however many are applied.
+
+export class JpegError extends Error {}
+
+export type ImageOp =
+    // Drop EXIF, XMP, ICC and comment segments the camera or an earlier
+    // step added
+    | { op: 'strip' }
+    // Clockwise rotation viewers should apply, written as EXIF Orientation
+    | { op: 'orient'; degrees: 0 | 90 | 180 | 270 }
+    // Text carried in a COM segment, e.g. the entrance and capture time
+    | { op: 'annotate'; text: string };
+
+type Segment = { marker: number; bytes: Uint8Array };
+
+// Telegram refuses photos over 10 MB, with width + height over 10000 or
+// with an aspect ratio beyond 20
+const maxTelegramBytes = 10 * 1024 * 1024;
+const maxTelegramDimensions = 10_000;
+const maxTelegramRatio = 20;
+
+const SOI = 0xd8;
+const EOI = 0xd9;
+const SOS = 0xda;
+const APP0 = 0xe0;
+const APP1 = 0xe1;
+const APP14 = 0xee;
+const COM = 0xfe;
+
+// SOF0..SOF15, except DHT, JPG and DAC which share the range
+const isFrameHeader = (marker: number) =>
+    marker >= 0xc0 &&
+    marker <= 0xcf &&
+    marker !== 0xc4 &&
+    marker !== 0xc8 &&
+    marker !== 0xcc;
+
+const exifSignature = [0x45, 0x78, 0x69, 0x66, 0, 0]; // "Exif\0\0"
+
+const isExif = (segment: Segment) =>
+    segment.marker === APP1 &&
+    exifSignature.every((byte, i) => segment.bytes[4 + i] === byte);
+
+// APP0 (JFIF) and APP14 (Adobe colour transform) affect decoding; the
+// other application segments and comments don't
+const isMetadata = (marker: number) =>
+    marker === COM || (marker > APP0 && marker <= 0xef && marker !== APP14);
+
+export const parseJpeg = (frame: Uint8Array) => {
+    if (frame.length < 4 || frame[0] !== 0xff || frame[1] !== SOI) {
+        throw new JpegError('missing SOI');
+    }
+    if (frame[frame.length - 2] !== 0xff || frame[frame.length - 1] !== EOI) {
+        throw new JpegError('missing EOI');
+    }
+
+    const segments: Segment[] = [];
+    let width = 0;
+    let height = 0;
+    let offset = 2;
+    while (offset + 4 <= frame.length) {
+        if (frame[offset] !== 0xff) {
+            throw new JpegError(`no marker at offset ${offset}`);
+        }
+        const marker = frame[offset + 1];
+        if (marker === 0xff) {
+            // Fill byte before a marker
+            offset++;
+            continue;
+        }
+        const length = (frame[offset + 2] << 8) | frame[offset + 3];
+        const end = offset + 2 + length;
+        if (length < 2 || end > frame.length) {
+            throw new JpegError(`truncated segment at offset ${offset}`);
+        }
+        if (marker === SOS) {
+            if (width === 0 || height === 0) {
+                throw new JpegError('no frame header before scan');
+            }
+            return { width, height, segments, scan: frame.subarray(offset) };
+        }
+        if (isFrameHeader(marker)) {
+            height = (frame[offset + 5] << 8) | frame[offset + 6];
+            width = (frame[offset + 7] << 8) | frame[offset + 8];
+        }
+        segments.push({ marker, bytes: frame.subarray(offset, end) });
+        offset = end;
+    }
+    throw new JpegError('no scan');
+};
+
+const segment = (marker: number, payload: Uint8Array): Segment => {
+    const bytes = new Uint8Array(4 + payload.length);
+    bytes[0] = 0xff;
+    bytes[1] = marker;
+    bytes[2] = (payload.length + 2) >> 8;
+    bytes[3] = (payload.length + 2) & 0xff;
+    bytes.set(payload, 4);
+    return { marker, bytes };
+};
+
+const orientationTags = { 0: 1, 90: 6, 180: 3, 270: 8 };
+
+// Big-endian TIFF header with a single IFD holding Orientation (0x0112)
+const exifSegment = (degrees: 0 | 90 | 180 | 270) =>
+    segment(
+        APP1,
+        Uint8Array.from([
+            ...exifSignature,
+            ...[0x4d, 0x4d, 0x00, 0x2a, 0x00, 0x00, 0x00, 0x08],
+            ...[0x00, 0x01],
+            ...[0x01, 0x12, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01],
+            ...[0x00, orientationTags[degrees], 0x00, 0x00],
+            ...[0x00, 0x00, 0x00, 0x00],
+        ])
+    );
+
+const commentSegment = (text: string) =>
+    segment(COM, new TextEncoder().encode(text).subarray(0, 0xffff - 2));
+
+// JFIF wants APP0 right after SOI; everything we add goes after it
+const afterApp0 = (header: Segment[]) =>
+    header.length > 0 && header[0].marker === APP0 ? 1 : 0;
+
+const afterAppSegments = (header: Segment[]) => {
+    let index = 0;
+    while (
+        index < header.length &&
+        header[index].marker >= APP0 &&
+        header[index].marker <= 0xef
+    ) {
+        index++;
+    }
+    return index;
+};
+
+// Apply ops in order and lay the result out in a new ArrayBuffer that can
+// be transferred back to the caller
+export const applyOps = (frame: Uint8Array, ops: ImageOp[]) => {
+    const { width, height, segments, scan } = parseJpeg(frame);
+    if (
+        width + height > maxTelegramDimensions ||
+        Math.max(width, height) / Math.min(width, height) > maxTelegramRatio
+    ) {
+        throw new JpegError(`${width}x${height} exceeds Telegram limits`);
+    }
+
+    let header = segments;
+    for (const op of ops) {
+        switch (op.op) {
+            case 'strip':
+                header = header.filter((s) => !isMetadata(s.marker));
+                break;
+            case 'orient':
+                header = header.filter((s) => !isExif(s));
+                header.splice(afterApp0(header), 0, exifSegment(op.degrees));
+                break;
+            case 'annotate':
+                header.splice(
+                    afterAppSegments(header),
+                    0,
+                    commentSegment(op.text)
+                );
+                break;
+        }
+    }
+
+    let size = 2 + scan.length;
+    header.forEach((s) => (size += s.bytes.length));
+    if (size > maxTelegramBytes) {
+        throw new JpegError(`${size} bytes exceeds Telegram limits`);
+    }
+    const output = new Uint8Array(size);
+    output[0] = 0xff;
+    output[1] = SOI;
+    let offset = 2;
+    header.forEach((s) => {
+        output.set(s.bytes, offset);
+        offset += s.bytes.length;
+    });
+    output.set(scan, offset);
+    return { data: output.buffer, width, height };
+};
+
+// "strip,orient:90,annotate" -> ops, applied in that order; annotate text
+// is filled in per frame
+export const parseImageOps = (spec: string): ImageOp[] =>
+    spec
+        .split(',')
+        .map((item) => item.trim())
+        .filter((item) => item.length > 0)
+        .map((item): ImageOp => {
+            const [name, arg] = item.split(':');
+            switch (name) {
+                case 'strip':
+                    return { op: 'strip' };
+                case 'annotate':
+                    return { op: 'annotate', text: arg ?? '' };
+                case 'orient': {
+                    const degrees = Number(arg ?? 0);
+                    if (![0, 90, 180, 270].includes(degrees)) {
+                        throw new Error(`Bad rotation in "${item}"`);
+                    }
+                    return {
+                        op: 'orient',
+                        degrees: degrees as 0 | 90 | 180 | 270,
+                    };
+                }
+                default:
+                    throw new Error(`Unknown image op "${item}"`);
+            }
+        });
@@ -0,0 +1,136 @@
+import os from 'node:os';
+import { Worker } from 'node:worker_threads';
+import type { ImageOp } from './jpeg';
+import type { ImageJob, ImageReply } from './worker';
+
+export type { ImageReply };
+
+// Refused because every worker is busy and the queue is full. The frame
+// passed to run() was not transferred and is still the caller's.
+export class ImagePoolBusyError extends Error {}
+
+type Pending = {
+    job: ImageJob;
+    resolve: (reply: ImageReply) => void;
+    reject: (err: Error) => void;
+};
+
+// Fixed set of workers fed from a bounded FIFO, so image work never runs on
+// the event loop that serves the devices. Frames are transferred rather
+// than copied both ways: run() takes ownership of the ArrayBuffer and the
+// reply carries a new one. When the queue is full run() refuses the job
+// instead of buffering more frames; callers check `saturated` first to
+// fall back before they commit to a buffered frame.
+export class ImagePool {
+    private idle: Worker[] = [];
+    private running = new Map<Worker, Pending>();
+    private queue: Pending[] = [];
+    private nextId = 1;
+    private closed = false;
+
+    constructor(
+        readonly size: number,
+        readonly maxQueue: number
+    ) {
+        for (let i = 0; i < size; i++) {
+            this.spawn();
+        }
+    }
+
+    get queued() {
+        return this.queue.length;
+    }
+
+    get busy() {
+        return this.running.size;
+    }
+
+    get saturated() {
+        return this.idle.length === 0 && this.queue.length >= this.maxQueue;
+    }
+
+    run(data: ArrayBuffer, ops: ImageOp[]) {
+        if (this.closed) {
+            return Promise.reject(new Error('Image pool is closed'));
+        }
+        if (this.saturated) {
+            return Promise.reject(
+                new ImagePoolBusyError(`${this.queue.length} jobs queued`)
+            );
+        }
+        return new Promise<ImageReply>((resolve, reject) => {
+            const pending = {
+                job: { id: this.nextId++, data, ops },
+                resolve,
+                reject,
+            };
+            const worker = this.idle.pop();
+            if (worker) {
+                this.dispatch(worker, pending);
+            } else {
+                this.queue.push(pending);
+            }
+        });
+    }
+
+    async close() {
+        this.closed = true;
+        this.queue.forEach((p) => p.reject(new Error('Image pool closed')));
+        this.queue = [];
+        const workers = [...this.idle, ...this.running.keys()];
+        this.idle = [];
+        await Promise.all(workers.map((worker) => worker.terminate()));
+    }
+
+    private spawn() {
+        const worker = new Worker(new URL('./worker.js', import.meta.url));
+        worker.on('message', (reply: ImageReply) => {
+            const pending = this.running.get(worker)!;
+            this.running.delete(worker);
+            pending.resolve(reply);
+            this.next(worker);
+        });
+        worker.on('error', (err) => {
+            // The job's frame went down with the worker
+            console.error('Image worker failed:', err);
+            this.running.get(worker)?.reject(err);
+            this.running.delete(worker);
+            this.idle = this.idle.filter((w) => w !== worker);
+        });
+        worker.on('exit', () => {
+            if (!this.closed) {
+                this.spawn();
+            }
+        });
+        this.next(worker);
+    }
+
+    private next(worker: Worker) {
+        if (this.closed) {
+            return;
+        }
+        const pending = this.queue.shift();
+        if (pending) {
+            this.dispatch(worker, pending);
+        } else {
+            this.idle.push(worker);
+        }
+    }
+
+    private dispatch(worker: Worker, pending: Pending) {
+        this.running.set(worker, pending);
+        worker.postMessage(pending.job, [pending.job.data]);
+    }
+}
+
+let pool: ImagePool | null = null;
+
+// Shared pool, started on first use. Leaves a core for the event loop.
+export const imagePool = () =>
+    (pool ??= new ImagePool(
+        Number(
+            process.env.IMAGE_WORKERS ??
+                Math.max(1, os.availableParallelism() - 1)
+        ),
+        Number(process.env.IMAGE_QUEUE ?? 8)
+    ));
@@ -0,0 +1,21 @@
+// Image pool worker: one job at a time, frames arrive and leave as
+// transferred ArrayBuffers.
+import { parentPort } from 'node:worker_threads';
+import { applyOps, ImageOp } from './jpeg';
+
+export type ImageJob = { id: number; data: ArrayBuffer; ops: ImageOp[] };
+
+export type ImageReply =
+    | { id: number; data: ArrayBuffer; width: number; height: number }
+    // The untouched frame comes back so the caller can still use it
+    | { id: number; data: ArrayBuffer; error: string };
+
+parentPort!.on('message', ({ id, data, ops }: ImageJob) => {
+    let reply: ImageReply;
+    try {
+        reply = { id, ...applyOps(new Uint8Array(data), ops) };
+    } catch (err) {
+        reply = { id, data, error: (err as Error).message };
+    }
+    parentPort!.postMessage(reply, [reply.data]);
+});
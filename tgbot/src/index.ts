@@ -1,16 +1,41 @@
-import { bot } from './bot';
-import { server } from './wss';
+import { bot, launchBot } from './bot';
+import { drain, listenOptions, server } from './wss';
+import { callJournal } from './journal';
+import { Role, runCluster } from './cluster';
 import mongoose from 'mongoose';
 
-await mongoose.connect(process.env.MONGO_URI as string, {
-    user: process.env.MONGO_USER,
-    pass: process.env.MONGO_PASSWORD,
-});
+await runCluster(async (role: Role) => {
+    await mongoose.connect(process.env.MONGO_URI as string, {
+        user: process.env.MONGO_USER,
+        pass: process.env.MONGO_PASSWORD,
+    });
 
-bot.launch(() => {
-    console.log('BOT started');
-});
+    if (role !== 'device') {
+        launchBot(() => {
+            console.log('BOT started');
+        });
+    }
+
+    if (role !== 'bot') {
+        server.listen(listenOptions(Number(process.env.WSS_PORT)), () => {
+            console.log('Socket Server started');
+        });
+    }
+
+    // Calls in progress are handed over to the next server and calls still
+    // buffered for the journal are written before exiting
+    const shutdown = async (signal: string) => {
+        if (role !== 'device') {
+            bot.stop(signal);
+        }
+        if (role !== 'bot') {
+            await drain();
+        }
+        await callJournal.flush();
+        await mongoose.disconnect();
+        process.exit(0);
+    };
 
-server.listen(Number(process.env.WSS_PORT), () => {
-    console.log('Socket Server started');
+    process.once('SIGINT', () => shutdown('SIGINT'));
+    process.once('SIGTERM', () => shutdown('SIGTERM'));
 });
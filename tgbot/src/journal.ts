@@ -0,0 +1,166 @@
+import { randomBytes } from 'node:crypto';
+import { BatchWriter } from './batch-writer';
+import { Call, CallOutcome, callsRepo } from './calls';
+import { SessionRecord, sessionStore } from './session-store';
+
+const writer = new BatchWriter<Call>((calls) => callsRepo.insertMany(calls), {
+    maxBatch: Number(process.env.JOURNAL_BATCH ?? 500),
+    flushMs: Number(process.env.JOURNAL_FLUSH_MS ?? 1000),
+});
+
+// Tells apart the ActiveCalls a resumed call has had
+const newHolder = () => randomBytes(8).toString('hex');
+
+// A call while it is in progress. It is journaled once, when it ends,
+// after any snapshots still being stored have their hashes.
+//
+// Once the device has been given the call's id (persist()), every change
+// is also written through to the session store, so the call can be resumed
+// on another server if this one goes away before it ends. The store takes
+// writes from one holder at a time; once the device has resumed the call
+// elsewhere this one stops writing, and leaves journaling it to the new
+// holder.
+export class ActiveCall {
+    private record: Call;
+    private holder: string;
+    private snapshots: Promise<void>[] = [];
+    private ended = false;
+    private persisted = false;
+    private removed = false;
+    // Writes to the session store, in order
+    private saved: Promise<void> = Promise.resolve();
+
+    // A resumed call comes with the holder that claimed it
+    constructor(record: SessionRecord, holder?: string) {
+        this.record = {
+            ...record,
+            endedAt: record.startedAt,
+            outcome: 'abandoned',
+        };
+        this.holder = holder ?? newHolder();
+        this.persisted = holder !== undefined;
+    }
+
+    get id() {
+        return this.record.sessionId;
+    }
+
+    get flat() {
+        return this.record.flat;
+    }
+
+    stage(name: keyof Call['stages']) {
+        if (!this.record.stages[name]) {
+            this.record.stages[name] = new Date();
+            this.save();
+        }
+    }
+
+    decide(chatId: number) {
+        this.stage('decided');
+        if (this.record.decidedBy === undefined) {
+            this.record.decidedBy = chatId;
+            this.save();
+        }
+    }
+
+    snapshot(hash: Promise<string | null>) {
+        this.snapshots.push(
+            hash.then((hash) => {
+                if (hash !== null) {
+                    this.record.snapshots.push(hash);
+                    this.save();
+                }
+            })
+        );
+    }
+
+    // Make the call resumable; resolves once the record is stored
+    persist() {
+        this.persisted = true;
+        this.save();
+        return this.saved;
+    }
+
+    // This server is going away but the call isn't over: store it with its
+    // snapshots for the server the device resumes on, which journals it
+    async suspend() {
+        if (this.ended) {
+            return;
+        }
+        this.ended = true;
+        await Promise.all(this.snapshots);
+        await this.saved;
+    }
+
+    async end(outcome: CallOutcome) {
+        if (this.ended) {
+            return;
+        }
+        this.ended = true;
+        this.record.endedAt = new Date();
+        this.record.outcome = outcome;
+        await Promise.all(this.snapshots);
+        if (!this.persisted) {
+            writer.push(this.record);
+            return;
+        }
+        this.removed = true;
+        this.saved = this.saved
+            .then(() => sessionStore.remove(this.record, this.holder))
+            // Journaled twice beats not at all
+            .catch((err) => {
+                console.error('Removing session failed:', err);
+                return true;
+            })
+            .then((held) => {
+                if (held) {
+                    writer.push(this.record);
+                }
+            });
+    }
+
+    private save() {
+        if (!this.persisted || this.removed) {
+            return;
+        }
+        this.saved = this.saved
+            .then(() => sessionStore.save(this.record, this.holder))
+            .then((held) => {
+                if (!held) {
+                    console.log(`Call ${this.id} was resumed elsewhere`);
+                    this.ended = true;
+                    this.removed = true;
+                }
+            })
+            .catch((err) => console.error('Saving session failed:', err));
+    }
+}
+
+export const callJournal = {
+    // Ids are short enough for the device to hold and present on resume
+    begin: (flat: number, device: string) =>
+        new ActiveCall({
+            sessionId: randomBytes(8).toString('hex'),
+            device,
+            flat,
+            startedAt: new Date(),
+            stages: {},
+            snapshots: [],
+        }),
+    // The call with this id, as the server that had it last stored it;
+    // null if it has ended or expired. Claiming it first fences off
+    // whichever holder had it, here or on another server.
+    resume: async (sessionId: string) => {
+        if (!/^[0-9a-f]{16}$/.test(sessionId)) {
+            return null;
+        }
+        const holder = newHolder();
+        const record = (await sessionStore.claim(sessionId, holder))
+            ? await sessionStore.load(sessionId)
+            : null;
+        return record ? new ActiveCall(record, holder) : null;
+    },
+    // Write out buffered calls, e.g. before shutting down
+    flush: () => writer.flush(),
+};
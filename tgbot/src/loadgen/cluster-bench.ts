@@ -0,0 +1,170 @@
+// Device channel scaling across processes on one machine. For each --scale
+// entry N the server runs with N device workers (DEVICE_WORKERS), and
+// --clients client processes of --connections devices each drive it for
+// --duration seconds with not_found calls: TLS connect or resumption, two
+// commands and the reply, with no Bot API in the way.
+//
+//   npm run build && npm run cluster-bench -- --scale 1,2,4 --duration 20
+//
+// Give the clients at least as many cores as the largest N, or they become
+// the bottleneck; with fewer than twice that many cores in all the run says
+// so, as workers and clients then share them. Each connection makes one
+// call at a time, so for the workers' capacity rather than the clients'
+// pacing run with --frame-gap 0 and enough connections to keep them busy.
+// Cluster mode routes taps through Redis, so REDIS_PATH must point at one
+// even though this path doesn't use it.
+import { config } from './config';
+import { ChildProcess, spawn } from 'node:child_process';
+import { once } from 'node:events';
+import os from 'node:os';
+import { fileURLToPath } from 'node:url';
+import { TelegramMock } from './telegram-mock';
+
+const script = (name: string) =>
+    fileURLToPath(new URL(`./${name}.js`, import.meta.url));
+
+const port = 18_300;
+
+const startServer = (workers: number) =>
+    new Promise<ChildProcess>((resolve, reject) => {
+        const child = spawn(
+            process.execPath,
+            [
+                script('server'),
+                '--devices',
+                String(config.devices),
+                '--telegram-port',
+                String(config.telegramPort),
+            ],
+            {
+                env: {
+                    ...process.env,
+                    WSS_PORT: String(port),
+                    DEVICE_WORKERS: String(workers),
+                },
+                stdio: ['ignore', 'pipe', 'inherit'],
+            }
+        );
+        // Keep reading after "ready" so the server never blocks on its logs
+        let output = '';
+        let ready = false;
+        child.stdout!.on('data', (chunk) => {
+            if (!ready) {
+                output += chunk;
+                ready = output.split('\n').includes('ready');
+                if (ready) {
+                    resolve(child);
+                }
+            }
+        });
+        child.once('exit', () =>
+            reject(new Error('Server exited before it was ready'))
+        );
+    });
+
+const runClient = async (index: number) => {
+    const child = spawn(
+        process.execPath,
+        [
+            script('cluster-client'),
+            '--target',
+            `127.0.0.1:${port}`,
+            '--connections',
+            String(config.connections),
+            '--duration',
+            String(config.durationMs / 1000),
+            '--frame-gap',
+            String(config.frameGapMs),
+            '--seed',
+            String(index + 1),
+        ],
+        { stdio: ['ignore', 'pipe', 'inherit'] }
+    );
+    let output = '';
+    child.stdout!.on('data', (chunk) => (output += chunk));
+    await once(child, 'exit');
+    return JSON.parse(output) as {
+        calls: number;
+        errors: Record<string, number>;
+        connectP99: number;
+        callP50: number;
+        callP99: number;
+    };
+};
+
+const stopServer = async (child: ChildProcess) => {
+    child.kill('SIGTERM');
+    await once(child, 'exit');
+};
+
+// The bot workers need a Bot API to launch against
+const telegram = new TelegramMock();
+await telegram.listen(config.telegramPort);
+
+const cores = os.availableParallelism();
+const coresShared = cores < 2 * Math.max(...config.scale);
+const results: object[] = [];
+let baseline = 0;
+if (!config.json) {
+    console.log(
+        `${config.clients} clients x ${config.connections} connections, ${config.durationMs / 1000} s per run, ${cores} cores`
+    );
+    if (coresShared) {
+        console.log(
+            'Workers and clients share the cores; speedups are not scaling'
+        );
+    }
+    console.log(
+        'workers    calls/s  speedup  connect p99  call p50  call p99 (ms)  errors'
+    );
+}
+
+for (const workers of config.scale) {
+    const server = await startServer(workers);
+    const clients = await Promise.all(
+        Array.from({ length: config.clients }, (_, i) => runClient(i))
+    );
+    await stopServer(server);
+
+    let calls = 0;
+    let errors = 0;
+    clients.forEach((client) => {
+        calls += client.calls;
+        Object.values(client.errors).forEach((count) => (errors += count));
+    });
+    // Worst client, so one starved client can't hide behind the others
+    const worst = (key: 'connectP99' | 'callP50' | 'callP99') =>
+        Math.max(...clients.map((client) => client[key]));
+    const callsPerSecond = calls / (config.durationMs / 1000);
+    baseline ||= callsPerSecond;
+
+    const result = {
+        workers,
+        callsPerSecond,
+        speedup: callsPerSecond / baseline,
+        connectP99: worst('connectP99'),
+        callP50: worst('callP50'),
+        callP99: worst('callP99'),
+        errors,
+    };
+    results.push(result);
+    if (!config.json) {
+        console.log(
+            [
+                String(workers).padStart(7),
+                callsPerSecond.toFixed(0).padStart(10),
+                result.speedup.toFixed(2).padStart(8),
+                result.connectP99.toFixed(1).padStart(12),
+                result.callP50.toFixed(1).padStart(9),
+                result.callP99.toFixed(1).padStart(9),
+                String(errors).padStart(14),
+            ].join(' ')
+        );
+    }
+}
+
+if (config.json) {
+    console.log(JSON.stringify({ config, cores, coresShared, results }));
+}
+await telegram.close();
+process.exit(0);
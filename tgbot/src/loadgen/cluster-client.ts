@@ -0,0 +1,59 @@
+// One client process of cluster-bench: --connections simulated devices,
+// each repeating connect (resuming its TLS session), start, an unknown flat
+// and the server's not_found reply until --duration is up. That path needs
+// no Bot API, so the server's device workers are all that is measured.
+// Prints one JSON line.
+import { config } from './config';
+import { setTimeout as sleep } from 'node:timers/promises';
+import { DeviceLink, LoadError } from './device';
+import { Histogram } from './stats';
+
+const [host, port] = config.target!.split(':');
+const connect = new Histogram();
+const call = new Histogram();
+const errors: Record<string, number> = {};
+
+const runDevice = async (index: number, deadline: number) => {
+    // Session cache key; distinct per client process and connection
+    const flat = config.seed * 100_000 + index;
+    while (performance.now() < deadline) {
+        const started = performance.now();
+        try {
+            const { link } = await DeviceLink.connect(host, Number(port), flat);
+            connect.record(performance.now() - started);
+            try {
+                await link.write('start');
+                await sleep(config.frameGapMs);
+                await link.write('0');
+                const reply = await link.next(config.callTimeoutMs);
+                if (reply !== 'not_found') {
+                    throw new LoadError(`unexpected:${reply}`);
+                }
+            } finally {
+                link.close();
+            }
+            call.record(performance.now() - started);
+        } catch (err) {
+            const kind = err instanceof LoadError ? err.message : 'internal';
+            errors[kind] = (errors[kind] ?? 0) + 1;
+        }
+    }
+};
+
+const deadline = performance.now() + config.durationMs;
+const devices: Promise<void>[] = [];
+for (let i = 0; i < config.connections; i++) {
+    devices.push(runDevice(i, deadline));
+}
+await Promise.all(devices);
+
+console.log(
+    JSON.stringify({
+        calls: call.count,
+        errors,
+        connectP99: connect.percentile(99),
+        callP50: call.percentile(50),
+        callP99: call.percentile(99),
+    })
+);
+process.exit(0);
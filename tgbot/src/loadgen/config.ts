@@ -0,0 +1,139 @@
+import os from 'node:os';
+import path from 'node:path';
+import { parseArgs } from 'node:util';
+
+// Parsed before the bot module is evaluated, so the bot picks up the mock
+// Bot API root. Keep this the first import of the load generator.
+const { values } = parseArgs({
+    options: {
+        devices: { type: 'string', default: '50' },
+        rate: { type: 'string', default: '2' },
+        duration: { type: 'string', default: '60' },
+        seed: { type: 'string', default: '1' },
+        'frame-gap': { type: 'string', default: '500' },
+        'think-time': { type: 'string', default: '300' },
+        'photo-ratio': { type: 'string', default: '0.3' },
+        'reject-ratio': { type: 'string', default: '0.2' },
+        'cancel-ratio': { type: 'string', default: '0.1' },
+        'unknown-ratio': { type: 'string', default: '0.05' },
+        'photo-size': { type: 'string', default: '20000' },
+        'uplink-rate': { type: 'string', default: '0' },
+        'upload-rate': { type: 'string', default: '0' },
+        'photo-sizes': {
+            type: 'string',
+            default: '16384,65536,262144,1048576',
+        },
+        samples: { type: 'string', default: '10' },
+        rows: { type: 'string', default: '1000000' },
+        flats: { type: 'string', default: '1000' },
+        queries: { type: 'string', default: '1000' },
+        'max-p99': { type: 'string', default: '50' },
+        reset: { type: 'boolean', default: false },
+        scale: { type: 'string', default: '1,2,4' },
+        clients: {
+            type: 'string',
+            default: String(os.availableParallelism()),
+        },
+        connections: { type: 'string', default: '32' },
+        'image-ops': { type: 'string', default: 'strip,orient:90,annotate' },
+        workers: {
+            type: 'string',
+            default: String(Math.max(1, os.availableParallelism() - 1)),
+        },
+        'call-timeout': { type: 'string', default: '15000' },
+        'telegram-port': { type: 'string', default: '18081' },
+        webhook: { type: 'boolean', default: false },
+        'webhook-port': { type: 'string', default: '18082' },
+        'max-errors': { type: 'string', default: '-1' },
+        target: { type: 'string' },
+        backend: { type: 'string', default: 'memory' },
+        json: { type: 'boolean', default: false },
+        'redis-cache': { type: 'boolean', default: false },
+        'restart-every': { type: 'string', default: '10' },
+        rolling: { type: 'boolean', default: false },
+        capture: { type: 'string' },
+        speed: { type: 'string', default: '1' },
+        'capture-out': { type: 'string' },
+        residents: { type: 'string', default: '4' },
+        rounds: { type: 'string', default: '1000' },
+    },
+});
+
+export const config = {
+    // Number of simulated intercoms, each bound to its own flat and resident
+    devices: Number(values.devices),
+    // Mean call arrivals per device per minute (Poisson)
+    ratePerMinute: Number(values.rate),
+    durationMs: Number(values.duration) * 1000,
+    seed: Number(values.seed),
+    // Pause between consecutive device writes, mirrors vTaskDelay in main.c
+    frameGapMs: Number(values['frame-gap']),
+    thinkTimeMs: Number(values['think-time']),
+    photoRatio: Number(values['photo-ratio']),
+    rejectRatio: Number(values['reject-ratio']),
+    cancelRatio: Number(values['cancel-ratio']),
+    unknownRatio: Number(values['unknown-ratio']),
+    photoSize: Number(values['photo-size']),
+    // KiB/s from device to server and from server to the Bot API; 0 is
+    // unthrottled loopback
+    uplinkRate: Number(values['uplink-rate']),
+    uploadRate: Number(values['upload-rate']),
+    // photo-bench only: frame sizes to sweep and calls per size
+    photoSizes: values['photo-sizes']!.split(',').map(Number),
+    samples: Number(values.samples),
+    // image-bench only: PHOTO_TRANSFORMS-style ops and image pool size
+    imageOps: values['image-ops']!,
+    workers: Number(values.workers),
+    // journal-bench only: calls to seed over how many flats, "last 20
+    // visitors" queries to time and their p99 budget in ms
+    rows: Number(values.rows),
+    flats: Number(values.flats),
+    queries: Number(values.queries),
+    maxP99Ms: Number(values['max-p99']),
+    // Drop the calls collection before seeding
+    reset: values.reset!,
+    // cluster-bench only: device worker counts to compare, client processes
+    // and concurrent device connections per client process
+    scale: values.scale!.split(',').map(Number),
+    clients: Number(values.clients),
+    connections: Number(values.connections),
+    // restart-bench only: seconds between server restarts, and whether to
+    // restart cluster workers with SIGHUP instead of whole servers
+    restartEveryMs: Number(values['restart-every']) * 1000,
+    rolling: values.rolling!,
+    // replay only: the capture to play, how many times faster than it was
+    // recorded, and where to write the replay's own capture
+    capture: values.capture ?? null,
+    speed: Number(values.speed),
+    captureOut: values['capture-out'] ?? null,
+    // decision-bench only: chats bound to the flat, all tapping at once, and
+    // rounds of taps straight at the arbitration script
+    residents: Number(values.residents),
+    rounds: Number(values.rounds),
+    // Keep the cache in Redis with the memory backend, so call sessions
+    // outlive the server process
+    redisCache: values['redis-cache']!,
+    callTimeoutMs: Number(values['call-timeout']),
+    telegramPort: Number(values['telegram-port']),
+    // Deliver taps by webhook instead of getUpdates long polling
+    webhook: values.webhook!,
+    webhookPort: Number(values['webhook-port']),
+    maxErrors: Number(values['max-errors']),
+    target: values.target ?? null,
+    backend: values.backend as 'memory' | 'real',
+    json: values.json!,
+};
+
+process.env.BOT_TOKEN ||= '1:loadgen';
+process.env.TELEGRAM_API_ROOT = `http://127.0.0.1:${config.telegramPort}`;
+if (config.webhook) {
+    process.env.WEBHOOK_DOMAIN = `127.0.0.1:${config.webhookPort}`;
+    process.env.WEBHOOK_HOST = '127.0.0.1';
+    process.env.WEBHOOK_PORT = String(config.webhookPort);
+    process.env.WEBHOOK_PATH = '/telegram';
+    process.env.WEBHOOK_SECRET = 'loadgen';
+}
+// Loadgen photos are all alike; dedup keeps this to one file per size
+process.env.SNAPSHOT_DIR ||= path.join(os.tmpdir(), 'intercom-loadgen');
+// Must match the target's TLS_PSK when --target is used
+process.env.TLS_PSK ||= '6c6f616467656e2d70736b2d30303031';
@@ -0,0 +1,238 @@
+// Residents of one flat answering a call at once. Every chat bound to the
+// flat taps accept or reject at the same moment; exactly one decision
+// must reach the device, the others must be told it's handled, and every
+// keyboard must come down. A tap on the previous call's keyboard must not
+// reach the device at all.
+//
+//   npm run build && npm run decision-bench -- --residents 4 --samples 50
+//
+// First --rounds rounds of taps go straight at the arbitration script, to
+// time its round trip, then --samples calls run end to end through the
+// server and bot in-process against the Bot API mock. The cache is the
+// Redis at REDIS_PATH, or on localhost; flats are kept in memory.
+import { config } from './config';
+import { setTimeout as sleep } from 'node:timers/promises';
+import { bot } from '../bot';
+import { callDecisions, Decision, Verdict } from '../decisions';
+import { flatsRepo } from '../flats';
+import { server } from '../wss';
+import { DeviceLink, LoadError } from './device';
+import { createRng } from './rng';
+import { Stats } from './stats';
+import { BotApiCall, TelegramMock } from './telegram-mock';
+import { chatIdBase, setupBackend, startInProcess } from './standins';
+
+const flat = 1;
+const residents = Array.from(
+    { length: config.residents },
+    (_, i) => chatIdBase + 1000 + i
+);
+const rng = createRng(config.seed);
+const draw = (): Decision['command'] =>
+    rng.chance(0.5) ? 'accept' : 'reject';
+// After the first command, how long a second one has to show up
+const settleMs = 300;
+
+const telegram = new TelegramMock();
+await telegram.listen(config.telegramPort);
+await setupBackend('memory', true);
+await Promise.all(
+    residents.map((chatId) => flatsRepo.upsert({ chatId, number: flat }))
+);
+
+const stats = new Stats();
+stats.start();
+
+// One winner, whose decision every tap sees, and all keyboards to it
+const checkVerdicts = (verdicts: Verdict[]) => {
+    const winners = verdicts.filter((verdict) => verdict.won);
+    if (winners.length !== 1) {
+        return `winners:${winners.length}`;
+    }
+    const [winner] = winners;
+    if (
+        verdicts.some(
+            (verdict) =>
+                verdict.decision.chatId !== winner.decision.chatId ||
+                verdict.decision.command !== winner.decision.command
+        )
+    ) {
+        return 'split';
+    }
+    return winner.keyboards.length === residents.length ? null : 'keyboards';
+};
+
+for (let round = 0; round < config.rounds; round++) {
+    const callId = `round${round}`;
+    await callDecisions.open(callId);
+    await callDecisions.keyboards(
+        callId,
+        residents.map((chatId, i) => ({ chatId, messageId: i + 1 }))
+    );
+    const verdicts = await Promise.all(
+        residents.map(async (chatId) => {
+            const started = performance.now();
+            const verdict = await callDecisions.decide(callId, {
+                chatId,
+                command: draw(),
+            });
+            stats.stage('arbitrate', performance.now() - started);
+            return verdict;
+        })
+    );
+    const failure = checkVerdicts(verdicts);
+    if (failure) {
+        stats.error(failure);
+    }
+}
+
+const target = await startInProcess();
+let seen: BotApiCall[] = [];
+telegram.onCall = (call) => seen.push(call);
+
+const waitFor = async (done: () => boolean) => {
+    const deadline = performance.now() + config.callTimeoutMs;
+    while (!done()) {
+        if (performance.now() >= deadline) {
+            return false;
+        }
+        await sleep(5);
+    }
+    return true;
+};
+
+// A resident's keyboard from the call before
+type StaleTap = { data: string; messageId: number };
+
+const runCall = async (stale: StaleTap | null): Promise<StaleTap> => {
+    seen = [];
+    const { link } = await DeviceLink.connect(
+        target.host,
+        target.port,
+        flat,
+        0
+    );
+    try {
+        await link.write('start');
+        await link.write(String(flat));
+        const notifications = () =>
+            seen.filter(
+                (call) => call.method === 'sendMessage' && call.hasKeyboard
+            );
+        const notified = await waitFor(
+            () => notifications().length === residents.length
+        );
+        if (!notified) {
+            throw new LoadError('timeout:notify');
+        }
+        const messages = new Map(
+            notifications().map((call) => [call.chatId, call.messageId!])
+        );
+
+        if (stale) {
+            telegram.tap(residents[0], stale.data, stale.messageId);
+            if ((await link.next(settleMs).catch(() => null)) !== null) {
+                stats.error('stale');
+            }
+            await waitFor(() =>
+                seen.some((call) => call.method === 'answerCallbackQuery')
+            );
+            seen = seen.filter((call) => call.method === 'sendMessage');
+        }
+
+        const taps = new Map(residents.map((chatId) => [chatId, draw()]));
+        const tappedAt = performance.now();
+        taps.forEach((command, chatId) =>
+            telegram.tap(chatId, command, messages.get(chatId))
+        );
+
+        const command = await link.next(config.callTimeoutMs);
+        stats.stage('command', performance.now() - tappedAt);
+        const second = await link.next(settleMs).catch(() => null);
+        if (second !== null) {
+            stats.error('duplicate');
+        }
+
+        // A bare answer for the winner, one with text for the rest
+        const answers = () =>
+            seen.filter((call) => call.method === 'answerCallbackQuery');
+        const answered = await waitFor(
+            () => answers().length === residents.length
+        );
+        if (!answered) {
+            throw new LoadError('timeout:answer');
+        }
+        const winners = answers().filter((call) => !call.text);
+        answers()
+            .filter((call) => call.text)
+            .forEach((call) => stats.stage('handled', call.at - tappedAt));
+        if (winners.length !== 1) {
+            stats.error(`winners:${winners.length}`);
+        } else if (taps.get(winners[0].chatId) !== command) {
+            stats.error('wrong-command');
+        }
+
+        const removed = () =>
+            new Set(
+                seen
+                    .filter((call) => call.method === 'editMessageReplyMarkup')
+                    .map((call) => `${call.chatId} ${call.messageId}`)
+            );
+        const all = () =>
+            [...messages].every(([chatId, messageId]) =>
+                removed().has(`${chatId} ${messageId}`)
+            );
+        if (await waitFor(all)) {
+            const last = seen.findLast(
+                (call) => call.method === 'editMessageReplyMarkup'
+            )!;
+            stats.stage('keyboards', last.at - tappedAt);
+        } else {
+            stats.error('keyboards');
+        }
+
+        const confirmation =
+            command === 'accept'
+                ? '✅ Дверь открыта!'
+                : '❌ Дверь не будет открыта!';
+        await link.write(`${command}_ok`);
+        await link.write('\n');
+        const confirmed = await waitFor(() =>
+            seen.some((call) => call.text === confirmation)
+        );
+        if (!confirmed) {
+            throw new LoadError('timeout:confirm');
+        }
+        stats.outcome(command);
+        return {
+            data: telegram.button(residents[0], 'accept'),
+            messageId: messages.get(residents[0])!,
+        };
+    } finally {
+        link.close();
+    }
+};
+
+let stale: StaleTap | null = null;
+for (let i = 0; i < config.samples; i++) {
+    try {
+        stale = await runCall(stale);
+    } catch (err) {
+        stats.error(err instanceof LoadError ? err.message : String(err));
+    }
+}
+stats.finish();
+
+if (config.json) {
+    console.log(JSON.stringify({ config, ...stats.toJSON() }));
+} else {
+    console.log(
+        `${config.residents} residents, ${config.rounds} arbitration rounds, ${config.samples} calls`
+    );
+    console.log(stats.format());
+}
+
+bot.stop('decision-bench finished');
+server.close();
+await telegram.close();
+process.exit(stats.errorCount > 0 ? 1 : 0);
@@ -0,0 +1,377 @@
+import tls from 'node:tls';
+import { setTimeout as sleep } from 'node:timers/promises';
+import { createFixtureJpeg } from './jpeg-fixture';
+import { Rng } from './rng';
+import { Stats } from './stats';
+import { TelegramMock } from './telegram-mock';
+
+export class LoadError extends Error {}
+
+// Last TLS session per flat, offered on the next connect so the server can
+// resume it like the firmware does
+const sessions = new Map<number, Buffer>();
+
+// Like CONFIG_INTERCOM_RESUME_TIMEOUT_MS and the firmware's retry interval
+const resumeTimeoutMs = 20_000;
+const resumeRetryMs = 500;
+
+const sessionPrefix = 'session:';
+const sessionIdLength = 16;
+
+export const open = (host: string, port: number, flat: number) =>
+    new Promise<tls.TLSSocket>((resolve, reject) => {
+        const socket = tls.connect({
+            host,
+            port,
+            session: sessions.get(flat),
+            pskCallback: () => ({
+                psk: Buffer.from(process.env.TLS_PSK, 'hex'),
+                identity: process.env.TLS_PSK_IDENTITY ?? 'intercom',
+            }),
+            ciphers: 'PSK-AES128-GCM-SHA256',
+            maxVersion: 'TLSv1.2',
+            // The PSK authenticates the server; there is no certificate
+            checkServerIdentity: () => undefined,
+        });
+        // The firmware sets TCP_NODELAY; with Nagle the short record that
+        // ends a frame waits out the server's delayed ACK
+        socket.setNoDelay(true);
+        socket.on('session', (session) => sessions.set(flat, session));
+        socket.once('secureConnect', () => resolve(socket));
+        socket.once('error', () => reject(new LoadError('connect')));
+    });
+
+// Client side of the intercom protocol, one connection per call. Each
+// connect resumes the device's previous TLS session where it can. Like the
+// firmware, the link keeps the session id the server sends after "start",
+// and if the channel drops before the call ends it reconnects and resumes
+// the call.
+export class DeviceLink {
+    private chunks: string[] = [];
+    private waiter: ((chunk: string | null) => void) | null = null;
+    private closed = false;
+    private ending = false;
+    private sessionId: string | null = null;
+    // Set while a dropped call is being resumed; writes wait for it
+    private resuming: Promise<void> | null = null;
+    // Channel lost to session presented on a new one, per resume
+    readonly resumes: number[] = [];
+
+    private constructor(
+        private socket: tls.TLSSocket,
+        private target: { host: string; port: number; flat: number },
+        private frameGapMs: number
+    ) {
+        this.attach(socket);
+    }
+
+    static async connect(
+        host: string,
+        port: number,
+        flat: number,
+        frameGapMs = 500
+    ) {
+        const socket = await open(host, port, flat);
+        return {
+            link: new DeviceLink(socket, { host, port, flat }, frameGapMs),
+            resumed: socket.isSessionReused(),
+        };
+    }
+
+    // Write in TCP-segment-sized pieces at roughly bytesPerMs
+    async writePaced(data: Buffer, bytesPerMs: number) {
+        const started = performance.now();
+        for (let offset = 0; offset < data.length; offset += 1460) {
+            await this.write(data.subarray(offset, offset + 1460));
+            const due = started + (offset + 1460) / bytesPerMs;
+            const wait = due - performance.now();
+            if (wait > 1) {
+                await sleep(wait);
+            }
+        }
+    }
+
+    async write(data: string | Buffer) {
+        await this.resuming;
+        return this.send(this.socket, data);
+    }
+
+    // Next message from the server, as the firmware's recv() would see it
+    next(timeoutMs: number) {
+        if (this.chunks.length > 0) {
+            return Promise.resolve(this.chunks.shift()!);
+        }
+        if (this.closed) {
+            return Promise.reject(new LoadError('closed'));
+        }
+        return new Promise<string>((resolve, reject) => {
+            const timer = setTimeout(() => {
+                this.waiter = null;
+                reject(new LoadError('timeout:command'));
+            }, timeoutMs);
+            this.waiter = (chunk) => {
+                clearTimeout(timer);
+                this.waiter = null;
+                chunk === null
+                    ? reject(new LoadError('closed'))
+                    : resolve(chunk);
+            };
+        });
+    }
+
+    close() {
+        this.ending = true;
+        this.socket.end();
+    }
+
+    private attach(socket: tls.TLSSocket) {
+        socket.on('data', (data) => this.push(data.toString()));
+        socket.on('close', () => this.dropped(socket));
+        socket.on('error', () => {});
+    }
+
+    private send(socket: tls.TLSSocket, data: string | Buffer) {
+        return new Promise<void>((resolve, reject) =>
+            socket.write(data, (err) =>
+                err ? reject(new LoadError('socket')) : resolve()
+            )
+        );
+    }
+
+    private dropped(socket: tls.TLSSocket) {
+        if (socket !== this.socket || this.resuming) {
+            return;
+        }
+        if (this.ending || this.sessionId === null) {
+            this.closed = true;
+            this.waiter?.(null);
+            return;
+        }
+        this.resuming = this.resume().finally(() => (this.resuming = null));
+    }
+
+    // "resume" and the session id on a new channel, retried until the
+    // server or its replacement takes them
+    private async resume() {
+        const lost = performance.now();
+        while (performance.now() - lost < resumeTimeoutMs && !this.ending) {
+            try {
+                const socket = await open(
+                    this.target.host,
+                    this.target.port,
+                    this.target.flat
+                );
+                this.socket = socket;
+                this.attach(socket);
+                await this.send(socket, 'resume');
+                await sleep(this.frameGapMs);
+                await this.send(socket, this.sessionId!);
+                this.resumes.push(performance.now() - lost);
+                return;
+            } catch {
+                this.socket.destroy();
+                await sleep(resumeRetryMs);
+            }
+        }
+        this.closed = true;
+        this.waiter?.(null);
+    }
+
+    private push(chunk: string) {
+        if (chunk.startsWith(sessionPrefix)) {
+            const end = sessionPrefix.length + sessionIdLength;
+            this.sessionId = chunk.slice(sessionPrefix.length, end);
+            chunk = chunk.slice(end);
+            if (chunk.length === 0) {
+                return;
+            }
+        }
+        if (this.waiter) {
+            this.waiter(chunk);
+        } else {
+            this.chunks.push(chunk);
+        }
+    }
+}
+
+export interface DeviceOptions {
+    host: string;
+    port: number;
+    flat: number;
+    chatId: number;
+    frameGapMs: number;
+    thinkTimeMs: number;
+    callTimeoutMs: number;
+    photoSize: number;
+    // Device upload rate in KiB/s for photo frames, 0 for unthrottled
+    uplinkRate: number;
+}
+
+export type CallPlan = {
+    unknownFlat: boolean;
+    cancel: boolean;
+    photo: boolean;
+    decision: 'accept' | 'reject';
+};
+
+export const planCall = (
+    rng: Rng,
+    ratios: {
+        unknownRatio: number;
+        cancelRatio: number;
+        photoRatio: number;
+        rejectRatio: number;
+    }
+): CallPlan => ({
+    unknownFlat: rng.chance(ratios.unknownRatio),
+    cancel: rng.chance(ratios.cancelRatio),
+    photo: rng.chance(ratios.photoRatio),
+    decision: rng.chance(ratios.rejectRatio) ? 'reject' : 'accept',
+});
+
+// 4-byte big-endian length followed by a JPEG that the server's image
+// transforms can parse
+export const createPhotoFrame = (size: number) => {
+    const frame = Buffer.alloc(4);
+    frame.writeUInt32BE(size, 0);
+    return Buffer.concat([frame, createFixtureJpeg(size)]);
+};
+
+const expectStage = async <T>(promise: Promise<T>, stage: string) => {
+    try {
+        return await promise;
+    } catch {
+        throw new LoadError(`timeout:${stage}`);
+    }
+};
+
+export const runCall = async (
+    options: DeviceOptions,
+    plan: CallPlan,
+    telegram: TelegramMock,
+    stats: Stats
+) => {
+    const { chatId, frameGapMs, thinkTimeMs, callTimeoutMs } = options;
+    const callStarted = performance.now();
+
+    const { link, resumed } = await DeviceLink.connect(
+        options.host,
+        options.port,
+        options.flat,
+        frameGapMs
+    );
+    // TCP connect plus a full or an abbreviated (ticket) TLS handshake
+    stats.stage(
+        resumed ? 'resumption' : 'handshake',
+        performance.now() - callStarted
+    );
+
+    try {
+        // A call to an unknown flat notifies nobody; an expectation left
+        // waiting would take the next call's notification
+        const notified = plan.unknownFlat
+            ? null
+            : telegram.expect(
+                  chatId,
+                  (call) => call.method === 'sendMessage' && call.hasKeyboard,
+                  callTimeoutMs
+              );
+        await link.write('start');
+        await sleep(frameGapMs);
+        await link.write(String(plan.unknownFlat ? 0 : options.flat));
+        const numberSent = performance.now();
+
+        if (plan.unknownFlat) {
+            const reply = await link.next(callTimeoutMs);
+            if (reply !== 'not_found') {
+                throw new LoadError(`unexpected:${reply}`);
+            }
+            stats.stage('not_found', performance.now() - numberSent);
+            return 'not_found';
+        }
+
+        const keyboard = await expectStage(notified!, 'notify');
+        stats.stage('notify', keyboard.at - numberSent);
+
+        if (plan.cancel) {
+            await sleep(thinkTimeMs);
+            const confirmed = telegram.expect(
+                chatId,
+                (call) => call.text === '❌ Вход отменен на домофоне',
+                callTimeoutMs
+            );
+            await link.write('cancel');
+            await sleep(frameGapMs);
+            await link.write('\n');
+            const cancelSent = performance.now();
+            const confirmation = await expectStage(confirmed, 'confirm');
+            stats.stage('confirm', confirmation.at - cancelSent);
+            return 'cancel';
+        }
+
+        const tapAndReceive = async (data: string) => {
+            await sleep(thinkTimeMs);
+            const tappedAt = performance.now();
+            telegram.tap(chatId, data);
+            const command = await link.next(callTimeoutMs);
+            if (command !== data) {
+                throw new LoadError(`unexpected:${command}`);
+            }
+            stats.stage('command', performance.now() - tappedAt);
+        };
+
+        if (plan.photo) {
+            await tapAndReceive('photo');
+            const delivered = telegram.expect(
+                chatId,
+                (call) => call.method === 'sendPhoto',
+                callTimeoutMs
+            );
+            await link.write('photo');
+            await sleep(frameGapMs);
+            // First frame byte to the upload completing at the Bot API
+            const photoStarted = performance.now();
+            const frame = createPhotoFrame(options.photoSize);
+            if (options.uplinkRate > 0) {
+                await link.writePaced(
+                    frame,
+                    (options.uplinkRate * 1024) / 1000
+                );
+            } else {
+                await link.write(frame);
+            }
+            const photo = await expectStage(delivered, 'photo');
+            stats.stage('photo', photo.at - photoStarted);
+            // Transforms change the size; untouched, the frame must arrive
+            // whole
+            if (
+                !process.env.PHOTO_TRANSFORMS &&
+                photo.fileBytes !== options.photoSize
+            ) {
+                throw new LoadError('photo:truncated');
+            }
+        }
+
+        await tapAndReceive(plan.decision);
+        const confirmed = telegram.expect(
+            chatId,
+            (call) =>
+                call.text ===
+                (plan.decision === 'accept'
+                    ? '✅ Дверь открыта!'
+                    : '❌ Дверь не будет открыта!'),
+            callTimeoutMs
+        );
+        await link.write(`${plan.decision}_ok`);
+        await sleep(frameGapMs);
+        await link.write('\n');
+        const ackSent = performance.now();
+        const confirmation = await expectStage(confirmed, 'confirm');
+        stats.stage('confirm', confirmation.at - ackSent);
+        return plan.decision;
+    } finally {
+        link.close();
+        link.resumes.forEach((ms) => stats.stage('resume', ms));
+        stats.stage('call', performance.now() - callStarted);
+    }
+};
@@ -0,0 +1,113 @@
+// Photo transform throughput, and the event-loop lag it causes, with the
+// transforms run inline on the main thread versus in the image pool.
+//
+//   npm run build && npm run image-bench -- --samples 500 --workers 3
+//
+// Each job copies a fixture JPEG into a fresh ArrayBuffer, as the server
+// does when it collects a frame, then applies --image-ops to it. Lag is
+// sampled with monitorEventLoopDelay while the jobs run; it is the delay
+// every device socket on the server would see on top of its own work.
+import { config } from './config';
+import { monitorEventLoopDelay } from 'node:perf_hooks';
+import { setImmediate as yieldLoop } from 'node:timers/promises';
+import { applyOps, parseImageOps } from '../images/jpeg';
+import { ImagePool } from '../images/pool';
+import { createFixtureJpeg } from './jpeg-fixture';
+
+const ops = parseImageOps(config.imageOps);
+const pool = new ImagePool(config.workers, config.workers);
+
+const runInline = async (fixture: Buffer) => {
+    for (let i = 0; i < config.samples; i++) {
+        applyOps(new Uint8Array(fixture), ops);
+        await yieldLoop();
+    }
+};
+
+const runPooled = async (fixture: Buffer) => {
+    const inFlight = new Set<Promise<void>>();
+    for (let i = 0; i < config.samples; i++) {
+        // Backpressure: wait for a slot rather than have the job refused
+        while (pool.saturated) {
+            await Promise.race(inFlight);
+        }
+        const job: Promise<void> = pool
+            .run(new Uint8Array(fixture).buffer, ops)
+            .then((reply) => {
+                if ('error' in reply) {
+                    throw new Error(reply.error);
+                }
+            })
+            .finally(() => inFlight.delete(job));
+        inFlight.add(job);
+        await yieldLoop();
+    }
+    await Promise.all(inFlight);
+};
+
+const measure = async (
+    mode: 'inline' | 'pool',
+    size: number,
+    fixture: Buffer
+) => {
+    const lag = monitorEventLoopDelay({ resolution: 1 });
+    lag.enable();
+    const started = performance.now();
+    await (mode === 'inline' ? runInline(fixture) : runPooled(fixture));
+    const elapsedMs = performance.now() - started;
+    lag.disable();
+
+    const jobsPerSecond = config.samples / (elapsedMs / 1000);
+    return {
+        size,
+        mode,
+        jobsPerSecond,
+        mibPerSecond: (jobsPerSecond * size) / 1024 / 1024,
+        lagP99: lag.percentile(99) / 1e6,
+        lagMax: lag.max / 1e6,
+    };
+};
+
+// Start the workers before anything is timed
+await Promise.all(
+    Array.from({ length: pool.size }, () =>
+        pool.run(new Uint8Array(createFixtureJpeg(1024)).buffer, ops)
+    )
+);
+
+const results: Awaited<ReturnType<typeof measure>>[] = [];
+if (!config.json) {
+    console.log(
+        `ops ${config.imageOps}, ${config.workers} workers, ${config.samples} jobs per size`
+    );
+    console.log(
+        '   frame KiB  mode       jobs/s     MiB/s   lag p99   lag max (ms)'
+    );
+}
+
+for (const size of config.photoSizes) {
+    const fixture = createFixtureJpeg(size);
+    for (const mode of ['inline', 'pool'] as const) {
+        const result = await measure(mode, size, fixture);
+        results.push(result);
+        if (!config.json) {
+            console.log(
+                [
+                    String(size / 1024).padStart(10),
+                    mode.padEnd(6),
+                    result.jobsPerSecond.toFixed(0).padStart(10),
+                    result.mibPerSecond.toFixed(1).padStart(9),
+                    result.lagP99.toFixed(2).padStart(9),
+                    result.lagMax.toFixed(2).padStart(9),
+                ].join(' ')
+            );
+        }
+    }
+}
+
+if (config.json) {
+    console.log(JSON.stringify({ config, results }));
+}
+
+await pool.close();
+process.exit(0);
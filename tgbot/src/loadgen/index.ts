@@ -0,0 +1,124 @@
+// Load generator: simulates intercoms and residents against the socket
+// server and bot, with the Bot API replaced by a local mock.
+//
+//   npm run build && npm run loadgen -- --devices 200 --rate 3 --duration 120
+//
+// Without --target the server and bot run in this process against in-memory
+// Mongo/Redis stand-ins (--backend=real uses MONGO_URI/REDIS_PATH instead).
+// With --target host:port an external server is driven; start it with
+// TELEGRAM_API_ROOT=http://127.0.0.1:<telegram-port> and run the load generator
+// with the server's TLS_PSK.
+//
+// --webhook runs the bot in webhook mode and has the mock push taps to it;
+// the "command" stage is then tap-to-device-command latency without polling.
+// An external target needs WEBHOOK_DOMAIN=127.0.0.1:<webhook-port>,
+// WEBHOOK_PORT=<webhook-port>, WEBHOOK_PATH=/telegram and
+// WEBHOOK_SECRET=loadgen.
+import { config } from './config';
+import { setTimeout as sleep } from 'node:timers/promises';
+import { bot } from '../bot';
+import { server } from '../wss';
+import { createRng } from './rng';
+import { Stats } from './stats';
+import { TelegramMock } from './telegram-mock';
+import { LoadError, planCall, runCall } from './device';
+import {
+    chatIdBase,
+    seedFlats,
+    setupBackend,
+    startInProcess,
+    teardownBackend,
+} from './standins';
+
+const telegram = new TelegramMock();
+const stats = new Stats();
+
+const runDevice = async (
+    index: number,
+    target: { host: string; port: number },
+    deadline: number
+) => {
+    const rng = createRng(config.seed * 7919 + index);
+    const meanInterarrivalMs = 60_000 / config.ratePerMinute;
+
+    while (true) {
+        const wait = rng.exponential(meanInterarrivalMs);
+        if (performance.now() + wait >= deadline) {
+            return;
+        }
+        await sleep(wait);
+
+        const plan = planCall(rng, config);
+        try {
+            const outcome = await runCall(
+                {
+                    ...target,
+                    flat: index,
+                    chatId: chatIdBase + index,
+                    frameGapMs: config.frameGapMs,
+                    thinkTimeMs: config.thinkTimeMs,
+                    callTimeoutMs: config.callTimeoutMs,
+                    photoSize: config.photoSize,
+                    uplinkRate: config.uplinkRate,
+                },
+                plan,
+                telegram,
+                stats
+            );
+            stats.outcome(outcome);
+        } catch (err) {
+            stats.error(err instanceof LoadError ? err.message : 'internal');
+        }
+    }
+};
+
+await telegram.listen(config.telegramPort);
+telegram.uploadRate = config.uploadRate;
+if (config.webhook) {
+    telegram.useWebhook(
+        `http://127.0.0.1:${config.webhookPort}${process.env.WEBHOOK_PATH}`,
+        process.env.WEBHOOK_SECRET!
+    );
+}
+await setupBackend(config.backend);
+await seedFlats(config.devices);
+
+let target: { host: string; port: number };
+if (config.target) {
+    const [host, port] = config.target.split(':');
+    target = { host, port: Number(port) };
+} else {
+    target = await startInProcess();
+}
+
+stats.start();
+const deadline = performance.now() + config.durationMs;
+const devices: Promise<void>[] = [];
+for (let i = 1; i <= config.devices; i++) {
+    devices.push(runDevice(i, target, deadline));
+}
+await Promise.all(devices);
+stats.finish();
+
+if (config.json) {
+    console.log(
+        JSON.stringify({
+            config,
+            unmatchedBotCalls: telegram.unmatchedCalls,
+            ...stats.toJSON(),
+        })
+    );
+} else {
+    console.log(stats.format());
+    console.log(`unmatched bot calls ${telegram.unmatchedCalls}`);
+}
+
+if (!config.target) {
+    bot.stop('loadgen finished');
+    server.close();
+}
+await telegram.close();
+await teardownBackend(config.backend);
+
+const failed = config.maxErrors >= 0 && stats.errorCount > config.maxErrors;
+process.exit(failed ? 1 : 0);
@@ -0,0 +1,128 @@
+// Seeds the call journal with --rows calls spread over --flats flats and
+// the past year, through the batch writer the server uses, then times the
+// residents' "last 20 visitors" query for random flats.
+//
+//   npm run build && npm run journal-bench -- --rows 1000000 --reset
+//
+// Uses MONGO_URI; point it at a scratch database. --reset drops the calls
+// collection first, and without it a journal that already has calls is
+// left alone. Fails when the query's p99 exceeds --max-p99 ms, and before
+// seeding if the collection is not a time-series one (MongoDB 5.0+), as
+// the numbers would not be the journal's.
+import { config } from './config';
+import mongoose from 'mongoose';
+import { randomBytes, randomUUID } from 'node:crypto';
+import { BatchWriter } from '../batch-writer';
+import { Call, CallModel, CallOutcome, callsRepo } from '../calls';
+import { createRng } from './rng';
+import { Histogram } from './stats';
+
+await mongoose.connect(process.env.MONGO_URI as string, {
+    user: process.env.MONGO_USER,
+    pass: process.env.MONGO_PASSWORD,
+});
+
+if (config.reset) {
+    await CallModel.collection.drop().catch(() => {});
+} else if ((await CallModel.estimatedDocumentCount()) > 0) {
+    console.error('The calls collection is not empty; rerun with --reset');
+    process.exit(1);
+}
+await CallModel.createCollection();
+await CallModel.createIndexes();
+
+const db = mongoose.connection.db!;
+const [collection] = await db
+    .listCollections({ name: CallModel.collection.collectionName })
+    .toArray();
+if (collection?.type !== 'timeseries') {
+    console.error(
+        `${CallModel.collection.collectionName} is a ${collection?.type ?? 'missing'} collection, not a time-series one`
+    );
+    process.exit(1);
+}
+const { version: serverVersion } = await db.admin().serverInfo();
+
+const rng = createRng(config.seed);
+const outcomes: CallOutcome[] = [
+    'accept',
+    'accept',
+    'accept',
+    'reject',
+    'cancel',
+    'abandoned',
+    'not_found',
+];
+const yearMs = 365 * 24 * 3600 * 1000;
+const firstCall = Date.now() - yearMs;
+const step = yearMs / config.rows;
+
+// Calls arrive in time order, as they do from the server
+const seedCall = (index: number): Call => {
+    const startedAt = new Date(firstCall + index * step);
+    const at = (seconds: number) =>
+        new Date(startedAt.getTime() + seconds * 1000);
+    const photo = rng.chance(0.3);
+    const outcome = outcomes[Math.floor(rng.next() * outcomes.length)];
+    return {
+        sessionId: randomUUID(),
+        device: '10.0.0.2',
+        flat: 1 + Math.floor(rng.next() * config.flats),
+        startedAt,
+        endedAt: at(40),
+        stages: {
+            notified: at(1),
+            ...(photo && { photoRequested: at(10), photo: at(12) }),
+            ...(outcome !== 'abandoned' && { decided: at(30) }),
+        },
+        outcome,
+        snapshots: photo ? [randomBytes(32).toString('hex')] : [],
+    };
+};
+
+const writer = new BatchWriter<Call>((calls) => callsRepo.insertMany(calls), {
+    maxBatch: 1000,
+    concurrency: 4,
+});
+const seedStarted = performance.now();
+for (let i = 0; i < config.rows; i++) {
+    await writer.ready();
+    writer.push(seedCall(i));
+}
+await writer.flush();
+const seedMs = performance.now() - seedStarted;
+
+const latency = new Histogram();
+for (let i = 0; i < config.queries; i++) {
+    const flat = 1 + Math.floor(rng.next() * config.flats);
+    const started = performance.now();
+    await callsRepo.recentByFlat(flat, 20);
+    latency.record(performance.now() - started);
+}
+
+const report = {
+    serverVersion,
+    rows: writer.written,
+    dropped: writer.dropped,
+    seedMs: Math.round(seedMs),
+    rowsPerSecond: Math.round(writer.written / (seedMs / 1000)),
+    query: Object.fromEntries(
+        [50, 90, 99, 100].map((p) => [
+            p === 100 ? 'max' : `p${p}`,
+            Math.round(latency.percentile(p) * 100) / 100,
+        ])
+    ),
+};
+if (config.json) {
+    console.log(JSON.stringify({ config, ...report }));
+} else {
+    console.log(
+        `seeded ${report.rows} calls over ${config.flats} flats into a time-series collection on MongoDB ${serverVersion} in ${report.seedMs} ms, ${report.rowsPerSecond} calls/s, ${report.dropped} dropped`
+    );
+    console.log(
+        `last 20 visitors, ${config.queries} queries: p50 ${report.query.p50} p90 ${report.query.p90} p99 ${report.query.p99} max ${report.query.max} ms`
+    );
+}
+
+await mongoose.disconnect();
+process.exit(report.query.p99 > config.maxP99Ms || report.dropped > 0 ? 1 : 0);
@@ -0,0 +1,40 @@
+// Baseline JPEG of exactly `size` bytes laid out like an OV2640 frame: SOI,
+// APP0 JFIF, DQT, SOF0, DHT, SOS, scan data, EOI. The scan is filler, so a
+// decoder shows noise, but every segment parses like a camera frame's.
+export const createFixtureJpeg = (
+    size: number,
+    width = 1600,
+    height = 1200
+) => {
+    const header = Buffer.from([
+        ...[0xff, 0xd8],
+        // APP0 JFIF 1.1, no density, no thumbnail
+        ...[0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00],
+        ...[0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00],
+        // DQT, one flat 8-bit table
+        ...[0xff, 0xdb, 0x00, 0x43, 0x00, ...new Array(64).fill(1)],
+        // SOF0, 8-bit YCbCr 4:2:2
+        ...[0xff, 0xc0, 0x00, 0x11, 0x08],
+        ...[height >> 8, height & 0xff, width >> 8, width & 0xff, 0x03],
+        ...[0x01, 0x21, 0x00, 0x02, 0x11, 0x00, 0x03, 0x11, 0x00],
+        // DHT, a one-symbol DC table
+        ...[0xff, 0xc4, 0x00, 0x14, 0x00, 0x01, ...new Array(15).fill(0), 0],
+        // SOS over the three components
+        ...[0xff, 0xda, 0x00, 0x0c, 0x03, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00],
+        ...[0x00, 0x3f, 0x00],
+    ]);
+    if (size < header.length + 2) {
+        throw new Error(
+            `Fixture JPEG needs at least ${header.length + 2} bytes`
+        );
+    }
+
+    const jpeg = Buffer.alloc(size);
+    header.copy(jpeg);
+    // Entropy-coded data never contains an unstuffed 0xFF
+    for (let i = header.length; i < size - 2; i++) {
+        jpeg[i] = (i * 31) & 0x7f;
+    }
+    jpeg.writeUInt16BE(0xffd9, size - 2);
+    return jpeg;
+};
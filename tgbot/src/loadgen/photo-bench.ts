@@ -0,0 +1,99 @@
+// Time from the first photo frame byte leaving the device to the sendPhoto
+// upload completing at the Bot API, for a range of frame sizes.
+//
+//   npm run build && npm run photo-bench -- --uplink-rate 200 --upload-rate 400
+//
+// Runs the server and bot in-process against the Bot API mock and in-memory
+// backends. Rates are KiB/s; with both set, device upload and Telegram
+// upload overlap when the server streams the frame through.
+import { config } from './config';
+import { bot } from '../bot';
+import { server } from '../wss';
+import { Stats } from './stats';
+import { TelegramMock } from './telegram-mock';
+import { LoadError, runCall } from './device';
+import {
+    chatIdBase,
+    seedFlats,
+    setupBackend,
+    startInProcess,
+    teardownBackend,
+} from './standins';
+
+const telegram = new TelegramMock();
+telegram.uploadRate = config.uploadRate;
+await telegram.listen(config.telegramPort);
+await setupBackend('memory');
+await seedFlats(1);
+const target = await startInProcess();
+
+const results: object[] = [];
+let errors = 0;
+if (!config.json) {
+    console.log(
+        `uplink ${config.uplinkRate || '∞'} KiB/s, upload ${config.uploadRate || '∞'} KiB/s, ${config.samples} calls per size`
+    );
+    console.log('   frame KiB      p50      p90      max (ms)   MiB/s');
+}
+
+for (const size of config.photoSizes) {
+    const stats = new Stats();
+    for (let i = 0; i < config.samples; i++) {
+        try {
+            await runCall(
+                {
+                    ...target,
+                    flat: 1,
+                    chatId: chatIdBase + 1,
+                    frameGapMs: 0,
+                    thinkTimeMs: 0,
+                    callTimeoutMs: config.callTimeoutMs,
+                    photoSize: size,
+                    uplinkRate: config.uplinkRate,
+                },
+                {
+                    unknownFlat: false,
+                    cancel: false,
+                    photo: true,
+                    decision: 'reject',
+                },
+                telegram,
+                stats
+            );
+        } catch (err) {
+            errors++;
+            console.error(err instanceof LoadError ? err.message : err);
+        }
+    }
+
+    const photo = stats.stages.get('photo');
+    const p50 = photo?.percentile(50) ?? 0;
+    results.push({
+        size,
+        count: photo?.count ?? 0,
+        p50,
+        p90: photo?.percentile(90) ?? 0,
+        max: photo?.percentile(100) ?? 0,
+    });
+    if (!config.json && photo) {
+        console.log(
+            [
+                String(size / 1024).padStart(10),
+                ...[50, 90, 100].map((p) =>
+                    photo.percentile(p).toFixed(1).padStart(8)
+                ),
+                (size / 1024 / 1024 / (p50 / 1000)).toFixed(2).padStart(10),
+            ].join(' ')
+        );
+    }
+}
+
+if (config.json) {
+    console.log(JSON.stringify({ config, results }));
+}
+
+bot.stop('photo-bench finished');
+server.close();
+await telegram.close();
+await teardownBackend('memory');
+process.exit(errors > 0 ? 1 : 0);
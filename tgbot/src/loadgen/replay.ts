@@ -0,0 +1,293 @@
+// Plays a session capture (see ../capture.ts) against the server and
+// compares what the server does now with what it did then.
+//
+//   npm run build && npm run replay -- --capture call.icap --speed 4
+//
+// The device's side is played as recorded: each device write at its time,
+// scaled by --speed, after the turn before it. Where the server's next
+// bytes are a command only a resident's tap produces, the tap is made on
+// the Bot API mock at the time it came then. Captures from the firmware
+// work too; their photos were cut short there and are sent filled in.
+//
+// Without --target the server and bot run in this process, with each flat
+// the capture calls registered unless the server turned it away. The
+// replay's own capture goes to --capture-out (default <capture>.replay).
+import { config } from './config';
+import { setTimeout as sleep } from 'node:timers/promises';
+import tls from 'node:tls';
+import { bot } from '../bot';
+import {
+    Capture,
+    CaptureRecord,
+    captures,
+    diffCaptures,
+    readCapture,
+    recorders,
+} from '../capture';
+import { flatsRepo } from '../flats';
+import { server } from '../wss';
+import { open } from './device';
+import { TelegramMock } from './telegram-mock';
+import {
+    chatIdBase,
+    setupBackend,
+    startInProcess,
+    teardownBackend,
+} from './standins';
+
+const tapCommands = ['photo', 'accept', 'reject'];
+const sessionPattern = /session:(.{16})/;
+const fillByte = 0xa5; // Stands in for bytes that were not kept
+// Command frames closer together than this may reach the server as one
+// read; the pieces of a photo may
+const frameFloorMs = 20;
+const maxCommandLength = 16;
+
+if (!config.capture) {
+    console.error('usage: npm run replay -- --capture <file> [--speed n]');
+    process.exit(2);
+}
+
+// Records before the first channel opened are the end of an earlier call
+// the firmware's ring has cut off
+const loaded = await readCapture(config.capture);
+const first = loaded.records.findIndex((record) => record.kind === 'open');
+const recorded: Capture = {
+    ...loaded,
+    records: first < 0 ? [] : loaded.records.slice(first),
+};
+if (first > 0) {
+    console.log(`skipped ${first} records before the first call`);
+}
+
+const text = (record: CaptureRecord) => record.data.toString('latin1');
+
+// The flat each channel calls: the frame after "start"
+const flatOf = (from: number) => {
+    const records = recorded.records;
+    for (let i = from; i < records.length - 1; i++) {
+        if (records[i].kind === 'close') {
+            break;
+        }
+        if (records[i].kind === 'device' && text(records[i]) === 'start') {
+            const next = records
+                .slice(i + 1)
+                .find((record) => record.kind === 'device');
+            return next ? Number(text(next).trim()) : 0;
+        }
+    }
+    return 0;
+};
+
+// Registered flats: all that were called, except those turned away
+const registered = new Set<number>();
+recorded.records.forEach((record, i) => {
+    if (record.kind === 'open') {
+        registered.add(flatOf(i));
+    }
+});
+recorded.records.forEach((record, i) => {
+    if (record.kind === 'server' && text(record) === 'not_found') {
+        const opened = recorded.records.findLastIndex(
+            (r, j) => j < i && r.kind === 'open'
+        );
+        registered.delete(flatOf(opened));
+    }
+});
+registered.delete(0);
+
+const telegram = new TelegramMock();
+await telegram.listen(config.telegramPort);
+await setupBackend(config.backend);
+await Promise.all(
+    [...registered].map((number) =>
+        flatsRepo.upsert({ chatId: chatIdBase + number, number })
+    )
+);
+
+let target: { host: string; port: number };
+if (config.target) {
+    const [host, port] = config.target.split(':');
+    target = { host, port: Number(port) };
+} else {
+    target = await startInProcess();
+}
+
+const outFile = config.captureOut ?? `${config.capture}.replay`;
+const replay = captures.writer(outFile, recorders.device);
+
+// The channel being played
+let socket: tls.TLSSocket | null = null;
+let flat = 0;
+let received = 0; // Server bytes on this channel
+let expected = 0; // As many as the capture has up to the current record
+let closed = false;
+let finished = false; // Past the capture's end; the last close is ours
+let wake: (() => void) | null = null;
+let lastWrite = { at: 0, command: false };
+// Session ids the server hands out now, for the ones it handed out then
+const sessionIds = new Map<string, string>();
+let latestSessionId: string | null = null;
+
+const connect = async () => {
+    socket = await open(target.host, target.port, flat);
+    received = 0;
+    expected = 0;
+    closed = false;
+    replay.open(`${target.host}:${target.port}`);
+    socket.on('data', (data: Buffer) => {
+        replay.record('server', data);
+        latestSessionId =
+            sessionPattern.exec(data.toString('latin1'))?.[1] ??
+            latestSessionId;
+        received += data.length;
+        wake?.();
+    });
+    socket.on('close', () => {
+        closed = true;
+        if (!finished) {
+            replay.close();
+        }
+        wake?.();
+    });
+    socket.on('error', () => {});
+};
+
+const waitFor = async (done: () => boolean) => {
+    const deadline = performance.now() + config.callTimeoutMs;
+    while (!done()) {
+        const left = deadline - performance.now();
+        if (left <= 0) {
+            return false;
+        }
+        await Promise.race([
+            new Promise<void>((resolve) => (wake = resolve)),
+            sleep(left),
+        ]);
+        wake = null;
+    }
+    return true;
+};
+
+const sleepUntil = async (at: number) => {
+    const wait = at - performance.now();
+    if (wait > 0) {
+        await sleep(wait);
+    }
+};
+
+const isCommand = (record: CaptureRecord) =>
+    record.length <= maxCommandLength && /^[\x20-\x7e\n]*$/.test(text(record));
+
+const deviceBytes = (record: CaptureRecord) => {
+    const data = Buffer.alloc(record.length, fillByte);
+    record.data.copy(data);
+    let sent = data.toString('latin1');
+    sessionIds.forEach((now, then) => (sent = sent.replaceAll(then, now)));
+    return Buffer.from(sent, 'latin1');
+};
+
+// Plays the device's side of each record; false once the server stops
+// following the capture
+const play = async () => {
+    // The same moment in the recording and in the replay, to time from
+    let anchorUs = recorded.records[0]?.timeUs ?? 0;
+    let anchorMs = performance.now();
+    const due = (record: CaptureRecord) =>
+        anchorMs + (record.timeUs - anchorUs) / 1000 / config.speed;
+
+    for (const [i, record] of recorded.records.entries()) {
+        switch (record.kind) {
+            case 'open':
+                await sleepUntil(due(record));
+                flat = flatOf(i);
+                await connect();
+                break;
+
+            case 'device': {
+                const command = isCommand(record);
+                await sleepUntil(
+                    Math.max(
+                        due(record),
+                        command || lastWrite.command
+                            ? lastWrite.at + frameFloorMs
+                            : 0
+                    )
+                );
+                const data = deviceBytes(record);
+                replay.record('device', data);
+                socket?.write(data);
+                lastWrite = { at: performance.now(), command };
+                break;
+            }
+
+            case 'server': {
+                if (
+                    tapCommands.includes(text(record)) &&
+                    record.length === record.data.length
+                ) {
+                    await sleepUntil(due(record));
+                    telegram.tap(chatIdBase + flat, text(record));
+                }
+                expected += record.length;
+                if (!(await waitFor(() => received >= expected || closed))) {
+                    console.error(
+                        `record ${i + 1}: no ${record.length} B from the server`
+                    );
+                    return false;
+                }
+                const then = sessionPattern.exec(text(record))?.[1];
+                if (then && latestSessionId) {
+                    sessionIds.set(then, latestSessionId);
+                }
+                break;
+            }
+
+            case 'close':
+                await sleepUntil(due(record));
+                socket?.end();
+                await waitFor(() => closed);
+                break;
+
+            case 'event':
+                // The server's or the firmware's own doing
+                continue;
+        }
+        anchorUs = record.timeUs;
+        anchorMs = performance.now();
+    }
+    return true;
+};
+
+// A capture cut off mid-call leaves the channel open
+const hangUp = async () => {
+    finished = true;
+    if (socket && !closed) {
+        socket.end();
+        await waitFor(() => closed);
+    }
+};
+
+console.log(
+    `replaying ${recorded.records.length} records of a ${
+        recorded.recorder === recorders.device ? 'device' : 'server'
+    } capture at ${config.speed}x`
+);
+await play();
+await hangUp();
+await replay.end();
+
+const { differing, lines } = diffCaptures(
+    recorded,
+    await readCapture(outFile)
+);
+lines.forEach((line) => console.log(line));
+console.log(`replay capture: ${outFile}`);
+
+if (!config.target) {
+    bot.stop('replay finished');
+    server.close();
+}
+await telegram.close();
+await teardownBackend(config.backend);
+process.exit(differing > 0 ? 1 : 0);
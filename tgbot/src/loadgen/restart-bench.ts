@@ -0,0 +1,176 @@
+// Server restarts under load. Devices make calls like the load generator's
+// against loadgen/server.js, and every --restart-every seconds the device
+// server is replaced mid-call: a new one starts on the same port
+// (SO_REUSEPORT), and once it is ready the old one gets SIGTERM, drains and
+// hands its calls over. Devices caught mid-call resume their session on the
+// new server, so no call should fail.
+//
+//   npm run build && npm run restart-bench -- --devices 50 --rate 6 --duration 60
+//
+// The bot runs in a process of its own for the whole run, as two
+// long-polling bots would both take every tap. Taps reach the device server
+// through the Redis router and call sessions are kept in Redis, so
+// REDIS_PATH must point at one. With --rolling a cluster with two device workers is started
+// instead and restarted with SIGHUP.
+import { config } from './config';
+import { ChildProcess, spawn } from 'node:child_process';
+import { once } from 'node:events';
+import { setTimeout as sleep } from 'node:timers/promises';
+import { fileURLToPath } from 'node:url';
+import { createRng } from './rng';
+import { Histogram, Stats } from './stats';
+import { TelegramMock } from './telegram-mock';
+import { LoadError, planCall, runCall } from './device';
+import { chatIdBase } from './standins';
+
+const script = fileURLToPath(new URL('./server.js', import.meta.url));
+const port = 18_400;
+
+const startServer = (env: Record<string, string>) =>
+    new Promise<ChildProcess>((resolve, reject) => {
+        const child = spawn(
+            process.execPath,
+            [
+                script,
+                '--devices',
+                String(config.devices),
+                '--telegram-port',
+                String(config.telegramPort),
+                '--redis-cache',
+            ],
+            {
+                env: { ...process.env, WSS_PORT: String(port), ...env },
+                stdio: ['ignore', 'pipe', 'inherit'],
+            }
+        );
+        // Keep reading after "ready" so the server never blocks on its logs
+        let output = '';
+        let ready = false;
+        child.stdout!.on('data', (chunk) => {
+            if (!ready) {
+                output += chunk;
+                ready = output.split('\n').includes('ready');
+                if (ready) {
+                    resolve(child);
+                }
+            }
+        });
+        child.once('exit', () =>
+            reject(new Error('Server exited before it was ready'))
+        );
+    });
+
+const telegram = new TelegramMock();
+const stats = new Stats();
+// SIGTERM to the old server's exit, calls handed over included
+const drains = new Histogram();
+
+const runDevice = async (
+    index: number,
+    target: { host: string; port: number },
+    deadline: number
+) => {
+    const rng = createRng(config.seed * 7919 + index);
+    const meanInterarrivalMs = 60_000 / config.ratePerMinute;
+
+    while (true) {
+        const wait = rng.exponential(meanInterarrivalMs);
+        if (performance.now() + wait >= deadline) {
+            return;
+        }
+        await sleep(wait);
+
+        const plan = planCall(rng, config);
+        try {
+            const outcome = await runCall(
+                {
+                    ...target,
+                    flat: index,
+                    chatId: chatIdBase + index,
+                    frameGapMs: config.frameGapMs,
+                    thinkTimeMs: config.thinkTimeMs,
+                    callTimeoutMs: config.callTimeoutMs,
+                    photoSize: config.photoSize,
+                    uplinkRate: config.uplinkRate,
+                },
+                plan,
+                telegram,
+                stats
+            );
+            stats.outcome(outcome);
+        } catch (err) {
+            stats.error(err instanceof LoadError ? err.message : 'internal');
+        }
+    }
+};
+
+await telegram.listen(config.telegramPort);
+
+let bot: ChildProcess | null = null;
+let devices: ChildProcess;
+if (config.rolling) {
+    devices = await startServer({ DEVICE_WORKERS: '2' });
+} else {
+    bot = await startServer({ INTERCOM_ROLE: 'bot' });
+    devices = await startServer({ INTERCOM_ROLE: 'device' });
+}
+
+const restartServers = async (deadline: number) => {
+    let restarts = 0;
+    while (performance.now() + config.restartEveryMs < deadline) {
+        await sleep(config.restartEveryMs);
+        if (config.rolling) {
+            devices.kill('SIGHUP');
+        } else {
+            const previous = devices;
+            devices = await startServer({ INTERCOM_ROLE: 'device' });
+            const stopped = performance.now();
+            previous.kill('SIGTERM');
+            await once(previous, 'exit');
+            drains.record(performance.now() - stopped);
+        }
+        restarts++;
+    }
+    return restarts;
+};
+
+stats.start();
+const deadline = performance.now() + config.durationMs;
+const target = { host: '127.0.0.1', port };
+const running: Promise<void>[] = [];
+for (let i = 1; i <= config.devices; i++) {
+    running.push(runDevice(i, target, deadline));
+}
+const restarts = await restartServers(deadline);
+await Promise.all(running);
+stats.finish();
+
+for (const child of [devices, bot]) {
+    if (child) {
+        child.kill('SIGTERM');
+        await once(child, 'exit');
+    }
+}
+await telegram.close();
+
+if (config.json) {
+    console.log(
+        JSON.stringify({
+            config,
+            restarts,
+            drainP50: drains.percentile(50),
+            drainMax: drains.percentile(100),
+            unmatchedBotCalls: telegram.unmatchedCalls,
+            ...stats.toJSON(),
+        })
+    );
+} else {
+    console.log(stats.format());
+    console.log(
+        `${restarts} restarts, drain p50 ${drains.percentile(50).toFixed(0)} ms max ${drains.percentile(100).toFixed(0)} ms`
+    );
+    console.log(`unmatched bot calls ${telegram.unmatchedCalls}`);
+}
+
+// Any failed call is one the restarts lost
+process.exit(stats.errorCount > Math.max(0, config.maxErrors) ? 1 : 0);
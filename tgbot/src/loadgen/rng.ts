@@ -0,0 +1,21 @@
+// mulberry32: tiny seeded PRNG so every run draws the same call sequence
+export const createRng = (seed: number) => {
+    let state = seed >>> 0;
+
+    const next = () => {
+        state = (state + 0x6d2b79f5) >>> 0;
+        let t = state;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+
+    return {
+        next,
+        // Exponentially distributed delay for a Poisson process
+        exponential: (meanMs: number) => -Math.log(1 - next()) * meanMs,
+        chance: (probability: number) => next() < probability,
+    };
+};
+
+export type Rng = ReturnType<typeof createRng>;
@@ -0,0 +1,59 @@
+// The server as index.ts starts it, with Mongo and the cache swapped for
+// the in-memory stand-ins and --devices flats seeded in every process, so
+// cluster-bench can run it with DEVICE_WORKERS. Taps between processes
+// still go through the Redis router, which needs REDIS_PATH. With
+// --redis-cache call sessions are kept there too, so restart-bench can
+// replace the server mid-call.
+//
+// Prints "ready" once every device worker is accepting connections, or once
+// this process is up when it runs a single role.
+import { config } from './config';
+import cluster from 'node:cluster';
+import { bot, launchBot } from '../bot';
+import { drain, listenOptions, server } from '../wss';
+import { runCluster } from '../cluster';
+import { seedFlats, setupBackend } from './standins';
+
+const port = Number(process.env.WSS_PORT);
+
+if (cluster.isPrimary && process.env.DEVICE_WORKERS) {
+    let listening = 0;
+    cluster.on('listening', (_worker, address) => {
+        if (
+            address.port === port &&
+            ++listening === Number(process.env.DEVICE_WORKERS)
+        ) {
+            console.log('ready');
+        }
+    });
+}
+
+await runCluster(async (role) => {
+    await setupBackend('memory', config.redisCache);
+    await seedFlats(config.devices);
+    if (role !== 'device') {
+        await new Promise<void>((resolve, reject) => {
+            launchBot(resolve).catch(reject);
+        });
+    }
+    if (role !== 'bot') {
+        await new Promise<void>((resolve) =>
+            server.listen(listenOptions(port, '127.0.0.1'), resolve)
+        );
+    }
+    // A worker's readiness is reported by the primary
+    if (cluster.isPrimary) {
+        console.log('ready');
+    }
+
+    // Hand calls over on SIGTERM like index.ts does
+    process.once('SIGTERM', async () => {
+        if (role !== 'device') {
+            bot.stop('SIGTERM');
+        }
+        if (role !== 'bot') {
+            await drain();
+        }
+        process.exit(0);
+    });
+});
@@ -0,0 +1,168 @@
+import mongoose from 'mongoose';
+import { AddressInfo } from 'node:net';
+import { launchBot } from '../bot';
+import { CacheClient } from '../cache';
+import { Call, callsRepo } from '../calls';
+import { CallKeyboard, callDecisions, Decision } from '../decisions';
+import { Flat, flatsRepo } from '../flats';
+import { encodeSession, sessionStore } from '../session-store';
+import { listenOptions, server } from '../wss';
+
+// Replace Mongo and Redis access with in-memory maps so a run needs nothing
+// but Node. The real backends are used with --backend=real; redisCache keeps
+// the cache, and with it call sessions, in Redis at REDIS_PATH.
+const installMemoryBackend = (redisCache: boolean) => {
+    const flats = new Map<number, Flat>();
+    const cache = new Map<string, string | Buffer>();
+    const calls: Call[] = [];
+
+    flatsRepo.getByChatId = async (chatId) => flats.get(chatId) ?? null;
+    flatsRepo.getManyByNumber = async (number) =>
+        [...flats.values()].filter((flat) => flat.number === number);
+    flatsRepo.upsert = async (flat) => {
+        flats.set(flat.chatId, { ...flat });
+        return flat;
+    };
+    flatsRepo.update = async (chatId, updateData) => {
+        const flat = flats.get(chatId);
+        if (!flat) {
+            return null;
+        }
+        Object.assign(flat, updateData);
+        return flat;
+    };
+
+    callsRepo.insertMany = async (batch) => {
+        calls.push(...batch);
+    };
+    callsRepo.recentByFlat = async (flat, limit) =>
+        calls
+            .filter((call) => call.flat === flat)
+            .sort((a, b) => b.startedAt.getTime() - a.startedAt.getTime())
+            .slice(0, limit);
+
+    if (redisCache) {
+        return;
+    }
+    CacheClient.get = async (key) => {
+        const value = cache.get(key);
+        return value === undefined ? null : String(value);
+    };
+    CacheClient.getBuffer = async (key) => {
+        const value = cache.get(key);
+        return value === undefined ? null : Buffer.from(value);
+    };
+    CacheClient.set = async (key, value) => {
+        cache.set(key, Buffer.isBuffer(value) ? value : String(value));
+        return 'OK' as const;
+    };
+    CacheClient.del = async (key) => Number(cache.delete(key));
+
+    // The cache's Lua scripts, done in memory
+    const decisions = new Map<string, Decision>();
+    const keyboards = new Map<string, CallKeyboard[]>();
+    callDecisions.open = async (callId) => {
+        decisions.delete(callId);
+        keyboards.delete(callId);
+    };
+    callDecisions.keyboards = async (callId, added) => {
+        keyboards.set(callId, [...(keyboards.get(callId) ?? []), ...added]);
+        return decisions.get(callId) ?? null;
+    };
+    callDecisions.decide = async (callId, decision) => {
+        const current = decisions.get(callId);
+        if (current) {
+            return { won: false, decision: current, keyboards: [] };
+        }
+        decisions.set(callId, decision);
+        return {
+            won: true,
+            decision,
+            keyboards: keyboards.get(callId) ?? [],
+        };
+    };
+    callDecisions.withdraw = async (callId, decision) => {
+        const current = decisions.get(callId);
+        if (
+            current?.chatId === decision.chatId &&
+            current.command === decision.command
+        ) {
+            decisions.delete(callId);
+        }
+    };
+
+    const holders = new Map<string, string>();
+    const heldBy = (sessionId: string, holder: string) =>
+        (holders.get(sessionId) ?? holder) === holder;
+    sessionStore.save = async (record, holder) => {
+        if (!heldBy(record.sessionId, holder)) {
+            return false;
+        }
+        cache.set(`call:${record.sessionId}`, encodeSession(record));
+        cache.set(`callflat:${record.flat}`, record.sessionId);
+        holders.set(record.sessionId, holder);
+        return true;
+    };
+    sessionStore.claim = async (sessionId, holder) => {
+        if (!cache.has(`call:${sessionId}`)) {
+            return false;
+        }
+        holders.set(sessionId, holder);
+        return true;
+    };
+    sessionStore.remove = async (record, holder) => {
+        if (!heldBy(record.sessionId, holder)) {
+            return false;
+        }
+        cache.delete(`call:${record.sessionId}`);
+        holders.delete(record.sessionId);
+        if (cache.get(`callflat:${record.flat}`) === record.sessionId) {
+            cache.delete(`callflat:${record.flat}`);
+        }
+        return true;
+    };
+};
+
+export const setupBackend = async (
+    backend: 'memory' | 'real',
+    redisCache = false
+) => {
+    if (backend === 'memory') {
+        installMemoryBackend(redisCache);
+        return;
+    }
+
+    await mongoose.connect(process.env.MONGO_URI as string, {
+        user: process.env.MONGO_USER,
+        pass: process.env.MONGO_PASSWORD,
+    });
+};
+
+export const teardownBackend = async (backend: 'memory' | 'real') => {
+    if (backend === 'real') {
+        await mongoose.disconnect();
+    }
+};
+
+// Run the bot and socket server in this process; resolves with the
+// server's address once both are up
+export const startInProcess = async () => {
+    await new Promise<void>((resolve, reject) => {
+        launchBot(resolve).catch(reject);
+    });
+    await new Promise<void>((resolve) =>
+        server.listen(listenOptions(0, '127.0.0.1'), resolve)
+    );
+    return { host: '127.0.0.1', port: (server.address() as AddressInfo).port };
+};
+
+// Flat n is bound to chat chatIdBase + n
+export const chatIdBase = 900_000_000;
+
+export const seedFlats = async (devices: number) => {
+    const upserts: Promise<Flat>[] = [];
+    for (let i = 1; i <= devices; i++) {
+        upserts.push(flatsRepo.upsert({ chatId: chatIdBase + i, number: i }));
+    }
+    await Promise.all(upserts);
+};
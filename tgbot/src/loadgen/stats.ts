@@ -0,0 +1,118 @@
+export class Histogram {
+    private samples: number[] = [];
+    private sorted = true;
+
+    record(ms: number) {
+        this.samples.push(ms);
+        this.sorted = false;
+    }
+
+    get count() {
+        return this.samples.length;
+    }
+
+    percentile(p: number) {
+        if (this.samples.length === 0) {
+            return 0;
+        }
+        if (!this.sorted) {
+            this.samples.sort((a, b) => a - b);
+            this.sorted = true;
+        }
+        const index = Math.min(
+            this.samples.length - 1,
+            Math.ceil((p / 100) * this.samples.length) - 1
+        );
+        return this.samples[Math.max(0, index)];
+    }
+}
+
+export class Stats {
+    readonly stages = new Map<string, Histogram>();
+    readonly errors = new Map<string, number>();
+    readonly outcomes = new Map<string, number>();
+    private startedAt = 0;
+    private finishedAt = 0;
+
+    start() {
+        this.startedAt = performance.now();
+    }
+
+    finish() {
+        this.finishedAt = performance.now();
+    }
+
+    stage(name: string, ms: number) {
+        let histogram = this.stages.get(name);
+        if (!histogram) {
+            histogram = new Histogram();
+            this.stages.set(name, histogram);
+        }
+        histogram.record(ms);
+    }
+
+    error(kind: string) {
+        this.errors.set(kind, (this.errors.get(kind) ?? 0) + 1);
+    }
+
+    outcome(kind: string) {
+        this.outcomes.set(kind, (this.outcomes.get(kind) ?? 0) + 1);
+    }
+
+    get errorCount() {
+        let total = 0;
+        this.errors.forEach((count) => (total += count));
+        return total;
+    }
+
+    toJSON() {
+        const elapsedMs = this.finishedAt - this.startedAt;
+        let completed = 0;
+        this.outcomes.forEach((count) => (completed += count));
+
+        const stages: Record<string, object> = {};
+        this.stages.forEach((histogram, name) => {
+            stages[name] = {
+                count: histogram.count,
+                p50: round(histogram.percentile(50)),
+                p90: round(histogram.percentile(90)),
+                p99: round(histogram.percentile(99)),
+                max: round(histogram.percentile(100)),
+            };
+        });
+
+        return {
+            elapsedMs: round(elapsedMs),
+            completedCalls: completed,
+            callsPerSecond: round(completed / (elapsedMs / 1000)),
+            outcomes: Object.fromEntries(this.outcomes),
+            errors: Object.fromEntries(this.errors),
+            stages,
+        };
+    }
+
+    format() {
+        const report = this.toJSON();
+        const lines = [
+            `elapsed ${report.elapsedMs} ms, ${report.completedCalls} calls, ${report.callsPerSecond} calls/s`,
+            `outcomes ${JSON.stringify(report.outcomes)}`,
+            `errors   ${JSON.stringify(report.errors)}`,
+            '',
+            'stage          count      p50      p90      p99      max (ms)',
+        ];
+        this.stages.forEach((histogram, name) => {
+            lines.push(
+                [
+                    name.padEnd(12),
+                    String(histogram.count).padStart(7),
+                    ...[50, 90, 99, 100].map((p) =>
+                        round(histogram.percentile(p)).toFixed(1).padStart(8)
+                    ),
+                ].join(' ')
+            );
+        });
+        return lines.join('\n');
+    }
+}
+
+const round = (value: number) => Math.round(value * 10) / 10;
@@ -0,0 +1,321 @@
+import http from 'node:http';
+import { setTimeout as sleep } from 'node:timers/promises';
+
+export interface BotApiCall {
+    method: string;
+    chatId: number;
+    text?: string;
+    hasKeyboard: boolean;
+    // Of the message sent, or the one a keyboard was edited on
+    messageId?: number;
+    // Size of the file a sendPhoto uploaded
+    fileBytes?: number;
+    at: number;
+}
+
+type Expectation = {
+    match: (call: BotApiCall) => boolean;
+    resolve: (call: BotApiCall) => void;
+};
+
+// Minimal in-process Bot API: records what the bot sends and feeds it
+// callback queries through getUpdates long polling, or by webhook.
+export class TelegramMock {
+    private server = http.createServer((req, res) => this.handle(req, res));
+    private updates: object[] = [];
+    private nextUpdateId = 1;
+    private nextMessageId = 1;
+    private pollers = new Set<() => void>();
+    private expectations = new Map<number, Expectation[]>();
+    private webhook: { url: string; secretToken: string } | null = null;
+    // Chat of each tap, for its answerCallbackQuery
+    private callbackChats = new Map<string, number>();
+    // Callback data of the buttons on each chat's latest keyboard
+    private buttons = new Map<number, string[]>();
+    unmatchedCalls = 0;
+    // Sees every bot call, expected or not
+    onCall: ((call: BotApiCall) => void) | null = null;
+    // Upload bandwidth to the Bot API in KiB/s, 0 for unthrottled
+    uploadRate = 0;
+
+    listen(port: number) {
+        return new Promise<void>((resolve) =>
+            this.server.listen(port, '127.0.0.1', resolve)
+        );
+    }
+
+    close() {
+        this.pollers.forEach((wake) => wake());
+        this.server.closeAllConnections();
+        return new Promise<void>((resolve) =>
+            this.server.close(() => resolve())
+        );
+    }
+
+    // Resolves with the first bot call to chatId that matches, or rejects
+    expect(
+        chatId: number,
+        match: (call: BotApiCall) => boolean,
+        timeoutMs: number
+    ) {
+        const promise = new Promise<BotApiCall>((resolve, reject) => {
+            const list = this.expectations.get(chatId) ?? [];
+            const expectation: Expectation = {
+                match,
+                resolve: (call) => {
+                    clearTimeout(timer);
+                    resolve(call);
+                },
+            };
+            const timer = setTimeout(() => {
+                list.splice(list.indexOf(expectation), 1);
+                reject(new Error('timeout'));
+            }, timeoutMs);
+            list.push(expectation);
+            this.expectations.set(chatId, list);
+        });
+        // A call that fails early may never await this; don't crash on it
+        promise.catch(() => {});
+        return promise;
+    }
+
+    // Push updates to the bot's webhook instead of queueing them for polling
+    useWebhook(url: string, secretToken: string) {
+        this.webhook = { url, secretToken };
+    }
+
+    // Callback data of the button for `command` on the chat's latest
+    // keyboard, e.g. accept:<call id> for "accept"; anything else as is
+    button(chatId: number, command: string) {
+        return (
+            this.buttons
+                .get(chatId)
+                ?.find((button) => button.startsWith(`${command}:`)) ??
+            command
+        );
+    }
+
+    // Deliver a resident's inline keyboard tap, on the message with the
+    // keyboard if known. A bare command taps its button (see button()).
+    tap(chatId: number, command: string, messageId = this.nextMessageId) {
+        const data = this.button(chatId, command);
+        const id = String(this.nextUpdateId + 1);
+        this.callbackChats.set(id, chatId);
+        const update = {
+            update_id: this.nextUpdateId++,
+            callback_query: {
+                id,
+                from: { id: chatId, is_bot: false, first_name: 'loadgen' },
+                message: {
+                    message_id: messageId,
+                    date: Math.floor(Date.now() / 1000),
+                    chat: { id: chatId, type: 'private' },
+                    text: 'Кто-то хочет зайти!',
+                },
+                chat_instance: String(chatId),
+                data,
+            },
+        };
+        if (this.webhook) {
+            this.deliver(update);
+            return;
+        }
+        this.updates.push(update);
+        this.pollers.forEach((wake) => wake());
+    }
+
+    // POST an update like Telegram does. The bot may answer with a Bot API
+    // call in the response body, which counts as a call it made.
+    private deliver(update: object) {
+        const body = JSON.stringify(update);
+        const req = http.request(this.webhook!.url, {
+            method: 'POST',
+            headers: {
+                'content-type': 'application/json',
+                'content-length': Buffer.byteLength(body),
+                'x-telegram-bot-api-secret-token': this.webhook!.secretToken,
+            },
+        });
+        req.on('response', async (res) => {
+            const chunks: Buffer[] = [];
+            for await (const chunk of res) {
+                chunks.push(chunk);
+            }
+            const reply = Buffer.concat(chunks).toString();
+            if (reply.startsWith('{')) {
+                const { method, ...params } = JSON.parse(reply);
+                this.call(method, params);
+            }
+        });
+        req.on('error', () => this.unmatchedCalls++);
+        req.end(body);
+    }
+
+    private record(call: BotApiCall) {
+        this.onCall?.(call);
+        const list = this.expectations.get(call.chatId);
+        const index = list?.findIndex((e) => e.match(call)) ?? -1;
+        if (index < 0) {
+            this.unmatchedCalls++;
+            return;
+        }
+        const [expectation] = list!.splice(index, 1);
+        expectation.resolve(call);
+    }
+
+    private async handle(req: http.IncomingMessage, res: http.ServerResponse) {
+        const chunks: Buffer[] = [];
+        const started = performance.now();
+        let received = 0;
+        for await (const chunk of req) {
+            chunks.push(chunk);
+            received += chunk.length;
+            if (this.uploadRate > 0) {
+                const bytesPerMs = (this.uploadRate * 1024) / 1000;
+                const wait =
+                    started + received / bytesPerMs - performance.now();
+                if (wait > 1) {
+                    await sleep(wait);
+                }
+            }
+        }
+        const body = Buffer.concat(chunks);
+        const method = req.url!.split('/').pop()!;
+        const params = parseParams(req.headers['content-type'], body);
+
+        const reply = (result: unknown) => {
+            res.setHeader('content-type', 'application/json');
+            res.end(JSON.stringify({ ok: true, result }));
+        };
+
+        if (method === 'getUpdates') {
+            return this.poll(params, res, reply);
+        }
+        return reply(this.call(method, params));
+    }
+
+    private call(method: string, params: Record<string, any>) {
+        switch (method) {
+            case 'getMe':
+                return {
+                    id: 1,
+                    is_bot: true,
+                    first_name: 'intercom',
+                    username: 'intercom_loadgen_bot',
+                };
+            case 'sendMessage':
+            case 'sendPhoto': {
+                const chatId = Number(params.chat_id);
+                const messageId = this.nextMessageId++;
+                if (params.reply_markup) {
+                    this.buttons.set(chatId, callbackData(params.reply_markup));
+                }
+                this.record({
+                    method,
+                    chatId,
+                    text: params.text,
+                    hasKeyboard: Boolean(params.reply_markup),
+                    messageId,
+                    fileBytes:
+                        params.file_bytes === undefined
+                            ? undefined
+                            : Number(params.file_bytes),
+                    at: performance.now(),
+                });
+                return {
+                    message_id: messageId,
+                    date: Math.floor(Date.now() / 1000),
+                    chat: { id: chatId, type: 'private' },
+                    text: params.text,
+                };
+            }
+            case 'answerCallbackQuery':
+            case 'editMessageReplyMarkup': {
+                // Only seen, never expected
+                const tap = params.callback_query_id;
+                const chatId =
+                    Number(params.chat_id) || this.callbackChats.get(tap);
+                this.callbackChats.delete(tap);
+                this.onCall?.({
+                    method,
+                    chatId: chatId ?? 0,
+                    text: params.text,
+                    hasKeyboard: false,
+                    messageId: Number(params.message_id) || undefined,
+                    at: performance.now(),
+                });
+                return true;
+            }
+            default:
+                // setWebhook...
+                return true;
+        }
+    }
+
+    private poll(
+        params: Record<string, string>,
+        res: http.ServerResponse,
+        reply: (result: unknown) => void
+    ) {
+        const offset = Number(params.offset ?? 0);
+        this.updates = this.updates.filter(
+            (update: any) => update.update_id >= offset
+        );
+        if (this.updates.length > 0) {
+            return reply(this.updates);
+        }
+
+        const timeoutMs = Number(params.timeout ?? 0) * 1000;
+        const wake = () => {
+            clearTimeout(timer);
+            this.pollers.delete(wake);
+            reply(this.updates);
+        };
+        const timer = setTimeout(wake, timeoutMs);
+        this.pollers.add(wake);
+        res.on('close', () => {
+            clearTimeout(timer);
+            this.pollers.delete(wake);
+        });
+    }
+}
+
+// An inline keyboard's buttons; multipart forms carry it as JSON
+const callbackData = (markup: string | object): string[] => {
+    const keyboard = typeof markup === 'string' ? JSON.parse(markup) : markup;
+    return (keyboard.inline_keyboard ?? [])
+        .flat()
+        .map(
+            (button: { callback_data?: string }) => button.callback_data ?? ''
+        );
+};
+
+// Telegraf posts JSON, or multipart/form-data when a file is attached
+const parseParams = (
+    contentType: string | undefined,
+    body: Buffer
+): Record<string, string> => {
+    if (body.length === 0) {
+        return {};
+    }
+    if (contentType?.startsWith('application/json')) {
+        return JSON.parse(body.toString());
+    }
+
+    const params: Record<string, string> = {};
+    const text = body.toString('latin1');
+    const fieldPattern = /name="([^"]+)"\r\n\r\n([^\r]*)\r\n/g;
+    let match: RegExpExecArray | null;
+    while ((match = fieldPattern.exec(text))) {
+        params[match[1]] = match[2];
+    }
+    // The file part runs from its headers to the closing boundary
+    const boundary = /boundary=("?)([^";]+)\1/.exec(contentType ?? '')?.[2];
+    const file = text.indexOf('filename="');
+    if (boundary && file >= 0) {
+        const start = text.indexOf('\r\n\r\n', file) + 4;
+        const end = text.indexOf(`\r\n--${boundary}`, start);
+        params.file_bytes = String(end - start);
+    }
+    return params;
+};
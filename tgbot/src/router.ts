@@ -0,0 +1,160 @@
+import Redis, { Result } from 'ioredis';
+import os from 'node:os';
+import { role } from './cluster';
+
+export type RoutedCommand = {
+    flat: number;
+    // The call whose keyboard was tapped
+    callId: string;
+    command: 'photo' | 'accept' | 'reject';
+    // Resident who tapped
+    chatId: number;
+};
+
+// Carries residents' taps from the process that handled the bot update to
+// the one holding the calling device's socket
+export interface Router {
+    // This process holds the call to `flat` from now on
+    claim(flat: number): Promise<unknown>;
+    release(flat: number): Promise<unknown>;
+    // Whether the process holding the flat's call took the command; false
+    // when nobody holds it or the receiver turned it down
+    send(command: RoutedCommand): Promise<boolean>;
+    // Handle commands for calls this process holds; return false for one
+    // that has already ended, or is not the flat's call in progress
+    receive(handler: (command: RoutedCommand) => boolean): void;
+}
+
+// Single process: the bot and the sockets share memory
+class LocalRouter implements Router {
+    private handler: ((command: RoutedCommand) => boolean) | null = null;
+
+    async claim() {}
+
+    async release() {}
+
+    async send(command: RoutedCommand) {
+        return this.handler?.(command) ?? false;
+    }
+
+    receive(handler: (command: RoutedCommand) => boolean) {
+        this.handler = handler;
+    }
+}
+
+declare module 'ioredis' {
+    interface RedisCommander<Context> {
+        routeCommand(key: string, message: string): Result<number, Context>;
+        releaseSession(key: string, owner: string): Result<number, Context>;
+    }
+}
+
+// A session's key expires by itself if its worker dies mid-call
+const sessionTtlSeconds = 600;
+// How long a sender waits for the holder's answer before giving up on it
+const replyTimeoutMs = 2000;
+
+// A command on its way to a device worker, and where to answer it
+type Routed = { command: RoutedCommand; replyTo: string; seq: number };
+type Reply = { seq: number; handled: boolean };
+
+// Cluster: session:<flat> names the device worker holding the flat's call,
+// and each device worker subscribes to its own devices:<worker> channel.
+// A script looks up the owner and publishes to its channel; the owner
+// publishes its handler's answer to the sender's replies:<id> channel.
+// Until then the tap isn't taken: the call may have ended or moved on
+// while the command was in flight.
+class RedisRouter implements Router {
+    private id = `${os.hostname()}:${process.pid}`;
+    private redis = new Redis(process.env.REDIS_PATH!);
+    // Sends waiting for their answer, by sequence number
+    private pending = new Map<number, (handled: boolean) => void>();
+    private seq = 0;
+    // Subscribed on the first send, so device workers don't
+    private replies: Promise<unknown> | null = null;
+
+    constructor() {
+        this.redis.defineCommand('routeCommand', {
+            numberOfKeys: 1,
+            lua: `
+                local owner = redis.call('GET', KEYS[1])
+                if not owner then return 0 end
+                return redis.call('PUBLISH', 'devices:' .. owner, ARGV[1])`,
+        });
+        this.redis.defineCommand('releaseSession', {
+            numberOfKeys: 1,
+            lua: `
+                if redis.call('GET', KEYS[1]) ~= ARGV[1] then return 0 end
+                return redis.call('DEL', KEYS[1])`,
+        });
+    }
+
+    claim(flat: number) {
+        return this.redis.set(
+            `session:${flat}`,
+            this.id,
+            'EX',
+            sessionTtlSeconds
+        );
+    }
+
+    release(flat: number) {
+        return this.redis.releaseSession(`session:${flat}`, this.id);
+    }
+
+    private listen() {
+        if (!this.replies) {
+            const subscriber = this.redis.duplicate();
+            subscriber.on('message', (_channel, message) => {
+                const { seq, handled }: Reply = JSON.parse(message);
+                this.pending.get(seq)?.(handled);
+            });
+            this.replies = subscriber.subscribe(`replies:${this.id}`);
+        }
+        return this.replies;
+    }
+
+    async send(command: RoutedCommand) {
+        await this.listen();
+        const seq = ++this.seq;
+        const reply = new Promise<boolean>((resolve) => {
+            const timer = setTimeout(() => settle(false), replyTimeoutMs);
+            const settle = (handled: boolean) => {
+                clearTimeout(timer);
+                this.pending.delete(seq);
+                resolve(handled);
+            };
+            this.pending.set(seq, settle);
+        });
+        const routed: Routed = { command, replyTo: this.id, seq };
+        const receivers = await this.redis
+            .routeCommand(`session:${command.flat}`, JSON.stringify(routed))
+            .catch((err) => {
+                this.pending.get(seq)?.(false);
+                throw err;
+            });
+        if (receivers === 0) {
+            this.pending.get(seq)?.(false);
+        }
+        return reply;
+    }
+
+    receive(handler: (command: RoutedCommand) => boolean) {
+        const subscriber = this.redis.duplicate();
+        subscriber.on('message', (_channel, message) => {
+            const { command, replyTo, seq }: Routed = JSON.parse(message);
+            const reply: Reply = { seq, handled: handler(command) };
+            this.redis
+                .publish(`replies:${replyTo}`, JSON.stringify(reply))
+                .catch((err) =>
+                    console.error('Answering a device command failed:', err)
+                );
+        });
+        subscriber.subscribe(`devices:${this.id}`).catch((err) => {
+            console.error('Subscribing to device commands failed:', err);
+        });
+    }
+}
+
+export const router: Router =
+    role === 'all' ? new LocalRouter() : new RedisRouter();
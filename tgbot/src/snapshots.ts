@@ -0,0 +1,89 @@
+import { createHash, randomUUID } from 'node:crypto';
+import { createWriteStream } from 'node:fs';
+import fs from 'node:fs/promises';
+import path from 'node:path';
+import { PassThrough } from 'node:stream';
+import { pipeline } from 'node:stream/promises';
+
+const exists = (file: string) =>
+    fs.access(file).then(
+        () => true,
+        () => false
+    );
+
+// Photos stored under their SHA-256, as <root>/ab/abcd….jpg. Storing a
+// frame that is already there, like a repeated still of an empty porch,
+// costs no disk. Files are written under tmp/ and renamed into place, so a
+// hash that exists always names a complete photo.
+export class SnapshotStore {
+    private tmp: Promise<string> | null = null;
+
+    constructor(readonly root: string) {}
+
+    path(hash: string) {
+        return path.join(this.root, hash.slice(0, 2), `${hash}.jpg`);
+    }
+
+    async put(data: Uint8Array) {
+        const hash = createHash('sha256').update(data).digest('hex');
+        if (!(await exists(this.path(hash)))) {
+            const temp = await this.tempFile();
+            await fs.writeFile(temp, data);
+            await this.commit(temp, hash);
+        }
+        return hash;
+    }
+
+    // For a photo that is still arriving: pipe it into `stream`, and `hash`
+    // resolves once it is stored, or with null if the stream was aborted
+    writer() {
+        const stream = new PassThrough();
+        const hash = (async () => {
+            const digest = createHash('sha256');
+            const temp = await this.tempFile();
+            try {
+                await pipeline(
+                    stream,
+                    async function* (source) {
+                        for await (const chunk of source) {
+                            digest.update(chunk);
+                            yield chunk;
+                        }
+                    },
+                    createWriteStream(temp)
+                );
+            } catch {
+                await fs.rm(temp, { force: true });
+                return null;
+            }
+            const hex = digest.digest('hex');
+            await this.commit(temp, hex);
+            return hex;
+        })().catch((err) => {
+            console.error('Storing snapshot failed:', err);
+            return null;
+        });
+        return { stream, hash };
+    }
+
+    private async tempFile() {
+        this.tmp ??= fs
+            .mkdir(path.join(this.root, 'tmp'), { recursive: true })
+            .then(() => path.join(this.root, 'tmp'));
+        return path.join(await this.tmp, randomUUID());
+    }
+
+    private async commit(temp: string, hash: string) {
+        const target = this.path(hash);
+        if (await exists(target)) {
+            await fs.rm(temp, { force: true });
+            return;
+        }
+        await fs.mkdir(path.dirname(target), { recursive: true });
+        await fs.rename(temp, target);
+    }
+}
+
+export const snapshots = new SnapshotStore(
+    process.env.SNAPSHOT_DIR ?? 'snapshots'
+);
@@ -1,33 +1,479 @@
+import cluster from 'node:cluster';
 import net from 'node:net';
-import { bot } from './bot';
+import tls from 'node:tls';
+import { PassThrough } from 'node:stream';
+import { setTimeout as sleep } from 'node:timers/promises';
+import { bot, BotContext } from './bot';
 import { flatsRepo } from './flats';
+import { ImageOp, parseImageOps } from './images/jpeg';
+import { imagePool, ImagePoolBusyError } from './images/pool';
+import { ActiveCall, callJournal } from './journal';
+import { CallOutcome } from './calls';
+import { captures, CaptureWriter } from './capture';
+import { CallKeyboard, callDecisions, Decision } from './decisions';
+import { firmwareUpdates, maxUpdateRequestLength } from './firmware';
+import { flatDirectory } from './directory';
+import { RoutedCommand, router } from './router';
+import { sessionStore } from './session-store';
+import { snapshots } from './snapshots';
 import { Markup } from 'telegraf';
 import { inlineKeyboard } from 'telegraf/markup';
 
 export let clientSocket: net.Socket | null = null;
 
-// Create a server instance
-export const server = net.createServer();
+const pskIdentity = process.env.TLS_PSK_IDENTITY ?? 'intercom';
+const psk = Buffer.from(process.env.TLS_PSK ?? '', 'hex');
+// Like the firmware, refuse rather than run with a guessable key
+const pskUsable = psk.length >= 16 && psk.length <= 32;
+if (!pskUsable) {
+    console.error(
+        'TLS_PSK must be 16 to 32 bytes of hex; devices cannot connect'
+    );
+}
+
+// Devices authenticate with a pre-shared key, so the ESP32 does no
+// certificate or public-key work; AES-GCM and SHA-256 are hardware
+// accelerated there. Session tickets are on by default, letting a device
+// that reconnects resume with an abbreviated handshake.
+export const server = tls.createServer({
+    pskCallback: (_socket, identity) =>
+        identity === pskIdentity && pskUsable ? psk : null,
+    ciphers: 'PSK-AES128-GCM-SHA256',
+    minVersion: 'TLSv1.2',
+    maxVersion: 'TLSv1.2',
+});
+
+// Two servers can listen on the port at once (SO_REUSEPORT, Node 22.12+),
+// so a replacement can take new connections before the old one drains. In
+// a cluster the primary holds the socket and workers don't need it.
+export const listenOptions = (
+    port: number,
+    host?: string
+): net.ListenOptions & { reusePort?: boolean } => ({
+    port,
+    host,
+    reusePort: cluster.isPrimary,
+});
 
-let currentSocket: net.Socket | null = null;
-let currentCommand:
+type DeviceCommand =
     | 'start'
+    | 'resume'
     | 'photo'
     | 'cancel'
     | 'accept_ok'
-    | 'reject_ok'
-    | null = null;
-let currentFlat: number | null = null;
+    | 'reject_ok';
+
+type PhotoController = ((data: Buffer) => void) & { reset: () => void };
+
+// One device connection. A device makes one call at a time; `flat` is the
+// number it sent after 'start', until the call ends.
+type Session = {
+    socket: net.Socket;
+    command: DeviceCommand | null;
+    flat: number | null;
+    call: ActiveCall | null; // Journal entry of the call
+    photo: PhotoController;
+    demux: ((data: Buffer) => void) | null; // Set while a photo comes as records
+    capture: CaptureWriter | null; // With CAPTURE_DIR set
+};
+
+// Calls in progress in this process, by flat, for routing residents' taps
+const sessions = new Map<number, Session>();
+
+// Every open device channel, and work a drain waits for: command handlers
+// and photo uploads
+const connections = new Set<Session>();
+const pending = new Set<Promise<unknown>>();
+
+// Everything for the device goes through here, to be captured
+const send = (session: Session, data: string | Buffer) => {
+    session.capture?.record('server', data);
+    session.socket.write(data);
+};
+
+const track = <T>(work: T | Promise<T>) => {
+    const promise = Promise.resolve(work);
+    pending.add(promise);
+    const done = () => pending.delete(promise);
+    promise.then(done, done);
+    return promise;
+};
+
+// Sending the call's id lets the device resume it after losing the server.
+// Firmware built without CONFIG_INTERCOM_SESSION_RESUME would take the id
+// for a command; set SESSION_RESUME=0 while such devices are in service.
+const resumable = process.env.SESSION_RESUME !== '0';
+
+// How long taps wait for a call whose device is reconnecting, and how long
+// a drain waits for frames and uploads in progress
+const resumeGraceMs = Number(process.env.RESUME_GRACE_MS ?? 5_000);
+const drainTimeoutMs = Number(process.env.DRAIN_TIMEOUT_MS ?? 10_000);
+
+// Frames larger than this are refused before any upload starts
+const maxPhotoSize = Number(process.env.MAX_PHOTO_SIZE ?? 2 * 1024 * 1024);
+
+// Photo records, see createPhotoController
+const photoRecordsFlag = 0x80000000;
+const recordHeaderSize = 3;
+const recordImage = 0;
+const recordCommand = 1;
+const recordEnd = 2;
+
+// Transforms run on every photo in the image pool, e.g.
+// PHOTO_TRANSFORMS=strip,orient:90,annotate. Without any, frames stream
+// straight through to the uploads.
+const photoOps = parseImageOps(process.env.PHOTO_TRANSFORMS ?? '');
+const entranceName = process.env.ENTRANCE_NAME ?? 'Домофон';
+
+const opsForFrame = (flatNumber: number): ImageOp[] =>
+    photoOps.map((op) =>
+        op.op === 'annotate' && op.text === ''
+            ? {
+                  ...op,
+                  text: `${entranceName}, кв. ${flatNumber}, ${new Date().toISOString()}`,
+              }
+            : op
+    );
+
+// The buttons name the call they were offered for, so a tap on a keyboard
+// left over from an earlier call to the flat can't answer this one
+const photoKeyboard = (callId: string) =>
+    Markup.inlineKeyboard([
+        Markup.button.callback('📸 Фото', `photo:${callId}`),
+        Markup.button.callback('✅ Пустить', `accept:${callId}`),
+        Markup.button.callback('❌ Не пускать', `reject:${callId}`),
+    ]);
+
+// Each in its own request; one that fails, say because the resident took
+// it down already, doesn't hold up the others
+const takeDown = (keyboards: CallKeyboard[]) =>
+    keyboards.map(({ chatId, messageId }) =>
+        bot.telegram
+            .editMessageReplyMarkup(chatId, messageId, undefined, {
+                inline_keyboard: [],
+            })
+            .catch((err) => console.error('Removing keyboard failed:', err))
+    );
+
+// Keyboards that went out after the call was decided come down at once
+const keepKeyboards = async (
+    callId: string,
+    messages: { chat: { id: number }; message_id: number }[]
+) => {
+    const keyboards = messages.map((message) => ({
+        chatId: message.chat.id,
+        messageId: message.message_id,
+    }));
+    try {
+        if (await callDecisions.keyboards(callId, keyboards)) {
+            await Promise.all(takeDown(keyboards));
+        }
+    } catch (err) {
+        console.error('Recording keyboards failed:', err);
+    }
+};
+
+// Every resident's upload reads the same buffer
+const sendPhotos = async (
+    flatNumber: number,
+    callId: string,
+    photo: Buffer
+) => {
+    const flats = await flatsRepo.getManyByNumber(flatNumber);
+    const sent = await Promise.all(
+        flats.map((flat) =>
+            bot.telegram
+                .sendPhoto(
+                    flat.chatId,
+                    { source: photo, filename: 'photo.jpg' },
+                    photoKeyboard(callId)
+                )
+                .catch((err) => {
+                    console.error('Photo upload failed:', err);
+                    return null;
+                })
+        )
+    );
+    await keepKeyboards(
+        callId,
+        sent.filter((message) => message !== null)
+    );
+};
+
+// Transforms the frame once in the image pool, off the event loop, and fans
+// the result out. A frame the transforms reject, or one the pool has no
+// room for or loses to a failed worker, is sent as it came. The pool takes
+// ownership of what it is given, so it gets a copy and the frame is still
+// here to send.
+const processPhoto = async (
+    flatNumber: number,
+    call: ActiveCall,
+    frame: ArrayBuffer
+) => {
+    let photo = frame;
+    try {
+        const reply = await imagePool().run(
+            frame.slice(0),
+            opsForFrame(flatNumber)
+        );
+        if ('error' in reply) {
+            console.error(`Sending photo unprocessed: ${reply.error}`);
+        }
+        photo = reply.data;
+    } catch (err) {
+        if (err instanceof ImagePoolBusyError) {
+            console.error('Image pool busy, sending photo unprocessed');
+        } else {
+            console.error(
+                'Photo processing failed, sending it unprocessed:',
+                err
+            );
+        }
+    }
+    const data = Buffer.from(photo);
+    call.snapshot(
+        snapshots.put(data).catch((err) => {
+            console.error('Storing snapshot failed:', err);
+            return null;
+        })
+    );
+    await sendPhotos(flatNumber, call.id, data);
+};
 
-const createPhotoController = () => {
-    // Variables to keep track of the incoming data
+// Streams the frame into the residents' sendPhoto uploads as it arrives.
+// Uploads start as soon as the size header is read, and the device socket
+// is paused whenever an upload falls behind, so memory use is bounded by
+// stream buffers rather than the frame size.
+//
+// With PHOTO_TRANSFORMS set the frame is collected into one ArrayBuffer of
+// the announced size instead and handed to the image pool whole; while the
+// pool is saturated frames keep streaming through unprocessed.
+//
+// Firmware with CONFIG_INTERCOM_TX_QUEUE sets the top bit of the size and
+// sends the frame as records, each a type byte, a u16 length and the
+// payload: image pieces, commands sent meanwhile (handled as if they had
+// come on their own), or an end record for a photo cut short. Until the
+// last image byte or the end record all device data goes through
+// session.demux.
+const createPhotoController = (session: Session): PhotoController => {
     let imageSize: number | null = null; // The size of the image to receive
-    let imageBuffer: Buffer | null = null; // Buffer to store the image data
+    let frame: PassThrough | null = null; // Frame bytes, piped to every upload
+    let buffered: Uint8Array | null = null; // Whole frame for the image pool
     let receivedBytes = 0; // Number of bytes received so far
     let headerBuffer = Buffer.alloc(4); // Buffer to accumulate the image size header
     let headerBytesReceived = 0; // Number of header bytes received
 
-    const retFunc = async (data: Buffer) => {
+    let recordHeader = Buffer.alloc(recordHeaderSize);
+    let recordHeaderBytes = 0;
+    let recordType = 0;
+    let recordLength: number | null = null; // Null while reading a header
+    let recordReceived = 0;
+    let commandParts: Buffer[] = []; // Command record received so far
+
+    let pausedSocket: net.Socket | null = null; // Device held back by backpressure
+
+    const startUploads = (flatNumber: number, call: ActiveCall) => {
+        const source = new PassThrough();
+        const snapshot = snapshots.writer();
+        source.once('close', () => {
+            if (!source.readableEnded) {
+                snapshot.stream.destroy();
+            }
+        });
+        call.snapshot(snapshot.hash);
+        // Until every reader is attached the frame stays in `source`, and
+        // backpressure holds the device; the first pipe sets it flowing, so
+        // a reader piped later would miss the start of the frame
+        flatsRepo.getManyByNumber(flatNumber).then(
+            (flats) => {
+                // The snapshot store reads the frame alongside the uploads
+                source.pipe(snapshot.stream);
+                let active = flats.length;
+                flats.forEach((flat) => {
+                    const upload = new PassThrough();
+                    source.pipe(upload);
+                    track(
+                        bot.telegram
+                            .sendPhoto(
+                                flat.chatId,
+                                { source: upload, filename: 'photo.jpg' },
+                                photoKeyboard(call.id)
+                            )
+                            .then((message) =>
+                                keepKeyboards(call.id, [message])
+                            )
+                    ).catch((err) => {
+                        // Don't hold the device back for a failed upload
+                        console.error('Photo upload failed:', err);
+                        source.unpipe(upload);
+                        upload.destroy();
+                        if (--active === 0) {
+                            source.resume();
+                        }
+                    });
+                });
+            },
+            (err) => {
+                console.error('Photo upload failed:', err);
+                source.destroy();
+            }
+        );
+        return source;
+    };
+
+    const resumeDevice = () => {
+        pausedSocket?.resume();
+        pausedSocket = null;
+    };
+
+    const clear = () => {
+        imageSize = null;
+        frame = null;
+        buffered = null;
+        receivedBytes = 0;
+        headerBytesReceived = 0;
+        recordHeaderBytes = 0;
+        recordLength = null;
+        recordReceived = 0;
+        commandParts = [];
+    };
+
+    // Drops the frame being received. A frame sent as records is still read
+    // to its end, as commands may follow among them.
+    const reset = () => {
+        frame?.destroy();
+        resumeDevice();
+        session.command = null;
+        if (session.demux) {
+            frame = null;
+            buffered = null;
+            return;
+        }
+        clear();
+    };
+
+    const endRecords = () => {
+        resumeDevice();
+        session.demux = null;
+        clear();
+    };
+
+    // Passes image bytes on; true once the whole image has arrived
+    const takeImage = (chunk: Buffer) => {
+        const { socket } = session;
+        let writable = true;
+        if (buffered) {
+            buffered.set(chunk, receivedBytes);
+        } else if (frame) {
+            writable = frame.write(chunk);
+        }
+        receivedBytes += chunk.length;
+
+        if (receivedBytes === imageSize) {
+            // Nothing to deliver if the call was cancelled meanwhile
+            if (buffered || frame) {
+                console.log('Image received completely');
+                session.call?.stage('photo');
+                session.capture?.event(`photo ${imageSize}`);
+            }
+            if (buffered) {
+                track(
+                    processPhoto(session.flat!, session.call!, buffered.buffer)
+                ).catch((err) => console.error('Photo upload failed:', err));
+            } else {
+                frame?.end();
+            }
+            frame = null;
+            buffered = null;
+            return true;
+        }
+        if (!writable && !frame!.destroyed) {
+            // Backpressure: stop reading from the device until the
+            // slowest upload catches up
+            socket.pause();
+            pausedSocket = socket;
+            frame!.once('drain', resumeDevice);
+            frame!.once('close', resumeDevice);
+        }
+        return false;
+    };
+
+    const demux = (data: Buffer) => {
+        let offset = 0;
+        while (offset < data.length && session.demux) {
+            if (recordLength === null) {
+                const bytesToCopy = Math.min(
+                    recordHeaderSize - recordHeaderBytes,
+                    data.length - offset
+                );
+                data.copy(
+                    recordHeader,
+                    recordHeaderBytes,
+                    offset,
+                    offset + bytesToCopy
+                );
+                recordHeaderBytes += bytesToCopy;
+                offset += bytesToCopy;
+                if (recordHeaderBytes < recordHeaderSize) {
+                    break;
+                }
+                recordHeaderBytes = 0;
+                recordType = recordHeader.readUInt8(0);
+                recordLength = recordHeader.readUInt16BE(1);
+                recordReceived = 0;
+
+                if (recordType === recordEnd) {
+                    console.log('Image cut short by the device');
+                    frame?.destroy();
+                    endRecords();
+                } else if (
+                    (recordType !== recordImage &&
+                        recordType !== recordCommand) ||
+                    (recordType === recordImage &&
+                        receivedBytes + recordLength > imageSize!)
+                ) {
+                    console.error(`Bad ${recordType} record in image`);
+                    frame?.destroy();
+                    endRecords();
+                    session.socket.destroy();
+                    return;
+                }
+                continue;
+            }
+
+            const bytesToCopy = Math.min(
+                recordLength - recordReceived,
+                data.length - offset
+            );
+            const chunk = data.subarray(offset, offset + bytesToCopy);
+            offset += bytesToCopy;
+            recordReceived += bytesToCopy;
+
+            let complete = false;
+            if (recordType === recordImage) {
+                complete = takeImage(chunk);
+            } else {
+                commandParts.push(chunk);
+            }
+            if (recordReceived === recordLength) {
+                if (recordType === recordCommand) {
+                    onFrame(session, Buffer.concat(commandParts));
+                    commandParts = [];
+                }
+                recordLength = null;
+            }
+            if (complete) {
+                endRecords();
+            }
+        }
+
+        // Frames sent after the last image record
+        if (offset < data.length) {
+            onFrame(session, data.subarray(offset));
+        }
+    };
+
+    const retFunc = (data: Buffer) => {
         let offset = 0; // Offset in the data buffer
 
         // Process the received data
@@ -53,185 +499,383 @@ const createPhotoController = () => {
                 // Check if we have received the full header
                 if (headerBytesReceived === 4) {
                     // Read the image size from the header buffer (big-endian order)
-                    imageSize = headerBuffer.readUInt32BE(0);
-                    console.log(`Image size to receive: ${imageSize} bytes`);
-
-                    // Allocate a buffer to store the image data
-                    imageBuffer = Buffer.alloc(imageSize);
+                    const header = headerBuffer.readUInt32BE(0);
+                    const records = (header & photoRecordsFlag) !== 0;
+                    const size = header & ~photoRecordsFlag;
+                    if (size === 0 || size > maxPhotoSize) {
+                        // The rest of the stream can't be framed any more
+                        console.error(`Rejecting ${size} byte image`);
+                        reset();
+                        session.socket.destroy();
+                        return;
+                    }
+                    console.log(`Image size to receive: ${size} bytes`);
+                    imageSize = size;
                     receivedBytes = 0;
+                    if (photoOps.length > 0 && !imagePool().saturated) {
+                        buffered = new Uint8Array(size);
+                    } else {
+                        frame = startUploads(session.flat!, session.call!);
+                    }
+                    if (records) {
+                        // Commands now come as records; the photo is no
+                        // longer the one being answered
+                        session.command = null;
+                        session.demux = demux;
+                        demux(data.subarray(offset));
+                        return;
+                    }
                 }
             } else {
-                // We have the image size; now receive the image data
-
-                // Calculate how many bytes we need to complete the image
-                const bytesNeeded = imageSize - receivedBytes;
-                const bytesAvailable = data.length - offset;
-                const bytesToCopy = Math.min(bytesNeeded, bytesAvailable);
-
-                // Copy bytes from the received data into the image buffer
-                data.copy(
-                    imageBuffer!,
-                    receivedBytes,
-                    offset,
-                    offset + bytesToCopy
+                // We have the image size; pass the image data on
+                const bytesToCopy = Math.min(
+                    imageSize - receivedBytes,
+                    data.length - offset
                 );
-                receivedBytes += bytesToCopy;
+                const chunk = data.subarray(offset, offset + bytesToCopy);
                 offset += bytesToCopy;
-
-                // Check if we have received the full image
-                if (receivedBytes === imageSize) {
-                    console.log('Image received completely');
-                    const flats = await flatsRepo.getManyByNumber(currentFlat!);
-                    const promises = flats.map((flat) =>
-                        bot.telegram.sendPhoto(
-                            flat.chatId,
-                            { source: imageBuffer! },
-                            Markup.inlineKeyboard([
-                                Markup.button.callback('📸 Фото', 'photo'),
-                                Markup.button.callback('✅ Пустить', 'accept'),
-                                Markup.button.callback(
-                                    '❌ Не пускать',
-                                    'reject'
-                                ),
-                            ])
-                        )
-                    );
-                    await Promise.all(promises);
-                    // Reset variables to receive the next image
-                    imageSize = null;
-                    imageBuffer = null;
-                    receivedBytes = 0;
-                    headerBytesReceived = 0;
-                    currentCommand = null;
+                if (takeImage(chunk)) {
+                    reset();
                 }
             }
         }
     };
 
-    retFunc.reset = () => {
-        imageSize = null;
-        imageBuffer = null;
-        receivedBytes = 0;
-        headerBytesReceived = 0;
-        currentCommand = null;
-    };
+    retFunc.reset = reset;
 
     return retFunc;
 };
 
-const photoController = createPhotoController();
+const endCall = (session: Session, outcome: CallOutcome) => {
+    if (session.call) {
+        session.capture?.event(`end ${outcome}`);
+    }
+    session.call?.end(outcome);
+    const flat = session.flat;
+    if (flat !== null && sessions.get(flat) === session) {
+        sessions.delete(flat);
+        router
+            .release(flat)
+            .catch((err) => console.error('Releasing session failed:', err));
+    }
+    session.call = null;
+    session.flat = null;
+};
 
-bot.action('photo', async (ctx) => {
-    await ctx.editMessageReplyMarkup({ inline_keyboard: [] });
-    if (!currentSocket || !ctx.flat || ctx.flat.number !== currentFlat) {
-        return ctx.reply('Сессия сейчас неактивна');
+// Hand the call over to whichever server the device resumes on: taps stop
+// coming here and the stored record is brought up to date
+const suspendCall = async (session: Session) => {
+    const { call, flat } = session;
+    if (flat !== null && sessions.get(flat) === session) {
+        sessions.delete(flat);
+        await router
+            .release(flat)
+            .catch((err) => console.error('Releasing session failed:', err));
     }
-    currentSocket.write('photo');
-    return ctx.reply('📸 Ждем фото');
-});
+    session.call = null;
+    session.flat = null;
+    await call?.suspend();
+};
 
-bot.action('accept', async (ctx) => {
-    await ctx.editMessageReplyMarkup({ inline_keyboard: [] });
-    if (!currentSocket || !ctx.flat || ctx.flat.number !== currentFlat) {
-        return ctx.reply('Сессия сейчас неактивна');
+// A resident's tap, routed to this process because it holds the call
+router.receive(({ flat, callId, command, chatId }) => {
+    const session = sessions.get(flat);
+    if (!session || session.call?.id !== callId) {
+        return false;
     }
-    currentSocket.write('accept');
-    return ctx.reply('✅ Пускаем...');
+    session.capture?.event(`tap ${command}`);
+    send(session, command);
+    if (command === 'photo') {
+        session.call?.stage('photoRequested');
+    } else {
+        session.call?.decide(chatId);
+    }
+    return true;
 });
 
-bot.action('reject', async (ctx) => {
-    await ctx.editMessageReplyMarkup({ inline_keyboard: [] });
-    if (!currentSocket || !ctx.flat || ctx.flat.number !== currentFlat) {
-        return ctx.reply('Сессия сейчас неактивна');
+// The door gets its command before any Bot API round trip; the spinner,
+// keyboard removal and reply then go out together. answerCbQuery goes first
+// so in webhook mode it is the call carried in the webhook response.
+//
+// While a call's device is reconnecting nobody holds the call, but its
+// record is still stored; the tap waits for the resume.
+const routeTap = async (command: RoutedCommand) => {
+    const deadline = performance.now() + resumeGraceMs;
+    while (!(await router.send(command))) {
+        if (
+            performance.now() >= deadline ||
+            !(await sessionStore.hasCall(command.flat, command.callId))
+        ) {
+            return false;
+        }
+        await sleep(100);
     }
-    currentSocket.write('reject');
-    return ctx.reply('❌ Не пускаем...');
-});
+    return true;
+};
 
-const startController = async (data: Buffer) => {
-    currentFlat = Number(data.toString().trim());
-    const flats = await flatsRepo.getManyByNumber(currentFlat);
+const handledAnswer = (decision: Decision, chatId: number) => {
+    if (decision.chatId === chatId) {
+        return 'Вы уже ответили';
+    }
+    return decision.command === 'accept'
+        ? 'Другой житель уже впустил гостя'
+        : 'Другой житель уже отказал гостю';
+};
+
+// Several residents can answer one call. Only the first accept or reject
+// goes to the device; a later one is answered at once and goes nowhere.
+// The winner's process takes down the other residents' keyboards along
+// with its own. A decision that can't reach the device is withdrawn, so
+// the call is still open to the next tap.
+const relayTap = async (
+    ctx: BotContext,
+    callId: string,
+    command: 'photo' | 'accept' | 'reject',
+    reply: string
+) => {
+    const chatId = ctx.chat!.id;
+    let others: CallKeyboard[] = [];
+    let decision: Decision | null = null;
+    if (ctx.flat !== undefined && command !== 'photo') {
+        decision = { chatId, command };
+        const verdict = await callDecisions.decide(callId, decision);
+        if (!verdict.won) {
+            await Promise.all([
+                ctx.answerCbQuery(handledAnswer(verdict.decision, chatId)),
+                // The winner may have taken it down already
+                ctx
+                    .editMessageReplyMarkup({ inline_keyboard: [] })
+                    .catch(() => {}),
+            ]);
+            return;
+        }
+        const tapped = ctx.callbackQuery?.message?.message_id;
+        others = verdict.keyboards.filter(
+            (keyboard) =>
+                keyboard.chatId !== chatId || keyboard.messageId !== tapped
+        );
+    }
+    const active =
+        ctx.flat !== undefined &&
+        (await routeTap({ flat: ctx.flat.number, callId, command, chatId }));
+    if (!active && decision) {
+        await callDecisions
+            .withdraw(callId, decision)
+            .catch((err) => console.error('Withdrawing decision failed:', err));
+    }
+    await Promise.all([
+        ctx.answerCbQuery(),
+        ctx.editMessageReplyMarkup({ inline_keyboard: [] }),
+        ctx.reply(active ? reply : 'Сессия сейчас неактивна'),
+        ...(active ? takeDown(others) : []),
+    ]);
+};
+
+bot.action(/^photo:(\w+)$/, (ctx) =>
+    relayTap(ctx, ctx.match[1], 'photo', '📸 Ждем фото')
+);
+
+bot.action(/^accept:(\w+)$/, (ctx) =>
+    relayTap(ctx, ctx.match[1], 'accept', '✅ Пускаем...')
+);
+
+bot.action(/^reject:(\w+)$/, (ctx) =>
+    relayTap(ctx, ctx.match[1], 'reject', '❌ Не пускаем...')
+);
+
+// Keyboards sent before the buttons named their call
+bot.action(['photo', 'accept', 'reject'], (ctx) =>
+    Promise.all([
+        ctx.answerCbQuery(),
+        ctx.editMessageReplyMarkup({ inline_keyboard: [] }),
+        ctx.reply('Сессия сейчас неактивна'),
+    ])
+);
+
+const startController = async (session: Session, data: Buffer) => {
+    // A new call closes whatever the device left unfinished
+    endCall(session, 'abandoned');
+    const flatNumber = Number(data.toString().trim());
+    const call = callJournal.begin(
+        flatNumber,
+        session.socket.remoteAddress ?? ''
+    );
+    session.flat = flatNumber;
+    session.call = call;
+    const flats = await flatsRepo.getManyByNumber(flatNumber);
     if (flats.length === 0) {
-        currentSocket?.write('not_found');
-        currentSocket = null;
+        // The device keeps its channel open; only the call ends here
+        send(session, 'not_found');
+        endCall(session, 'not_found');
     } else {
+        // Undecided before any tap can reach it
+        await callDecisions.open(call.id);
+        // Taps on the notification find the call from here on
+        sessions.set(flatNumber, session);
+        await router.claim(flatNumber);
+        if (resumable) {
+            await call.persist();
+            send(session, `session:${call.id}`);
+        }
         const promises = flats.map((flat) =>
             bot.telegram.sendMessage(
                 flat.chatId,
                 'Кто-то хочет зайти!',
-                Markup.inlineKeyboard([
-                    Markup.button.callback('📸 Фото', 'photo'),
-                    Markup.button.callback('✅ Пустить', 'accept'),
-                    Markup.button.callback('❌ Не пускать', 'reject'),
-                ])
+                photoKeyboard(call.id)
             )
         );
-        await Promise.all(promises);
+        const messages = await Promise.all(promises);
+        call.stage('notified');
+        await keepKeyboards(call.id, messages);
     }
 
-    currentCommand = null;
+    session.command = null;
+};
+
+// A device that lost its channel mid-call presents the call's id on a new
+// one. The call carries on from its stored record; the residents have been
+// notified already. An id that is unknown here ends the call on the device.
+const resumeController = async (session: Session, data: Buffer) => {
+    endCall(session, 'abandoned');
+    session.command = null;
+    const call = await callJournal.resume(data.toString().trim());
+    if (!call) {
+        send(session, 'not_found');
+        return;
+    }
+    console.log(`Resumed call ${call.id} to flat ${call.flat}`);
+    // The device's old channel may not have closed yet. Its session lets go
+    // of the call without ending it; the store refuses its writes already.
+    const previous = sessions.get(call.flat);
+    if (previous && previous.call?.id === call.id) {
+        previous.call = null;
+        previous.flat = null;
+    }
+    session.flat = call.flat;
+    session.call = call;
+    sessions.set(call.flat, session);
+    await router.claim(call.flat);
 };
 
-const acceptOkController = async () => {
-    const flats = await flatsRepo.getManyByNumber(currentFlat!);
+// The device's acknowledgement ends the call; residents are told after
+const acceptOkController = async (session: Session) => {
+    const flatNumber = session.flat!;
+    endCall(session, 'accept');
+    session.command = null;
+    const flats = await flatsRepo.getManyByNumber(flatNumber);
     const promises = flats.map((flat) =>
         bot.telegram.sendMessage(flat.chatId, '✅ Дверь открыта!')
     );
     await Promise.all(promises);
-    currentCommand = null;
 };
 
-const rejectOkController = async () => {
-    const flats = await flatsRepo.getManyByNumber(currentFlat!);
+const rejectOkController = async (session: Session) => {
+    const flatNumber = session.flat!;
+    endCall(session, 'reject');
+    session.command = null;
+    const flats = await flatsRepo.getManyByNumber(flatNumber);
     const promises = flats.map((flat) =>
         bot.telegram.sendMessage(flat.chatId, '❌ Дверь не будет открыта!')
     );
     await Promise.all(promises);
-    currentCommand = null;
 };
 
-const cancelController = async () => {
-    const flats = await flatsRepo.getManyByNumber(currentFlat!);
+const cancelController = async (session: Session) => {
+    const flatNumber = session.flat!;
+    session.photo.reset();
+    endCall(session, 'cancel');
+    const flats = await flatsRepo.getManyByNumber(flatNumber);
     const promises = flats.map((flat) =>
         bot.telegram.sendMessage(flat.chatId, '❌ Вход отменен на домофоне')
     );
     await Promise.all(promises);
-    currentCommand = null;
-    currentFlat = null;
-    photoController.reset();
 };
 
 const espCommandsMapping = {
-    photo: photoController,
+    photo: (session: Session, data: Buffer) => session.photo(data),
     start: startController,
+    resume: resumeController,
     accept_ok: acceptOkController,
     reject_ok: rejectOkController,
     cancel: cancelController,
 };
 
-server.on('connection', (socket) => {
-    console.log('Client connected');
-    currentSocket = socket;
+const maxCommandLength = 16;
 
-    // Handle incoming data from the client
-    socket.on('data', async (data) => {
-        const command = data.toString().trim() as any;
-        if (espCommandsMapping[command]) {
-            currentCommand = data.toString().trim() as any;
+// One frame from the device: a command, the data that follows it, or a
+// request between calls
+const onFrame = async (session: Session, data: Buffer) => {
+    // Update and directory requests come between calls, each in one
+    // frame with its arguments, and are answered straight away
+    if (session.command === null && data.length <= maxUpdateRequestLength) {
+        const request = data.toString();
+        const reply =
+            firmwareUpdates.handle(request) ?? flatDirectory.handle(request);
+        if (reply) {
+            send(session, await track(reply));
             return;
         }
+    }
+
+    // Commands are short frames; don't stringify photo chunks
+    const command =
+        data.length <= maxCommandLength
+            ? (data.toString().trim() as any)
+            : null;
+    if (espCommandsMapping[command]) {
+        session.command = command;
+        return;
+    }
 
-        if (currentCommand) {
-            await espCommandsMapping[currentCommand](data);
+    if (session.command) {
+        await track(espCommandsMapping[session.command](session, data));
+    } else {
+        console.error(`No command for ${data.length} bytes of data`);
+    }
+};
+
+const createSession = (socket: net.Socket) => {
+    const session = {
+        socket,
+        command: null,
+        flat: null,
+        call: null,
+        demux: null,
+        capture: captures.open(
+            `${socket.remoteAddress}:${socket.remotePort}`
+        ),
+    } as Session;
+    session.photo = createPhotoController(session);
+    return session;
+};
+
+server.on('secureConnection', (socket) => {
+    console.log(
+        `Client connected${socket.isSessionReused() ? ' (resumed)' : ''}`
+    );
+    const session = createSession(socket);
+    connections.add(session);
+    // The channel stays open between calls
+    socket.setKeepAlive(true, 60_000);
+
+    // Handle incoming data from the client
+    socket.on('data', async (data) => {
+        session.capture?.record('device', data);
+        if (session.demux) {
+            session.demux(data);
         } else {
-            console.error(`No command for data ${command}`);
+            await onFrame(session, data);
         }
     });
 
-    // Handle client disconnection
-    socket.on('end', () => {
+    // Handle client disconnection; 'close' also follows a reset or error
+    socket.on('close', () => {
         console.log('Client disconnected');
-        currentSocket = null;
+        connections.delete(session);
+        session.photo.reset();
+        endCall(session, 'abandoned');
+        session.capture?.close();
+        session.capture?.end();
     });
 
     // Handle socket errors
@@ -240,7 +884,37 @@ server.on('connection', (socket) => {
     });
 });
 
+server.on('tlsClientError', (err) => {
+    console.error('TLS handshake failed:', err.message);
+});
+
 // Handle server errors
 server.on('error', (err) => {
     console.error('Server error:', err);
 });
+
+// Graceful stop: take no new connections, let frames being received and
+// work in progress finish, then hand calls over. Their records are stored
+// already; the closed channel is the device's cue to resume elsewhere. Idle
+// channels are closed too and reconnect on their next call.
+export const drain = async () => {
+    server.close();
+    const deadline = performance.now() + drainTimeoutMs;
+    const remaining = () => Math.max(0, deadline - performance.now());
+
+    // A frame cut off midway can't be resumed; wait for it to arrive
+    const receiving = () =>
+        [...connections].some(
+            (session) => session.command !== null || session.demux !== null
+        );
+    while (receiving() && remaining() > 0) {
+        await sleep(50);
+    }
+    await Promise.race([Promise.allSettled(pending), sleep(remaining())]);
+
+    const handOver = [...connections].map(async (session) => {
+        await suspendCall(session);
+        session.socket.end();
+    });
+    await Promise.race([Promise.all(handOver), sleep(remaining())]);
+};